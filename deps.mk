@@ -0,0 +1,148 @@
+build/src/main.o.d:
+include build/src/main.o.d
+build/src/main.o: src/main.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/cache.o.d:
+include build/src/utils/cache.o.d
+build/src/utils/cache.o: src/utils/cache.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/chain.o.d:
+include build/src/utils/chain.o.d
+build/src/utils/chain.o: src/utils/chain.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/compress.o.d:
+include build/src/utils/compress.o.d
+build/src/utils/compress.o: src/utils/compress.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/config.o.d:
+include build/src/utils/config.o.d
+build/src/utils/config.o: src/utils/config.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/error.o.d:
+include build/src/utils/error.o.d
+build/src/utils/error.o: src/utils/error.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/file.o.d:
+include build/src/utils/file.o.d
+build/src/utils/file.o: src/utils/file.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/git.o.d:
+include build/src/utils/git.o.d
+build/src/utils/git.o: src/utils/git.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/http.o.d:
+include build/src/utils/http.o.d
+build/src/utils/http.o: src/utils/http.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/lines.o.d:
+include build/src/utils/lines.o.d
+build/src/utils/lines.o: src/utils/lines.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/object.o.d:
+include build/src/utils/object.o.d
+build/src/utils/object.o: src/utils/object.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/obuf.o.d:
+include build/src/utils/obuf.o.d
+build/src/utils/obuf.o: src/utils/obuf.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/path.o.d:
+include build/src/utils/path.o.d
+build/src/utils/path.o: src/utils/path.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/prefetch.o.d:
+include build/src/utils/prefetch.o.d
+build/src/utils/prefetch.o: src/utils/prefetch.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/res.o.d:
+include build/src/utils/res.o.d
+build/src/utils/res.o: src/utils/res.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/shm.o.d:
+include build/src/utils/shm.o.d
+build/src/utils/shm.o: src/utils/shm.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/stats.o.d:
+include build/src/utils/stats.o.d
+build/src/utils/stats.o: src/utils/stats.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/text.o.d:
+include build/src/utils/text.o.d
+build/src/utils/text.o: src/utils/text.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/url.o.d:
+include build/src/utils/url.o.d
+build/src/utils/url.o: src/utils/url.c
+	$(COMPILE) -c $< -o $@
+build/src/utils/watched.o.d:
+include build/src/utils/watched.o.d
+build/src/utils/watched.o: src/utils/watched.c
+	$(COMPILE) -c $< -o $@
+build/src/html/cache.o.d:
+include build/src/html/cache.o.d
+build/src/html/cache.o: src/html/cache.c
+	$(COMPILE) -c $< -o $@
+build/src/html/escape.o.d:
+include build/src/html/escape.o.d
+build/src/html/escape.o: src/html/escape.c
+	$(COMPILE) -c $< -o $@
+build/src/html/highlight.o.d:
+include build/src/html/highlight.o.d
+build/src/html/highlight.o: src/html/highlight.c
+	$(COMPILE) -c $< -o $@
+build/src/html/html.o.d:
+include build/src/html/html.o.d
+build/src/html/html.o: src/html/html.c
+	$(COMPILE) -c $< -o $@
+build/src/html/markdown.o.d:
+include build/src/html/markdown.o.d
+build/src/html/markdown.o: src/html/markdown.c
+	$(COMPILE) -c $< -o $@
+build/src/html/template.o.d:
+include build/src/html/template.o.d
+build/src/html/template.o: src/html/template.c
+	$(COMPILE) -c $< -o $@
+build/src/html/pages/common.o.d:
+include build/src/html/pages/common.o.d
+build/src/html/pages/common.o: src/html/pages/common.c
+	$(COMPILE) -c $< -o $@
+build/src/html/pages/dir.o.d:
+include build/src/html/pages/dir.o.d
+build/src/html/pages/dir.o: src/html/pages/dir.c
+	$(COMPILE) -c $< -o $@
+build/src/html/pages/error.o.d:
+include build/src/html/pages/error.o.d
+build/src/html/pages/error.o: src/html/pages/error.c
+	$(COMPILE) -c $< -o $@
+build/src/html/pages/file.o.d:
+include build/src/html/pages/file.o.d
+build/src/html/pages/file.o: src/html/pages/file.c
+	$(COMPILE) -c $< -o $@
+build/src/html/pages/index.o.d:
+include build/src/html/pages/index.o.d
+build/src/html/pages/index.o: src/html/pages/index.c
+	$(COMPILE) -c $< -o $@
+build/src/html/pages/status.o.d:
+include build/src/html/pages/status.o.d
+build/src/html/pages/status.o: src/html/pages/status.c
+	$(COMPILE) -c $< -o $@
+build/src/css/css.o.d:
+include build/src/css/css.o.d
+build/src/css/css.o: src/css/css.c
+	$(COMPILE) -c $< -o $@
+build/src/raw/raw.o.d:
+include build/src/raw/raw.o.d
+build/src/raw/raw.o: src/raw/raw.c
+	$(COMPILE) -c $< -o $@
+build/src/maint/maint.o.d:
+include build/src/maint/maint.o.d
+build/src/maint/maint.o: src/maint/maint.c
+	$(COMPILE) -c $< -o $@
+build/src/warm/warm.o.d:
+include build/src/warm/warm.o.d
+build/src/warm/warm.o: src/warm/warm.c
+	$(COMPILE) -c $< -o $@
+build/src/watch/watch.o.d:
+include build/src/watch/watch.o.d
+build/src/watch/watch.o: src/watch/watch.c
+	$(COMPILE) -c $< -o $@
@@ -7,10 +7,65 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <utils/http.h>
+#include <utils/obuf.h>
+#include <utils/file.h>
+#include <utils/error.h>
+
+#include "css.h"
+
+/** Path to stylesheet, temporary. */
+#define CSS_PATH "res/styles.css"
+
+/**
+ * Format version of stylesheet.
+ *
+ * @param st Status of stylesheet file.
+ * @param version Where to place version.
+ */
+static void css_format_version(const struct stat *st,
+                               char version[CSS_VERSION_MAX])
+{
+	snprintf(version, CSS_VERSION_MAX, "%llx-%llx",
+	         (unsigned long long)st->st_mtime,
+	         (unsigned long long)st->st_size);
+}
+
+int css_version(char version[CSS_VERSION_MAX])
+{
+	struct stat st;
+	if (stat(CSS_PATH, &st))
+		return -1;
+
+	css_format_version(&st, version);
+	return 0;
+}
+
+/**
+ * Serve bare error status.
+ * An error is never cached, the stylesheet might show up later.
+ *
+ * @param out Output buffer to write to.
+ * @param code Status code.
+ * @param msg Reason of error, only logged.
+ */
+static void css_error(struct obuf *out, int code, const char *msg)
+{
+	error("reporting error: %s\n", msg);
+	http_clear_headers();
+	http_status(out, code);
+}
 
 void css_serve()
 {
-	fputs("Content-type: text/css\n\n", stdout);
+	struct obuf out;
+	obuf_init(&out, STDOUT_FILENO);
 
 	/** @todo how should I store user themes? In theory I could use
 	 * postgres, just add something like `theme text` to the user's entry?
@@ -20,12 +75,48 @@ void css_serve()
 	 * `.`, `~/.local/share/exgt`, `/usr/share/exgt` and otherwise give up?
 	 */
 
-	/* temporary */
-	FILE *css = fopen("res/styles.css", "r");
-	if (!css)
-		return;
+	char *etag = NULL;
+	int fd = open(CSS_PATH, O_RDONLY);
+	if (fd < 0) {
+		css_error(&out, errno == ENOENT ? 404 : 500,
+		          "couldn't open stylesheet");
+		goto out;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st)) {
+		css_error(&out, 500, "couldn't stat stylesheet");
+		goto out;
+	}
+
+	/* pages link to the stylesheet with its version in the query, so once
+	 * fetched it can be kept until it's changed */
+	char id[CSS_VERSION_MAX];
+	css_format_version(&st, id);
+
+	if ((etag = http_etag(id))) {
+		http_add_header("ETag", etag);
+		http_add_header("Cache-Control",
+		                "public, max-age=31536000, immutable");
+	}
+
+	if (etag && http_not_modified(etag)) {
+		http_status(&out, 304);
+		goto out;
+	}
+
+	http_header(&out, 200, "text/css");
+
+	/* header goes out first, the stylesheet itself straight from the
+	 * file */
+	if (obuf_flush(&out) == 0
+	    && send_file(STDOUT_FILENO, fd, 0, st.st_size))
+		error("sending stylesheet failed\n");
 
-	int c;
-	while ((c = fgetc(css)) != EOF)
-		fputc(c, stdout);
+out:
+	obuf_flush(&out);
+	obuf_free(&out);
+	free(etag);
+	if (fd >= 0)
+		close(fd);
 }
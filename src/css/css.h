@@ -9,6 +9,19 @@
 #ifndef EXGT_CSS_H
 #define EXGT_CSS_H
 
+/** Size of buffer large enough for any stylesheet version. */
+#define CSS_VERSION_MAX 64
+
+/**
+ * Get version of stylesheet.
+ * The version changes whenever the stylesheet does, so pages can link to it
+ * with the version in the query and it can be cached as immutable.
+ *
+ * @param version Where to place version.
+ * @return \c 0 on success, non-zero if there's no stylesheet.
+ */
+int css_version(char version[CSS_VERSION_MAX]);
+
 /** Generate css document. */
 void css_serve();
 
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file cache.c
+ * Rendered page cache implementation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/cache.h>
+#include <utils/config.h>
+#include <utils/error.h>
+#include <utils/stats.h>
+#include <utils/file.h>
+#include <utils/path.h>
+#include <utils/git.h>
+#include <utils/url.h>
+#include <utils/compress.h>
+#include <css/css.h>
+
+#include "cache.h"
+
+char *html_cache_key(const char *commit)
+{
+	char *repo = git_repo_name();
+	char *path = git_path();
+	char *web_root = web_root_path();
+	char *query = url_query();
+
+	char *key = NULL;
+	if (!repo || !path || !web_root || !query)
+		goto out;
+
+	/* pages link to the stylesheet by its version */
+	char styles[CSS_VERSION_MAX] = "";
+	css_version(styles);
+
+	const char *version = config_version();
+	const char *encoding = compress_name(compress_negotiate());
+	size_t len = strlen(version) + strlen(styles) + strlen(repo)
+	             + strlen(commit)
+	             + strlen(path) + strlen(query) + strlen(web_root)
+	             + strlen(encoding) + 8;
+	if (!(key = malloc(len)))
+		goto out;
+
+	snprintf(key, len, "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s", version, styles,
+	         repo, commit, path, query, web_root, encoding);
+
+	/* fields are tab separated, and keys can't contain newlines */
+	size_t fields = 0;
+	for (char *c = key; *c; ++c) {
+		if (*c == '\t')
+			fields++;
+
+		if (*c == '\n')
+			fields = -1;
+	}
+
+	if (fields != 7) {
+		free(key);
+		key = NULL;
+	}
+
+out:
+	free(repo);
+	free(path);
+	free(web_root);
+	free(query);
+	return key;
+}
+
+int html_cache_serve(const char *key)
+{
+	size_t offset, size;
+	int fd = cache_open("page", key, &offset, &size);
+	if (fd < 0) {
+		stats_add("page_misses", 1);
+		return -1;
+	}
+
+	stats_add("page_hits", 1);
+
+	/* once we start sending there's no going back */
+	fflush(stdout);
+	if (send_file(STDOUT_FILENO, fd, offset, size))
+		error("sending cached page failed\n");
+
+	close(fd);
+	return 0;
+}
+
+struct cache_entry *html_cache_create(const char *key)
+{
+	return cache_create("page", key);
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file cache.h
+ * Rendered page cache header.
+ *
+ * Whole responses, HTTP header included, are kept in the \c page namespace of
+ * the on-disk cache. Pages are keyed by everything that goes into rendering
+ * them, so an entry never has to be invalidated. Compressed responses are
+ * stored compressed, so hits are sent as is.
+ */
+
+#ifndef EXGT_HTML_CACHE_H
+#define EXGT_HTML_CACHE_H
+
+#include <stddef.h>
+
+#include <utils/cache.h>
+
+/**
+ * Get page cache key of current request.
+ * The key is made up of exgt version, stylesheet version, repository,
+ * resolved commit, path, normalized query string, web root and content
+ * encoding. The view is fully determined by the path and query string, and
+ * options pages don't read are left out so they can't fill the cache with
+ * copies of the same page.
+ *
+ * @param commit Resolved commit ID of request, or the object ID the request is
+ * pinned to, which gives the same page without resolving anything.
+ * @return Key in new buffer, \c NULL if the page can't be cached.
+ */
+char *html_cache_key(const char *commit);
+
+/**
+ * Serve page from cache.
+ * The cached response is sent directly to \c stdout with sendfile().
+ *
+ * @param key Key of page.
+ * @return \c 0 if page was served, non-zero on cache miss.
+ */
+int html_cache_serve(const char *key);
+
+/**
+ * Start storing rendered page in cache.
+ * The response, HTTP header included, is appended with cache_append() as it's
+ * sent, see utils/cache.h.
+ *
+ * @param key Key of page.
+ * @return Entry being written, \c NULL on error.
+ */
+struct cache_entry *html_cache_create(const char *key);
+
+#endif /* EXGT_HTML_CACHE_H */
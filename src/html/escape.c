@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file escape.c
+ * HTML escaping implementation.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "escape.h"
+
+/**
+ * Check if character needs escaping.
+ *
+ * @param c Character to check.
+ * @return \c true if \p c needs escaping.
+ */
+static inline bool escape_special(char c)
+{
+	return c == '<' || c == '>' || c == '&' || c == '"' || c == '\'';
+}
+
+/**
+ * Scalar version of escape_span().
+ *
+ * @param s Text to scan.
+ * @param len Length of \p s.
+ * @return Index of first character that needs escaping, \p len if none do.
+ */
+static size_t escape_span_scalar(const char *s, size_t len)
+{
+	size_t i = 0;
+	while (i < len && !escape_special(s[i]))
+		++i;
+
+	return i;
+}
+
+#if defined(__x86_64__)
+/**
+ * SSE2 version of escape_span().
+ * SSE2 is part of x86-64, so this is always available.
+ *
+ * @param s Text to scan.
+ * @param len Length of \p s.
+ * @return Index of first character that needs escaping, \p len if none do.
+ */
+static size_t escape_span_sse2(const char *s, size_t len)
+{
+	const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>');
+	const __m128i amp = _mm_set1_epi8('&'), quot = _mm_set1_epi8('"');
+	const __m128i apos = _mm_set1_epi8('\'');
+
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, lt),
+			             _mm_cmpeq_epi8(v, gt)),
+			_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, amp),
+			                          _mm_cmpeq_epi8(v, quot)),
+			             _mm_cmpeq_epi8(v, apos)));
+
+		unsigned mask = _mm_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + escape_span_scalar(s + i, len - i);
+}
+
+/**
+ * AVX2 version of escape_span().
+ *
+ * @param s Text to scan.
+ * @param len Length of \p s.
+ * @return Index of first character that needs escaping, \p len if none do.
+ */
+__attribute__((target("avx2")))
+static size_t escape_span_avx2(const char *s, size_t len)
+{
+	const __m256i lt = _mm256_set1_epi8('<'), gt = _mm256_set1_epi8('>');
+	const __m256i amp = _mm256_set1_epi8('&');
+	const __m256i quot = _mm256_set1_epi8('"');
+	const __m256i apos = _mm256_set1_epi8('\'');
+
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+		__m256i m = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, lt),
+			                _mm256_cmpeq_epi8(v, gt)),
+			_mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, amp),
+				                _mm256_cmpeq_epi8(v, quot)),
+				_mm256_cmpeq_epi8(v, apos)));
+
+		unsigned mask = _mm256_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	/* leaving upper halves dirty makes the SSE2 code stall on every
+	 * instruction, which adds up for the many short spans of a page */
+	_mm256_zeroupper();
+	return i + escape_span_sse2(s + i, len - i);
+}
+#endif
+
+size_t escape_span(const char *s, size_t len)
+{
+#if defined(__x86_64__)
+	static int avx2 = -1;
+	if (avx2 < 0)
+		avx2 = __builtin_cpu_supports("avx2");
+
+	if (avx2)
+		return escape_span_avx2(s, len);
+
+	return escape_span_sse2(s, len);
+#else
+	return escape_span_scalar(s, len);
+#endif
+}
+
+/**
+ * Get entity of character.
+ *
+ * @param c Character that needs escaping.
+ * @return Corresponding entity.
+ */
+static const char *escape_entity(char c)
+{
+	switch (c) {
+	case '<': return "&lt;";
+	case '>': return "&gt;";
+	case '&': return "&amp;";
+	case '"': return "&quot;";
+	default: return "&#39;";
+	}
+}
+
+void escape_write(struct obuf *o, const char *s, size_t len)
+{
+	while (len) {
+		size_t clean = escape_span(s, len);
+		if (clean)
+			obuf_write(o, s, clean);
+
+		if (clean == len)
+			break;
+
+		obuf_str(o, escape_entity(s[clean]));
+		s += clean + 1;
+		len -= clean + 1;
+	}
+}
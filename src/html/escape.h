@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file escape.h
+ * HTML escaping header.
+ *
+ * Escapes the five characters that can change the meaning of text or
+ * attribute values, \c <>&"', and nothing else, so the result is safe in
+ * both contexts. Most text has none of them, so the scan for the next one is
+ * vectorised with SSE2 or AVX2 where available and clean runs are written
+ * out in one go.
+ */
+
+#ifndef EXGT_ESCAPE_H
+#define EXGT_ESCAPE_H
+
+#include <stddef.h>
+
+#include <utils/obuf.h>
+
+/**
+ * Find first character that needs escaping.
+ *
+ * @param s Text to scan.
+ * @param len Length of \p s.
+ * @return Index of first character that needs escaping, \p len if none do.
+ */
+size_t escape_span(const char *s, size_t len);
+
+/**
+ * Write text escaped.
+ *
+ * @param o Output buffer to write to.
+ * @param s Text to write.
+ * @param len Length of \p s.
+ */
+void escape_write(struct obuf *o, const char *s, size_t len);
+
+#endif /* EXGT_ESCAPE_H */
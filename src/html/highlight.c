@@ -0,0 +1,1127 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file highlight.c
+ * Built-in syntax highlighter implementation.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include <utils/config.h>
+
+#include "escape.h"
+#include "highlight.h"
+
+/** Span classes. */
+enum highlight_class {
+	/** Plain text, not in a span. */
+	HIGHLIGHT_PLAIN,
+	/** Number. */
+	HIGHLIGHT_NUM,
+	/** Escape sequence in string. */
+	HIGHLIGHT_ESC,
+	/** String. */
+	HIGHLIGHT_STR,
+	/** String in preprocessor directive. */
+	HIGHLIGHT_PPS,
+	/** Line comment. */
+	HIGHLIGHT_SLC,
+	/** Block comment. */
+	HIGHLIGHT_COM,
+	/** Preprocessor directive. */
+	HIGHLIGHT_PPC,
+	/** Operator. */
+	HIGHLIGHT_OPT,
+	/** Interpolation, variable expansion and such. */
+	HIGHLIGHT_IPL,
+	/** First keyword group. */
+	HIGHLIGHT_KWA,
+	/** Second keyword group. */
+	HIGHLIGHT_KWB,
+	/** Third keyword group. */
+	HIGHLIGHT_KWC,
+	/** Function calls, rule targets and other names worth pointing out. */
+	HIGHLIGHT_KWD,
+};
+
+/** Opening tag of span of each class. */
+#define HIGHLIGHT_OPEN(name) "<span class=\"hl " name "\">"
+
+/** Length of opening tags, class names all have three letters. */
+#define HIGHLIGHT_OPEN_LEN (sizeof(HIGHLIGHT_OPEN("num")) - 1)
+
+/** Opening tags of spans, using the same class names as highlight(1). */
+static const char *const highlight_open[] = {
+	[HIGHLIGHT_NUM] = HIGHLIGHT_OPEN("num"),
+	[HIGHLIGHT_ESC] = HIGHLIGHT_OPEN("esc"),
+	[HIGHLIGHT_STR] = HIGHLIGHT_OPEN("str"),
+	[HIGHLIGHT_PPS] = HIGHLIGHT_OPEN("pps"),
+	[HIGHLIGHT_SLC] = HIGHLIGHT_OPEN("slc"),
+	[HIGHLIGHT_COM] = HIGHLIGHT_OPEN("com"),
+	[HIGHLIGHT_PPC] = HIGHLIGHT_OPEN("ppc"),
+	[HIGHLIGHT_OPT] = HIGHLIGHT_OPEN("opt"),
+	[HIGHLIGHT_IPL] = HIGHLIGHT_OPEN("ipl"),
+	[HIGHLIGHT_KWA] = HIGHLIGHT_OPEN("kwa"),
+	[HIGHLIGHT_KWB] = HIGHLIGHT_OPEN("kwb"),
+	[HIGHLIGHT_KWC] = HIGHLIGHT_OPEN("kwc"),
+	[HIGHLIGHT_KWD] = HIGHLIGHT_OPEN("kwd"),
+};
+
+/** Language quirks. */
+enum highlight_flags {
+	/** Lines starting with \c # are preprocessor directives. */
+	HIGHLIGHT_PREPROC = 1 << 0,
+	/** Identifiers followed by \c ( are function calls. */
+	HIGHLIGHT_CALLS = 1 << 1,
+	/** Strings can be triple quoted. */
+	HIGHLIGHT_TRIPLE = 1 << 2,
+	/** \c $var, \c ${var} and \c $(cmd) expand, also in double quotes. */
+	HIGHLIGHT_VARS = 1 << 3,
+	/** Strings can span lines. */
+	HIGHLIGHT_MULTILINE = 1 << 4,
+	/** Line comments only start at the start of a word. */
+	HIGHLIGHT_WORD_COMMENT = 1 << 5,
+	/** Unindented \c name: starts a make rule. */
+	HIGHLIGHT_TARGETS = 1 << 6,
+	/** Identifiers can contain dashes, \c name: in braces is a property,
+	 * \c @name an at-rule and \c #hex a colour. */
+	HIGHLIGHT_CSS = 1 << 7,
+	/** Strings followed by \c : are keys. */
+	HIGHLIGHT_KEYS = 1 << 8,
+};
+
+/** What the previous line left open. */
+enum highlight_mode {
+	/** Nothing. */
+	HIGHLIGHT_CODE,
+	/** Block comment. */
+	HIGHLIGHT_COMMENT,
+	/** String. */
+	HIGHLIGHT_STRING,
+	/** Fenced code block in markdown. */
+	HIGHLIGHT_FENCE,
+};
+
+/** State carried from one line to the next. */
+struct highlight_state {
+	/** What the previous line left open. */
+	enum highlight_mode mode;
+	/** Quote of string left open. */
+	char quote;
+	/** Whether string left open is triple quoted. */
+	bool triple;
+	/** Depth of braces, for CSS. */
+	size_t depth;
+};
+
+/** Sorted list of words. */
+struct highlight_words {
+	/** Words, sorted by strcmp(). */
+	const char *const *words;
+	/** Number of words. */
+	size_t n;
+};
+
+/** Initialize \ref highlight_words from array. */
+#define HIGHLIGHT_WORDS(w) {(w), sizeof(w) / sizeof(*(w))}
+
+/** Tokenizer of one line, line doesn't include newline. */
+typedef void highlight_line_fn(struct obuf *o,
+                               const struct highlight_lang *lang,
+                               struct highlight_state *st,
+                               const char *s, size_t len);
+
+struct highlight_lang {
+	/** Syntax names language is used for, \c NULL terminated. */
+	const char *const *names;
+	/** Tokenizer. */
+	highlight_line_fn *line;
+	/** Keywords, highlighted as \c kwa, \c kwb and \c kwc. */
+	struct highlight_words words[3];
+	/** Start of line comment, \c NULL if none. */
+	const char *line_comment;
+	/** Start of block comment, \c NULL if none. */
+	const char *block_start;
+	/** End of block comment. */
+	const char *block_end;
+	/** Characters that start strings, \c NULL if none. */
+	const char *quotes;
+	/** Characters highlighted as operators, \c NULL if none. */
+	const char *operators;
+	/** Language quirks, see \ref highlight_flags. */
+	unsigned flags;
+};
+
+/**
+ * Write span.
+ *
+ * @param o Output buffer to write to.
+ * @param cls Class of span, \ref HIGHLIGHT_PLAIN for no span.
+ * @param s Text of span.
+ * @param len Length of \p s.
+ */
+static void highlight_span(struct obuf *o, enum highlight_class cls,
+                           const char *s, size_t len)
+{
+	if (!len)
+		return;
+
+	if (cls == HIGHLIGHT_PLAIN) {
+		escape_write(o, s, len);
+		return;
+	}
+
+	obuf_write(o, highlight_open[cls], HIGHLIGHT_OPEN_LEN);
+	escape_write(o, s, len);
+	obuf_lit(o, "</span>");
+}
+
+/**
+ * Check if character is in set.
+ *
+ * @param set Characters to check against, \c NULL for none.
+ * @param c Character to check.
+ * @return \c true if \p c is in \p set.
+ */
+static bool highlight_in(const char *set, char c)
+{
+	if (!set || !c)
+		return false;
+
+	for (; *set; ++set)
+		if (*set == c)
+			return true;
+
+	return false;
+}
+
+/**
+ * Check if string starts at index.
+ *
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param i Index to check at.
+ * @param p String to look for, \c NULL never matches.
+ * @return \c true if \p p is at \p i.
+ */
+static bool highlight_at(const char *s, size_t len, size_t i, const char *p)
+{
+	if (!p)
+		return false;
+
+	size_t plen = strlen(p);
+	return plen <= len - i && memcmp(s + i, p, plen) == 0;
+}
+
+/**
+ * Find string in line.
+ *
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param i Index to start looking from.
+ * @param p String to look for.
+ * @return Index of \p p, \p len if not found.
+ */
+static size_t highlight_search(const char *s, size_t len, size_t i,
+                               const char *p)
+{
+	for (; i < len; ++i) {
+		const char *c = memchr(s + i, p[0], len - i);
+		if (!c)
+			break;
+
+		i = c - s;
+		if (highlight_at(s, len, i, p))
+			return i;
+	}
+
+	return len;
+}
+
+/**
+ * Skip spaces and tabs.
+ *
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param i Index to start from.
+ * @return Index of next other character, \p len if none.
+ */
+static size_t highlight_skip_space(const char *s, size_t len, size_t i)
+{
+	while (i < len && (s[i] == ' ' || s[i] == '\t'))
+		++i;
+
+	return i;
+}
+
+/**
+ * Check if identifier starts at index.
+ *
+ * @param lang Language of line.
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param i Index to check at.
+ * @return \c true if identifier starts at \p i.
+ */
+static bool highlight_ident_start(const struct highlight_lang *lang,
+                                  const char *s, size_t len, size_t i)
+{
+	unsigned char c = s[i];
+	if (isalpha(c) || c == '_')
+		return true;
+
+	/* custom properties and vendor prefixes */
+	return (lang->flags & HIGHLIGHT_CSS) && c == '-' && i + 1 < len
+	       && (isalpha((unsigned char)s[i + 1]) || s[i + 1] == '-');
+}
+
+/**
+ * Find end of identifier.
+ *
+ * @param lang Language of line.
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param i Index of first character of identifier.
+ * @return Index after identifier.
+ */
+static size_t highlight_ident_end(const struct highlight_lang *lang,
+                                  const char *s, size_t len, size_t i)
+{
+	bool dash = lang->flags & HIGHLIGHT_CSS;
+	for (++i; i < len; ++i) {
+		unsigned char c = s[i];
+		if (!isalnum(c) && c != '_' && !(dash && c == '-'))
+			break;
+	}
+
+	return i;
+}
+
+/**
+ * Look up keyword.
+ *
+ * @param lang Language of word.
+ * @param w Word, not \c NUL terminated.
+ * @param len Length of \p w.
+ * @return Class of keyword, \ref HIGHLIGHT_PLAIN if not a keyword.
+ */
+static enum highlight_class highlight_word(const struct highlight_lang *lang,
+                                           const char *w, size_t len)
+{
+	for (size_t g = 0; g < 3; ++g) {
+		const struct highlight_words *words = &lang->words[g];
+		size_t lo = 0, hi = words->n;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			const char *k = words->words[mid];
+			/* most probes differ in the first character already */
+			int cmp = (unsigned char)w[0] - (unsigned char)k[0];
+			if (cmp == 0)
+				cmp = strncmp(w, k, len);
+
+			/* w is a prefix of k */
+			if (cmp == 0 && k[len])
+				cmp = -1;
+
+			if (cmp == 0)
+				return HIGHLIGHT_KWA + g;
+
+			if (cmp < 0)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+	}
+
+	return HIGHLIGHT_PLAIN;
+}
+
+/**
+ * Find end of number.
+ *
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param i Index of first character of number.
+ * @return Index after number.
+ */
+static size_t highlight_number(const char *s, size_t len, size_t i)
+{
+	bool hex = s[i] == '0' && i + 1 < len
+	           && (s[i + 1] == 'x' || s[i + 1] == 'X');
+
+	/* suffixes and units are part of the number */
+	for (++i; i < len; ++i) {
+		unsigned char c = s[i];
+		if (isalnum(c) || c == '.' || c == '_')
+			continue;
+
+		if ((c == '+' || c == '-') && !hex
+		    && (s[i - 1] == 'e' || s[i - 1] == 'E'))
+			continue;
+
+		break;
+	}
+
+	return i;
+}
+
+/**
+ * Find end of variable expansion.
+ *
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param i Index of \c $.
+ * @return Index after expansion, \p i + 1 if \c $ doesn't start one.
+ */
+static size_t highlight_var(const char *s, size_t len, size_t i)
+{
+	if (i + 1 >= len)
+		return i + 1;
+
+	unsigned char c = s[i + 1];
+	if (c == '(' || c == '{') {
+		char close = c == '(' ? ')' : '}';
+		size_t depth = 0;
+		for (size_t j = i + 1; j < len; ++j) {
+			if (s[j] == c)
+				depth++;
+			else if (s[j] == close && !--depth)
+				return j + 1;
+		}
+
+		return len;
+	}
+
+	if (isalpha(c) || c == '_') {
+		size_t j = i + 2;
+		while (j < len && (isalnum((unsigned char)s[j]) || s[j] == '_'))
+			++j;
+
+		return j;
+	}
+
+	/* special parameters and automatic variables */
+	if (highlight_in("$@?#*!-<^+%0123456789", c))
+		return i + 2;
+
+	return i + 1;
+}
+
+/**
+ * Check if backslash escapes in string.
+ *
+ * @param lang Language of string.
+ * @param quote Quote of string.
+ * @return \c true if backslash escapes.
+ */
+static bool highlight_escapes(const struct highlight_lang *lang, char quote)
+{
+	/* shell single quotes take everything literally */
+	return !((lang->flags & HIGHLIGHT_VARS) && quote == '\'');
+}
+
+/**
+ * Write string, with escape sequences and expansions picked out.
+ *
+ * @param o Output buffer to write to.
+ * @param lang Language of string.
+ * @param cls Class of string.
+ * @param s Line.
+ * @param start Index of start of string.
+ * @param end Index after end of string.
+ * @param quote Quote of string.
+ */
+static void highlight_string_write(struct obuf *o,
+                                   const struct highlight_lang *lang,
+                                   enum highlight_class cls, const char *s,
+                                   size_t start, size_t end, char quote)
+{
+	bool escapes = highlight_escapes(lang, quote);
+	bool vars = (lang->flags & HIGHLIGHT_VARS) && quote == '"';
+
+	size_t run = start;
+	for (size_t i = start; i < end;) {
+		size_t next;
+		enum highlight_class inner;
+		if (escapes && s[i] == '\\' && i + 1 < end) {
+			next = i + 2;
+			inner = HIGHLIGHT_ESC;
+		}
+		else if (vars && s[i] == '$'
+		         && (next = highlight_var(s, end, i)) > i + 1)
+			inner = HIGHLIGHT_IPL;
+		else {
+			++i;
+			continue;
+		}
+
+		highlight_span(o, cls, s + run, i - run);
+		highlight_span(o, inner, s + i, next - i);
+		i = run = next;
+	}
+
+	highlight_span(o, cls, s + run, end - run);
+}
+
+/**
+ * Highlight string, either starting at index or continuing from previous
+ * line.
+ *
+ * @param o Output buffer to write to.
+ * @param lang Language of line.
+ * @param st Highlighter state.
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param i Index of opening quote, or start of line if string continues.
+ * @param cls Class of string.
+ * @return Index after string.
+ */
+static size_t highlight_string(struct obuf *o,
+                               const struct highlight_lang *lang,
+                               struct highlight_state *st, const char *s,
+                               size_t len, size_t i, enum highlight_class cls)
+{
+	size_t start = i;
+	if (st->mode != HIGHLIGHT_STRING) {
+		char q = s[i];
+		st->quote = q;
+		st->triple = (lang->flags & HIGHLIGHT_TRIPLE) && i + 2 < len
+		             && s[i + 1] == q && s[i + 2] == q;
+		i += st->triple ? 3 : 1;
+	}
+
+	bool escapes = highlight_escapes(lang, st->quote), closed = false;
+	for (; i < len; ++i) {
+		if (escapes && s[i] == '\\') {
+			++i;
+			continue;
+		}
+
+		if (s[i] != st->quote)
+			continue;
+
+		if (!st->triple) {
+			closed = true;
+			i += 1;
+			break;
+		}
+
+		if (i + 2 < len && s[i + 1] == st->quote && s[i + 2] == st->quote) {
+			closed = true;
+			i += 3;
+			break;
+		}
+	}
+
+	if (i > len)
+		i = len;
+
+	size_t after = highlight_skip_space(s, len, i);
+	if ((lang->flags & HIGHLIGHT_KEYS) && closed && after < len
+	    && s[after] == ':')
+		cls = HIGHLIGHT_KWD;
+
+	highlight_string_write(o, lang, cls, s, start, i, st->quote);
+
+	bool open = !closed
+	            && (st->triple || (lang->flags & HIGHLIGHT_MULTILINE));
+	st->mode = open ? HIGHLIGHT_STRING : HIGHLIGHT_CODE;
+	return i;
+}
+
+/**
+ * Highlight block comment, either starting at index or continuing from
+ * previous line.
+ *
+ * @param o Output buffer to write to.
+ * @param lang Language of line.
+ * @param st Highlighter state.
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param i Index of comment start, or start of line if comment continues.
+ * @return Index after comment.
+ */
+static size_t highlight_comment(struct obuf *o,
+                                const struct highlight_lang *lang,
+                                struct highlight_state *st, const char *s,
+                                size_t len, size_t i)
+{
+	size_t from = i;
+	if (st->mode != HIGHLIGHT_COMMENT)
+		from += strlen(lang->block_start);
+
+	size_t end = highlight_search(s, len, from, lang->block_end);
+	if (end < len) {
+		end += strlen(lang->block_end);
+		st->mode = HIGHLIGHT_CODE;
+	}
+	else
+		st->mode = HIGHLIGHT_COMMENT;
+
+	highlight_span(o, HIGHLIGHT_COM, s + i, end - i);
+	return end;
+}
+
+/**
+ * Find end of make rule target.
+ *
+ * @param s Line, not indented.
+ * @param len Length of \p s.
+ * @return Index of colon after target, \c 0 if line isn't a rule.
+ */
+static size_t highlight_target(const char *s, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		if (s[i] == '=' || s[i] == '#')
+			return 0;
+
+		if (s[i] != ':')
+			continue;
+
+		/* := and ::= are assignments */
+		if (i + 1 < len && s[i + 1] == '=')
+			return 0;
+
+		if (i + 2 < len && s[i + 1] == ':' && s[i + 2] == '=')
+			return 0;
+
+		return i;
+	}
+
+	return 0;
+}
+
+/**
+ * Classify identifier that's not a keyword.
+ *
+ * @param lang Language of line.
+ * @param st Highlighter state.
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param end Index after identifier.
+ * @return Class of identifier.
+ */
+static enum highlight_class highlight_name(const struct highlight_lang *lang,
+                                           struct highlight_state *st,
+                                           const char *s, size_t len,
+                                           size_t end)
+{
+	size_t after = highlight_skip_space(s, len, end);
+	if (after >= len)
+		return HIGHLIGHT_PLAIN;
+
+	if ((lang->flags & HIGHLIGHT_CALLS) && s[after] == '(')
+		return HIGHLIGHT_KWD;
+
+	/* selectors with pseudo-classes look the same, but open a block
+	 * instead of ending in a semicolon, which matters inside at-rules */
+	if ((lang->flags & HIGHLIGHT_CSS) && st->depth && s[after] == ':') {
+		size_t end = after;
+		while (end < len && !highlight_in("{;}", s[end]))
+			++end;
+
+		if (end == len || s[end] != '{')
+			return HIGHLIGHT_KWB;
+	}
+
+	return HIGHLIGHT_PLAIN;
+}
+
+/**
+ * Highlight line of code.
+ *
+ * @param o Output buffer to write to.
+ * @param lang Language of line.
+ * @param st Highlighter state.
+ * @param s Line.
+ * @param len Length of \p s.
+ */
+static void highlight_code(struct obuf *o, const struct highlight_lang *lang,
+                           struct highlight_state *st, const char *s,
+                           size_t len)
+{
+	size_t i = 0;
+	if (st->mode == HIGHLIGHT_COMMENT)
+		i = highlight_comment(o, lang, st, s, len, 0);
+	else if (st->mode == HIGHLIGHT_STRING)
+		i = highlight_string(o, lang, st, s, len, 0, HIGHLIGHT_STR);
+
+	enum highlight_class str = HIGHLIGHT_STR;
+	bool include = false;
+	size_t first = highlight_skip_space(s, len, i);
+	if (i == 0 && (lang->flags & HIGHLIGHT_PREPROC) && first < len
+	    && s[first] == '#') {
+		size_t dir = highlight_skip_space(s, len, first + 1);
+		size_t end = dir;
+		while (end < len && isalpha((unsigned char)s[end]))
+			++end;
+
+		include = end - dir == 7 && memcmp(s + dir, "include", 7) == 0;
+		str = HIGHLIGHT_PPS;
+
+		highlight_span(o, HIGHLIGHT_PLAIN, s, first);
+		highlight_span(o, HIGHLIGHT_PPC, s + first, end - first);
+		i = end;
+	}
+	else if (i == 0 && (lang->flags & HIGHLIGHT_TARGETS) && first == 0) {
+		i = highlight_target(s, len);
+		highlight_span(o, HIGHLIGHT_KWD, s, i);
+	}
+
+	size_t run = i;
+	while (i < len) {
+		char c = s[i];
+		size_t next;
+		enum highlight_class cls;
+		if (highlight_at(s, len, i, lang->line_comment)
+		    && (!(lang->flags & HIGHLIGHT_WORD_COMMENT) || i == 0
+		        || highlight_in(" \t;|&(", s[i - 1]))) {
+			next = len;
+			cls = HIGHLIGHT_SLC;
+		}
+		else if (highlight_at(s, len, i, lang->block_start)) {
+			highlight_span(o, HIGHLIGHT_PLAIN, s + run, i - run);
+			i = run = highlight_comment(o, lang, st, s, len, i);
+			continue;
+		}
+		else if (highlight_in(lang->quotes, c)) {
+			highlight_span(o, HIGHLIGHT_PLAIN, s + run, i - run);
+			i = run = highlight_string(o, lang, st, s, len, i, str);
+			continue;
+		}
+		else if (include && c == '<') {
+			const char *gt = memchr(s + i, '>', len - i);
+			next = gt ? (size_t)(gt - s) + 1 : len;
+			cls = HIGHLIGHT_PPS;
+		}
+		else if ((lang->flags & HIGHLIGHT_VARS) && c == '$') {
+			next = highlight_var(s, len, i);
+			cls = HIGHLIGHT_IPL;
+		}
+		else if ((lang->flags & HIGHLIGHT_CSS) && c == '@' && i + 1 < len
+		         && isalpha((unsigned char)s[i + 1])) {
+			next = highlight_ident_end(lang, s, len, i + 1);
+			cls = HIGHLIGHT_KWA;
+		}
+		else if ((lang->flags & HIGHLIGHT_CSS) && c == '#' && st->depth
+		         && i + 1 < len && isxdigit((unsigned char)s[i + 1])) {
+			next = highlight_ident_end(lang, s, len, i + 1);
+			cls = HIGHLIGHT_NUM;
+		}
+		else if (isdigit((unsigned char)c)
+		         || (c == '.' && i + 1 < len
+		             && isdigit((unsigned char)s[i + 1]))) {
+			next = highlight_number(s, len, i);
+			cls = HIGHLIGHT_NUM;
+		}
+		else if (highlight_ident_start(lang, s, len, i)) {
+			next = highlight_ident_end(lang, s, len, i);
+			cls = highlight_word(lang, s + i, next - i);
+			if (cls == HIGHLIGHT_PLAIN)
+				cls = highlight_name(lang, st, s, len, next);
+		}
+		else if (highlight_in(lang->operators, c)) {
+			for (next = i; next < len
+			     && highlight_in(lang->operators, s[next]); ++next) {
+				if (s[next] == '{')
+					st->depth++;
+				else if (s[next] == '}' && st->depth)
+					st->depth--;
+			}
+
+			cls = HIGHLIGHT_OPT;
+		}
+		else {
+			++i;
+			continue;
+		}
+
+		highlight_span(o, HIGHLIGHT_PLAIN, s + run, i - run);
+		highlight_span(o, cls, s + i, next - i);
+		i = run = next;
+	}
+
+	highlight_span(o, HIGHLIGHT_PLAIN, s + run, i - run);
+}
+
+/**
+ * Find end of markdown list marker.
+ *
+ * @param s Line.
+ * @param len Length of \p s.
+ * @param i Index of first non-space character.
+ * @return Index after marker, \p i if there's no marker.
+ */
+static size_t highlight_list_marker(const char *s, size_t len, size_t i)
+{
+	size_t end = i;
+	if (end < len && highlight_in("-*+", s[end]))
+		end++;
+	else {
+		while (end < len && isdigit((unsigned char)s[end]))
+			end++;
+
+		if (end == i || end >= len || !highlight_in(".)", s[end]))
+			return i;
+
+		end++;
+	}
+
+	if (end >= len || s[end] != ' ')
+		return i;
+
+	return end;
+}
+
+/**
+ * Highlight line of markdown.
+ *
+ * @param o Output buffer to write to.
+ * @param lang Language of line.
+ * @param st Highlighter state.
+ * @param s Line.
+ * @param len Length of \p s.
+ */
+static void highlight_markdown(struct obuf *o,
+                               const struct highlight_lang *lang,
+                               struct highlight_state *st, const char *s,
+                               size_t len)
+{
+	(void)lang;
+	size_t first = highlight_skip_space(s, len, 0);
+	bool fence = highlight_at(s, len, first, "```")
+	             || highlight_at(s, len, first, "~~~");
+
+	if (fence || st->mode == HIGHLIGHT_FENCE) {
+		if (fence)
+			st->mode = st->mode == HIGHLIGHT_FENCE ? HIGHLIGHT_CODE
+			           : HIGHLIGHT_FENCE;
+
+		highlight_span(o, HIGHLIGHT_STR, s, len);
+		return;
+	}
+
+	if (first < len && s[first] == '#') {
+		highlight_span(o, HIGHLIGHT_KWA, s, len);
+		return;
+	}
+
+	if (first < len && s[first] == '>') {
+		highlight_span(o, HIGHLIGHT_COM, s, len);
+		return;
+	}
+
+	size_t i = highlight_list_marker(s, len, first);
+	highlight_span(o, HIGHLIGHT_PLAIN, s, first);
+	highlight_span(o, HIGHLIGHT_OPT, s + first, i - first);
+
+	size_t run = i;
+	while (i < len) {
+		char c = s[i];
+		size_t next;
+		enum highlight_class cls;
+		if (c == '\\' && i + 1 < len && ispunct((unsigned char)s[i + 1])) {
+			next = i + 2;
+			cls = HIGHLIGHT_ESC;
+		}
+		else if (c == '`' || c == '*' || c == '_') {
+			/* code spans and emphasis end with the same run of
+			 * characters they start with */
+			size_t n = 1;
+			while (i + n < len && s[i + n] == c && n < 3)
+				n++;
+
+			char delim[4] = {c, c, c, 0};
+			delim[n] = 0;
+
+			size_t end = highlight_search(s, len, i + n, delim);
+			bool word = c == '_' && i && isalnum((unsigned char)s[i - 1]);
+			if (word || end == len || end == i + n) {
+				i += n;
+				continue;
+			}
+
+			next = end + n;
+			cls = c == '`' ? HIGHLIGHT_STR : HIGHLIGHT_KWB;
+		}
+		else if (c == '[') {
+			const char *close = memchr(s + i, ']', len - i);
+			size_t paren = close ? (size_t)(close - s) + 1 : len;
+			const char *end = paren < len && s[paren] == '('
+			                  ? memchr(s + paren, ')', len - paren)
+			                  : NULL;
+			if (!end) {
+				++i;
+				continue;
+			}
+
+			highlight_span(o, HIGHLIGHT_PLAIN, s + run, i - run);
+			highlight_span(o, HIGHLIGHT_KWC, s + i, paren - i);
+			i = run = paren;
+			next = end - s + 1;
+			cls = HIGHLIGHT_KWD;
+		}
+		else {
+			++i;
+			continue;
+		}
+
+		highlight_span(o, HIGHLIGHT_PLAIN, s + run, i - run);
+		highlight_span(o, cls, s + i, next - i);
+		i = run = next;
+	}
+
+	highlight_span(o, HIGHLIGHT_PLAIN, s + run, i - run);
+}
+
+/**
+ * Write line of plain text.
+ *
+ * @param o Output buffer to write to.
+ * @param lang Language of line.
+ * @param st Highlighter state.
+ * @param s Line.
+ * @param len Length of \p s.
+ */
+static void highlight_plain(struct obuf *o, const struct highlight_lang *lang,
+                            struct highlight_state *st, const char *s,
+                            size_t len)
+{
+	(void)lang;
+	(void)st;
+	highlight_span(o, HIGHLIGHT_PLAIN, s, len);
+}
+
+/** C keywords. */
+static const char *const c_keywords[] = {
+	"_Alignas", "_Alignof", "_Atomic", "_Generic", "_Noreturn",
+	"_Static_assert", "_Thread_local", "auto", "break", "case", "const",
+	"continue", "default", "do", "else", "enum", "extern", "for", "goto",
+	"if", "inline", "register", "restrict", "return", "sizeof", "static",
+	"struct", "switch", "typedef", "union", "volatile", "while",
+};
+
+/** C types. */
+static const char *const c_types[] = {
+	"FILE", "_Bool", "_Complex", "bool", "char", "double", "float", "int",
+	"int16_t", "int32_t", "int64_t", "int8_t", "intptr_t", "long", "off_t",
+	"ptrdiff_t", "short", "signed", "size_t", "ssize_t", "uint16_t",
+	"uint32_t", "uint64_t", "uint8_t", "uintptr_t", "unsigned", "void",
+	"wchar_t",
+};
+
+/** C constants. */
+static const char *const c_constants[] = {
+	"EOF", "NULL", "errno", "false", "stderr", "stdin", "stdout", "true",
+};
+
+/** C++ keywords. */
+static const char *const cpp_keywords[] = {
+	"alignas", "alignof", "asm", "auto", "break", "case", "catch", "class",
+	"co_await", "co_return", "co_yield", "concept", "const", "const_cast",
+	"consteval", "constexpr", "constinit", "continue", "decltype",
+	"default", "delete", "do", "dynamic_cast", "else", "enum", "explicit",
+	"export", "extern", "final", "for", "friend", "goto", "if", "inline",
+	"mutable", "namespace", "new", "noexcept", "operator", "override",
+	"private", "protected", "public", "register", "reinterpret_cast",
+	"requires", "return", "sizeof", "static", "static_assert",
+	"static_cast", "struct", "switch", "template", "this", "thread_local",
+	"throw", "try", "typedef", "typeid", "typename", "union", "using",
+	"virtual", "volatile", "while",
+};
+
+/** C++ types. */
+static const char *const cpp_types[] = {
+	"bool", "char", "char16_t", "char32_t", "char8_t", "double", "float",
+	"int", "int16_t", "int32_t", "int64_t", "int8_t", "long", "ptrdiff_t",
+	"short", "signed", "size_t", "uint16_t", "uint32_t", "uint64_t",
+	"uint8_t", "unsigned", "void", "wchar_t",
+};
+
+/** C++ constants. */
+static const char *const cpp_constants[] = {
+	"NULL", "false", "nullptr", "true",
+};
+
+/** Python keywords. */
+static const char *const python_keywords[] = {
+	"and", "as", "assert", "async", "await", "break", "case", "class",
+	"continue", "def", "del", "elif", "else", "except", "finally", "for",
+	"from", "global", "if", "import", "in", "is", "lambda", "match",
+	"nonlocal", "not", "or", "pass", "raise", "return", "try", "while",
+	"with", "yield",
+};
+
+/** Python builtin types. */
+static const char *const python_types[] = {
+	"bool", "bytearray", "bytes", "complex", "dict", "float", "frozenset",
+	"int", "list", "object", "range", "set", "str", "tuple", "type",
+};
+
+/** Python constants. */
+static const char *const python_constants[] = {
+	"Ellipsis", "False", "None", "NotImplemented", "True", "cls", "self",
+};
+
+/** Shell keywords. */
+static const char *const shell_keywords[] = {
+	"case", "do", "done", "elif", "else", "esac", "fi", "for", "function",
+	"if", "in", "select", "then", "time", "until", "while",
+};
+
+/** Shell builtins. */
+static const char *const shell_builtins[] = {
+	"alias", "bg", "break", "cd", "command", "continue", "declare", "echo",
+	"eval", "exec", "exit", "export", "false", "fg", "getopts", "hash",
+	"jobs", "kill", "let", "local", "printf", "pwd", "read", "readonly",
+	"return", "set", "shift", "source", "test", "trap", "true", "type",
+	"typeset", "ulimit", "umask", "unalias", "unset", "wait",
+};
+
+/** Make directives. */
+static const char *const make_keywords[] = {
+	"define", "else", "endef", "endif", "export", "ifdef", "ifeq",
+	"ifndef", "ifneq", "include", "override", "private", "sinclude",
+	"undefine", "unexport", "vpath",
+};
+
+/** Common CSS values. */
+static const char *const css_values[] = {
+	"absolute", "auto", "block", "bold", "center", "fixed", "flex", "grid",
+	"hidden", "inherit", "initial", "inline", "inline-block", "italic",
+	"left", "none", "normal", "relative", "right", "solid", "static",
+	"sticky", "transparent", "underline", "unset",
+};
+
+/** JSON constants. */
+static const char *const json_constants[] = {
+	"false", "null", "true",
+};
+
+/** Operators of C-like languages. */
+#define HIGHLIGHT_C_OPERATORS "+-*/%=<>!&|^~?:;,.()[]{}"
+
+/** Languages the built-in highlighter knows. */
+static const struct highlight_lang highlight_langs[] = {
+	{
+		.names = (const char *const[]){"c", "h", NULL},
+		.line = highlight_code,
+		.words = {HIGHLIGHT_WORDS(c_keywords),
+		          HIGHLIGHT_WORDS(c_types),
+		          HIGHLIGHT_WORDS(c_constants)},
+		.line_comment = "//",
+		.block_start = "/*",
+		.block_end = "*/",
+		.quotes = "\"'",
+		.operators = HIGHLIGHT_C_OPERATORS,
+		.flags = HIGHLIGHT_PREPROC | HIGHLIGHT_CALLS,
+	},
+	{
+		.names = (const char *const[]){"cpp", "cc", "cxx", "c++", "hpp",
+		                               "hh", "hxx", "h++", "ipp",
+		                               "tpp", NULL},
+		.line = highlight_code,
+		.words = {HIGHLIGHT_WORDS(cpp_keywords),
+		          HIGHLIGHT_WORDS(cpp_types),
+		          HIGHLIGHT_WORDS(cpp_constants)},
+		.line_comment = "//",
+		.block_start = "/*",
+		.block_end = "*/",
+		.quotes = "\"'",
+		.operators = HIGHLIGHT_C_OPERATORS,
+		.flags = HIGHLIGHT_PREPROC | HIGHLIGHT_CALLS,
+	},
+	{
+		.names = (const char *const[]){"py", "pyw", "pyi", NULL},
+		.line = highlight_code,
+		.words = {HIGHLIGHT_WORDS(python_keywords),
+		          HIGHLIGHT_WORDS(python_types),
+		          HIGHLIGHT_WORDS(python_constants)},
+		.line_comment = "#",
+		.quotes = "\"'",
+		.operators = HIGHLIGHT_C_OPERATORS "@",
+		.flags = HIGHLIGHT_TRIPLE | HIGHLIGHT_CALLS,
+	},
+	{
+		.names = (const char *const[]){"sh", "bash", "zsh", "ksh", NULL},
+		.line = highlight_code,
+		.words = {HIGHLIGHT_WORDS(shell_keywords),
+		          HIGHLIGHT_WORDS(shell_builtins)},
+		.line_comment = "#",
+		.quotes = "\"'`",
+		.operators = "|&;<>()=!{}[]",
+		.flags = HIGHLIGHT_VARS | HIGHLIGHT_MULTILINE
+		         | HIGHLIGHT_WORD_COMMENT,
+	},
+	{
+		.names = (const char *const[]){"makefile", "mk", "mak", NULL},
+		.line = highlight_code,
+		.words = {HIGHLIGHT_WORDS(make_keywords)},
+		.line_comment = "#",
+		.operators = "=:+?!|;",
+		.flags = HIGHLIGHT_VARS | HIGHLIGHT_TARGETS,
+	},
+	{
+		.names = (const char *const[]){"md", "markdown", "mkd", NULL},
+		.line = highlight_markdown,
+	},
+	{
+		.names = (const char *const[]){"css", NULL},
+		.line = highlight_code,
+		.words = {{NULL, 0}, {NULL, 0}, HIGHLIGHT_WORDS(css_values)},
+		.block_start = "/*",
+		.block_end = "*/",
+		.quotes = "\"'",
+		.operators = "{}:;,>+~()[]*=!",
+		.flags = HIGHLIGHT_CSS | HIGHLIGHT_CALLS,
+	},
+	{
+		.names = (const char *const[]){"json", NULL},
+		.line = highlight_code,
+		.words = {HIGHLIGHT_WORDS(json_constants)},
+		.quotes = "\"",
+		.operators = "{}[]:,-",
+		.flags = HIGHLIGHT_KEYS,
+	},
+	{
+		/* nothing to highlight, but no need to fork for that either */
+		.names = (const char *const[]){"txt", NULL},
+		.line = highlight_plain,
+	},
+};
+
+const struct highlight_lang *highlight_find(const char *syntax)
+{
+	if (!config_size("EXGT_HIGHLIGHT_BUILTIN", 1))
+		return NULL;
+
+	size_t n = sizeof(highlight_langs) / sizeof(*highlight_langs);
+	for (size_t i = 0; i < n; ++i)
+		for (const char *const *name = highlight_langs[i].names; *name;
+		     ++name)
+			if (strcmp(*name, syntax) == 0)
+				return &highlight_langs[i];
+
+	return NULL;
+}
+
+void highlight_write(struct obuf *o, const struct highlight_lang *lang,
+                     const char *src, size_t size)
+{
+	struct highlight_state st = {HIGHLIGHT_CODE, 0, false, 0};
+	const char *end = src + size;
+	while (src < end) {
+		const char *nl = memchr(src, '\n', end - src);
+		size_t len = nl ? (size_t)(nl - src) : (size_t)(end - src);
+
+		lang->line(o, lang, &st, src, len);
+		if (!nl)
+			break;
+
+		obuf_char(o, '\n');
+		src = nl + 1;
+	}
+}
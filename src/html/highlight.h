@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file highlight.h
+ * Built-in syntax highlighter header.
+ *
+ * Covers the languages most of our files are in, without forking
+ * highlight(1) for each file view. Each language is a table of keywords,
+ * comment and string delimiters and a few flags for quirks, handled by one
+ * shared tokenizer. Markdown, being line oriented, gets a small tokenizer of
+ * its own.
+ *
+ * Output uses the same \c "hl xyz" span classes as highlight(1), so the
+ * stylesheet works for both. Spans never cross lines, comments and strings
+ * spanning several lines are closed at the end of each line and reopened on
+ * the next, so each line of output is valid HTML on its own.
+ *
+ * Setting \c EXGT_HIGHLIGHT_BUILTIN to \c 0 always uses highlight(1).
+ */
+
+#ifndef EXGT_HIGHLIGHT_H
+#define EXGT_HIGHLIGHT_H
+
+#include <stddef.h>
+
+#include <utils/obuf.h>
+
+/** Version of built-in highlighter, bump whenever its output changes. */
+#define HIGHLIGHT_VERSION "builtin-1"
+
+/** Language the built-in highlighter knows. */
+struct highlight_lang;
+
+/**
+ * Find language by syntax name.
+ *
+ * @param syntax Syntax name, usually file suffix.
+ * @return Language, \c NULL if built-in highlighter doesn't know it or is
+ * disabled.
+ */
+const struct highlight_lang *highlight_find(const char *syntax);
+
+/**
+ * Highlight source code.
+ *
+ * @param o Output buffer to write to.
+ * @param lang Language of \p src.
+ * @param src Source to highlight.
+ * @param size Size of \p src.
+ */
+void highlight_write(struct obuf *o, const struct highlight_lang *lang,
+                     const char *src, size_t size);
+
+#endif /* EXGT_HIGHLIGHT_H */
@@ -6,125 +6,185 @@
  * HTML generation implementation.
  */
 
+/* memmem() */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <assert.h>
 
 #include <utils/path.h>
 #include <utils/git.h>
-#include <utils/chain.h>
+#include <utils/prefetch.h>
+#include <utils/http.h>
+#include <utils/compress.h>
+#include <utils/error.h>
 
 #include "pages/pages.h"
+#include "escape.h"
+#include "cache.h"
 #include "html.h"
 
-static void html_print_elems(FILE *file, struct html_elem *elem);
-
 /**
- * Print one html attribute.
+ * Finish start tag of innermost element, if it's still unfinished.
  *
- * @param file Output file to print to.
- * @param attr Attribute to print.
+ * @param s Stream to write to.
  */
-static void html_print_attr(FILE *file, struct html_attr *attr)
+static void html_stream_finish(struct html_stream *s)
 {
-	if (attr->value)
-		fprintf(file, " %s=\"%s\"", attr->name, attr->value);
-	else
-		fprintf(file, " %s", attr->name);
+	if (!s->pending)
+		return;
+
+	obuf_char(s->out, '>');
+	s->pending = false;
 }
 
-/**
- * Print html element attributes.
- *
- * @param file Output file to print to.
- * @param attr Attributes to print.
- */
-static void html_print_attrs(FILE *file, struct html_attr *attr)
+void html_stream_start(struct html_stream *s, struct obuf *out)
 {
-	for (; attr; attr = attr->prev)
-		html_print_attr(file, attr);
+	s->out = out;
+	s->depth = 0;
+	s->pending = false;
 }
 
-/**
- * Print start tag, stuff like <p> etc.
- * If element is just raw text, no tag will be printed.
- *
- * @param file Output file to print to.
- * @param elem Element whose start tag to print.
- */
-static void html_print_starttag(FILE *file, struct html_elem *elem)
+void html_stream_open(struct html_stream *s, const char *tag)
 {
-	if (elem->tag) {
-		fprintf(file, "<%s", elem->tag);
-		html_print_attrs(file, elem->attrs);
-		fprintf(file, ">");
-	}
+	assert(s->depth < HTML_STREAM_DEPTH);
+	html_stream_finish(s);
+
+	obuf_char(s->out, '<');
+	obuf_str(s->out, tag);
+	s->tags[s->depth++] = tag;
+	s->pending = true;
 }
 
-/**
- * Print end tag, stuff like </p> etc.
- * If element is raw text, no tag will be printed.
- *
- * @param file Output file to print to.
- * @param elem Element whose end tag to print.
- */
-static void html_print_endtag(FILE *file, struct html_elem *elem)
+void html_stream_attr(struct html_stream *s, const char *name,
+                      const char *value)
 {
-	if (elem->tag)
-		fprintf(file, "</%s>\n", elem->tag);
+	assert(s->pending);
+	obuf_char(s->out, ' ');
+	obuf_str(s->out, name);
+	if (!value)
+		return;
+
+	obuf_lit(s->out, "=\"");
+	escape_write(s->out, value, strlen(value));
+	obuf_char(s->out, '"');
 }
 
-/**
- * Print one HTML element.
- *
- * @param file Output file to print to.
- * @param elem Element to print.
- */
-static void html_print_elem(FILE *file, struct html_elem *elem)
+void html_stream_text(struct html_stream *s, const char *text)
 {
-	html_print_starttag(file, elem);
+	html_stream_textn(s, text, strlen(text));
+}
+
+void html_stream_textn(struct html_stream *s, const char *text, size_t len)
+{
+	html_stream_finish(s);
+	escape_write(s->out, text, len);
+}
 
-	if (elem->value)
-		fprintf(file, "%s", elem->value);
+void html_stream_raw(struct html_stream *s, const char *html, size_t len)
+{
+	html_stream_finish(s);
+	obuf_write(s->out, html, len);
+}
 
-	html_print_elems(file, elem->child);
-	html_print_endtag(file, elem);
+struct obuf *html_stream_out(struct html_stream *s)
+{
+	html_stream_finish(s);
+	return s->out;
 }
 
-/**
- * Print all HTML elements in \p elem.
- *
- * @param file Output file to print to.
- * @param elem Head element to start printing from.
- */
-static void html_print_elems(FILE *file, struct html_elem *elem)
+void html_stream_close(struct html_stream *s)
 {
-	for (; elem; elem = elem->next)
-		html_print_elem(file, elem);
+	assert(s->depth);
+	html_stream_finish(s);
+
+	obuf_lit(s->out, "</");
+	obuf_str(s->out, s->tags[--s->depth]);
+	obuf_lit(s->out, ">\n");
 }
 
-void html_print(FILE *file, struct html_elem *elem)
+void html_stream_elem(struct html_stream *s, const char *tag,
+                      const char *text)
 {
-	pages_generate_doctype(file);
-	html_print_elems(file, elem);
+	html_stream_open(s, tag);
+	if (text)
+		html_stream_text(s, text);
+
+	html_stream_close(s);
 }
 
-struct html_attr *html_create_attr(const char *name, const char *value)
+void html_stream_end(struct html_stream *s)
 {
-	struct html_attr content = (struct html_attr){name, value, NULL};
-	struct html_attr *attr = malloc(sizeof(struct html_attr));
-	memcpy(attr, &content, sizeof(struct html_attr));
+	while (s->depth)
+		html_stream_close(s);
+}
+
+void html_stream_template(struct html_stream *s, const struct template *t,
+                          const char *values[])
+{
+	html_stream_finish(s);
+	template_write(s->out, t, values);
+
+	for (const char *const *tag = t->open; *tag; ++tag) {
+		assert(s->depth < HTML_STREAM_DEPTH);
+		s->tags[s->depth++] = *tag;
+	}
+}
+
+void html_stream_tree(struct html_stream *s, struct html_elem *elem)
+{
+	for (; elem; elem = elem->next) {
+		/* raw text elements have no tags to print */
+		if (elem->tag) {
+			html_stream_open(s, elem->tag);
+			for (struct html_attr *attr = elem->attrs; attr;
+			     attr = attr->prev)
+				html_stream_attr(s, attr->name, attr->value);
+		}
+
+		if (elem->value)
+			html_stream_text(s, elem->value);
+
+		html_stream_tree(s, elem->child);
+
+		if (elem->tag)
+			html_stream_close(s);
+	}
+}
+
+void html_print(struct obuf *out, struct html_elem *elem)
+{
+	pages_generate_doctype(out);
+
+	struct html_stream s;
+	html_stream_start(&s, out);
+	html_stream_tree(&s, elem);
+}
+
+struct html_attr *html_create_attr(struct res *r, const char *name,
+                                   const char *value)
+{
+	struct html_attr *attr;
+	if (!(attr = res_alloc(r, sizeof(*attr))))
+		return NULL;
+
+	*attr = (struct html_attr){name, value, NULL};
 	return attr;
 }
 
-struct html_elem *html_create_elem(const char *tag, const char *value)
+struct html_elem *html_create_elem(struct res *r, const char *tag,
+                                   const char *value)
 {
-	struct html_elem content =
-		(struct html_elem){tag, value, NULL, NULL, NULL};
-	struct html_elem *elem = malloc(sizeof(struct html_elem));
-	memcpy(elem, &content, sizeof(struct html_elem));
+	struct html_elem *elem;
+	if (!(elem = res_alloc(r, sizeof(*elem))))
+		return NULL;
+
+	*elem = (struct html_elem){tag, value, NULL, NULL, NULL};
 	return elem;
 }
 
@@ -134,10 +194,13 @@ void html_append_attr(struct html_elem *elem, struct html_attr *attr)
 	elem->attrs = attr;
 }
 
-struct html_attr *html_add_attr(struct html_elem *elem, const char *name,
-                                const char *value)
+struct html_attr *html_add_attr(struct res *r, struct html_elem *elem,
+                                const char *name, const char *value)
 {
-	struct html_attr *attr = html_create_attr(name, value);
+	struct html_attr *attr;
+	if (!(attr = html_create_attr(r, name, value)))
+		return NULL;
+
 	html_append_attr(elem, attr);
 	return attr;
 }
@@ -148,10 +211,13 @@ void html_append_elem(struct html_elem *prev, struct html_elem *next)
 	prev->next = next;
 }
 
-struct html_elem *html_add_elem(struct html_elem *prev, const char *tag,
-                                const char *value)
+struct html_elem *html_add_elem(struct res *r, struct html_elem *prev,
+                                const char *tag, const char *value)
 {
-	struct html_elem *elem = html_create_elem(tag, value);
+	struct html_elem *elem;
+	if (!(elem = html_create_elem(r, tag, value)))
+		return NULL;
+
 	html_append_elem(prev, elem);
 	return elem;
 }
@@ -162,130 +228,308 @@ void html_append_child(struct html_elem *parent, struct html_elem *child)
 	parent->child = child;
 }
 
-struct html_elem *html_add_child(struct html_elem *parent, const char *tag,
-                                 const char *value)
+struct html_elem *html_add_child(struct res *r, struct html_elem *parent,
+                                 const char *tag, const char *value)
 {
-	struct html_elem *elem = html_create_elem(tag, value);
+	struct html_elem *elem;
+	if (!(elem = html_create_elem(r, tag, value)))
+		return NULL;
+
 	html_append_child(parent, elem);
 	return elem;
 }
 
-/**
- * Destroy element attribues.
- *
- * @param attr Start of attribute list.
- */
-static void html_attrs_destroy(struct html_attr *attr)
-{
-	while (attr) {
-		struct html_attr *tmp = attr->prev;
-		free(attr);
-		attr = tmp;
-	}
-}
-
-void html_destroy(struct html_elem *elem)
-{
-	while (elem) {
-		html_destroy(elem->child);
-		html_attrs_destroy(elem->attrs);
-
-		struct html_elem *tmp = elem->next;
-		free(elem);
-		elem = tmp;
-	}
-}
+/** Page cache key of current request, \c NULL if it shouldn't be stored. */
+static char *page_key;
 
 /**
  * Serve page that is based on a "real" file in some repo.
+ * Pages are served from the page cache when possible, in which case nothing is
+ * written to \p out.
  *
- * @param file Output file to print to.
+ * @param out Output buffer to print to.
  */
-static void real_serve(FILE *file)
+static void real_serve(struct obuf *out)
 {
-	char *object;
-	if (!(object = git_object())) {
-		error_serve(file, 500, "couldn't get intended git object");
-		return;
-	}
-
 	char *root;
 	if (!(root = git_real_root())) {
-		error_serve(file, 500, "couldn't get git real root");
-		free(object);
+		error_serve(out, 500, "couldn't get git real root");
 		return;
 	}
 
-	char **cmds[] =
-	{(char *[]){"git", "-C", root, "cat-file", "-t", object, 0}};
-	FILE *file_type = exgt_chain(1, cmds);
-
-	free(object);
-	free(root);
+	char *commit;
+	if (!(commit = git_commit())) {
+		error_serve(out, 500, "couldn't get intended git commit");
+		free(root);
+		return;
+	}
 
-	if (!file_type) {
-		error_serve(file, 500, "illegal command format");
+	char *path;
+	if (!(path = git_path())) {
+		error_serve(out, 500, "couldn't get intended git path");
+		free(commit);
+		free(root);
 		return;
 	}
 
-	size_t len = 0;
-	char *line = NULL;
-	getline(&line, &len, file_type);
+	/* pages pinned to an object ID can't change, so they're looked up by
+	 * the request alone and resolved only on a miss. Conditional requests
+	 * still resolve to compare against the tag of the object. */
+	bool pinned = git_is_oid(commit);
+	bool looked_up = false;
+	char *key = NULL;
+	if (pinned && !getenv("HTTP_IF_NONE_MATCH")) {
+		looked_up = true;
+		if ((key = html_cache_key(commit)) && !html_cache_serve(key))
+			goto out;
+	}
 
-	fclose(file_type);
+	struct git_obj obj;
+	if (git_resolve_commit(root, commit, &obj)
+	    || git_resolve_path(root, path, &obj))
+		goto not_found;
+
+	/* page content is fully determined by the object, anything pinned to
+	 * a specific commit can never change. Each encoding is a different
+	 * representation, so they need different tags. */
+	enum compress_encoding enc = compress_negotiate();
+	char id[GIT_OID_MAX + 16];
+	snprintf(id, sizeof(id), "%s%s%s", obj.oid,
+	         enc == COMPRESS_IDENTITY ? "" : "-", enc == COMPRESS_IDENTITY
+	         ? "" : compress_name(enc));
+
+	char *etag;
+	if ((etag = http_etag(id))) {
+		http_add_header("ETag", etag);
+		http_add_header("Cache-Control", git_is_oid(commit)
+		                ? "public, max-age=31536000, immutable"
+		                : "no-cache");
+	}
 
-	if (!line) {
-		error_serve(file, 500, "not a git repo");
-		return;
+	if (etag && http_not_modified(etag)) {
+		http_status(out, 304);
+		free(etag);
+		goto out;
 	}
 
-	if (strncmp(line, "tree", 4) == 0)
-		dir_serve(file);
-	else if (strncmp(line, "blob", 4) == 0)
-		file_serve(file);
+	free(etag);
+
+	if (!looked_up && (key = html_cache_key(pinned ? commit : obj.commit))
+	    && !html_cache_serve(key))
+		goto out;
+
+	page_key = key;
+
+	free(path);
+	free(commit);
+	free(root);
 
-	free(line);
+	if (strcmp(obj.type, "tree") == 0)
+		dir_serve(out, &obj);
+	else if (strcmp(obj.type, "blob") == 0)
+		file_serve(out, &obj);
+	else
+		error_serve(out, 501, "unsupported object type");
+
+	return;
+
+not_found:
+	error_serve(out, 404, "no such object");
+out:
+	free(key);
+	free(path);
+	free(commit);
+	free(root);
 }
 
 /**
  * Serve page that is not based on "real" files.
- * Currently only the index page, but eventually probably other pages like git
- * log or git commit or whatever.
+ * Currently the index page and status page, but eventually probably other
+ * pages like git log or git commit or whatever. Repositories starting with a
+ * dot aren't listed, so those names are free to use here.
  *
- * @param file Output file to print to.
+ * @param out Output buffer to print to.
+ * @param path Path of page.
  */
-static void unreal_serve(FILE *file)
+static void unreal_serve(struct obuf *out, const char *path)
 {
-	index_serve(file);
+	if (strcmp(path, "/") == 0)
+		index_serve(out);
+	else if (strcmp(path, "/.status") == 0)
+		status_serve(out);
+	else
+		error_serve(out, 404, "no such page");
 }
 
-void html_serve()
+/** Page being sent. */
+struct html_page {
+	/** Header of response, collected until it's complete. */
+	struct obuf head;
+	/** Set once the header is complete and the body is being sent. */
+	bool body;
+	/** Encoding client accepts. */
+	enum compress_encoding enc;
+	/** Compression stream of body, \c NULL if it's sent as is. */
+	struct compress_stream *z;
+	/** Page cache entry response is stored in, \c NULL if it isn't. */
+	struct cache_entry *entry;
+	/** Response as sent, teed into \ref entry and \ref out. */
+	struct obuf resp;
+	/** Standard output. */
+	struct obuf out;
+};
+
+/**
+ * Send part of response and store it in the page cache.
+ *
+ * @param ctx Page being sent.
+ * @param data Part of response.
+ * @param len Length of \p data.
+ * @return \c 0 on success, non-zero if writing failed.
+ */
+static int html_page_send(void *ctx, const char *data, size_t len)
 {
+	struct html_page *p = ctx;
+	if (p->entry && cache_append(p->entry, data, len)) {
+		cache_abort(p->entry);
+		p->entry = NULL;
+	}
 
-	char *buf;
-	size_t size;
-	FILE *file = open_memstream(&buf, &size);
-	if (!file) {
-		perror("open_memstream failed");
+	obuf_write(&p->out, data, len);
+	return p->out.err;
+}
+
+/**
+ * Send header of response and decide what to do with the body.
+ * Only successful pages are compressed and stored in the page cache.
+ *
+ * @param p Page being sent.
+ * @param head Header, up to and including the empty line.
+ * @param len Length of \p head.
+ */
+static void html_page_start(struct html_page *p, const char *head, size_t len)
+{
+	bool ok = len >= 11 && strncmp(head, "Status: 200", 11) == 0;
+	if (ok && p->enc != COMPRESS_IDENTITY)
+		p->z = compress_open(p->enc);
+
+	/* the key says which encoding the page is stored in */
+	if (ok && page_key && (p->enc == COMPRESS_IDENTITY || p->z))
+		p->entry = html_cache_create(page_key);
+
+	if (!p->z) {
+		obuf_write(&p->resp, head, len);
 		return;
 	}
 
-	char *path = getenv("PATH_INFO");
-	if (!path) {
-		fprintf(stderr, "PATH_INFO missing\n");
-		error_serve(file, 500, "PATH_INFO missing\n");
-		goto out;
+	/* keep the newline of the last header, body starts after the empty
+	 * line */
+	obuf_write(&p->resp, head, len - 1);
+	obuf_lit(&p->resp, "Content-Encoding: ");
+	obuf_str(&p->resp, compress_name(p->enc));
+	obuf_lit(&p->resp, "\n\n");
+}
+
+/**
+ * Send part of rendered page.
+ * Called whenever the page buffer fills up, see obuf_sink().
+ *
+ * @param ctx Page being sent.
+ * @param data Part of page.
+ * @param len Length of \p data.
+ * @return \c 0 on success, non-zero if some of the page was lost.
+ */
+static int html_page_write(void *ctx, const char *data, size_t len)
+{
+	struct html_page *p = ctx;
+	if (!p->body) {
+		/* the header is short and normally all in the first block,
+		 * but the empty line ending it might still be split */
+		size_t seen = p->head.len;
+		size_t from = seen ? seen - 1 : 0;
+		obuf_write(&p->head, data, len);
+		if (p->head.err)
+			return -1;
+
+		char *end;
+		if (!(end = memmem(p->head.buf + from, p->head.len - from,
+		                   "\n\n", 2)))
+			return 0;
+
+		size_t hlen = end + 2 - p->head.buf;
+		html_page_start(p, p->head.buf, hlen);
+		obuf_free(&p->head);
+		p->body = true;
+
+		data += hlen - seen;
+		len -= hlen - seen;
 	}
 
+	if (p->z)
+		return compress_write(p->z, &p->resp, data, len);
+
+	obuf_write(&p->resp, data, len);
+	return p->resp.err;
+}
+
+void html_serve()
+{
+	/* the page is sent as it's rendered, compressed and teed into the
+	 * page cache on the way. Only the first block is held back, so it can
+	 * still turn into an error page. */
+	struct html_page p = {.enc = compress_negotiate()};
+	obuf_init(&p.head, -1);
+	obuf_init(&p.resp, -1);
+	obuf_sink(&p.resp, html_page_send, &p);
+	obuf_init(&p.out, STDOUT_FILENO);
+
+	struct obuf page;
+	obuf_init(&page, -1);
+	obuf_sink(&page, html_page_write, &p);
+
+	/* responses depend on Accept-Encoding, let caches know */
+	http_add_header("Vary", "Accept-Encoding");
+
 	/** @todo what about profile pages etc? */
-	if (strcmp(path, "/") == 0)
-		unreal_serve(file);
+	char *path = getenv("PATH_INFO");
+	if (!path) {
+		fprintf(stderr, "PATH_INFO missing\n");
+		error_serve(&page, 500, "PATH_INFO missing\n");
+	} else if (strcmp(path, "/") == 0 || strncmp(path, "/.", 2) == 0)
+		unreal_serve(&page, path);
 	else
-		real_serve(file);
+		real_serve(&page);
 
-out:
-	/* print file buffer content to server */
-	fclose(file);
-	fputs(buf, stdout);
-	free(buf);
+	/* nothing was sent yet, better nothing than a broken page */
+	if (page.err && !page.flushed)
+		obuf_truncate(&page);
+
+	/* nothing to send if the page came from the cache */
+	bool err = obuf_flush(&page);
+
+	/* header never ended, send whatever there is */
+	if (!p.body && p.head.len)
+		obuf_write(&p.resp, p.head.buf, p.head.len);
+
+	if (p.z && compress_finish(p.z, &p.resp))
+		err = true;
+
+	if (obuf_flush(&p.resp))
+		err = true;
+
+	if (p.entry && err)
+		cache_abort(p.entry);
+	else if (p.entry)
+		cache_commit(p.entry);
+
+	if (obuf_flush(&p.out))
+		error("writing page failed\n");
+
+	compress_close(p.z);
+	obuf_free(&page);
+	obuf_free(&p.head);
+	obuf_free(&p.resp);
+	obuf_free(&p.out);
+	free(page_key);
+	prefetch_run();
 }
@@ -9,7 +9,12 @@
 #ifndef EXGT_HTML_H
 #define EXGT_HTML_H
 
-#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <utils/res.h>
+#include <utils/obuf.h>
+#include <html/template.h>
 
 /** Linked list of html attributes. */
 struct html_attr {
@@ -60,13 +65,14 @@ void html_append_attr(struct html_elem *elem, struct html_attr *attr);
 /**
  * Add attribute with specified values to element.
  *
+ * @param r Resource manager to allocate attribute from.
  * @param elem Element to add attributes to.
  * @param name Name of attribute.
  * @param value Value of attribute.
  * @return New attribute.
  */
-struct html_attr *html_add_attr(struct html_elem *elem, const char *name,
-                                const char *value);
+struct html_attr *html_add_attr(struct res *r, struct html_elem *elem,
+                                const char *name, const char *value);
 
 /**
  * Append element to list of html elements in current context.
@@ -79,13 +85,14 @@ void html_append_elem(struct html_elem *prev, struct html_elem *next);
 /**
  * Add element with specified values to element.
  *
+ * @param r Resource manager to allocate element from.
  * @param prev Element to append after.
  * @param tag Tag of new element.
  * @param value Value of new element.
  * @return New element.
  */
-struct html_elem *html_add_elem(struct html_elem *prev, const char *tag,
-                                const char *value);
+struct html_elem *html_add_elem(struct res *r, struct html_elem *prev,
+                                const char *tag, const char *value);
 
 /**
  * Append child element.
@@ -100,48 +107,190 @@ void html_append_child(struct html_elem *parent, struct html_elem *child);
  * Add child with specified values to element.
  * Any element can only do this once.
  *
+ * @param r Resource manager to allocate element from.
  * @param parent Parent element.
  * @param tag Tag of new element.
  * @param value Value of new element.
  * @return New element.
  */
-struct html_elem *html_add_child(struct html_elem *parent, const char *tag,
-                                 const char *value);
+struct html_elem *html_add_child(struct res *r, struct html_elem *parent,
+                                 const char *tag, const char *value);
 
 /**
  * Print out html.
  *
- * @param file File to print to.
+ * @param out Output buffer to print to.
  * @param elem Tree of html element nodes.
  */
-void html_print(FILE *file, struct html_elem *elem);
+void html_print(struct obuf *out, struct html_elem *elem);
 
 /**
  * Helper function for creating an attribute.
+ * Nodes are released along with the resource manager, text strings
+ * associated with them are up to the caller.
  *
+ * @param r Resource manager to allocate attribute from.
  * @param name Name of attribute.
  * @param value Value of attribute.
  * @return Allocated node with specified parameters.
  */
-struct html_attr *html_create_attr(const char *name, const char *value);
+struct html_attr *html_create_attr(struct res *r, const char *name,
+                                   const char *value);
 
 /**
  * Helper function for creating an element.
+ * Nodes are released along with the resource manager, text strings
+ * associated with them are up to the caller.
  *
+ * @param r Resource manager to allocate element from.
  * @param tag Tag of element.
  * @param value Value of element.
  * @return Allocated node with specified attributes.
  */
-struct html_elem *html_create_elem(const char *tag, const char *value);
+struct html_elem *html_create_elem(struct res *r, const char *tag,
+                                   const char *value);
+
+/** Maximum nesting depth of streamed elements. */
+#define HTML_STREAM_DEPTH 32
+
+/**
+ * Streaming html emitter.
+ *
+ * Where the tree above is built up and printed once complete, a stream
+ * writes each element out as soon as it's opened, so generating a page takes
+ * the same amount of memory no matter how many elements it has. Elements are
+ * printed the same way html_print() prints them, and the tree is still handy
+ * for small fragments, see html_stream_tree().
+ *
+ * Text and attribute values are escaped, see escape.h. Markup that's
+ * already html, like highlighter output, goes through html_stream_raw().
+ *
+ * @code
+ *	html_stream_open(s, "a");
+ *	html_stream_attr(s, "href", href);
+ *	html_stream_text(s, "link");
+ *	html_stream_close(s);
+ * @endcode
+ */
+struct html_stream {
+	/** Output buffer to write to. */
+	struct obuf *out;
+	/** Tags of currently open elements, innermost last. */
+	const char *tags[HTML_STREAM_DEPTH];
+	/** Number of currently open elements. */
+	size_t depth;
+	/** Start tag of innermost element is unfinished and takes attributes. */
+	bool pending;
+};
+
+/**
+ * Start streaming html.
+ *
+ * @param s Stream to initialize.
+ * @param out Output buffer to print to.
+ */
+void html_stream_start(struct html_stream *s, struct obuf *out);
+
+/**
+ * Open element.
+ * Attributes can be added until something else is written.
+ *
+ * @param s Stream to write to.
+ * @param tag Tag of element, must stay valid until element is closed.
+ */
+void html_stream_open(struct html_stream *s, const char *tag);
+
+/**
+ * Add attribute to element that was just opened.
+ *
+ * @param s Stream to write to.
+ * @param name Name of attribute.
+ * @param value Value of attribute, \c NULL for attributes without one.
+ */
+void html_stream_attr(struct html_stream *s, const char *name,
+                      const char *value);
+
+/**
+ * Write text into innermost open element.
+ *
+ * @param s Stream to write to.
+ * @param text Text to write.
+ */
+void html_stream_text(struct html_stream *s, const char *text);
+
+/**
+ * Write text of known length into innermost open element.
+ *
+ * @param s Stream to write to.
+ * @param text Text to write.
+ * @param len Length of \p text.
+ */
+void html_stream_textn(struct html_stream *s, const char *text, size_t len);
+
+/**
+ * Write html as is into innermost open element.
+ * Only for markup from trusted sources, it is not escaped.
+ *
+ * @param s Stream to write to.
+ * @param html Markup to write.
+ * @param len Length of \p html.
+ */
+void html_stream_raw(struct html_stream *s, const char *html, size_t len);
+
+/**
+ * Get output buffer of stream, for generators that write markup into the
+ * innermost open element themselves.
+ * Only for markup from trusted sources, same as html_stream_raw().
+ *
+ * @param s Stream to write to.
+ * @return Output buffer, ready to be appended to.
+ */
+struct obuf *html_stream_out(struct html_stream *s);
+
+/**
+ * Close innermost open element.
+ *
+ * @param s Stream to write to.
+ */
+void html_stream_close(struct html_stream *s);
+
+/**
+ * Write element with text and no attributes.
+ * Shorthand for opening, writing text and closing.
+ *
+ * @param s Stream to write to.
+ * @param tag Tag of element.
+ * @param text Text of element, \c NULL for none.
+ */
+void html_stream_elem(struct html_stream *s, const char *tag,
+                      const char *text);
+
+/**
+ * Write template into innermost open element.
+ * Elements the template leaves open are closed like any other, see
+ * template.h.
+ *
+ * @param s Stream to write to.
+ * @param t Template to write.
+ * @param values Values of template slots.
+ */
+void html_stream_template(struct html_stream *s, const struct template *t,
+                          const char *values[]);
+
+/**
+ * Write tree of html elements into innermost open element.
+ *
+ * @param s Stream to write to.
+ * @param elem Tree of html element nodes.
+ */
+void html_stream_tree(struct html_stream *s, struct html_elem *elem);
 
 /**
- * Iterate tree and free nodes.
- * Note that text strings associated with each element and/or attribute
- * are not freed, that is up to the caller.
+ * Close all open elements, finishing document.
  *
- * @param elem Element to free (probably root of HTML).
+ * @param s Stream to finish.
  */
-void html_destroy(struct html_elem *elem);
+void html_stream_end(struct html_stream *s);
 
 /** Generate html document. */
 void html_serve();
@@ -0,0 +1,2352 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file markdown.c
+ * Built-in markdown renderer implementation.
+ *
+ * Blocks are parsed one container at a time, block quotes and list items
+ * strip their markers off their lines and parse what's left recursively.
+ * The whole document is parsed twice, first only to collect link reference
+ * definitions, as they're usually at the end, after the links using them.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include <utils/lines.h>
+
+#include "escape.h"
+#include "markdown.h"
+
+/** Deepest nesting of containers and inlines still rendered as such. */
+#define MARKDOWN_DEPTH 16
+
+/** Most table columns. */
+#define MARKDOWN_COLUMNS 64
+
+/** Steps allowed per byte of source for finding closing delimiters. */
+#define MARKDOWN_BUDGET 64
+
+/** Piece of source, usually a line with container markers stripped. */
+struct markdown_str {
+	/** Start of piece. */
+	const char *s;
+	/** Length of piece. */
+	size_t len;
+};
+
+/** Link reference definition. */
+struct markdown_ref {
+	/** Normalized label, see markdown_label(). */
+	char *label;
+	/** Destination, backslash escapes still in place. */
+	char *url;
+	/** Title, \c NULL if none. */
+	char *title;
+};
+
+/** Entry in string table. */
+struct markdown_entry {
+	/** Key of entry, \c NULL if slot is free. */
+	const char *key;
+	/** Value of entry. */
+	size_t value;
+};
+
+/** Hash table of strings, open addressing with linear probing. */
+struct markdown_table {
+	/** Slots, a power of two of them. */
+	struct markdown_entry *slots;
+	/** Number of \ref slots. */
+	size_t cap;
+	/** Number of slots in use. */
+	size_t n;
+};
+
+/** Renderer state. */
+struct markdown {
+	/** Output buffer, \c NULL while collecting references. */
+	struct obuf *o;
+	/** Prefix of heading ids. */
+	const char *prefix;
+	/** Link reference definitions. */
+	struct markdown_ref *refs;
+	/** Number of \ref refs. */
+	size_t nrefs;
+	/** Room in \ref refs. */
+	size_t maxrefs;
+	/** Labels of \ref refs, mapped to their index. */
+	struct markdown_table labels;
+	/** Heading ids handed out so far, owned by the table. Each is mapped
+	 * to the next number to try when it's repeated. */
+	struct markdown_table ids;
+	/** Current container nesting. */
+	size_t depth;
+	/** Steps left for finding closing delimiters, once out of them
+	 * delimiters are taken as text so bad input can't take forever. */
+	size_t budget;
+};
+
+/** Fenced code block opening or closing fence. */
+struct markdown_fence {
+	/** Fence character, backtick or tilde. */
+	char c;
+	/** Number of fence characters. */
+	size_t n;
+	/** Indentation of fence, removed from content lines as well. */
+	size_t indent;
+	/** Info string, the language of the code. */
+	struct markdown_str info;
+};
+
+/** List item marker. */
+struct markdown_item {
+	/** Whether item is part of an ordered list. */
+	bool ordered;
+	/** Bullet character, or delimiter after the number of ordered item. */
+	char c;
+	/** Number of ordered item. */
+	unsigned long start;
+	/** Column content of item starts at. */
+	size_t width;
+	/** Content on line of marker. */
+	struct markdown_str rest;
+	/** Set if there's no content on line of marker. */
+	bool empty;
+};
+
+/**
+ * FNV-1a hash of string.
+ *
+ * @param s String to hash.
+ * @return Hash of \p s.
+ */
+static uint64_t markdown_hash(const char *s)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (; *s; ++s) {
+		hash ^= (unsigned char)*s;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Find slot of key in table.
+ *
+ * @param slots Slots of table, at least one of them free.
+ * @param cap Number of \p slots, a power of two.
+ * @param key Key to look for.
+ * @return Slot with \p key, or the free slot it would go in.
+ */
+static struct markdown_entry *markdown_slot(struct markdown_entry *slots,
+                                            size_t cap, const char *key)
+{
+	size_t i = markdown_hash(key) & (cap - 1);
+	while (slots[i].key && strcmp(slots[i].key, key))
+		i = (i + 1) & (cap - 1);
+
+	return &slots[i];
+}
+
+/**
+ * Look up key in table.
+ *
+ * @param t Table to look in.
+ * @param key Key to look for.
+ * @return Entry of \p key, \c NULL if there's none.
+ */
+static struct markdown_entry *markdown_find(struct markdown_table *t,
+                                            const char *key)
+{
+	if (!t->cap)
+		return NULL;
+
+	struct markdown_entry *e = markdown_slot(t->slots, t->cap, key);
+	return e->key ? e : NULL;
+}
+
+/**
+ * Add key that isn't in table yet.
+ * The table is kept at most half full, so probes stay short.
+ *
+ * @param t Table to add to.
+ * @param key Key to add, must outlive \p t.
+ * @param value Value of \p key.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int markdown_insert(struct markdown_table *t, const char *key,
+                           size_t value)
+{
+	if (2 * (t->n + 1) > t->cap) {
+		size_t cap = t->cap ? 2 * t->cap : 64;
+		struct markdown_entry *slots;
+		if (!(slots = calloc(cap, sizeof(*slots))))
+			return -1;
+
+		for (size_t i = 0; i < t->cap; ++i)
+			if (t->slots[i].key)
+				*markdown_slot(slots, cap, t->slots[i].key) =
+					t->slots[i];
+
+		free(t->slots);
+		t->slots = slots;
+		t->cap = cap;
+	}
+
+	*markdown_slot(t->slots, t->cap, key) =
+		(struct markdown_entry){key, value};
+	t->n++;
+	return 0;
+}
+
+/**
+ * Append markup.
+ *
+ * @param md Renderer state.
+ * @param s Markup to append.
+ * @param len Length of \p s.
+ */
+static void markdown_raw(struct markdown *md, const char *s, size_t len)
+{
+	if (md->o && len)
+		obuf_write(md->o, s, len);
+}
+
+/**
+ * Append markup literal.
+ *
+ * @param md Renderer state.
+ * @param s String literal.
+ */
+#define markdown_lit(md, s) markdown_raw((md), (s), sizeof(s) - 1)
+
+/**
+ * Append text, escaped.
+ *
+ * @param md Renderer state.
+ * @param s Text to append.
+ * @param len Length of \p s.
+ */
+static void markdown_text(struct markdown *md, const char *s, size_t len)
+{
+	if (md->o && len)
+		escape_write(md->o, s, len);
+}
+
+/**
+ * Append attribute value, escaped.
+ * Backslash escapes are resolved, unlike in markdown_text().
+ *
+ * @param md Renderer state.
+ * @param s Value to append.
+ * @param len Length of \p s.
+ */
+static void markdown_attr(struct markdown *md, const char *s, size_t len)
+{
+	size_t run = 0;
+	for (size_t i = 0; i + 1 < len; ++i) {
+		if (s[i] != '\\' || !ispunct((unsigned char)s[i + 1]))
+			continue;
+
+		markdown_text(md, s + run, i - run);
+		run = ++i;
+	}
+
+	markdown_text(md, s + run, len - run);
+}
+
+/**
+ * Mark output incomplete.
+ *
+ * @param md Renderer state.
+ */
+static void markdown_fail(struct markdown *md)
+{
+	if (md->o)
+		md->o->err = true;
+}
+
+/**
+ * Check if character is whitespace, as far as inlines are concerned.
+ *
+ * @param c Character to check.
+ * @return \c true if \p c is whitespace, \c false otherwise.
+ */
+static bool markdown_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n';
+}
+
+/**
+ * Check if character is ASCII punctuation.
+ *
+ * @param c Character to check.
+ * @return \c true if \p c is punctuation, \c false otherwise.
+ */
+static bool markdown_punct(char c)
+{
+	return ispunct((unsigned char)c);
+}
+
+/**
+ * Get indentation of line.
+ *
+ * @param l Line to check.
+ * @return Indentation in columns, tabs stop every four columns.
+ */
+static size_t markdown_indent(struct markdown_str l)
+{
+	size_t col = 0;
+	for (size_t i = 0; i < l.len; ++i) {
+		if (l.s[i] == ' ')
+			col++;
+		else if (l.s[i] == '\t')
+			col += 4 - col % 4;
+		else
+			break;
+	}
+
+	return col;
+}
+
+/**
+ * Remove indentation from line.
+ * A tab only partially within \p cols is removed as a whole.
+ *
+ * @param l Line to strip.
+ * @param cols Number of columns to remove, at most.
+ * @return Rest of \p l.
+ */
+static struct markdown_str markdown_strip(struct markdown_str l, size_t cols)
+{
+	size_t col = 0, i = 0;
+	for (; i < l.len && col < cols; ++i) {
+		if (l.s[i] == ' ')
+			col++;
+		else if (l.s[i] == '\t')
+			col += 4 - col % 4;
+		else
+			break;
+	}
+
+	return (struct markdown_str){l.s + i, l.len - i};
+}
+
+/**
+ * Remove leading and trailing spaces and tabs.
+ *
+ * @param l Piece to trim.
+ * @return Trimmed \p l.
+ */
+static struct markdown_str markdown_trim(struct markdown_str l)
+{
+	while (l.len && (l.s[0] == ' ' || l.s[0] == '\t')) {
+		l.s++;
+		l.len--;
+	}
+
+	while (l.len && (l.s[l.len - 1] == ' ' || l.s[l.len - 1] == '\t'))
+		l.len--;
+
+	return l;
+}
+
+/**
+ * Check if line is blank.
+ *
+ * @param l Line to check.
+ * @return \c true if \p l only has spaces and tabs, \c false otherwise.
+ */
+static bool markdown_blank(struct markdown_str l)
+{
+	return !markdown_trim(l).len;
+}
+
+/**
+ * Check if line contains string.
+ *
+ * @param l Line to search.
+ * @param needle String to look for.
+ * @return \c true if \p needle is in \p l, \c false otherwise.
+ */
+static bool markdown_contains(struct markdown_str l, const char *needle)
+{
+	size_t n = strlen(needle);
+	for (size_t i = 0; i + n <= l.len; ++i) {
+		if (!strncasecmp(l.s + i, needle, n))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Check if line is a code fence.
+ *
+ * @param l Line to check.
+ * @param f Where to place fence.
+ * @return \c true if \p l is a fence, \c false otherwise.
+ */
+static bool markdown_fence(struct markdown_str l, struct markdown_fence *f)
+{
+	size_t indent = markdown_indent(l);
+	if (indent >= 4)
+		return false;
+
+	l = markdown_strip(l, indent);
+	if (!l.len || (l.s[0] != '`' && l.s[0] != '~'))
+		return false;
+
+	size_t n = 0;
+	while (n < l.len && l.s[n] == l.s[0])
+		n++;
+
+	if (n < 3)
+		return false;
+
+	struct markdown_str info = {l.s + n, l.len - n};
+	info = markdown_trim(info);
+
+	/* would be a code span */
+	if (l.s[0] == '`' && memchr(info.s, '`', info.len))
+		return false;
+
+	f->c = l.s[0];
+	f->n = n;
+	f->indent = indent;
+	f->info = info;
+	return true;
+}
+
+/**
+ * Check if line is an ATX heading.
+ *
+ * @param l Line to check.
+ * @param text Where to place text of heading.
+ * @return Level of heading, \c 0 if \p l isn't one.
+ */
+static int markdown_atx(struct markdown_str l, struct markdown_str *text)
+{
+	if (markdown_indent(l) >= 4)
+		return 0;
+
+	l = markdown_trim(l);
+
+	size_t level = 0;
+	while (level < l.len && l.s[level] == '#')
+		level++;
+
+	if (!level || level > 6)
+		return 0;
+
+	if (level < l.len && l.s[level] != ' ' && l.s[level] != '\t')
+		return 0;
+
+	struct markdown_str t = {l.s + level, l.len - level};
+	t = markdown_trim(t);
+
+	/* optional closing sequence, if separated by space */
+	size_t end = t.len;
+	while (end && t.s[end - 1] == '#')
+		end--;
+
+	if (!end)
+		t.len = 0;
+	else if (end < t.len && (t.s[end - 1] == ' ' || t.s[end - 1] == '\t'))
+		t.len = end;
+
+	*text = markdown_trim(t);
+	return level;
+}
+
+/**
+ * Check if line is a thematic break.
+ *
+ * @param l Line to check.
+ * @return \c true if \p l is a thematic break, \c false otherwise.
+ */
+static bool markdown_hr(struct markdown_str l)
+{
+	if (markdown_indent(l) >= 4)
+		return false;
+
+	char c = 0;
+	size_t n = 0;
+	for (size_t i = 0; i < l.len; ++i) {
+		if (l.s[i] == ' ' || l.s[i] == '\t')
+			continue;
+
+		if (!c && l.s[i] != '-' && l.s[i] != '*' && l.s[i] != '_')
+			return false;
+
+		if (c && l.s[i] != c)
+			return false;
+
+		c = l.s[i];
+		n++;
+	}
+
+	return n >= 3;
+}
+
+/**
+ * Check if line is a setext heading underline.
+ *
+ * @param l Line to check.
+ * @return Level of heading, \c 0 if \p l isn't an underline.
+ */
+static int markdown_setext(struct markdown_str l)
+{
+	if (markdown_indent(l) >= 4)
+		return 0;
+
+	l = markdown_trim(l);
+	if (!l.len || (l.s[0] != '=' && l.s[0] != '-'))
+		return 0;
+
+	for (size_t i = 1; i < l.len; ++i) {
+		if (l.s[i] != l.s[0])
+			return 0;
+	}
+
+	return l.s[0] == '=' ? 1 : 2;
+}
+
+/**
+ * Check if line is part of a block quote.
+ *
+ * @param l Line to check.
+ * @param rest Where to place line with quote marker stripped.
+ * @return \c true if \p l starts with a quote marker, \c false otherwise.
+ */
+static bool markdown_quote(struct markdown_str l, struct markdown_str *rest)
+{
+	size_t indent = markdown_indent(l);
+	if (indent >= 4)
+		return false;
+
+	l = markdown_strip(l, indent);
+	if (!l.len || l.s[0] != '>')
+		return false;
+
+	l.s++;
+	l.len--;
+	if (l.len && (l.s[0] == ' ' || l.s[0] == '\t')) {
+		l.s++;
+		l.len--;
+	}
+
+	*rest = l;
+	return true;
+}
+
+/**
+ * Check if line starts a list item.
+ *
+ * @param l Line to check.
+ * @param it Where to place item marker.
+ * @return \c true if \p l starts a list item, \c false otherwise.
+ */
+static bool markdown_item(struct markdown_str l, struct markdown_item *it)
+{
+	size_t indent = markdown_indent(l);
+	if (indent >= 4)
+		return false;
+
+	struct markdown_str m = markdown_strip(l, indent);
+
+	size_t i = 0;
+	if (m.len && (m.s[0] == '-' || m.s[0] == '+' || m.s[0] == '*')) {
+		it->ordered = false;
+		it->c = m.s[0];
+		it->start = 0;
+		i = 1;
+	} else {
+		unsigned long start = 0;
+		while (i < m.len && i < 9 && isdigit((unsigned char)m.s[i]))
+			start = start * 10 + m.s[i++] - '0';
+
+		if (!i || i >= m.len || (m.s[i] != '.' && m.s[i] != ')'))
+			return false;
+
+		it->ordered = true;
+		it->c = m.s[i++];
+		it->start = start;
+	}
+
+	if (i < m.len && m.s[i] != ' ' && m.s[i] != '\t')
+		return false;
+
+	struct markdown_str after = {m.s + i, m.len - i};
+	size_t spaces = markdown_indent(after);
+
+	it->empty = markdown_blank(after);
+
+	/* content indented further is indented code within the item */
+	if (it->empty || spaces > 4)
+		spaces = 1;
+
+	it->rest = it->empty ? (struct markdown_str){m.s + m.len, 0}
+	                     : markdown_strip(after, spaces);
+	it->width = indent + i + spaces;
+	return true;
+}
+
+/**
+ * Find end of HTML tag, comment or declaration.
+ *
+ * @param s Text starting with \c <.
+ * @param len Length of \p s.
+ * @return Length of tag, \c 0 if \p s doesn't start with one.
+ */
+static size_t markdown_tag(const char *s, size_t len)
+{
+	if (len < 3 || s[0] != '<')
+		return 0;
+
+	if (len >= 4 && !strncmp(s, "<!--", 4)) {
+		for (size_t i = 4; i + 3 <= len; ++i) {
+			if (!strncmp(s + i, "-->", 3))
+				return i + 3;
+		}
+
+		return 0;
+	}
+
+	size_t i = 1;
+	if (s[i] == '!' || s[i] == '?') {
+		const char *end = memchr(s, '>', len);
+		return end ? (size_t)(end - s) + 1 : 0;
+	}
+
+	if (s[i] == '/')
+		i++;
+
+	if (i >= len || !isalpha((unsigned char)s[i]))
+		return 0;
+
+	while (i < len && (isalnum((unsigned char)s[i]) || s[i] == '-'))
+		i++;
+
+	if (i < len && !markdown_space(s[i]) && s[i] != '>' && s[i] != '/')
+		return 0;
+
+	/* attributes, quoted values may contain anything */
+	char quote = 0;
+	for (; i < len; ++i) {
+		if (quote) {
+			if (s[i] == quote)
+				quote = 0;
+		} else if (s[i] == '"' || s[i] == '\'') {
+			quote = s[i];
+		} else if (s[i] == '<') {
+			return 0;
+		} else if (s[i] == '>') {
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+/** Tags that start an HTML block even in the middle of a paragraph. */
+static const char *const markdown_html_tags[] = {
+	"address", "article", "aside", "blockquote", "body", "center",
+	"details", "dialog", "dd", "div", "dl", "dt", "fieldset", "figcaption",
+	"figure", "footer", "form", "h1", "h2", "h3", "h4", "h5", "h6",
+	"header", "hr", "html", "iframe", "legend", "li", "main", "nav", "ol",
+	"p", "pre", "script", "section", "style", "summary", "table", "tbody",
+	"td", "textarea", "tfoot", "th", "thead", "tr", "ul",
+};
+
+/**
+ * Check if line starts an HTML block.
+ *
+ * @param l Line to check.
+ * @param interrupt Whether line would interrupt a paragraph.
+ * @return \c true if \p l starts an HTML block, \c false otherwise.
+ */
+static bool markdown_html(struct markdown_str l, bool interrupt)
+{
+	if (markdown_indent(l) >= 4)
+		return false;
+
+	l = markdown_trim(l);
+	if (l.len < 2 || l.s[0] != '<')
+		return false;
+
+	if (l.s[1] == '!' || l.s[1] == '?')
+		return true;
+
+	size_t start = l.s[1] == '/' ? 2 : 1, i = start;
+	while (i < l.len && isalnum((unsigned char)l.s[i]))
+		i++;
+
+	if (i == start || !isalpha((unsigned char)l.s[start]))
+		return false;
+
+	size_t n = i - start;
+	for (size_t t = 0; t < sizeof(markdown_html_tags)
+	     / sizeof(*markdown_html_tags); ++t) {
+		const char *tag = markdown_html_tags[t];
+		if (strlen(tag) == n && !strncasecmp(l.s + start, tag, n))
+			return true;
+	}
+
+	/* any other complete tag on its own line, outside paragraphs */
+	return !interrupt && markdown_tag(l.s, l.len) == l.len;
+}
+
+/**
+ * Split table row into cells.
+ * Leading and trailing pipes are optional, escaped pipes don't split.
+ *
+ * @param l Row to split.
+ * @param cells Where to place cells, \ref MARKDOWN_COLUMNS at most.
+ * @return Number of cells in \p l, may be more than were placed.
+ */
+static size_t markdown_cells(struct markdown_str l, struct markdown_str *cells)
+{
+	l = markdown_trim(l);
+	if (l.len && l.s[0] == '|') {
+		l.s++;
+		l.len--;
+	}
+
+	if (l.len && l.s[l.len - 1] == '|'
+	    && (l.len < 2 || l.s[l.len - 2] != '\\'))
+		l.len--;
+
+	size_t n = 0, start = 0;
+	for (size_t i = 0; i <= l.len; ++i) {
+		if (i < l.len && l.s[i] == '\\') {
+			i++;
+			continue;
+		}
+
+		if (i < l.len && l.s[i] != '|')
+			continue;
+
+		if (n < MARKDOWN_COLUMNS)
+			cells[n] = markdown_trim((struct markdown_str){l.s + start,
+			                                              i - start});
+
+		n++;
+		start = i + 1;
+	}
+
+	return n;
+}
+
+/**
+ * Check if line is a table delimiter row.
+ *
+ * @param l Line to check.
+ * @param align Where to place alignment of each column, \c l, \c c, \c r or
+ * \c 0 for none.
+ * @return Number of columns, \c 0 if \p l isn't a delimiter row.
+ */
+static size_t markdown_delim(struct markdown_str l, char *align)
+{
+	if (markdown_indent(l) >= 4 || !memchr(l.s, '-', l.len))
+		return 0;
+
+	struct markdown_str cells[MARKDOWN_COLUMNS];
+	size_t n = markdown_cells(l, cells);
+	if (n > MARKDOWN_COLUMNS)
+		return 0;
+
+	for (size_t i = 0; i < n; ++i) {
+		struct markdown_str c = cells[i];
+		bool left = c.len && c.s[0] == ':';
+		bool right = c.len > left && c.s[c.len - 1] == ':';
+		if (c.len < (size_t)(1 + left + right))
+			return 0;
+
+		for (size_t j = left; j < c.len - right; ++j) {
+			if (c.s[j] != '-')
+				return 0;
+		}
+
+		align[i] = left && right ? 'c' : left ? 'l' : right ? 'r' : 0;
+	}
+
+	return n;
+}
+
+/**
+ * Normalize link label.
+ * Labels match case insensitively and regardless of whitespace.
+ *
+ * @param s Label.
+ * @param len Length of \p s.
+ * @return Normalized label, \c NULL on error.
+ */
+static char *markdown_label(const char *s, size_t len)
+{
+	char *label;
+	if (!(label = malloc(len + 1)))
+		return NULL;
+
+	size_t n = 0;
+	bool space = false;
+	for (size_t i = 0; i < len; ++i) {
+		if (markdown_space(s[i])) {
+			space = n;
+			continue;
+		}
+
+		if (space)
+			label[n++] = ' ';
+
+		space = false;
+		label[n++] = tolower((unsigned char)s[i]);
+	}
+
+	label[n] = 0;
+	return label;
+}
+
+/**
+ * Find link reference definition.
+ *
+ * @param md Renderer state.
+ * @param s Label of reference.
+ * @param len Length of \p s.
+ * @return Definition, \c NULL if there's none.
+ */
+static const struct markdown_ref *markdown_ref(struct markdown *md,
+                                               const char *s, size_t len)
+{
+	char *label;
+	if (!(label = markdown_label(s, len)))
+		return NULL;
+
+	struct markdown_entry *e = markdown_find(&md->labels, label);
+	free(label);
+	return e ? &md->refs[e->value] : NULL;
+}
+
+/**
+ * Add link reference definition.
+ * First definition of a label wins.
+ *
+ * @param md Renderer state.
+ * @param label Label.
+ * @param url Destination.
+ * @param title Title, \c s is \c NULL if none.
+ */
+static void markdown_define(struct markdown *md, struct markdown_str label,
+                            struct markdown_str url, struct markdown_str title)
+{
+	if (markdown_ref(md, label.s, label.len))
+		return;
+
+	if (md->nrefs == md->maxrefs) {
+		size_t max = md->maxrefs ? 2 * md->maxrefs : 16;
+		struct markdown_ref *refs;
+		if (!(refs = realloc(md->refs, max * sizeof(*refs))))
+			return;
+
+		md->refs = refs;
+		md->maxrefs = max;
+	}
+
+	struct markdown_ref *ref = &md->refs[md->nrefs];
+	ref->label = markdown_label(label.s, label.len);
+	ref->url = strndup(url.s, url.len);
+	ref->title = title.s ? strndup(title.s, title.len) : NULL;
+	if (!ref->label || !ref->url || (title.s && !ref->title)
+	    || markdown_insert(&md->labels, ref->label, md->nrefs)) {
+		free(ref->label);
+		free(ref->url);
+		free(ref->title);
+		return;
+	}
+
+	md->nrefs++;
+}
+
+/**
+ * Parse link destination and optional title.
+ *
+ * @param s Text to parse.
+ * @param len Length of \p s.
+ * @param i Index to start at.
+ * @param url Where to place destination.
+ * @param title Where to place title, \c s is \c NULL if none.
+ * @return Index after title, or destination if there's no title, \c 0 if
+ * there's no valid destination.
+ */
+static size_t markdown_dest(const char *s, size_t len, size_t i,
+                            struct markdown_str *url,
+                            struct markdown_str *title)
+{
+	while (i < len && markdown_space(s[i]))
+		i++;
+
+	if (i < len && s[i] == '<') {
+		size_t start = ++i;
+		while (i < len && s[i] != '>' && s[i] != '<' && s[i] != '\n')
+			i++;
+
+		if (i >= len || s[i] != '>')
+			return 0;
+
+		*url = (struct markdown_str){s + start, i - start};
+		i++;
+	} else {
+		size_t start = i, parens = 0;
+		for (; i < len; ++i) {
+			if (s[i] == '\\' && i + 1 < len) {
+				i++;
+				continue;
+			}
+
+			if (markdown_space(s[i]) || iscntrl((unsigned char)s[i]))
+				break;
+
+			/* same limit as cmark, keeps this linear */
+			if (s[i] == '(' && ++parens > 32)
+				return 0;
+
+			if (s[i] == ')' && !parens)
+				break;
+
+			if (s[i] == ')')
+				parens--;
+		}
+
+		*url = (struct markdown_str){s + start, i - start};
+	}
+
+	*title = (struct markdown_str){NULL, 0};
+
+	size_t after = i;
+	while (i < len && markdown_space(s[i]))
+		i++;
+
+	if (i == after || i >= len || (s[i] != '"' && s[i] != '\'' && s[i] != '('))
+		return after;
+
+	char close = s[i] == '(' ? ')' : s[i];
+	size_t start = ++i;
+	for (; i < len && s[i] != close; ++i) {
+		if (s[i] == '\\')
+			i++;
+	}
+
+	if (i >= len)
+		return after;
+
+	*title = (struct markdown_str){s + start, i - start};
+	return i + 1;
+}
+
+/**
+ * Check if line is a link reference definition, and collect it if so.
+ * Definitions are only collected while collecting, but recognized in both
+ * passes so that they're skipped when rendering.
+ *
+ * @param md Renderer state.
+ * @param l Line to check.
+ * @return \c true if \p l is a definition, \c false otherwise.
+ */
+static bool markdown_refdef(struct markdown *md, struct markdown_str l)
+{
+	if (markdown_indent(l) >= 4)
+		return false;
+
+	l = markdown_trim(l);
+	if (!l.len || l.s[0] != '[')
+		return false;
+
+	size_t i = 1;
+	for (; i < l.len && l.s[i] != ']'; ++i) {
+		if (l.s[i] == '[')
+			return false;
+
+		if (l.s[i] == '\\')
+			i++;
+	}
+
+	if (i + 1 >= l.len || i == 1 || l.s[i + 1] != ':')
+		return false;
+
+	struct markdown_str label = {l.s + 1, i - 1};
+	struct markdown_str url, title;
+	size_t end;
+	if (!(end = markdown_dest(l.s, l.len, i + 2, &url, &title)) || !url.len)
+		return false;
+
+	if (end != l.len)
+		return false;
+
+	if (!md->o)
+		markdown_define(md, label, url, title);
+
+	return true;
+}
+
+/**
+ * Join lines of paragraph for inline parsing.
+ * Indentation and trailing whitespace is removed, lines ending in two spaces
+ * end in a backslash instead, so hard breaks have only one form.
+ *
+ * @param lines Lines to join.
+ * @param n Number of \p lines.
+ * @param len Where to place length of joined text.
+ * @return Joined text, \c NULL on error.
+ */
+static char *markdown_join(const struct markdown_str *lines, size_t n,
+                           size_t *len)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < n; ++i)
+		size += lines[i].len + 2;
+
+	char *buf;
+	if (!(buf = malloc(size + 1)))
+		return NULL;
+
+	size_t k = 0;
+	for (size_t i = 0; i < n; ++i) {
+		struct markdown_str l = markdown_strip(lines[i], SIZE_MAX);
+		size_t end = l.len;
+		while (end && (l.s[end - 1] == ' ' || l.s[end - 1] == '\t'))
+			end--;
+
+		memcpy(buf + k, l.s, end);
+		k += end;
+		if (i + 1 == n)
+			break;
+
+		if (l.len - end >= 2)
+			buf[k++] = '\\';
+
+		buf[k++] = '\n';
+	}
+
+	*len = k;
+	return buf;
+}
+
+static void markdown_inline(struct markdown *md, const char *s, size_t len,
+                            size_t depth);
+
+/**
+ * Take one step of searching for a closing delimiter.
+ *
+ * @param md Renderer state.
+ * @return \c true if there was budget left for it, \c false otherwise.
+ */
+static bool markdown_step(struct markdown *md)
+{
+	if (!md->budget)
+		return false;
+
+	md->budget--;
+	return true;
+}
+
+/**
+ * Find end of code span.
+ *
+ * @param md Renderer state.
+ * @param s Text to search.
+ * @param len Length of \p s.
+ * @param i Index of opening backtick run.
+ * @param n Where to place length of opening run.
+ * @return Index of closing run, \c 0 if span isn't closed.
+ */
+static size_t markdown_code_close(struct markdown *md, const char *s,
+                                  size_t len, size_t i, size_t *n)
+{
+	size_t open = 0;
+	while (i + open < len && s[i + open] == '`')
+		open++;
+
+	*n = open;
+	for (size_t j = i + open; j < len && markdown_step(md);) {
+		if (s[j] != '`') {
+			j++;
+			continue;
+		}
+
+		size_t run = 0;
+		while (j + run < len && s[j + run] == '`')
+			run++;
+
+		if (run == open)
+			return j;
+
+		j += run;
+	}
+
+	return 0;
+}
+
+/**
+ * Render code span, or its backticks as text if it isn't closed.
+ *
+ * @param md Renderer state.
+ * @param s Text being rendered.
+ * @param len Length of \p s.
+ * @param i Index of opening backtick run.
+ * @return Index after code span.
+ */
+static size_t markdown_code_span(struct markdown *md, const char *s,
+                                 size_t len, size_t i)
+{
+	size_t n, close;
+	if (!(close = markdown_code_close(md, s, len, i, &n))) {
+		markdown_text(md, s + i, n);
+		return i + n;
+	}
+
+	size_t start = i + n, end = close;
+
+	/* one space of padding on both sides is stripped, unless all spaces */
+	bool padded = end - start >= 2 && markdown_space(s[start])
+	              && markdown_space(s[end - 1]);
+	for (size_t j = start; padded && j < end; ++j) {
+		if (!markdown_space(s[j]))
+			break;
+
+		if (j + 1 == end)
+			padded = false;
+	}
+
+	if (padded) {
+		start++;
+		end--;
+	}
+
+	markdown_lit(md, "<code>");
+	for (size_t j = start; j < end;) {
+		const char *nl = memchr(s + j, '\n', end - j);
+		size_t stop = nl ? (size_t)(nl - s) : end;
+		markdown_text(md, s + j, stop - j);
+		if (nl)
+			markdown_lit(md, " ");
+
+		j = stop + 1;
+	}
+
+	markdown_lit(md, "</code>");
+	return close + n;
+}
+
+/**
+ * Check which side of a delimiter run is flanked by text.
+ *
+ * @param s Text containing run.
+ * @param len Length of \p s.
+ * @param i Index of run.
+ * @param n Length of run.
+ * @param left Check if run is left flanking instead of right flanking.
+ * @return \c true if run is flanking as asked, \c false otherwise.
+ */
+static bool markdown_flanking(const char *s, size_t len, size_t i, size_t n,
+                              bool left)
+{
+	char before = i ? s[i - 1] : ' ';
+	char after = i + n < len ? s[i + n] : ' ';
+	char inner = left ? after : before;
+	char outer = left ? before : after;
+
+	if (markdown_space(inner))
+		return false;
+
+	if (!markdown_punct(inner))
+		return true;
+
+	return markdown_space(outer) || markdown_punct(outer);
+}
+
+/**
+ * Check if delimiter run can open emphasis.
+ *
+ * @param s Text containing run.
+ * @param len Length of \p s.
+ * @param i Index of run.
+ * @param n Length of run.
+ * @return \c true if run can open emphasis, \c false otherwise.
+ */
+static bool markdown_opens(const char *s, size_t len, size_t i, size_t n)
+{
+	bool left = markdown_flanking(s, len, i, n, true);
+	if (s[i] == '*')
+		return left;
+
+	/* no intraword emphasis with underscores */
+	bool right = markdown_flanking(s, len, i, n, false);
+	return left && (!right || (i && markdown_punct(s[i - 1])));
+}
+
+/**
+ * Check if delimiter run can close emphasis.
+ *
+ * @param s Text containing run.
+ * @param len Length of \p s.
+ * @param i Index of run.
+ * @param n Length of run.
+ * @return \c true if run can close emphasis, \c false otherwise.
+ */
+static bool markdown_closes(const char *s, size_t len, size_t i, size_t n)
+{
+	bool right = markdown_flanking(s, len, i, n, false);
+	if (s[i] == '*')
+		return right;
+
+	bool left = markdown_flanking(s, len, i, n, true);
+	return right && (!left || (i + n < len && markdown_punct(s[i + n])));
+}
+
+/**
+ * Find run closing emphasis.
+ * Runs opening nested emphasis with the same character are skipped along
+ * with whatever closes them.
+ *
+ * @param md Renderer state.
+ * @param s Text to search.
+ * @param len Length of \p s.
+ * @param i Index to start searching at.
+ * @param c Delimiter character.
+ * @param depth Nesting depth.
+ * @param m Where to place length of closing run.
+ * @return Index of closing run, \p len if there's none.
+ */
+static size_t markdown_emph_close(struct markdown *md, const char *s,
+                                  size_t len, size_t i, char c, size_t depth,
+                                  size_t *m)
+{
+	while (i < len && markdown_step(md)) {
+		if (s[i] == '\\') {
+			i += 2;
+			continue;
+		}
+
+		if (s[i] == '`') {
+			size_t n, close = markdown_code_close(md, s, len, i, &n);
+			i = close ? close + n : i + n;
+			continue;
+		}
+
+		if (s[i] != c) {
+			i++;
+			continue;
+		}
+
+		size_t run = 0;
+		while (i + run < len && s[i + run] == c)
+			run++;
+
+		if (markdown_closes(s, len, i, run)) {
+			*m = run;
+			return i;
+		}
+
+		if (depth < MARKDOWN_DEPTH && markdown_opens(s, len, i, run)) {
+			size_t nested;
+			size_t close = markdown_emph_close(md, s, len, i + run,
+			                                   c, depth + 1, &nested);
+
+			/* would go on from the same place and fail the same way */
+			if (close == len)
+				return len;
+
+			i = close + nested;
+			continue;
+		}
+
+		i += run;
+	}
+
+	return len;
+}
+
+/**
+ * Render emphasis, or its delimiters as text if it isn't closed.
+ *
+ * @param md Renderer state.
+ * @param s Text being rendered.
+ * @param len Length of \p s.
+ * @param i Index of opening run.
+ * @param depth Nesting depth.
+ * @return Index after emphasis.
+ */
+static size_t markdown_emphasis(struct markdown *md, const char *s,
+                                size_t len, size_t i, size_t depth)
+{
+	char c = s[i];
+	size_t n = 0;
+	while (i + n < len && s[i + n] == c)
+		n++;
+
+	size_t m = 0, close = len;
+	if (depth < MARKDOWN_DEPTH && markdown_opens(s, len, i, n))
+		close = markdown_emph_close(md, s, len, i + n, c, depth, &m);
+
+	if (close == len) {
+		markdown_text(md, s + i, n);
+		return i + n;
+	}
+
+	size_t k = n < m ? n : m;
+	if (k > 3)
+		k = 3;
+
+	/* unmatched part of opening run is just text */
+	markdown_text(md, s + i, n - k);
+
+	if (k != 2)
+		markdown_lit(md, "<em>");
+
+	if (k != 1)
+		markdown_lit(md, "<strong>");
+
+	markdown_inline(md, s + i + n, close - (i + n), depth + 1);
+
+	if (k != 1)
+		markdown_lit(md, "</strong>");
+
+	if (k != 2)
+		markdown_lit(md, "</em>");
+
+	return close + k;
+}
+
+/**
+ * Find bracket closing link text.
+ *
+ * @param md Renderer state.
+ * @param s Text to search.
+ * @param len Length of \p s.
+ * @param i Index of opening bracket.
+ * @return Index of closing bracket, \p len if there's none.
+ */
+static size_t markdown_bracket(struct markdown *md, const char *s,
+                               size_t len, size_t i)
+{
+	size_t depth = 0;
+	while (i < len && markdown_step(md)) {
+		if (s[i] == '\\') {
+			i += 2;
+			continue;
+		}
+
+		if (s[i] == '`') {
+			size_t n, close = markdown_code_close(md, s, len, i, &n);
+			i = close ? close + n : i + n;
+			continue;
+		}
+
+		if (s[i] == '[')
+			depth++;
+
+		if (s[i] == ']' && !--depth)
+			return i;
+
+		i++;
+	}
+
+	return len;
+}
+
+/**
+ * Render link or image, or its opening bracket as text if it isn't one.
+ *
+ * @param md Renderer state.
+ * @param s Text being rendered.
+ * @param len Length of \p s.
+ * @param i Index of opening bracket, or exclamation mark of image.
+ * @param depth Nesting depth.
+ * @return Index after link.
+ */
+static size_t markdown_link(struct markdown *md, const char *s, size_t len,
+                            size_t i, size_t depth)
+{
+	bool image = s[i] == '!';
+	size_t open = i + image;
+	if (open >= len || s[open] != '[') {
+		markdown_text(md, s + i, 1);
+		return i + 1;
+	}
+
+	size_t close = markdown_bracket(md, s, len, open);
+	if (close == len || depth >= MARKDOWN_DEPTH)
+		goto literal;
+
+	struct markdown_str text = {s + open + 1, close - open - 1};
+	struct markdown_str url, title;
+	size_t end = 0;
+	if (close + 1 < len && s[close + 1] == '(') {
+		end = markdown_dest(s, len, close + 2, &url, &title);
+		while (end && end < len && markdown_space(s[end]))
+			end++;
+
+		end = end && end < len && s[end] == ')' ? end + 1 : 0;
+	}
+
+	if (!end) {
+		struct markdown_str label = text;
+		end = close + 1;
+
+		const char *rb;
+		if (end < len && s[end] == '['
+		    && (rb = memchr(s + end, ']', len - end))) {
+			if ((size_t)(rb - s) > end + 1)
+				label = (struct markdown_str){s + end + 1,
+				                              rb - s - end - 1};
+
+			end = rb - s + 1;
+		}
+
+		const struct markdown_ref *ref;
+		if (!(ref = markdown_ref(md, label.s, label.len)))
+			goto literal;
+
+		url = (struct markdown_str){ref->url, strlen(ref->url)};
+		title = (struct markdown_str){ref->title,
+		                              ref->title ? strlen(ref->title) : 0};
+	}
+
+	if (image) {
+		markdown_lit(md, "<img src=\"");
+		markdown_attr(md, url.s, url.len);
+		markdown_lit(md, "\" alt=\"");
+		markdown_attr(md, text.s, text.len);
+		markdown_lit(md, "\"");
+	} else {
+		markdown_lit(md, "<a href=\"");
+		markdown_attr(md, url.s, url.len);
+		markdown_lit(md, "\"");
+	}
+
+	if (title.s) {
+		markdown_lit(md, " title=\"");
+		markdown_attr(md, title.s, title.len);
+		markdown_lit(md, "\"");
+	}
+
+	if (image) {
+		markdown_lit(md, " />");
+		return end;
+	}
+
+	markdown_lit(md, ">");
+	markdown_inline(md, text.s, text.len, depth + 1);
+	markdown_lit(md, "</a>");
+	return end;
+
+literal:
+	markdown_text(md, s + i, open + 1 - i);
+	return open + 1;
+}
+
+/**
+ * Find end of email address autolink.
+ *
+ * @param s Text after opening angle bracket.
+ * @param len Length of \p s.
+ * @return Length of address, \c 0 if \p s doesn't start with one.
+ */
+static size_t markdown_email(const char *s, size_t len)
+{
+	size_t i = 0;
+	while (i < len && (isalnum((unsigned char)s[i])
+	                   || strchr(".!#$%&'*+/=?^_`{|}~-", s[i])))
+		i++;
+
+	if (!i || i >= len || s[i] != '@')
+		return 0;
+
+	size_t domain = ++i;
+	while (i < len && (isalnum((unsigned char)s[i]) || s[i] == '.'
+	                   || s[i] == '-'))
+		i++;
+
+	if (i == domain || i >= len || s[i] != '>')
+		return 0;
+
+	return i;
+}
+
+/**
+ * Render autolink or inline HTML, or the angle bracket as text if it's
+ * neither.
+ *
+ * @param md Renderer state.
+ * @param s Text being rendered.
+ * @param len Length of \p s.
+ * @param i Index of angle bracket.
+ * @return Index after autolink or HTML.
+ */
+static size_t markdown_angle(struct markdown *md, const char *s, size_t len,
+                             size_t i)
+{
+	size_t start = i + 1, j = start;
+	while (j < len && (isalnum((unsigned char)s[j]) || s[j] == '+'
+	                   || s[j] == '.' || s[j] == '-'))
+		j++;
+
+	if (j - start >= 2 && j - start <= 32 && j < len && s[j] == ':'
+	    && isalpha((unsigned char)s[start])) {
+		while (j < len && s[j] != '>' && s[j] != '<'
+		       && !markdown_space(s[j]))
+			j++;
+
+		if (j < len && s[j] == '>') {
+			markdown_lit(md, "<a href=\"");
+			markdown_text(md, s + start, j - start);
+			markdown_lit(md, "\">");
+			markdown_text(md, s + start, j - start);
+			markdown_lit(md, "</a>");
+			return j + 1;
+		}
+	}
+
+	size_t email;
+	if ((email = markdown_email(s + start, len - start))) {
+		markdown_lit(md, "<a href=\"mailto:");
+		markdown_text(md, s + start, email);
+		markdown_lit(md, "\">");
+		markdown_text(md, s + start, email);
+		markdown_lit(md, "</a>");
+		return start + email + 1;
+	}
+
+	size_t tag;
+	if ((tag = markdown_tag(s + i, len - i))) {
+		markdown_raw(md, s + i, tag);
+		return i + tag;
+	}
+
+	markdown_lit(md, "&lt;");
+	return i + 1;
+}
+
+/**
+ * Render entity or character reference as is, or the ampersand escaped if
+ * it's neither.
+ *
+ * @param md Renderer state.
+ * @param s Text being rendered.
+ * @param len Length of \p s.
+ * @param i Index of ampersand.
+ * @return Index after reference.
+ */
+static size_t markdown_entity(struct markdown *md, const char *s, size_t len,
+                              size_t i)
+{
+	size_t j = i + 1, start;
+	if (j < len && s[j] == '#') {
+		bool hex = ++j < len && (s[j] == 'x' || s[j] == 'X');
+		start = j += hex;
+		while (j < len && j - start < 7
+		       && (hex ? isxdigit((unsigned char)s[j])
+		           : isdigit((unsigned char)s[j])))
+			j++;
+	} else {
+		start = j;
+		while (j < len && j - start < 32 && isalnum((unsigned char)s[j]))
+			j++;
+	}
+
+	if (j == start || j >= len || s[j] != ';') {
+		markdown_lit(md, "&amp;");
+		return i + 1;
+	}
+
+	markdown_raw(md, s + i, j + 1 - i);
+	return j + 1;
+}
+
+/** Characters that may start an inline construct. */
+static const bool markdown_special[256] = {
+	['\\'] = true, ['`'] = true, ['*'] = true, ['_'] = true,
+	['['] = true, ['!'] = true, ['<'] = true, ['&'] = true,
+};
+
+/**
+ * Render inlines.
+ *
+ * @param md Renderer state.
+ * @param s Text to render.
+ * @param len Length of \p s.
+ * @param depth Nesting depth.
+ */
+static void markdown_inline(struct markdown *md, const char *s, size_t len,
+                            size_t depth)
+{
+	size_t run = 0, i = 0;
+	while (i < len) {
+		char c = s[i];
+		if (!markdown_special[(unsigned char)c]) {
+			i++;
+			continue;
+		}
+
+		/* whatever comes before is text, whether or not c starts
+		 * something */
+		markdown_text(md, s + run, i - run);
+
+		if (c == '\\' && i + 1 < len && s[i + 1] == '\n') {
+			markdown_lit(md, "<br />\n");
+			i += 2;
+		} else if (c == '\\' && i + 1 < len && markdown_punct(s[i + 1])) {
+			markdown_text(md, s + i + 1, 1);
+			i += 2;
+		} else if (c == '\\') {
+			markdown_lit(md, "\\");
+			i++;
+		} else if (c == '`') {
+			i = markdown_code_span(md, s, len, i);
+		} else if (c == '*' || c == '_') {
+			i = markdown_emphasis(md, s, len, i, depth);
+		} else if (c == '[' || c == '!') {
+			i = markdown_link(md, s, len, i, depth);
+		} else if (c == '<') {
+			i = markdown_angle(md, s, len, i);
+		} else {
+			i = markdown_entity(md, s, len, i);
+		}
+
+		run = i;
+	}
+
+	markdown_text(md, s + run, len - run);
+}
+
+/**
+ * Render lines as inlines.
+ *
+ * @param md Renderer state.
+ * @param lines Lines to render.
+ * @param n Number of \p lines.
+ */
+static void markdown_inline_lines(struct markdown *md,
+                                  const struct markdown_str *lines, size_t n)
+{
+	if (!md->o)
+		return;
+
+	size_t len;
+	char *text;
+	if (!(text = markdown_join(lines, n, &len))) {
+		markdown_fail(md);
+		return;
+	}
+
+	markdown_inline(md, text, len, 0);
+	free(text);
+}
+
+/**
+ * Create unique heading id.
+ * Made from letters and numbers of rendered heading, lowercased, with spaces
+ * turned into dashes and anything else dropped, like GitHub does. Repeated
+ * ids get a number at the end.
+ *
+ * @param md Renderer state.
+ * @param html Rendered heading.
+ * @param len Length of \p html.
+ * @return Id, owned by \p md, \c NULL on error.
+ */
+static const char *markdown_id(struct markdown *md, const char *html,
+                               size_t len)
+{
+	size_t plen = strlen(md->prefix);
+
+	char *id;
+	if (!(id = malloc(plen + len + OBUF_UINT_MAX + 2)))
+		return NULL;
+
+	memcpy(id, md->prefix, plen);
+
+	size_t n = plen;
+	for (size_t i = 0; i < len; ++i) {
+		unsigned char c = html[i];
+		const char *end;
+
+		/* tags and references aren't part of the text */
+		if ((c == '<' && (end = memchr(html + i, '>', len - i)))
+		    || (c == '&' && (end = memchr(html + i, ';', len - i))))
+			i = end - html;
+		else if (isalnum(c) || c >= 0x80 || c == '_' || c == '-')
+			id[n++] = tolower(c);
+		else if (c == ' ' || c == '\t')
+			id[n++] = '-';
+	}
+
+	id[n] = 0;
+
+	/* numbers only go up, so a heading repeated over and over doesn't
+	 * retry all the numbers before it every time */
+	struct markdown_entry *base;
+	if ((base = markdown_find(&md->ids, id))) {
+		size_t k = base->value;
+		do {
+			id[n] = '-';
+			obuf_format_uint(id + n + 1, k++);
+		} while (markdown_find(&md->ids, id));
+
+		base->value = k;
+	}
+
+	if (markdown_insert(&md->ids, id, 1)) {
+		free(id);
+		return NULL;
+	}
+
+	return id;
+}
+
+/**
+ * Render heading.
+ * The id depends on the rendered text, so the text is rendered first.
+ *
+ * @param md Renderer state.
+ * @param level Level of heading.
+ * @param s Text of heading.
+ * @param len Length of \p s.
+ */
+static void markdown_heading(struct markdown *md, int level, const char *s,
+                             size_t len)
+{
+	if (!md->o)
+		return;
+
+	struct obuf *o = md->o;
+	struct obuf text;
+	obuf_init(&text, -1);
+
+	md->o = &text;
+	markdown_inline(md, s, len, 0);
+	md->o = o;
+
+	if (text.err) {
+		obuf_free(&text);
+		markdown_fail(md);
+		return;
+	}
+
+	char tag[] = {'h', '0' + level};
+	const char *id = markdown_id(md, text.buf, text.len);
+
+	markdown_lit(md, "<");
+	markdown_raw(md, tag, sizeof(tag));
+	if (id) {
+		markdown_lit(md, " id=\"");
+		markdown_text(md, id, strlen(id));
+		markdown_lit(md, "\"><a class=\"anchor\" href=\"#");
+		markdown_text(md, id, strlen(id));
+		markdown_lit(md, "\"></a>");
+	} else {
+		markdown_lit(md, ">");
+	}
+
+	markdown_raw(md, text.buf, text.len);
+	obuf_free(&text);
+
+	markdown_lit(md, "</");
+	markdown_raw(md, tag, sizeof(tag));
+	markdown_lit(md, ">\n");
+}
+
+static void markdown_blocks(struct markdown *md,
+                            const struct markdown_str *lines, size_t n,
+                            bool tight);
+
+/**
+ * Check if line interrupts a paragraph.
+ *
+ * @param md Renderer state.
+ * @param l Line to check.
+ * @return \c true if \p l starts a new block, \c false if it continues the
+ * paragraph.
+ */
+static bool markdown_interrupts(struct markdown *md, struct markdown_str l)
+{
+	struct markdown_fence f;
+	struct markdown_str rest;
+	if (markdown_fence(l, &f) || markdown_atx(l, &rest) || markdown_hr(l)
+	    || markdown_html(l, true))
+		return true;
+
+	if (md->depth >= MARKDOWN_DEPTH)
+		return false;
+
+	struct markdown_item it;
+	if (markdown_quote(l, &rest))
+		return true;
+
+	return markdown_item(l, &it) && !it.empty
+	       && (!it.ordered || it.start == 1);
+}
+
+/**
+ * Check if line leaves a paragraph open, so that the next line may continue
+ * it lazily without container markers.
+ *
+ * @param l Line to check, with container markers stripped.
+ * @return \c true if \p l may be paragraph text, \c false otherwise.
+ */
+static bool markdown_lazy(struct markdown_str l)
+{
+	struct markdown_fence f;
+	struct markdown_str text;
+	return !markdown_blank(l) && markdown_indent(l) < 4
+	       && !markdown_fence(l, &f) && !markdown_atx(l, &text)
+	       && !markdown_hr(l);
+}
+
+/**
+ * Render indented code block.
+ *
+ * @param md Renderer state.
+ * @param lines Lines starting with block.
+ * @param n Number of \p lines.
+ * @return Number of lines in block.
+ */
+static size_t markdown_indented(struct markdown *md,
+                                const struct markdown_str *lines, size_t n)
+{
+	size_t end = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (markdown_blank(lines[i]))
+			continue;
+
+		if (markdown_indent(lines[i]) < 4)
+			break;
+
+		end = i + 1;
+	}
+
+	markdown_lit(md, "<pre><code>");
+	for (size_t i = 0; i < end; ++i) {
+		struct markdown_str l = markdown_strip(lines[i], 4);
+		markdown_text(md, l.s, l.len);
+		markdown_lit(md, "\n");
+	}
+
+	markdown_lit(md, "</code></pre>\n");
+	return end;
+}
+
+/**
+ * Render fenced code block.
+ *
+ * @param md Renderer state.
+ * @param lines Lines starting with opening fence.
+ * @param n Number of \p lines.
+ * @param f Opening fence.
+ * @return Number of lines in block.
+ */
+static size_t markdown_fenced(struct markdown *md,
+                              const struct markdown_str *lines, size_t n,
+                              const struct markdown_fence *f)
+{
+	markdown_lit(md, "<pre><code");
+	if (f->info.len) {
+		size_t lang = 0;
+		while (lang < f->info.len && !markdown_space(f->info.s[lang]))
+			lang++;
+
+		markdown_lit(md, " class=\"language-");
+		markdown_attr(md, f->info.s, lang);
+		markdown_lit(md, "\"");
+	}
+
+	markdown_lit(md, ">");
+
+	size_t i = 1;
+	for (; i < n; ++i) {
+		struct markdown_fence close;
+		if (markdown_fence(lines[i], &close) && close.c == f->c
+		    && close.n >= f->n && !close.info.len) {
+			i++;
+			break;
+		}
+
+		struct markdown_str l = markdown_strip(lines[i], f->indent);
+		markdown_text(md, l.s, l.len);
+		markdown_lit(md, "\n");
+	}
+
+	markdown_lit(md, "</code></pre>\n");
+	return i;
+}
+
+/**
+ * Render HTML block as is.
+ *
+ * @param md Renderer state.
+ * @param lines Lines starting with block.
+ * @param n Number of \p lines.
+ * @return Number of lines in block.
+ */
+static size_t markdown_html_block(struct markdown *md,
+                                  const struct markdown_str *lines, size_t n)
+{
+	/* comments and raw text elements may contain blank lines */
+	static const char *const raw[][2] = {
+		{"<!--", "-->"}, {"<pre", "</pre>"}, {"<script", "</script>"},
+		{"<style", "</style>"}, {"<textarea", "</textarea>"},
+	};
+
+	struct markdown_str first = markdown_trim(lines[0]);
+	const char *end = NULL;
+	for (size_t r = 0; r < sizeof(raw) / sizeof(*raw); ++r) {
+		size_t len = strlen(raw[r][0]);
+		if (first.len >= len && !strncasecmp(first.s, raw[r][0], len)) {
+			end = raw[r][1];
+			break;
+		}
+	}
+
+	size_t i = 0;
+	for (; i < n; ++i) {
+		if (!end && markdown_blank(lines[i]))
+			break;
+
+		markdown_raw(md, lines[i].s, lines[i].len);
+		markdown_lit(md, "\n");
+
+		if (end && markdown_contains(lines[i], end)) {
+			i++;
+			break;
+		}
+	}
+
+	return i;
+}
+
+/**
+ * Render table row.
+ *
+ * @param md Renderer state.
+ * @param l Row to render.
+ * @param cols Number of columns.
+ * @param align Alignment of each column.
+ * @param head Whether row is the header row.
+ */
+static void markdown_row(struct markdown *md, struct markdown_str l,
+                         size_t cols, const char *align, bool head)
+{
+	struct markdown_str cells[MARKDOWN_COLUMNS];
+	size_t n = markdown_cells(l, cells);
+
+	markdown_lit(md, "<tr>\n");
+	for (size_t i = 0; i < cols; ++i) {
+		markdown_raw(md, head ? "<th" : "<td", 3);
+		if (align[i] == 'l')
+			markdown_lit(md, " style=\"text-align: left\"");
+		else if (align[i] == 'c')
+			markdown_lit(md, " style=\"text-align: center\"");
+		else if (align[i] == 'r')
+			markdown_lit(md, " style=\"text-align: right\"");
+
+		markdown_lit(md, ">");
+		if (i < n)
+			markdown_inline(md, cells[i].s, cells[i].len, 0);
+
+		markdown_raw(md, head ? "</th>\n" : "</td>\n", 6);
+	}
+
+	markdown_lit(md, "</tr>\n");
+}
+
+/**
+ * Render table.
+ *
+ * @param md Renderer state.
+ * @param lines Lines starting with header row.
+ * @param n Number of \p lines.
+ * @param cols Number of columns.
+ * @param align Alignment of each column.
+ * @return Number of lines in table.
+ */
+static size_t markdown_table(struct markdown *md,
+                             const struct markdown_str *lines, size_t n,
+                             size_t cols, const char *align)
+{
+	markdown_lit(md, "<table>\n<thead>\n");
+	markdown_row(md, lines[0], cols, align, true);
+	markdown_lit(md, "</thead>\n");
+
+	size_t i = 2;
+	for (; i < n; ++i) {
+		if (markdown_blank(lines[i]) || markdown_interrupts(md, lines[i]))
+			break;
+
+		if (i == 2)
+			markdown_lit(md, "<tbody>\n");
+
+		markdown_row(md, lines[i], cols, align, false);
+	}
+
+	if (i > 2)
+		markdown_lit(md, "</tbody>\n");
+
+	markdown_lit(md, "</table>\n");
+	return i;
+}
+
+/**
+ * Render block quote.
+ *
+ * @param md Renderer state.
+ * @param lines Lines starting with block.
+ * @param n Number of \p lines.
+ * @return Number of lines in block.
+ */
+static size_t markdown_blockquote(struct markdown *md,
+                                  const struct markdown_str *lines, size_t n)
+{
+	struct markdown_str *inner;
+	if (!(inner = malloc(n * sizeof(*inner)))) {
+		markdown_fail(md);
+		return n;
+	}
+
+	size_t i = 0, k = 0;
+	bool lazy = false;
+	for (; i < n; ++i) {
+		struct markdown_str rest;
+		if (markdown_quote(lines[i], &rest)) {
+			inner[k++] = rest;
+			lazy = markdown_lazy(rest);
+			continue;
+		}
+
+		if (!lazy || markdown_blank(lines[i])
+		    || markdown_interrupts(md, lines[i]))
+			break;
+
+		inner[k++] = lines[i];
+	}
+
+	markdown_lit(md, "<blockquote>\n");
+	md->depth++;
+	markdown_blocks(md, inner, k, false);
+	md->depth--;
+	markdown_lit(md, "</blockquote>\n");
+
+	free(inner);
+	return i;
+}
+
+/**
+ * Render list.
+ * List is tight, without paragraphs in its items, unless there are blank
+ * lines between items or between blocks of an item.
+ *
+ * @param md Renderer state.
+ * @param lines Lines starting with first item.
+ * @param n Number of \p lines.
+ * @param first Marker of first item.
+ * @return Number of lines in list.
+ */
+static size_t markdown_list(struct markdown *md,
+                            const struct markdown_str *lines, size_t n,
+                            const struct markdown_item *first)
+{
+	/* lines of all items back to back, ends[j] is where item j ends */
+	struct markdown_str *inner = malloc(n * sizeof(*inner));
+	size_t *ends = malloc(n * sizeof(*ends));
+	if (!inner || !ends) {
+		free(inner);
+		free(ends);
+		markdown_fail(md);
+		return n;
+	}
+
+	struct markdown_item it = *first;
+	size_t i = 0, k = 0, items = 0;
+	bool loose = false;
+	while (i < n) {
+		size_t start = k;
+		inner[k++] = it.rest;
+
+		struct markdown_fence fence;
+		bool fenced = markdown_fence(it.rest, &fence);
+		bool lazy = markdown_lazy(it.rest);
+		bool blank = it.empty;
+
+		for (++i; i < n; ++i) {
+			struct markdown_str l = lines[i];
+			if (markdown_blank(l)) {
+				/* item starting with a blank line can't have
+				 * another */
+				if (it.empty && k == start + 1)
+					break;
+
+				inner[k++] = (struct markdown_str){l.s, 0};
+				blank = true;
+				lazy = false;
+				continue;
+			}
+
+			if (markdown_indent(l) >= it.width) {
+				l = markdown_strip(l, it.width);
+				if (blank && !fenced && k > start + 1)
+					loose = true;
+
+				struct markdown_fence f;
+				if (!fenced && markdown_fence(l, &f)) {
+					fenced = true;
+					fence = f;
+				} else if (fenced && markdown_fence(l, &f)
+				           && f.c == fence.c && f.n >= fence.n
+				           && !f.info.len) {
+					fenced = false;
+				}
+
+				inner[k++] = l;
+				lazy = !fenced && markdown_lazy(l);
+				blank = false;
+				continue;
+			}
+
+			struct markdown_item next;
+			if (!lazy || markdown_item(l, &next)
+			    || markdown_interrupts(md, l))
+				break;
+
+			inner[k++] = l;
+		}
+
+		/* trailing blank lines separate items instead */
+		size_t trailing = 0;
+		while (k > start + 1 && !inner[k - 1].len) {
+			k--;
+			trailing++;
+		}
+
+		ends[items++] = k;
+
+		struct markdown_item next;
+		if (i >= n || markdown_hr(lines[i]) || !markdown_item(lines[i], &next)
+		    || next.ordered != it.ordered || next.c != it.c)
+			break;
+
+		if (trailing)
+			loose = true;
+
+		it = next;
+	}
+
+	if (first->ordered && first->start != 1) {
+		markdown_lit(md, "<ol start=\"");
+		if (md->o)
+			obuf_uint(md->o, first->start);
+
+		markdown_lit(md, "\">\n");
+	} else if (first->ordered) {
+		markdown_lit(md, "<ol>\n");
+	} else {
+		markdown_lit(md, "<ul>\n");
+	}
+
+	md->depth++;
+	for (size_t j = 0, start = 0; j < items; start = ends[j++]) {
+		markdown_lit(md, "<li>");
+		markdown_blocks(md, inner + start, ends[j] - start, !loose);
+		markdown_lit(md, "</li>\n");
+	}
+
+	md->depth--;
+
+	if (first->ordered)
+		markdown_lit(md, "</ol>\n");
+	else
+		markdown_lit(md, "</ul>\n");
+
+	free(inner);
+	free(ends);
+	return i;
+}
+
+/**
+ * Render paragraph, or setext heading if the paragraph is underlined.
+ * Link reference definitions at the start of the paragraph are skipped.
+ *
+ * @param md Renderer state.
+ * @param lines Lines starting with paragraph.
+ * @param n Number of \p lines.
+ * @param tight Whether paragraph is in a tight list item, rendered without
+ * \c p tags.
+ * @return Number of lines in paragraph.
+ */
+static size_t markdown_paragraph(struct markdown *md,
+                                 const struct markdown_str *lines, size_t n,
+                                 bool tight)
+{
+	size_t start = 0;
+	while (start < n && markdown_refdef(md, lines[start]))
+		start++;
+
+	size_t i = start;
+	int level = 0;
+	for (; i < n; ++i) {
+		if (markdown_blank(lines[i]))
+			break;
+
+		if (i > start && (level = markdown_setext(lines[i])))
+			break;
+
+		if (i > start && markdown_interrupts(md, lines[i]))
+			break;
+	}
+
+	if (i == start)
+		return i;
+
+	if (level) {
+		if (md->o) {
+			size_t len;
+			char *text;
+			if (!(text = markdown_join(lines + start, i - start, &len)))
+				markdown_fail(md);
+			else
+				markdown_heading(md, level, text, len);
+
+			free(text);
+		}
+
+		return i + 1;
+	}
+
+	if (tight) {
+		markdown_inline_lines(md, lines + start, i - start);
+		if (i < n)
+			markdown_lit(md, "\n");
+
+		return i;
+	}
+
+	markdown_lit(md, "<p>");
+	markdown_inline_lines(md, lines + start, i - start);
+	markdown_lit(md, "</p>\n");
+	return i;
+}
+
+/**
+ * Render blocks of container.
+ *
+ * @param md Renderer state.
+ * @param lines Lines of container.
+ * @param n Number of \p lines.
+ * @param tight Whether container is a tight list item.
+ */
+static void markdown_blocks(struct markdown *md,
+                            const struct markdown_str *lines, size_t n,
+                            bool tight)
+{
+	size_t i = 0;
+	while (i < n) {
+		struct markdown_str l = lines[i];
+		if (markdown_blank(l)) {
+			i++;
+			continue;
+		}
+
+		const struct markdown_str *rest = lines + i;
+		size_t left = n - i;
+
+		struct markdown_fence f;
+		struct markdown_str text;
+		struct markdown_item it;
+		char align[MARKDOWN_COLUMNS];
+		struct markdown_str cells[MARKDOWN_COLUMNS];
+		size_t cols;
+		int level;
+
+		if (markdown_indent(l) >= 4) {
+			i += markdown_indented(md, rest, left);
+		} else if (markdown_fence(l, &f)) {
+			i += markdown_fenced(md, rest, left, &f);
+		} else if ((level = markdown_atx(l, &text))) {
+			markdown_heading(md, level, text.s, text.len);
+			i++;
+		} else if (markdown_hr(l)) {
+			markdown_lit(md, "<hr />\n");
+			i++;
+		} else if (md->depth < MARKDOWN_DEPTH && markdown_quote(l, &text)) {
+			i += markdown_blockquote(md, rest, left);
+		} else if (md->depth < MARKDOWN_DEPTH && markdown_item(l, &it)) {
+			i += markdown_list(md, rest, left, &it);
+		} else if (markdown_html(l, false)) {
+			i += markdown_html_block(md, rest, left);
+		} else if (left > 1 && memchr(l.s, '|', l.len)
+		           && (cols = markdown_delim(lines[i + 1], align))
+		           && markdown_cells(l, cells) == cols) {
+			i += markdown_table(md, rest, left, cols, align);
+		} else {
+			i += markdown_paragraph(md, rest, left, tight);
+		}
+	}
+}
+
+void markdown_write(struct obuf *o, const char *src, size_t size,
+                    const char *prefix)
+{
+	size_t n;
+	uint64_t *offsets;
+	if (!(offsets = lines_split(src, size, &n))) {
+		o->err = true;
+		return;
+	}
+
+	struct markdown_str *lines;
+	if (!(lines = malloc((n + 1) * sizeof(*lines)))) {
+		free(offsets);
+		o->err = true;
+		return;
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		const char *s = src + offsets[i];
+		size_t len = offsets[i + 1] - offsets[i];
+		if (len && s[len - 1] == '\n')
+			len--;
+
+		if (len && s[len - 1] == '\r')
+			len--;
+
+		lines[i] = (struct markdown_str){s, len};
+	}
+
+	free(offsets);
+
+	/* references first, then the real thing */
+	struct markdown md = {.o = NULL, .prefix = prefix,
+	                      .budget = MARKDOWN_BUDGET * (size + 1)};
+	markdown_blocks(&md, lines, n, false);
+
+	md.o = o;
+	markdown_blocks(&md, lines, n, false);
+
+	for (size_t i = 0; i < md.nrefs; ++i) {
+		free(md.refs[i].label);
+		free(md.refs[i].url);
+		free(md.refs[i].title);
+	}
+
+	for (size_t i = 0; i < md.ids.cap; ++i)
+		free((char *)md.ids.slots[i].key);
+
+	free(md.refs);
+	free(md.labels.slots);
+	free(md.ids.slots);
+	free(lines);
+}
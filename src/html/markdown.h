@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file markdown.h
+ * Built-in markdown renderer header.
+ *
+ * Renders the CommonMark subset READMEs actually use without forking
+ * markdown(1) for each directory view: ATX and setext headings, paragraphs,
+ * block quotes, nested lists, indented and fenced code, thematic breaks,
+ * pipe tables and HTML blocks, with code spans, emphasis, inline and
+ * reference links, images, autolinks, inline HTML, entities and hard breaks
+ * inside them.
+ *
+ * Every heading gets an id made from its text and the given prefix, plus an
+ * empty link to itself with class \c anchor, so sections can be linked to
+ * like with discount's \c toc and \c taganchor flags.
+ */
+
+#ifndef EXGT_MARKDOWN_H
+#define EXGT_MARKDOWN_H
+
+#include <stddef.h>
+
+#include <utils/obuf.h>
+
+/** Version of built-in renderer, bump whenever its output changes. */
+#define MARKDOWN_VERSION "builtin-1"
+
+/**
+ * Render markdown.
+ *
+ * @param o Output buffer to write to.
+ * @param src Markdown to render.
+ * @param size Size of \p src.
+ * @param prefix Prefix of heading ids.
+ */
+void markdown_write(struct obuf *o, const char *src, size_t size,
+                    const char *prefix);
+
+#endif /* EXGT_MARKDOWN_H */
@@ -12,171 +12,169 @@
 #include <utils/path.h>
 #include <utils/git.h>
 #include <html/pages/pages.h>
+#include <css/css.h>
 
+#include <stdio.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 
-struct html_elem *pages_generate_head(struct res *r, struct html_elem *html,
-                                      const char *page_title)
+/** Slots of \ref common_parts. */
+enum common_slot {
+	/** Title of page. */
+	COMMON_TITLE,
+	/** Path to stylesheet. */
+	COMMON_STYLES,
+	/** Web root, where the home button points to. */
+	COMMON_WEB_ROOT,
+};
+
+/** Parts of \ref common_template, everything up to page content. */
+static const struct iovec common_parts[] = {
+	TEMPLATE_TEXT(PAGES_DOCTYPE "<html><head><title>"),
+	TEMPLATE_SLOT(COMMON_TITLE),
+	TEMPLATE_TEXT("</title>\n"
+	              "<meta charset=\"utf8\"></meta>\n"
+	              "<link rel=\"preload\" href=\""),
+	TEMPLATE_SLOT(COMMON_STYLES),
+	TEMPLATE_TEXT("\" as=\"style\"></link>\n"
+	              "<link rel=\"stylesheet\" href=\""),
+	TEMPLATE_SLOT(COMMON_STYLES),
+	TEMPLATE_TEXT("\"></link>\n"
+	              "</head>\n"
+	              /** @todo allow user to specify home button text? */
+	              "<body><header><a class=\"button\" href=\""),
+	TEMPLATE_SLOT(COMMON_WEB_ROOT),
+	TEMPLATE_TEXT("\">EXGT</a>\n"
+	              "</header>\n"
+	              "<main>"),
+};
+
+/** Common elements of all pages. */
+static const struct template common_template =
+	TEMPLATE(common_parts, "html", "body", "main");
+
+int pages_generate_common(struct html_stream *s, struct obuf *out, struct res *r,
+                          const char *title)
 {
-	struct html_elem *head = html_add_child(html, "head", NULL);
-	struct html_elem *title = html_add_child(head, "title", page_title);
-	struct html_elem *utf8 = html_add_elem(title, "meta", NULL);
-	html_add_attr(utf8, "charset", "utf8");
+	/* versioned so the stylesheet can be cached as immutable, a missing
+	 * one just gets a link that can't be found */
+	char version[CSS_VERSION_MAX];
+	char styles_path[CSS_VERSION_MAX + 16] = "styles.css";
+	if (css_version(version) == 0)
+		snprintf(styles_path, sizeof(styles_path), "styles.css?v=%s",
+		         version);
 
 	char *styles;
-	if (!(styles = build_web_path("styles.css")))
-		return NULL;
-
-	struct html_elem *preload = html_add_elem(utf8, "link", NULL);
-	html_add_attr(preload, "rel", "preload");
-	html_add_attr(preload, "href", styles);
-	html_add_attr(preload, "as", "style");
-
-	struct html_elem *link = html_add_elem(preload, "link", NULL);
-	html_add_attr(link, "rel", "stylesheet");
-	html_add_attr(link, "href", styles);
+	if (!(styles = build_web_path(styles_path))) {
+		error("couldn't create stylesheet path\n");
+		return -1;
+	}
 
 	res_add(r, styles);
 
-	return head;
-}
+	char *web_root;
+	if (!(web_root = web_root_path())) {
+		error("couldn't create web root\n");
+		return -1;
+	}
 
-struct html_elem *pages_generate_header(struct res *r, struct html_elem *body,
-                                        struct html_elem **cont)
-{
-	struct html_elem *header = html_add_child(body, "header", NULL);
-	/** @todo allow user to specify home button text? */
-	char *web_root = web_root_path();
-	struct html_elem *exgt_button = html_add_child(header, "a", "EXGT");
-	html_add_attr(exgt_button, "class", "button");
-	html_add_attr(exgt_button, "href", web_root);
 	res_add(r, web_root);
 
-	if (cont)
-		*cont = exgt_button;
+	html_stream_start(s, out);
+	html_stream_template(s, &common_template, (const char *[]){
+		[COMMON_TITLE] = title,
+		[COMMON_STYLES] = styles,
+		[COMMON_WEB_ROOT] = web_root,
+	});
 
-	return header;
+	return 0;
 }
 
-struct html_elem *pages_generate_common(struct res *r,
-                                        const char *title,
-                                        struct html_elem **page_main,
-                                        struct html_elem **page_header)
-{
-	(void)r; /* unused for now */
-
-	/* normally I don't use C89 style initialization, but lto gives a
-	 * warning about possibly uninitialized variables if I use my typical
-	 * style. */
-	struct html_elem *html = NULL;
-	struct html_elem *head = NULL;
-	struct html_elem *body = NULL;
-	struct html_elem *elem_header = NULL;
-	struct html_elem *elem_main = NULL;
-
-	if (!(html = html_create_elem("html", NULL))) {
-		error("couldn't create html\n");
-		return NULL;
-	}
-
-	if (!(head = pages_generate_head(r, html, title))) {
-		error("couldn't create head\n");
-		goto out;
-	}
-
-	if (!(body = html_add_elem(head, "body", NULL))) {
-		error("couldn't create body\n");
-		goto out;
-	}
-
-	if (!(elem_header = pages_generate_header(r, body, NULL))) {
-		error("couldn't create header");
-		goto out;
-	}
-
-	if (!(elem_main = html_add_elem(elem_header, "main", NULL))) {
-		error("couldn't create main");
-		goto out;
-	}
-
-out:
-	if (page_main)
-		*page_main = elem_main;
+/** Parts of \ref clone_template. */
+static const struct iovec clone_parts[] = {
+	TEMPLATE_TEXT("<div class=\"clone\">"
+	              "<span>https://tmp</span>\n"
+	              "<span>exgt@tmp:tmp</span>\n"
+	              "</div>\n"),
+};
 
-	if (page_header)
-		*page_header = elem_header;
+/** Clone box. */
+static const struct template clone_template = TEMPLATE(clone_parts);
 
-	return html;
-}
-
-struct html_elem *pages_generate_clone(struct res *r,
-                                       struct html_elem *page_main)
+int pages_generate_clone(struct html_stream *s, struct res *r)
 {
 	(void)r; /* unused for now */
-	struct html_elem *clone = html_add_child(page_main, "div", NULL);
-	html_add_attr(clone, "class", "clone");
-
-	struct html_elem *http_clone = html_add_child(clone, "span",
-	                                              "https://tmp");
-	html_add_elem(http_clone, "span", "exgt@tmp:tmp");
-	return clone;
+	html_stream_template(s, &clone_template, NULL);
+	return 0;
 }
 
-struct html_elem *pages_generate_path(struct res *r, struct html_elem *clone)
+int pages_generate_path(struct html_stream *s, struct res *r)
 {
 	char *path;
 	if (!(path = git_path()))
-		return NULL;
+		return -1;
 	res_add(r, path);
 
 	char *web_root;
 	if (!(web_root = git_web_root()))
-		return NULL;
+		return -1;
 	res_add(r, web_root);
 
-	struct html_elem *path_div = html_add_elem(clone, "div", NULL);
-	html_add_attr(path_div, "class", "path");
-
 	char *repo_name;
 	if (!(repo_name = git_repo_name()))
-		return NULL;
+		return -1;
 	res_add(r, repo_name);
 
-	struct html_elem *root = html_add_child(path_div, "a", repo_name);
-	html_add_attr(root, "class", "path-elem hover-underline");
-	html_add_attr(root, "href", web_root);
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "path");
+
+	html_stream_open(s, "a");
+	html_stream_attr(s, "class", "path-elem hover-underline");
+	html_stream_attr(s, "href", web_root);
+	html_stream_text(s, repo_name);
+	html_stream_close(s);
 
-	struct html_elem *elem = html_add_elem(root, "span", "/");
-	html_add_attr(elem, "class", "path-sep");
+	html_stream_open(s, "span");
+	html_stream_attr(s, "class", "path-sep");
+	html_stream_text(s, "/");
+	html_stream_close(s);
 
 	char *next, *prev = path, *href = web_root;
 	while ((next = strchr(prev, '/'))) {
 		*next++ = 0;
 
-		elem = html_add_elem(elem, "a", prev);
+		if (!(href = build_path(href, prev)))
+			return -1;
 
-		href = build_path(href, prev);
-		html_add_attr(elem, "class", "path-elem hover-underline");
-		html_add_attr(elem, "href", href);
 		res_add(r, href);
 
-		elem = html_add_elem(elem, "span", "/");
-		html_add_attr(elem, "class", "path-sep");
+		html_stream_open(s, "a");
+		html_stream_attr(s, "class", "path-elem hover-underline");
+		html_stream_attr(s, "href", href);
+		html_stream_text(s, prev);
+		html_stream_close(s);
+
+		html_stream_open(s, "span");
+		html_stream_attr(s, "class", "path-sep");
+		html_stream_text(s, "/");
+		html_stream_close(s);
 
 		prev = next;
 	}
 
 	if (*prev != 0) {
-		struct html_elem *fname = html_add_elem(elem, "span", prev);
-		html_add_attr(fname, "class", "path-elem");
+		html_stream_open(s, "span");
+		html_stream_attr(s, "class", "path-elem");
+		html_stream_text(s, prev);
+		html_stream_close(s);
 	}
 
-	return path_div;
+	html_stream_close(s);
+	return 0;
 }
 
-void pages_generate_doctype(FILE *file)
+void pages_generate_doctype(struct obuf *out)
 {
-	fprintf(file, "<!DOCTYPE html>\n");
+	obuf_lit(out, PAGES_DOCTYPE);
 }
@@ -7,16 +7,22 @@
  */
 
 #include <html/html.h>
+#include <html/markdown.h>
 #include <utils/http.h>
 #include <utils/chain.h>
 #include <utils/path.h>
 #include <utils/res.h>
 #include <utils/git.h>
+#include <utils/url.h>
+#include <utils/prefetch.h>
+#include <utils/cache.h>
+#include <utils/file.h>
 
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <unistd.h>
 
 #include "pages.h"
 
@@ -60,7 +66,7 @@ static char *generate_perms(char *perms)
  * @param fname Filename to make uppercase.
  * @return Uppercase version of \p fname in new buffer.
  */
-static char *get_upper(char *fname)
+static char *get_upper(const char *fname)
 {
 	char *new;
 	if (!(new = strdup(fname)))
@@ -80,7 +86,7 @@ static char *get_upper(char *fname)
  * @param fname Filename to check.
  * @return \c true if \p fname is some README, \c false otherwise.
  */
-static bool check_readme(char *fname)
+static bool check_readme(const char *fname)
 {
 	char *upper;
 	if (!(upper = get_upper(fname)))
@@ -107,15 +113,14 @@ static bool check_readme(char *fname)
 static char *generate_ref_path(char *fname)
 {
 	/* since we already know we're dealing with a dir, the web dir is just
-	 * REQUEST_URI. No need to fiddle with parsing a git command or anything. */
+	 * the request path. No need to fiddle with parsing a git command or
+	 * anything. */
 	char *web_dir;
-	if (!(web_dir = getenv("REQUEST_URI")))
-		return NULL;
-
-	char *ref;
-	if (!(ref = build_path(web_dir, fname)))
+	if (!(web_dir = request_path()))
 		return NULL;
 
+	char *ref = build_path(web_dir, fname);
+	free(web_dir);
 	return ref;
 }
 
@@ -134,245 +139,398 @@ static char *generate_ref_path(char *fname)
 
 /**
  * Generate directory entry in dirview based on \p ls_line.
+ * Subdirectories are likely to be visited next, so they are queued for
+ * prefetching, READMEs included.
  *
- * @param ls_line One line of output from \c 'git ls-tree -l'.
+ * @param s Stream to write to.
+ * @param root Path to repository.
+ * @param ls_line One entry of output from \c 'git ls-tree -z'.
+ * @param size Size of entry, \c -1 if unknown or not a blob.
  * @param readme Pointer to set to git object string if file is a README.
  * Caller should free.
- * @return dir element.
  */
-static struct html_elem *generate_dir(char *ls_line, char **readme)
+static void generate_dir(struct html_stream *s, char *root, char *ls_line,
+                         ssize_t size, char **readme)
 {
 
 	char *next = ls_line;
 	char *perms = NEXT_FIELD(next);
 	char *type = NEXT_FIELD(next);
 	char *object = NEXT_FIELD(next);
-	char *size = NEXT_FIELD(next);
 	char *fname = next;
 
-	size = strdup(size);
-	res_add(r, size);
-
-	fname = strdup(fname);
-	res_add(r, fname);
+	char size_str[32] = "-";
+	if (size >= 0)
+		snprintf(size_str, sizeof(size_str), "%zd", size);
 
-	(void)type;
+	if (strcmp(type, "tree") == 0)
+		prefetch_add(root, PREFETCH_TREE, object);
 
-	struct html_elem *dir = html_create_elem("div", NULL);
-	html_add_attr(dir, "class", "dir");
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "dir");
 
 	char *perms_rwx = generate_perms(perms);
-	struct html_elem *attrs_elem = html_add_child(dir, "span", perms_rwx);
-	html_add_attr(attrs_elem, "class", "attrs");
-	res_add(r, perms_rwx);
-
-	struct html_elem *size_elem = html_add_elem(attrs_elem, "span", size);
-	html_add_attr(size_elem, "class", "size");
+	html_stream_open(s, "span");
+	html_stream_attr(s, "class", "attrs");
+	if (perms_rwx)
+		html_stream_text(s, perms_rwx);
+	html_stream_close(s);
+	free(perms_rwx);
+
+	html_stream_open(s, "span");
+	html_stream_attr(s, "class", "size");
+	html_stream_text(s, size_str);
+	html_stream_close(s);
 
 	char *ref_path = generate_ref_path(fname);
-	struct html_elem *location = html_add_elem(size_elem, "a", fname);
-	html_add_attr(location, "class", "hover-underline");
-	html_add_attr(location, "href", ref_path);
-	res_add(r, ref_path);
+	html_stream_open(s, "a");
+	html_stream_attr(s, "class", "hover-underline");
+	if (ref_path)
+		html_stream_attr(s, "href", ref_path);
+	html_stream_text(s, fname);
+	html_stream_close(s);
+	free(ref_path);
 
 	/** @todo modification time? could be cool but would need a git
 	 * invocation per object file, not great */
 
-	if (check_readme(fname))
-		*readme = strdup(object);
+	html_stream_close(s);
 
-	return dir;
+	if (check_readme(fname)) {
+		free(*readme);
+		*readme = strdup(object);
+	}
 }
 
 #undef NEXT_FIELD
 
 /**
- * Generate directory view.
+ * Generate sizes of directory entries.
+ * Only blobs have sizes, everything else is set to \c -1.
  *
- * @param path Directory path (URL) to generate view for.
- * @param readme Pointer to set to git object string if dir contains README.
- * @return dirview element.
+ * @param root Path to repository.
+ * @param listing Tree listing from git_tree().
+ * @param n Number of entries in \p listing.
+ * @param sizes Where to place sizes.
+ * @return \c 0 on success, non-zero otherwise.
  */
-static struct html_elem *generate_dirview(struct html_elem *path, char **readme)
+static int generate_sizes(char *root, char *listing, size_t n, ssize_t sizes[])
 {
-	/** @todo error checking */
-	struct html_elem *dirview = html_add_elem(path, "dir", NULL);
-	html_add_attr(dirview, "class", "border dirview");
+	char (*oids)[GIT_OID_MAX + 1] = calloc(n, sizeof(*oids));
+	char **blobs = calloc(n, sizeof(char *));
+	ssize_t *blob_sizes = calloc(n, sizeof(ssize_t));
+	size_t *idx = calloc(n, sizeof(size_t));
+	if (!oids || !blobs || !blob_sizes || !idx) {
+		free(oids);
+		free(blobs);
+		free(blob_sizes);
+		free(idx);
+		return -1;
+	}
 
-	char *object;
-	if (!(object = git_object()))
-		return NULL;
+	size_t nblobs = 0;
+	char *entry = listing;
+	for (size_t i = 0; i < n; ++i, entry += strlen(entry) + 1) {
+		char type[8];
+		sizes[i] = -1;
+		if (sscanf(entry, "%*s %7s %64s", type, oids[i]) != 2)
+			continue;
+
+		if (strcmp(type, "blob") != 0)
+			continue;
+
+		blobs[nblobs] = oids[i];
+		idx[nblobs++] = i;
+	}
+
+	int ret = git_blob_sizes(root, nblobs, blobs, blob_sizes);
+	for (size_t i = 0; !ret && i < nblobs; ++i)
+		sizes[idx[i]] = blob_sizes[i];
 
+	free(oids);
+	free(blobs);
+	free(blob_sizes);
+	free(idx);
+	return ret;
+}
+
+/**
+ * Generate directory view.
+ * Sizes can be skipped with the \c nosizes URL option, which saves looking
+ * up every blob in huge directories.
+ *
+ * @param s Stream to write to.
+ * @param tree Tree to generate view of.
+ * @param readme Pointer to set to git object string if dir contains README.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int generate_dirview(struct html_stream *s, struct git_obj *tree,
+                            char **readme)
+{
 	char *root;
-	if (!(root = git_real_root())) {
-		free(object);
-		return NULL;
+	if (!(root = git_real_root()))
+		return -1;
+
+	size_t size = 0;
+	char *listing;
+	if (!(listing = git_tree(root, tree->oid, &size))) {
+		free(root);
+		return -1;
 	}
 
-	char **cmds[] =
-	{(char *[]){"git", "-C", root, "ls-tree", "-l", object, 0}};
-	FILE *ls_tree = exgt_chain(1, cmds);
-	free(object);
-	free(root);
+	size_t n = 0;
+	for (size_t i = 0; i < size; ++i)
+		if (listing[i] == 0)
+			n++;
 
-	if (!ls_tree)
-		return NULL;
+	ssize_t *sizes;
+	if (!(sizes = calloc(n ? n : 1, sizeof(ssize_t)))) {
+		free(listing);
+		free(root);
+		return -1;
+	}
 
-	size_t len = 0;
-	ssize_t read = 0;
-	char *line = NULL;
-	struct html_elem *dir = NULL;
-	while ((read = getline(&line, &len, ls_tree)) != -1) {
-		struct html_elem *newdir = generate_dir(line, readme);
+	char *nosizes = url_option("nosizes");
+	if (nosizes || generate_sizes(root, listing, n, sizes))
+		for (size_t i = 0; i < n; ++i)
+			sizes[i] = -1;
 
-		if (dir)
-			html_append_elem(dir, newdir);
-		else
-			html_append_child(dirview, newdir);
+	free(nosizes);
 
-		dir = newdir;
+	html_stream_open(s, "dir");
+	html_stream_attr(s, "class", "border dirview");
+
+	char *entry = listing;
+	for (size_t i = 0; i < n; ++i) {
+		char *next = entry + strlen(entry) + 1;
+		generate_dir(s, root, entry, sizes[i], readme);
+		entry = next;
 	}
 
-	if (line)
-		free(line);
+	html_stream_close(s);
+
+	free(sizes);
+	free(listing);
+	free(root);
+	return 0;
+}
+
+/** Prefix of README heading ids, keeps them apart from ids of the page. */
+#define MARKDOWN_ANCHOR "exgt-"
+
+/**
+ * Generate markdown cache key.
+ * Output only depends on the README blob, the prefix and the renderer, so it
+ * is cached by those and shared between branches and forks.
+ *
+ * @param readme Blob ID of README.
+ * @return Cache key, \c NULL on error.
+ */
+static char *generate_markdown_key(const char *readme)
+{
+	size_t kl = strlen(readme) + sizeof(MARKDOWN_ANCHOR)
+	            + sizeof(MARKDOWN_VERSION) + 2;
 
-	fclose(ls_tree);
+	char *key;
+	if (!(key = malloc(kl)))
+		return NULL;
 
-	return dirview;
+	snprintf(key, kl, "%s\t%s\t%s", readme, MARKDOWN_ANCHOR,
+	         MARKDOWN_VERSION);
+	return key;
 }
 
 /**
- * Generate markdown output.
+ * Read README blob.
  *
- * @param readme Git object string to README.
- * @return Corresponding markdown html output.
+ * @param root Path to repository.
+ * @param readme Blob ID of README.
+ * @param size Where to place size of README.
+ * @return Contents of README, \c NULL on error.
  */
-static char *generate_markdown(char *readme)
+static char *generate_markdown_source(const char *root, const char *readme,
+                                      size_t *size)
 {
-	char *root = git_real_root();
+	if (!root)
+		return NULL;
+
 	char **cmds[] =
-	{(char *[]){"git", "-C", root, "show", readme, 0},
-		/* currently uses my fork of discount, include it as a lib? */
-	 (char *[]){"markdown", "-a", "exgt-",
-		    "-ffencedcode,fencedinline,toc,taganchor", 0}};
-	FILE *markdown = exgt_chain(2, cmds);
-	free(root);
+	{(char *[]){"git", "-C", (char *)root, "cat-file", "blob", (char *)readme,
+		    0}};
+	FILE *cat = exgt_chain(1, cmds);
 
-	if (!markdown)
+	if (!cat)
 		return NULL;
 
+	char *src = read_stream(cat, size);
+	fclose(cat);
+	return src;
+}
 
-	/* arguably not the fastest way, but likely good enough for now */
-	int c;
-	size_t i;
-	size_t buf_size = 64;
-	char *buf = malloc(buf_size);
-	for(i = 0; (c = fgetc(markdown)) != EOF; ++i) {
-		/* -1 to ensure we always have enough space for a trailing 0. */
-		if (i >= buf_size - 1) {
-			buf = realloc(buf, buf_size *= 2);
-			if (!buf) {
-				fclose(markdown);
-				return NULL;
-			}
-		}
+/**
+ * Generate readme view. Nothing is output if directory doesn't contain readme.
+ * README is rendered into memory and the result copied into the page and
+ * cached, later views copy it from the cache.
+ *
+ * @param s Stream to write to.
+ * @param readme Pointer to git object string or \c null if readme doesn't exist.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int generate_readmeview(struct html_stream *s, char *readme)
+{
+	if (!readme)
+		return 0;
+
+	char *key = generate_markdown_key(readme);
 
-		buf[i] = c;
+	size_t size = 0;
+	char *cached = NULL, *src = NULL;
+	if (!(key && (cached = cache_get("markdown", key, &size)))) {
+		char *root = git_real_root();
+		src = generate_markdown_source(root, readme, &size);
+		free(root);
 	}
 
-	/* set trailing 0. */
-	buf[i] = 0;
+	if (!cached && !src) {
+		free(key);
+		return -1;
+	}
+
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "border readmeview");
+
+	struct obuf *out = html_stream_out(s);
+	if (cached) {
+		obuf_write(out, cached, size);
+	} else {
+		/* the page might be flushed halfway through, so render
+		 * into memory first to have all of it for the cache */
+		struct obuf readme;
+		obuf_init(&readme, -1);
+		markdown_write(&readme, src, size, MARKDOWN_ANCHOR);
+
+		size_t rendered;
+		char *buf;
+		if ((buf = obuf_take(&readme, &rendered))) {
+			obuf_write(out, buf, rendered);
+			if (key)
+				cache_put("markdown", key, buf, rendered);
+		}
+
+		free(buf);
+	}
 
-	fclose(markdown);
+	html_stream_close(s);
 
-	return buf;
+	free(cached);
+	free(src);
+	free(key);
+	return 0;
 }
 
 /**
- * Generate readme view. Nothing is output if directory doesn't contain readme.
+ * Render README of prefetched tree into the cache, where the readme view of
+ * the tree will find it.
  *
- * @param dirview Directory view that readme view should follow.
- * @param readme Pointer to git object string or \c null if readme doesn't exist.
- * @return readmeview if readme exists, dirview otherwise.
+ * @param root Path to repository.
+ * @param name Name of blob in tree.
+ * @param oid ID of blob.
  */
-static struct html_elem *generate_readmeview(struct html_elem *dirview,
-                                             char *readme)
+static void prefetch_readme(const char *root, const char *name,
+                            const char *oid)
 {
-	if (!readme)
-		return dirview;
+	if (!check_readme(name))
+		return;
 
-	char *markdown;
-	if (!(markdown = generate_markdown(readme)))
-		return NULL;
+	char *key;
+	if (!(key = generate_markdown_key(oid)))
+		return;
+
+	size_t offset, size;
+	int fd = cache_open("markdown", key, &offset, &size);
+	if (fd >= 0) {
+		close(fd);
+		free(key);
+		return;
+	}
 
-	struct html_elem *readmeview = html_add_elem(dirview, "div", markdown);
-	html_add_attr(readmeview, "class", "border readmeview");
-	res_add(r, markdown);
+	char *src;
+	if (!(src = generate_markdown_source(root, oid, &size))) {
+		free(key);
+		return;
+	}
 
-	return readmeview;
+	struct obuf out;
+	obuf_init(&out, -1);
+	markdown_write(&out, src, size, MARKDOWN_ANCHOR);
+	if (!out.err && out.len)
+		cache_put("markdown", key, out.buf, out.len);
+
+	obuf_free(&out);
+	free(src);
+	free(key);
 }
 
 /**
  * Generate directory main.
  *
- * @param dir_main Main element to add dir content as child to.
- * @return Last element in main.
+ * @param s Stream to write to, with main element open.
+ * @param tree Tree to generate main of.
+ * @return \c 0 on success, non-zero otherwise.
  */
-static struct html_elem *generate_main(struct html_elem *dir_main)
+static int generate_main(struct html_stream *s, struct git_obj *tree)
 {
-	struct html_elem *clone;
-	if (!(clone = pages_generate_clone(r, dir_main)))
-		return NULL;
+	if (pages_generate_clone(s, r))
+		return -1;
 
-	struct html_elem *path;
-	if (!(path = pages_generate_path(r, clone)))
-		return NULL;
+	if (pages_generate_path(s, r))
+		return -1;
 
-	char *readme = NULL;
-	struct html_elem *dirview;
-	if (!(dirview = generate_dirview(path, &readme)))
-		return NULL;
+	/* subdirectories show their READMEs just like this one does */
+	prefetch_blobs(prefetch_readme);
 
-	struct html_elem *readmeview;
-	if (!(readmeview = generate_readmeview(dirview, readme))) {
+	char *readme = NULL;
+	if (generate_dirview(s, tree, &readme)) {
 		free(readme);
-		return NULL;
+		return -1;
 	}
 
+	int ret = generate_readmeview(s, readme);
 	free(readme);
-
-	return readmeview;
+	return ret;
 }
 
-void dir_serve(FILE *file)
+void dir_serve(struct obuf *out, struct git_obj *obj)
 {
 	char *title;
 	if (!(title = git_web_last())) {
-		error_serve(file, 500, "couldn't get current git element\n");
+		error_serve(out, 500, "couldn't get current git element\n");
+		return;
+	}
+
+	if (!(r = res_create())) {
+		free(title);
+		error_serve(out, 500, "couldn't create resource manager\n");
 		return;
 	}
 
-	r = res_create();
 	res_add(r, title);
 
-	http_header(file, 200, "text/html");
+	http_header(out, 200, "text/html");
 
-	struct html_elem *html, *dir_main;
+	struct html_stream s;
 	/** @todo set dir name instead of "dir" as title */
-	if (!(html =
-		      pages_generate_common(r, title,
-		                            &dir_main, NULL))) {
-		error_serve(file, 500, "error serving dir\n");
+	if (pages_generate_common(&s, out, r, title)) {
+		error_serve(out, 500, "error serving dir\n");
 		goto out;
 	}
 
-	if (!generate_main(dir_main)) {
-		error_serve(file, 500, "couldn't generate dir main\n");
+	if (generate_main(&s, obj)) {
+		error_serve(out, 500, "couldn't generate dir main\n");
 		goto out;
 	}
 
-	html_print(file, html);
+	html_stream_end(&s);
 out:
-	html_destroy(html);
 	res_destroy(r);
 }
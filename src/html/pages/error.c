@@ -6,15 +6,13 @@
  * Error page generator.
  */
 
-#include <unistd.h>
-
 #include <html/html.h>
 #include <utils/http.h>
 #include <utils/error.h>
 
 #include "pages.h"
 
-void error_serve(FILE *file, int code, const char *msg)
+void error_serve(struct obuf *out, int code, const char *msg)
 {
 	static int loop = 0;
 	if (loop++) {
@@ -24,14 +22,26 @@ void error_serve(FILE *file, int code, const char *msg)
 
 	error("reporting error: %s\n", msg);
 
-	/* reset cursor and set file length to zero, essentially erase whole file */
-	fseek(file, SEEK_SET, 0);
-	ftruncate(fileno(file), 0);
+	/* erase whatever was written so far. If some of it is already out,
+	 * the page is broken either way and mustn't be cached. */
+	if (obuf_truncate(out)) {
+		error("part of the page was already sent\n");
+		out->err = true;
+	}
+
+	/* whatever caching headers the page had don't apply to the error */
+	http_clear_headers();
 
 	/* for now, just go with absolute minimum effort. */
-	http_header(file, code, "text/html");
-	struct html_elem *err = html_create_elem("p", msg);
-	html_print(file, err);
-	html_destroy(err);
+	http_header(out, code, "text/html");
+
+	struct res *r;
+	struct html_elem *err;
+	if ((r = res_create()) && (err = html_create_elem(r, "p", msg)))
+		html_print(out, err);
+
+	if (r)
+		res_destroy(r);
+
 	loop = 0;
 }
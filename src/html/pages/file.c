@@ -4,260 +4,913 @@
 /**
  * @file file.c
  * Code browser file view generator.
+ *
+ * Files longer than \c EXGT_FILE_WINDOW lines, 1000 by default, are shown one
+ * window of lines at a time. Setting it to \c 0 always shows whole files.
+ *
+ * Before a file is highlighted for the first time, the start of it is checked
+ * for binary data, which is only summarized. Files larger than
+ * \c EXGT_FILE_MAX_SIZE bytes, 16 MiB by default, or with lines longer than
+ * \c EXGT_FILE_MAX_LINE bytes, 8 KiB by default, aren't highlighted either,
+ * only a plain preview of their start is shown. Setting either to \c 0 lifts
+ * the limit. Both link to the raw file, see raw.h.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <utils/git.h>
+#include <utils/url.h>
 #include <utils/chain.h>
 #include <utils/http.h>
+#include <utils/file.h>
+#include <utils/lines.h>
+#include <utils/text.h>
+#include <utils/cache.h>
+#include <utils/config.h>
+
+#include <html/highlight.h>
 
 #include "pages.h"
 
 /** File generator resource manager. */
 static struct res *r;
 
+/** Parts of \ref entry_template, up to the line itself. */
+static const struct iovec entry_parts[] = {
+	TEMPLATE_TEXT("<tr><td class=\"lineno\"><a id=\"l_"),
+	TEMPLATE_SLOT(0),
+	TEMPLATE_TEXT("\" href=\""),
+	TEMPLATE_SLOT(1),
+	TEMPLATE_SLOT(2),
+	TEMPLATE_TEXT("#l_"),
+	TEMPLATE_SLOT(0),
+	TEMPLATE_TEXT("\">"),
+	TEMPLATE_SLOT(0),
+	TEMPLATE_TEXT("</a>\n</td>\n<td>"),
+};
+
+/** Line table entry, with line number. */
+static const struct template entry_template =
+	TEMPLATE(entry_parts, "tr", "td");
+
+/**
+ * Generate one entry into the line table.
+ * Line numbers link to their own line. When only a window of the file is
+ * shown, the link also asks for the window the line is in, so it works
+ * wherever it's followed from.
+ *
+ * @param s Stream to write to.
+ * @param line Line to insert, highlighter output so already html unless
+ * \p plain is set.
+ * @param len Length of \p line.
+ * @param i Line number.
+ * @param plain Whether \p line is plain text, to be escaped.
+ * @param window Query string up to the value of \c lines, see
+ * generate_window_query(), \c NULL if the whole file is shown.
+ */
+static void generate_entry(struct html_stream *s, const char *line,
+                           size_t len, size_t i, bool plain,
+                           const char *window)
+{
+	char lineno[OBUF_UINT_MAX];
+	obuf_format_uint(lineno, i);
+
+	html_stream_template(s, &entry_template,
+	                     (const char *[]){lineno, window,
+	                                      window ? lineno : NULL});
+	if (plain)
+		html_stream_textn(s, line, len);
+	else
+		html_stream_raw(s, line, len);
+
+	/* line and row */
+	html_stream_close(s);
+	html_stream_close(s);
+}
+
 /**
- * Convert \c size_t to string.
- * @todo could be made more general.
+ * Get the line ending of the file or if unknown, pretend file is raw text.
  *
- * @param lineno Where to place the pointer to the generated string.
- * @param i Line number to generate.
- * @return Number of characters in \p lineno.
+ * @param object Path to extract file ending from.
+ * @return File ending or "txt" if unknown.
  */
-static size_t generate_lineno(char **lineno, size_t i)
+static char *generate_syntax(char *object)
 {
-	size_t sz = snprintf(NULL, 0, "%zu", i) + 1;
-	if (!(*lineno = malloc(sz)))
-		return 0;
+	char *prefix;
+	if (!(prefix = strrchr(object, '/')))
+		prefix = strchr(object, ':');
+
+	/* makefiles rarely have a suffix */
+	const char *name = prefix + 1;
+	if (strcmp(name, "Makefile") == 0 || strcmp(name, "makefile") == 0
+	    || strcmp(name, "GNUmakefile") == 0)
+		return strdup("makefile");
+
+	/** @todo figure out what to do with other files without a suffix,
+	 * like README, that aren't just raw text files? */
+	char *suffix;
+	if (!(suffix = strrchr(name, '.')))
+		return strdup("txt");
+
+	/* file is form .name, assume text */
+	if (suffix == name)
+		return strdup("txt");
+
+	return strdup(suffix + 1);
+}
 
-	return snprintf(*lineno, sz, "%zu", i);
+/**
+ * Build key highlighted blobs and their line indexes are cached by.
+ * Output only depends on the blob, the syntax and the highlighter, so the
+ * cached entries are shared between all repositories and commits the blob
+ * appears in.
+ *
+ * @param blob Blob to highlight.
+ * @param syntax Syntax to highlight blob as.
+ * @return Key in new buffer, \c NULL on error.
+ */
+static char *generate_highlight_key(struct git_obj *blob, const char *syntax)
+{
+	char *version = highlight_find(syntax) ? strdup(HIGHLIGHT_VERSION)
+	                : config_tool_version("highlight");
+	size_t kl = strlen(blob->oid) + strlen(syntax)
+	            + (version ? strlen(version) : 0) + 3;
+
+	char *key = malloc(kl);
+	if (key)
+		snprintf(key, kl, "%s\t%s\t%s", blob->oid, syntax,
+		         version ? version : "");
+
+	free(version);
+	return key;
 }
 
 /**
- * Generate id attribute from line number.
+ * Read blob.
  *
- * @param lineno_id Where to place the pointer to the generated string.
- * @param lineno Line number as a string.
- * @param len Length of the line number.
- * @return Line number id as a string.
+ * @param blob Blob to read.
+ * @param limit Most bytes to read, \c SIZE_MAX for all of them.
+ * @param len Where to place number of bytes read.
+ * @return Contents of blob, \c NULL terminated, \c NULL on error.
  */
-static size_t generate_lineno_id(char **lineno_id, char *lineno, size_t len)
+static char *generate_cat(struct git_obj *blob, size_t limit, size_t *len)
 {
-	size_t l = len + 3;
+	char *root = git_real_root();
+	char **cmds[] =
+	{(char *[]){"git", "-C", root, "cat-file", "blob", blob->oid, 0}};
+	FILE *cat = exgt_chain(1, cmds);
+	free(root);
 
-	if (!(*lineno_id = malloc(l)))
-		return 0;
+	if (!cat)
+		return NULL;
+
+	char *buf = NULL;
+	if (limit == SIZE_MAX) {
+		buf = read_stream(cat, len);
+	} else if ((buf = malloc(limit + 1))) {
+		/* rest of blob is left unread, git is done in by SIGPIPE */
+		*len = fread(buf, 1, limit, cat);
+		buf[*len] = 0;
+	}
 
-	/* create "empty" string */
-	*lineno_id[0] = 0;
-	strcat(*lineno_id, "l_");
-	strcat(*lineno_id, lineno);
-	return l;
+	fclose(cat);
+	return buf;
 }
 
 /**
- * Generate href of line number id.
+ * Highlight blob with built-in highlighter.
  *
- * @param lineno_href Where to place the pointer to the generated string.
- * @param lineno_id Line number id.
- * @param len Length of the line number id.
- * @return Href to the line number id.
+ * @param blob Blob to highlight.
+ * @param lang Language to highlight blob as.
+ * @param src Contents of blob, \c NULL to read them.
+ * @param src_size Size of \p src.
+ * @param size Where to place size of highlighted blob.
+ * @return Highlighted blob, \c NULL on error.
  */
-static size_t generate_lineno_href(char **lineno_href, char *lineno_id,
-                                   size_t len)
+static char *generate_builtin(struct git_obj *blob,
+                              const struct highlight_lang *lang,
+                              const char *src, size_t src_size, size_t *size)
 {
-	size_t l = len + 2;
+	char *read = NULL;
+	if (!src && !(src = read = generate_cat(blob, SIZE_MAX, &src_size)))
+		return NULL;
 
-	if (!(*lineno_href = malloc(l)))
-		return 0;
+	struct obuf o;
+	obuf_init(&o, -1);
+	highlight_write(&o, lang, src, src_size);
+	free(read);
 
-	*lineno_href[0] = 0;
-	strcat(*lineno_href, "#");
-	strcat(*lineno_href, lineno_id);
-	return l;
+	/* empty blob, nothing to take but not an error either */
+	if (!o.len && !o.err) {
+		obuf_free(&o);
+		*size = 0;
+		return strdup("");
+	}
+
+	return obuf_take(&o, size);
 }
 
 /**
- * Generate one entry into the line table.
+ * Highlight blob with highlight(1).
  *
- * @param line Line to insert.
- * @param i Line number.
- * @return Table entry element.
+ * @param blob Blob to highlight.
+ * @param syntax Syntax to highlight blob as.
+ * @param size Where to place size of highlighted blob.
+ * @return Highlighted blob, \c NULL on error.
  */
-static struct html_elem *generate_entry(char *line, size_t i)
+static char *generate_external(struct git_obj *blob, const char *syntax,
+                               size_t *size)
 {
-	struct html_elem *tr = html_create_elem("tr", NULL);
+	char *root = git_real_root();
+	char **cmds[] =
+	{(char *[]){"git", "-C", root, "cat-file", "blob", blob->oid, 0},
+	 (char *[]){"highlight", "-S", (char *)syntax, "-O", "html", "-f", 0}};
+	FILE *highlight = exgt_chain(2, cmds);
+	free(root);
 
-	char *lineno, *lineno_id, *lineno_href;
+	if (!highlight)
+		return NULL;
 
-	size_t l_n = generate_lineno(&lineno, i);
-	size_t l_i = generate_lineno_id(&lineno_id, lineno, l_n);
-	generate_lineno_href(&lineno_href, lineno_id, l_i);
+	char *highlighted = read_stream(highlight, size);
+	fclose(highlight);
+	return highlighted;
+}
 
-	res_add(r, lineno);
-	res_add(r, lineno_id);
-	res_add(r, lineno_href);
+/**
+ * Highlight blob.
+ * Text that isn't valid UTF-8, like text in legacy encodings, gets replacement
+ * characters in place of invalid bytes before it's cached, so the page stays
+ * valid UTF-8 whichever highlighter produced it.
+ *
+ * @param blob Blob to highlight.
+ * @param syntax Syntax to highlight blob as.
+ * @param key Cache key from generate_highlight_key(), \c NULL to not cache.
+ * @param src Contents of blob if already read, \c NULL otherwise.
+ * @param src_size Size of \p src.
+ * @param size Where to place size of highlighted blob.
+ * @return Highlighted blob, \c NULL on error.
+ */
+static char *generate_highlight(struct git_obj *blob, const char *syntax,
+                                const char *key, const char *src,
+                                size_t src_size, size_t *size)
+{
+	char *highlighted;
+	*size = 0;
+	if (key && (highlighted = cache_get("highlight", key, size)))
+		return highlighted;
+
+	const struct highlight_lang *lang;
+	if ((lang = highlight_find(syntax)))
+		highlighted = generate_builtin(blob, lang, src, src_size, size);
+	else
+		highlighted = generate_external(blob, syntax, size);
+
+	size_t len;
+	char *fixed;
+	if (highlighted && text_valid(highlighted, *size) < *size
+	    && (fixed = text_replace(highlighted, *size, &len))) {
+		free(highlighted);
+		highlighted = fixed;
+		*size = len;
+	}
 
-	/* line number */
-	struct html_elem *td0 = html_add_child(tr, "td", NULL);
-	html_add_attr(td0, "class", "lineno");
-	struct html_elem *a = html_add_child(td0, "a", lineno);
-	html_add_attr(a, "id", lineno_id);
-	html_add_attr(a, "href", lineno_href);
+	/* empty output most likely means highlight failed, try again later */
+	if (key && highlighted && *size)
+		cache_put("highlight", key, highlighted, *size);
 
-	/* line itself */
-	char *line_dup = strdup(line);
-	html_add_elem(td0, "td", line_dup);
-	res_add(r, line_dup);
+	return highlighted;
+}
+
+/** Line index of highlighted blob. */
+struct file_index {
+	/** Number of lines. */
+	size_t n;
+	/** Offset of each line, followed by size of highlighted blob. */
+	uint64_t *offsets;
+};
+
+/**
+ * Build line index of highlighted blob.
+ *
+ * @param buf Highlighted blob.
+ * @param size Size of \p buf.
+ * @param index Where to place index.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int generate_index(const char *buf, size_t size,
+                          struct file_index *index)
+{
+	if (!(index->offsets = lines_split(buf, size, &index->n)))
+		return -1;
 
-	return tr;
+	return 0;
 }
 
 /**
- * Get the line ending of the file or if unknown, pretend file is raw text.
+ * Highlight blob and index it, caching both.
  *
- * @param object Path to extract file ending from.
- * @return File ending or "txt" if unknown.
+ * @param blob Blob to highlight.
+ * @param syntax Syntax to highlight blob as.
+ * @param key Cache key from generate_highlight_key(), \c NULL to not cache.
+ * @param src Contents of blob if already read, \c NULL otherwise.
+ * @param src_size Size of \p src.
+ * @param highlighted Where to place highlighted blob.
+ * @param size Where to place size of highlighted blob.
+ * @param index Where to place index.
+ * @return \c 0 on success, non-zero otherwise.
  */
-static char *generate_syntax(char *object)
+static int generate_fresh(struct git_obj *blob, const char *syntax,
+                          const char *key, const char *src, size_t src_size,
+                          char **highlighted, size_t *size,
+                          struct file_index *index)
 {
-	/** @todo figure out what to do with files without a suffix, like
-	 * Makefile or README that aren't just raw text files? */
-	char *suffix;
-	if (!(suffix = strrchr(object, '.')))
-		return strdup("txt");
+	if (!(*highlighted = generate_highlight(blob, syntax, key, src, src_size,
+	                                        size)))
+		return -1;
 
-	char *prefix;
-	if (!(prefix = strrchr(object, '/')))
-		prefix = strchr(object, ':') + 1;
+	if (generate_index(*highlighted, *size, index))
+		return -1;
 
-	/* file is form .name, assume text */
-	if (suffix == prefix)
-		return strdup("txt");
+	/* no point in indexing what wasn't cached */
+	if (key && *size)
+		cache_put("lines", key, (char *)index->offsets,
+		          (index->n + 1) * sizeof(*index->offsets));
 
-	return strdup(suffix + 1);
+	return 0;
 }
 
 /**
- * Generate one file, with syntax highlighting and line numbers.
+ * Get cached line index.
  *
- * @param table Parent table element.
- * @return File element.
+ * @param key Cache key from generate_highlight_key().
+ * @param index Where to place index.
+ * @return \c 0 on success, non-zero if there's no usable index.
  */
-static struct html_elem *generate_file(struct html_elem *table)
+static int generate_cached_index(const char *key, struct file_index *index)
+{
+	size_t size;
+	char *buf;
+	if (!(buf = cache_get("lines", key, &size)))
+		return -1;
+
+	if (size < sizeof(uint64_t) || size % sizeof(uint64_t)) {
+		free(buf);
+		return -1;
+	}
+
+	/* cache_get() hands out malloc()'d buffers, so alignment is fine */
+	index->offsets = (uint64_t *)buf;
+	index->n = size / sizeof(uint64_t) - 1;
+	return 0;
+}
+
+/**
+ * Read range of lines of highlighted blob from the cache.
+ * Only the requested range is read, so huge files don't have to be loaded
+ * in full for each window.
+ *
+ * @param key Cache key from generate_highlight_key().
+ * @param start Offset of first byte.
+ * @param end Offset after last byte.
+ * @param range Where to place range, in new buffer.
+ * @return \c 0 on success, negative if the highlighted blob is gone from the
+ * cache or doesn't match the index anymore, positive on other errors.
+ */
+static int generate_cached_range(const char *key, uint64_t start,
+                                 uint64_t end, char **range)
+{
+	if (start > end)
+		return 1;
+
+	size_t offset, size;
+	int fd = cache_open("highlight", key, &offset, &size);
+	if (fd < 0)
+		return -1;
+
+	/* replaced by a highlight the index wasn't made for */
+	int ret = -1;
+	char *buf = NULL;
+	if (end > size)
+		goto out;
+
+	ret = 1;
+	if (!(buf = malloc(end - start + 1)))
+		goto out;
+
+	size_t got = 0;
+	while (got < end - start) {
+		ssize_t r = pread(fd, buf + got, end - start - got,
+		                  offset + start + got);
+		if (r <= 0) {
+			free(buf);
+			buf = NULL;
+			goto out;
+		}
+
+		got += r;
+	}
+
+	buf[got] = 0;
+	*range = buf;
+	ret = 0;
+out:
+	close(fd);
+	return ret;
+}
+
+/** Default number of lines in one window of a file. */
+#define FILE_WINDOW 1000
+
+/** Range of lines being shown. */
+struct file_window {
+	/** First line shown. */
+	size_t first;
+	/** Line after last line shown. */
+	size_t end;
+	/** Number of lines in one window. */
+	size_t size;
+};
+
+/**
+ * Figure out which lines to show.
+ * Small files are shown in full. Larger ones are shown one window at a time,
+ * picked with the \c lines URL option, either as an inclusive range
+ * \c lines=A-B or as \c lines=N for the window containing line \c N. Ranges
+ * are cut to one window, so a page never shows more than a window of lines.
+ *
+ * @param n Number of lines in file.
+ * @param window Where to place range of lines to show.
+ */
+static void generate_window(size_t n, struct file_window *window)
+{
+	size_t size = config_size("EXGT_FILE_WINDOW", FILE_WINDOW);
+	if (!size)
+		size = n ? n : 1;
+
+	*window = (struct file_window){0, n < size ? n : size, size};
+
+	char *lines;
+	if (!(lines = url_option("lines")))
+		return;
+
+	size_t first, last;
+	int form = url_lines(lines, &first, &last);
+	free(lines);
+	if (!form)
+		return;
+
+	/* written so nothing can overflow, first <= last always holds */
+	if (form == 1) {
+		first -= first % size;
+		last = SIZE_MAX - first < size - 1 ? SIZE_MAX
+		       : first + (size - 1);
+	}
+
+	if (last - first >= size)
+		last = first + (size - 1);
+
+	window->first = first < n ? first : n;
+	window->end = last < n ? last + 1 : n;
+}
+
+/**
+ * Generate link to other window of file.
+ *
+ * @param s Stream to write to.
+ * @param text Text of link.
+ * @param first First line of window.
+ * @param end Line after last line of window.
+ */
+static void generate_window_link(struct html_stream *s, const char *text,
+                                 size_t first, size_t end)
+{
+	char *lines, *href;
+	if (!(lines = res_printf(r, "%zu-%zu", first, end - 1))
+	    || !(href = url_with_option("lines", lines)))
+		return;
+
+	res_add(r, href);
+
+	html_stream_open(s, "a");
+	html_stream_attr(s, "class", "hover-underline");
+	html_stream_attr(s, "href", href);
+	html_stream_text(s, text);
+	html_stream_close(s);
+}
+
+/**
+ * Get query string that asks for window of a line, up to the line number.
+ * Line numbers are appended to it, \c lines=N shows the window line \c N is
+ * in.
+ *
+ * @return Query string ending in \c lines=, \c NULL on error.
+ */
+static const char *generate_window_query()
+{
+	char *query, *window;
+	if (!(query = url_with_option("lines", NULL)))
+		return NULL;
+
+	/* query always starts with a '?', anything after it needs a '&' */
+	window = res_printf(r, "%s%slines=", query, query[1] ? "&" : "");
+	free(query);
+	return window;
+}
+
+/**
+ * Generate navigation between windows of file.
+ * Nothing is generated if the whole file is shown.
+ *
+ * @param s Stream to write to.
+ * @param window Lines shown.
+ * @param n Number of lines in file.
+ */
+static void generate_window_nav(struct html_stream *s,
+                                struct file_window *window, size_t n)
+{
+	if (window->first == 0 && window->end == n)
+		return;
+
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "border lines");
+
+	if (window->first) {
+		size_t first = window->first > window->size
+		               ? window->first - window->size : 0;
+		generate_window_link(s, "previous", first, window->first);
+	}
+
+	char *shown = window->end > window->first
+	              ? res_printf(r, "lines %zu-%zu of %zu", window->first,
+	                           window->end - 1, n)
+	              : res_printf(r, "no lines, file has %zu", n);
+	html_stream_elem(s, "span", shown);
+
+	if (window->end < n) {
+		size_t end = window->end + window->size < n
+		             ? window->end + window->size : n;
+		generate_window_link(s, "next", window->end, end);
+	}
+
+	html_stream_close(s);
+}
+
+/** Default size of largest file that's highlighted. */
+#define FILE_MAX_SIZE (16 * 1024 * 1024)
+
+/** Default length of longest line in a file that's highlighted. */
+#define FILE_MAX_LINE (8 * 1024)
+
+/** How much of a file is checked for binary data, and shown in a preview. */
+#define FILE_PREVIEW (64 * 1024)
+
+/** Blob read before deciding how to show it. */
+struct file_blob {
+	/** Contents read, all of them unless the blob is too large. */
+	char *buf;
+	/** Number of bytes in \ref buf. */
+	size_t len;
+	/** Size of whole blob. */
+	size_t size;
+};
+
+/**
+ * Read blob, or only its start if it's too large to be highlighted.
+ * The size usually comes from the cache, as the directory view looked it up
+ * already.
+ *
+ * @param blob Blob to read.
+ * @param max Size of largest blob read in full.
+ * @param b Where to place what was read.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int generate_read(struct git_obj *blob, size_t max,
+                         struct file_blob *b)
 {
-	char *object = git_object();
 	char *root = git_real_root();
-	char *syntax = generate_syntax(object);
-	char **cmds[] =
-	{(char *[]){"git", "-C", root, "show", object, 0},
-	 (char *[]){"highlight", "-S", syntax, "-O", "html", "-f", 0}};
-	FILE *highlight = exgt_chain(2, cmds);
-	free(syntax);
-	free(object);
+	ssize_t size = -1;
+	if (git_blob_sizes(root, 1, (char *[]){blob->oid}, &size))
+		size = -1;
+
 	free(root);
 
-	if (!highlight)
-		return NULL;
+	/* without a size, read until the blob is known to be too large */
+	size_t limit = size < 0 ? max + 1
+	               : (size_t)size <= max ? (size_t)size : FILE_PREVIEW;
 
-	size_t len = 0;
-	ssize_t read = 0;
-	char *line = NULL;
-	struct html_elem *entry = NULL;
-	for (size_t i = 0; (read = getline(&line, &len, highlight)) != -1;
-	     ++i) {
-		struct html_elem *new_entry = generate_entry(line, i);
+	if (!(b->buf = generate_cat(blob, limit, &b->len)))
+		return -1;
 
-		if (entry)
-			html_append_elem(entry, new_entry);
-		else
-			html_append_child(table, new_entry);
+	b->size = size < 0 ? b->len : (size_t)size;
+	return 0;
+}
 
-		entry = new_entry;
+/**
+ * Generate note about file that isn't highlighted, with a link to the raw
+ * file.
+ *
+ * @param s Stream to write to.
+ * @param note Note to show.
+ */
+static void generate_note(struct html_stream *s, const char *note)
+{
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "border lines");
+	html_stream_elem(s, "span", note);
+
+	char *href;
+	if ((href = url_with_option("raw", "1"))) {
+		res_add(r, href);
+
+		html_stream_open(s, "a");
+		html_stream_attr(s, "class", "hover-underline");
+		html_stream_attr(s, "href", href);
+		html_stream_text(s, "raw");
+		html_stream_close(s);
 	}
 
-	if (line)
-		free(line);
+	html_stream_close(s);
+}
 
-	fclose(highlight);
+/**
+ * Generate summary of binary file.
+ *
+ * @param s Stream to write to.
+ * @param b Blob to summarize.
+ */
+static void generate_binary(struct html_stream *s, const struct file_blob *b)
+{
+	generate_note(s, res_printf(r, "binary file, %zu bytes", b->size));
+}
+
+/**
+ * Generate plain preview of file too large to highlight.
+ * Only whole lines from the start of the file are shown, up to one window of
+ * them, and lines are cut short at the line length limit. Invalid UTF-8 is
+ * replaced like in highlighted files.
+ *
+ * @param s Stream to write to.
+ * @param b Blob to preview.
+ * @param chunk Number of bytes of \p b to preview.
+ * @param max_line Length of longest line shown in full, \c 0 for no limit.
+ * @param note Explanation shown above preview.
+ */
+static void generate_preview(struct html_stream *s, const struct file_blob *b,
+                             size_t chunk, size_t max_line, const char *note)
+{
+	/* a line cut off by the chunk is dropped, unless it's the only one */
+	size_t len = chunk;
+	if (chunk < b->size) {
+		while (len && b->buf[len - 1] != '\n')
+			len--;
+
+		if (!len)
+			len = chunk;
+	}
+
+	const char *buf = b->buf;
+	char *fixed = NULL;
+	if (text_valid(buf, len) < len && (fixed = text_replace(buf, len, &len)))
+		buf = fixed;
+
+	size_t lines = config_size("EXGT_FILE_WINDOW", FILE_WINDOW);
+
+	generate_note(s, note);
+
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "border fileview");
+
+	html_stream_open(s, "table");
+	html_stream_attr(s, "class", "file");
 
-	return entry;
+	const char *line = buf, *end = buf + len;
+	for (size_t i = 0; line < end && (!lines || i < lines); ++i) {
+		const char *nl = memchr(line, '\n', end - line);
+		const char *next = nl ? nl + 1 : end;
+
+		size_t shown = next - line;
+		if (max_line && shown > max_line) {
+			/* don't cut a character in half */
+			shown = max_line;
+			while (shown && ((unsigned char)line[shown] & 0xc0) == 0x80)
+				shown--;
+		}
+
+		generate_entry(s, line, shown, i, true, NULL);
+		line = next;
+	}
+
+	html_stream_close(s);
+	html_stream_close(s);
+	free(fixed);
 }
 
 /**
- * Generate fileview.
+ * Check if blob is worth highlighting, and generate what's shown instead if
+ * it isn't.
  *
- * @param path Path element fileview is to be placed after.
- * @return Fileview element.
+ * @param s Stream to write to.
+ * @param b Blob to check.
+ * @param max_size Size of largest file that's highlighted.
+ * @return \c 0 if blob should be highlighted, \c 1 if something else was
+ * generated instead.
  */
-static struct html_elem *generate_fileview(struct html_elem *path)
+static int generate_check(struct html_stream *s, const struct file_blob *b,
+                          size_t max_size)
 {
-	struct html_elem *fileview = html_add_elem(path, "div", NULL);
-	html_add_attr(fileview, "class", "border fileview");
+	size_t chunk = b->len < FILE_PREVIEW ? b->len : FILE_PREVIEW;
 
-	struct html_elem *table = html_add_child(fileview, "table", NULL);
-	html_add_attr(table, "class", "file");
+	struct text_info info;
+	text_check(b->buf, chunk, chunk < b->size, &info);
+	if (info.binary) {
+		generate_binary(s, b);
+		return 1;
+	}
 
-	if (!generate_file(table))
-		return NULL;
+	size_t max_line = config_size("EXGT_FILE_MAX_LINE", FILE_MAX_LINE);
+	if (b->size > max_size) {
+		generate_preview(s, b, chunk, max_line,
+		                 res_printf(r, "file is %zu bytes, too large to "
+		                            "highlight, showing its start",
+		                            b->size));
+		return 1;
+	}
 
-	return fileview;
+	if (max_line && info.longest > max_line) {
+		generate_preview(s, b, chunk, max_line,
+		                 res_printf(r, "file has lines over %zu bytes, "
+		                            "too long to highlight, showing its "
+		                            "start", max_line));
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Generate one file, with syntax highlighting and line numbers.
+ * The first time a file is shown, its highlighted form is indexed by line,
+ * and after that only the lines in the requested window are read.
+ *
+ * @param s Stream to write to.
+ * @param blob Blob to generate.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int generate_file(struct html_stream *s, struct git_obj *blob)
+{
+	char *object = git_object();
+	char *syntax = generate_syntax(object);
+	char *key = generate_highlight_key(blob, syntax);
+	free(object);
+
+	struct file_index index = {0, NULL};
+	char *highlighted = NULL;
+	size_t size = 0;
+	if (!key || generate_cached_index(key, &index)) {
+		/* first view, cached files were checked already */
+		size_t max_size = config_size("EXGT_FILE_MAX_SIZE", FILE_MAX_SIZE);
+		if (!max_size)
+			max_size = SIZE_MAX - 1; /* plus one still fits */
+
+		struct file_blob b;
+		if (generate_read(blob, max_size, &b))
+			goto err;
+
+		int shown = generate_check(s, &b, max_size);
+		int ret = shown ? 0 : generate_fresh(blob, syntax, key, b.buf,
+		                                     b.len, &highlighted, &size,
+		                                     &index);
+		free(b.buf);
+		if (ret)
+			goto err;
+
+		if (shown) {
+			free(syntax);
+			free(key);
+			return 0;
+		}
+	}
+
+	struct file_window window;
+	generate_window(index.n, &window);
+
+	uint64_t first = index.offsets[window.first];
+	char *range = NULL;
+	int cached = highlighted ? 0
+	              : generate_cached_range(key, first,
+	                                      index.offsets[window.end], &range);
+	if (cached > 0)
+		goto err;
+
+	if (cached < 0) {
+		/* evicted from under us, and the new highlight won't necessarily
+		 * match the old index */
+		free(index.offsets);
+		index.offsets = NULL;
+		if (generate_fresh(blob, syntax, key, NULL, 0, &highlighted,
+		                   &size, &index))
+			goto err;
+
+		generate_window(index.n, &window);
+		first = index.offsets[window.first];
+	}
+
+	res_add(r, index.offsets);
+	res_add(r, highlighted);
+	res_add(r, range);
+	free(syntax);
+	free(key);
+
+	/* starts at the first line shown */
+	const char *text = range ? range : highlighted + first;
+
+	generate_window_nav(s, &window, index.n);
+
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "border fileview");
+
+	html_stream_open(s, "table");
+	html_stream_attr(s, "class", "file");
+
+	/* lines are linked with their window only if there are others */
+	const char *query = window.first != 0 || window.end != index.n
+	                    ? generate_window_query() : NULL;
+
+	for (size_t i = window.first; i < window.end; ++i)
+		generate_entry(s, text + (index.offsets[i] - first),
+		               index.offsets[i + 1] - index.offsets[i], i, false,
+		               query);
+
+	html_stream_close(s);
+	html_stream_close(s);
+
+	generate_window_nav(s, &window, index.n);
+	return 0;
+
+err:
+	free(index.offsets);
+	free(highlighted);
+	free(syntax);
+	free(key);
+	return -1;
 }
 
 /**
  * Generate file main content.
  *
- * @param file_main File main element content is to be placed under.
- * @return Last content element, currently the fileview.
+ * @param s Stream to write to, with main element open.
+ * @param blob Blob to generate main of.
+ * @return \c 0 on success, non-zero otherwise.
  */
-static struct html_elem *generate_main(struct html_elem *file_main)
+static int generate_main(struct html_stream *s, struct git_obj *blob)
 {
-	struct html_elem *clone;
-	if (!(clone = pages_generate_clone(r, file_main)))
-		return NULL;
+	if (pages_generate_clone(s, r))
+		return -1;
 
-	struct html_elem *path;
-	if (!(path = pages_generate_path(r, clone)))
-		return NULL;
+	if (pages_generate_path(s, r))
+		return -1;
 
-	struct html_elem *fileview;
-	if (!(fileview = generate_fileview(path)))
-		return NULL;
+	if (generate_file(s, blob))
+		return -1;
 
-	return fileview;
+	return 0;
 }
 
-void file_serve(FILE *file)
+void file_serve(struct obuf *out, struct git_obj *obj)
 {
 	char *title;
 	if (!(title = git_web_last())) {
-		error_serve(file, 500, "couldn't get current git element\n");
+		error_serve(out, 500, "couldn't get current git element\n");
+		return;
+	}
+
+	if (!(r = res_create())) {
+		free(title);
+		error_serve(out, 500, "couldn't create resource manager\n");
 		return;
 	}
 
-	r = res_create();
 	res_add(r, title);
 
-	http_header(file, 200, "text/html");
+	http_header(out, 200, "text/html");
 
-	struct html_elem *html, *file_main;
+	struct html_stream s;
 	/** @todo set file name instead of "file" as title */
-	if (!(html =
-		      pages_generate_common(r, title,
-		                            &file_main, NULL))) {
-		error_serve(file, 500, "error serving file\n");
+	if (pages_generate_common(&s, out, r, title)) {
+		error_serve(out, 500, "error serving file\n");
 		goto out;
 	}
 
-	if (!generate_main(file_main)) {
-		error_serve(file, 500, "couldn't generate file main\n");
+	if (generate_main(&s, obj)) {
+		error_serve(out, 500, "couldn't generate file main\n");
 		goto out;
 	}
 
-	html_print(file, html);
+	html_stream_end(&s);
 out:
-	html_destroy(html);
 	res_destroy(r);
 }
@@ -19,6 +19,8 @@
 #include <utils/path.h>
 #include <utils/git.h>
 #include <utils/res.h>
+#include <utils/config.h>
+#include <utils/watched.h>
 
 #include "pages.h"
 
@@ -29,141 +31,187 @@ static struct res *r;
  * Generate page content, in the context of the index page this means
  * instance header and description.
  *
- * @todo Should \c generate_* only actually generate the content, and adding as
- * a child or whatever be done in the calling function? Might be cleaner, but
- * sightly less compact.
- *
- * @param index_main Main element, which the content will be added to as a child.
- * @return Content element.
+ * @param s Stream to write to, with main element open.
  */
-static struct html_elem *generate_content(struct html_elem *index_main)
+static void generate_content(struct html_stream *s)
 {
-	struct html_elem *content = html_add_child(index_main, "div", NULL);
-	html_add_attr(content, "class", "content text");
-
 	/** @todo use instance text instead of dummy values */
-	struct html_elem *h1 =
-		html_add_child(content, "h1", "Example header\n");
-	html_add_elem(h1, "p", "This is example text.\n");
-
-	return content;
+	html_stream_elem(s, "h1", "Example header\n");
+	html_stream_elem(s, "p", "This is example text.\n");
 }
 
 /**
  * Generate project header, that is name and date as well as href link.
  *
- * @param project Project header is added to as a child.
+ * @param s Stream to write to.
  * @param name Name of project.
  * @param path Path of project.
  * @param date Last update of project.
- * @return Project header element.
  */
-static struct html_elem *generate_project_header(struct html_elem *project,
-                                                 const char *name,
-                                                 const char *path,
-                                                 const char *date)
+static void generate_project_header(struct html_stream *s, const char *name,
+                                    const char *path, const char *date)
 {
-	struct html_elem *project_header = html_add_child(project, "div", NULL);
-	html_add_attr(project_header, "class", "project header");
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "project header");
 
-	struct html_elem *project_title =
-		html_add_child(project_header, "a", name);
-	html_add_attr(project_title, "class", "project title bold");
-	html_add_attr(project_title, "href", path);
+	html_stream_open(s, "a");
+	html_stream_attr(s, "class", "project title bold");
+	html_stream_attr(s, "href", path);
+	html_stream_text(s, name);
+	html_stream_close(s);
 
-	struct html_elem *project_date =
-		html_add_elem(project_title, "time", date);
-	html_add_attr(project_date, "class", "date");
+	html_stream_open(s, "time");
+	html_stream_attr(s, "class", "date");
+	html_stream_text(s, date);
+	html_stream_close(s);
 
-	return project_header;
+	html_stream_close(s);
 }
 
 /**
  * Generate project content, namely project description.
  *
- * @param project_header Project header, after which the content is added.
- * @param description Description of project.
- * @return Project content element.
+ * @param s Stream to write to.
+ * @param description Description of project, \c NULL if there is none.
  */
-static struct html_elem *generate_project_content(
-	struct html_elem *project_header, const char *description)
+static void generate_project_content(struct html_stream *s,
+                                     const char *description)
 {
-	struct html_elem *project_content =
-		html_add_elem(project_header, "div", NULL);
-	html_add_attr(project_content, "class", "project content");
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "project content");
 
-	struct html_elem *project_description =
-		html_add_child(project_content, "p", description);
-	html_add_attr(project_description, "class", "project description");
+	html_stream_open(s, "p");
+	html_stream_attr(s, "class", "project description");
+	if (description)
+		html_stream_text(s, description);
+	html_stream_close(s);
 
-	return project_content;
+	html_stream_close(s);
 }
 
 /**
  * Generate one project entry in project list from known values.
  *
+ * @param s Stream to write to.
  * @param name Name of project.
  * @param path Path of project.
  * @param date Last update of project.
  * @param description Description of project.
- * @return Project element.
  */
-static struct html_elem *generate_known_project(const char *name,
-                                                const char *path,
-                                                const char *date,
-                                                const char *description)
+static void generate_known_project(struct html_stream *s, const char *name,
+                                   const char *path, const char *date,
+                                   const char *description)
+{
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "project border");
+
+	generate_project_header(s, name, path, date);
+	generate_project_content(s, description);
+
+	html_stream_close(s);
+}
+
+/** Default number of seconds project details are cached for, if no watcher is
+ * running. */
+#define PROJECT_TTL 5
+
+/**
+ * Get last update and description of project.
+ * Both only change when the repository does, so they're cached as a watched
+ * entry, see watched.h.
+ *
+ * @param name Name of project.
+ * @param real_path Path to repository.
+ * @param date Where to place last update of project.
+ * @param description Where to place description of project, \c NULL if it
+ * doesn't have one.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int generate_project_info(char *name, char *real_path, char **date,
+                                 char **description)
 {
-	struct html_elem *project = html_create_elem("div", NULL);
-	html_add_attr(project, "class", "project border");
-
-	struct html_elem *project_header;
-	if (!(project_header =
-		      generate_project_header(project, name, path, date))) {
-		fprintf(stderr, "couldn't generate project header\n");
-		return NULL;
+	size_t len = strlen(real_path) + sizeof("project\t");
+	char *key;
+	if (!(key = malloc(len)))
+		return -1;
+
+	snprintf(key, len, "project\t%s", real_path);
+
+	/* stored as date, which ends in a newline, followed by '+' and the
+	 * description or just '-' if there is no description */
+	char *stamp, *cached;
+	if ((cached = watched_get(real_path, key, NULL, &stamp))) {
+		char *nl = strchr(cached, '\n');
+		if (nl && (*date = strndup(cached, nl + 1 - cached))) {
+			*description = nl[1] == '+' ? strdup(nl + 2) : NULL;
+			free(cached);
+			goto out;
+		}
+
+		free(cached);
+	}
+
+	if (!(*date = repo_last_commit(real_path))) {
+		free(stamp);
+		free(key);
+		return -1;
 	}
 
-	if (!generate_project_content(project_header, description)) {
-		fprintf(stderr, "couldn't generate project content\n");
-		return NULL;
+	*description = repo_description(name);
+
+	size_t dl = strlen(*date), sl = *description ? strlen(*description) : 0;
+	char *info;
+	if (strchr(*date, '\n') && (info = malloc(dl + sl + 1))) {
+		memcpy(info, *date, dl);
+		info[dl] = *description ? '+' : '-';
+		if (sl)
+			memcpy(info + dl + 1, *description, sl);
+
+		watched_put(key, stamp, info, dl + 1 + sl,
+		            config_size("EXGT_PROJECT_TTL", PROJECT_TTL));
+		free(info);
 	}
 
-	return project;
+out:
+	free(stamp);
+	free(key);
+	return 0;
 }
 
 /**
  * Generate one project entry in project list with database connection info.
+ * Everything that's allocated is freed before returning, so memory use
+ * doesn't grow with the number of projects.
  *
+ * @param s Stream to write to.
  * @param entry Directory entry to generate project from.
- * @return Corresponding html element.
+ * @return \c 0 on success, non-zero otherwise.
  */
-static struct html_elem *generate_project(struct dirent *entry)
+static int generate_project(struct html_stream *s, struct dirent *entry)
 {
-	char *name = strdup(entry->d_name);
-	res_add(r, name);
-
-	char *description = repo_description(name);
-	res_add(r, description);
+	char *name = entry->d_name;
+	char *ref_path = NULL, *real_path = NULL;
+	char *date = NULL, *description = NULL;
+	int ret = -1;
 
-	char *ref_path = build_web_path(name);
-	if (!ref_path)
-		return NULL;
-
-	res_add(r, ref_path);
-
-	char *real_path = repo_real_file(name);
-	if (!real_path)
-		return NULL;
+	if (!(ref_path = build_web_path(name)))
+		goto out;
 
-	res_add(r, real_path);
+	if (!(real_path = repo_real_file(name)))
+		goto out;
 
-	char *date = repo_last_commit(real_path);
-	if (!date)
-		return NULL;
+	if (generate_project_info(name, real_path, &date, &description))
+		goto out;
 
-	res_add(r, date);
+	generate_known_project(s, name, ref_path, date, description);
+	ret = 0;
 
-	return generate_known_project(name, ref_path, date, description);
+out:
+	free(description);
+	free(date);
+	free(real_path);
+	free(ref_path);
+	return ret;
 }
 
 /**
@@ -173,106 +221,103 @@ static struct html_elem *generate_project(struct dirent *entry)
  * @todo Figure out which projects to choose, just newest or should I choose
  * try to implement some kind of `star` mechanism?
  *
- * @param project_list Project list into which the projects will be inserted.
- * @return Last project inserted.
+ * @param s Stream to write to, with project list element open.
+ * @return \c 0 on success, non-zero otherwise.
  */
-static struct html_elem *generate_projects(struct html_elem *project_list)
+static int generate_projects(struct html_stream *s)
 {
-	struct html_elem *project = NULL;
 	char *root = git_real_root();
 	if (!root)
-		return NULL;
+		return -1;
 
 	res_add(r, root);
 
 	DIR *dir = opendir(root);
 	if (!dir) {
 		fprintf(stderr, "couldn't open exgt root %s\n", root);
-		return NULL;
+		return -1;
 	}
 
+	bool any = false;
 	struct dirent *dirent = NULL;
 	while ((dirent = readdir(dir))) {
 		if (dirent->d_name[0] == '.')
 			continue;
 
-		struct html_elem *new_project = generate_project(dirent);
-		if (!new_project)
-			continue;
-
-		if (project)
-			html_append_elem(project, new_project);
-		else
-			html_append_child(project_list, new_project);
-
-		project = new_project;
+		if (!generate_project(s, dirent))
+			any = true;
 	}
 
-	if (!project) {
-		project = html_add_child(project_list, "p",
-		                         "Sorry, looks like there aren't any projects.");
-		html_add_attr(project, "class", "project");
+	closedir(dir);
+
+	if (!any) {
+		html_stream_open(s, "p");
+		html_stream_attr(s, "class", "project");
+		html_stream_text(s,
+		                 "Sorry, looks like there aren't any projects.");
+		html_stream_close(s);
 	}
 
-	return project;
+	return 0;
 }
 
 /**
  * Generate a list of projects. Something of a wrapper for \ref
  * generate_projects().
  *
- * @param content Content element after which the project list is added.
- * @return Project list element.
+ * @param s Stream to write to.
+ * @return \c 0 on success, non-zero otherwise.
  */
-static struct html_elem *generate_project_list(struct html_elem *content)
+static int generate_project_list(struct html_stream *s)
 {
-	struct html_elem *project_list = html_add_elem(content, "div", NULL);
-	html_add_attr(project_list, "class", "project-list");
-	if (!generate_projects(project_list))
-		return NULL;
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "project-list");
+	if (generate_projects(s))
+		return -1;
 
-	return project_list;
+	html_stream_close(s);
+	return 0;
 }
 
 /**
  * Generate index page main element. Consists of a content element and a project
  * list element.
  *
- * @param index_main Main element, which the main element will be added to as a child.
- * @return Main element.
+ * @param s Stream to write to, with main element open.
+ * @return \c 0 on success, non-zero otherwise.
  */
-static struct html_elem *generate_main(struct html_elem *index_main)
+static int generate_main(struct html_stream *s)
 {
-	struct html_elem *content;
-	if (!(content = generate_content(index_main)))
-		return NULL;
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "content text");
 
-	struct html_elem *project_list;
-	if (!(project_list = generate_project_list(content)))
-		return NULL;
+	generate_content(s);
+	html_stream_close(s);
 
-	return project_list;
+	return generate_project_list(s);
 }
 
-void index_serve(FILE *file)
+void index_serve(struct obuf *out)
 {
-	r = res_create();
+	if (!(r = res_create())) {
+		error_serve(out, 500, "couldn't create resource manager\n");
+		return;
+	}
+
+	http_header(out, 200, "text/html");
 
-	http_header(file, 200, "text/html");
-	struct html_elem *html, *index_main;
-	if (!(html = pages_generate_common(r, "Index\n",
-	                                   &index_main, NULL))) {
-		error_serve(file, 500, "error serving index\n");
+	struct html_stream s;
+	if (pages_generate_common(&s, out, r, "Index\n")) {
+		error_serve(out, 500, "error serving index\n");
 		goto out;
 	}
 
-	if (!generate_main(index_main)) {
-		error_serve(file, 500, "couldn't generate index main\n");
+	if (generate_main(&s)) {
+		error_serve(out, 500, "couldn't generate index main\n");
 		goto out;
 	}
 
-	html_print(file, html);
+	html_stream_end(&s);
 out:
-	html_destroy(html);
 	res_destroy(r);
 }
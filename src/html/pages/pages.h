@@ -12,36 +12,47 @@
 #include <stdio.h>
 #include <html/html.h>
 #include <utils/res.h>
+#include <utils/git.h>
+#include <utils/obuf.h>
 
 /**
  * Serve error page.
  *
- * @param file Output file to write to.
+ * @param out Output buffer to write to.
  * @param code Status code.
  * @param msg Error message.
  */
-void error_serve(FILE *file, int code, const char *msg);
+void error_serve(struct obuf *out, int code, const char *msg);
 
 /**
  * Serve landing page.
  *
- * @param file Output file to write to.
+ * @param out Output buffer to write to.
  */
-void index_serve(FILE *file);
+void index_serve(struct obuf *out);
 
 /**
  * Serve one file page.
  *
- * @param file Output file to write to.
+ * @param out Output buffer to write to.
+ * @param obj Blob to serve.
  */
-void file_serve(FILE *file);
+void file_serve(struct obuf *out, struct git_obj *obj);
 
 /**
  * Serve one directory page.
  *
- * @param file Output file to write to.
+ * @param out Output buffer to write to.
+ * @param obj Tree to serve.
  */
-void dir_serve(FILE *file);
+void dir_serve(struct obuf *out, struct git_obj *obj);
+
+/**
+ * Serve status page.
+ *
+ * @param out Output buffer to write to.
+ */
+void status_serve(struct obuf *out);
 
 /* Not entirely sure which features I want to implement, but here are a few
  * possibilities
@@ -57,69 +68,48 @@ void dir_serve(FILE *file);
 
 /* Common functions to all pages */
 
-/**
- * Generate page header.
- *
- * @param r Resource manager.
- * @param html Root html tag.
- * @param page_title Title of page.
- * @return Pointer to head tag element.
- */
-struct html_elem *pages_generate_head(struct res* r,
-                                      struct html_elem *html,
-                                      const char *page_title);
-
-/**
- * Generate page header.
- *
- * @param r Resource manager.
- * @param body Body tag.
- * @param cont If not \c NULL, last element node into this address.
- * Allows use to continue appending elements to header from some higher level
- * function.
- * @return Pointer to header tag element.
- */
-struct html_elem *pages_generate_header(struct res *r,
-                                        struct html_elem *body,
-                                        struct html_elem **cont);
-
 /**
  * Generate common elements of all pages.
+ * Writes out the doctype, head and page header from a template, and leaves
+ * the \c main element open for the page content. html_stream_end() closes it
+ * and everything around it.
  *
+ * @param s Stream to start.
+ * @param out Output buffer to write to.
  * @param r Resource manager.
  * @param title Title of page.
- * @param page_main Pointer where to place main element.
- * @param page_header Pointer where to place header element.
- * @return \c html element.
+ * @return \c 0 on success, non-zero otherwise.
  */
-struct html_elem *pages_generate_common(struct res *r, const char *title,
-                                        struct html_elem **page_main,
-                                        struct html_elem **page_header);
+int pages_generate_common(struct html_stream *s, struct obuf *out, struct res *r,
+                          const char *title);
 
 /**
  * Generate clone for page.
+ * Written from a template.
  *
+ * @param s Stream to write to.
  * @param r Resource manager.
- * @param page_main Parent main element.
- * @return Clone element.
+ * @return \c 0 on success, non-zero otherwise.
  */
-struct html_elem *pages_generate_clone(struct res *r,
-                                       struct html_elem *page_main);
+int pages_generate_clone(struct html_stream *s, struct res *r);
 
 /**
  * Generate path for page.
  *
+ * @param s Stream to write to.
  * @param r Resource manager.
- * @param clone Previous clone element.
- * @return Path element.
+ * @return \c 0 on success, non-zero otherwise.
  */
-struct html_elem *pages_generate_path(struct res *r, struct html_elem *clone);
+int pages_generate_path(struct html_stream *s, struct res *r);
+
+/** Doctype of html pages. */
+#define PAGES_DOCTYPE "<!DOCTYPE html>\n"
 
 /**
  * Generate doctype for html page.
  *
- * @param file File to ouput doctype to.
+ * @param out Output buffer to write doctype to.
  */
-void pages_generate_doctype(FILE *file);
+void pages_generate_doctype(struct obuf *out);
 
 #endif /* EXGT_PAGES_H */
@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file status.c
+ * Status page generator.
+ * Shows what the background modes have been up to.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <maint/maint.h>
+#include <utils/http.h>
+#include <utils/res.h>
+#include <utils/stats.h>
+#include <utils/shm.h>
+
+#include "pages.h"
+
+/** Status generator resource manager. */
+static struct res *r;
+
+/**
+ * Format number as string.
+ *
+ * @param n Number to format.
+ * @return \p n as string, managed by \ref r.
+ */
+static char *generate_number(size_t n)
+{
+	return res_printf(r, "%zu", n);
+}
+
+/**
+ * Format time as string.
+ *
+ * @param t Time to format.
+ * @return \p t as string, managed by \ref r.
+ */
+static char *generate_time(time_t t)
+{
+	if (!t)
+		return "never";
+
+	char *str;
+	if (!(str = res_alloc(r, 32)))
+		return NULL;
+
+	struct tm tm;
+	strftime(str, 32, "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+	return str;
+}
+
+/**
+ * Generate one table row.
+ *
+ * @param s Stream to write to, with table element open.
+ * @param cell Tag of cells, \c "td" or \c "th".
+ * @param values Values of cells, \c NULL terminated.
+ */
+static void generate_row(struct html_stream *s, const char *cell,
+                         const char *values[])
+{
+	html_stream_open(s, "tr");
+	for (; *values; ++values)
+		html_stream_elem(s, cell, *values);
+
+	html_stream_close(s);
+}
+
+/**
+ * Open status table.
+ *
+ * @param s Stream to write to.
+ */
+static void generate_table(struct html_stream *s)
+{
+	html_stream_open(s, "div");
+	html_stream_attr(s, "class", "border statusview");
+
+	html_stream_open(s, "table");
+	html_stream_attr(s, "class", "status");
+}
+
+/**
+ * Generate repository layout table.
+ *
+ * @param s Stream to write to, with main element open.
+ */
+static void generate_repos(struct html_stream *s)
+{
+	generate_table(s);
+	generate_row(s, "th", (const char *[]){
+		"repository", "loose objects", "packs", "commit-graph",
+		"multi-pack-index", "bitmaps", "checked", "maintained", 0
+	});
+
+	struct maint_repo *repos;
+	size_t n;
+	if (maint_load(&repos, &n)) {
+		html_stream_close(s);
+		html_stream_elem(s, "p", "Maintenance hasn't run yet.");
+		html_stream_close(s);
+		return;
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		struct maint_repo *repo = &repos[i];
+		generate_row(s, "td", (const char *[]){
+			repo->name,
+			generate_number(repo->loose),
+			generate_number(repo->packs),
+			repo->graph ? "yes" : "no",
+			repo->midx ? "yes" : "no",
+			repo->bitmap ? "yes" : "no",
+			generate_time(repo->checked),
+			generate_time(repo->maintained), 0
+		});
+	}
+
+	maint_free(repos, n);
+
+	/* table and view */
+	html_stream_close(s);
+	html_stream_close(s);
+}
+
+/**
+ * Format ratio as percentage.
+ *
+ * @param part Numerator.
+ * @param whole Denominator.
+ * @return Percentage as string, managed by \ref r.
+ */
+static char *generate_percentage(long long part, long long whole)
+{
+	if (!whole)
+		return "-";
+
+	return res_printf(r, "%.1f%%", 100.0 * part / whole);
+}
+
+/**
+ * Generate counter table.
+ *
+ * @param s Stream to write to, with main element open.
+ */
+static void generate_stats(struct html_stream *s)
+{
+	generate_table(s);
+	generate_row(s, "th", (const char *[]){"counter", "value", 0});
+
+	generate_row(s, "td", (const char *[]){
+		"prefetch hit rate",
+		generate_percentage(stats_get("prefetch_hits"),
+		                    stats_get("prefetch_issued")), 0
+	});
+
+	generate_row(s, "td", (const char *[]){
+		"compressed size",
+		generate_percentage(stats_get("compress_out"),
+		                    stats_get("compress_in")), 0
+	});
+
+	struct shm_stats shm;
+	if (!shm_stats(&shm)) {
+		generate_row(s, "td", (const char *[]){
+			"shared memory occupancy",
+			generate_percentage(shm.used, shm.slots), 0
+		});
+		generate_row(s, "td", (const char *[]){
+			"shared memory hit rate",
+			generate_percentage(shm.hits, shm.hits + shm.misses), 0
+		});
+		generate_row(s, "td", (const char *[]){
+			"shared memory hits", generate_number(shm.hits), 0
+		});
+		generate_row(s, "td", (const char *[]){
+			"shared memory misses", generate_number(shm.misses), 0
+		});
+		generate_row(s, "td", (const char *[]){
+			"shared memory evictions",
+			generate_number(shm.evictions), 0
+		});
+	}
+
+	struct stats_entry *entries;
+	size_t n;
+	if (stats_load(&entries, &n))
+		goto out;
+
+	for (size_t i = 0; i < n; ++i)
+		generate_row(s, "td", (const char *[]){
+			entries[i].name, generate_number(entries[i].value), 0
+		});
+
+	free(entries);
+out:
+	html_stream_close(s);
+	html_stream_close(s);
+}
+
+void status_serve(struct obuf *out)
+{
+	if (!(r = res_create())) {
+		error_serve(out, 500, "couldn't create resource manager\n");
+		return;
+	}
+
+	http_header(out, 200, "text/html");
+
+	struct html_stream s;
+	if (pages_generate_common(&s, out, r, "Status")) {
+		error_serve(out, 500, "error serving status\n");
+		goto out;
+	}
+
+	generate_repos(&s);
+	generate_stats(&s);
+	html_stream_end(&s);
+out:
+	res_destroy(r);
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file template.c
+ * Precompiled page template implementation.
+ */
+
+#include <string.h>
+
+#include "escape.h"
+#include "template.h"
+
+void template_write(struct obuf *o, const struct template *t,
+                    const char *values[])
+{
+	for (size_t i = 0; i < t->n; ++i) {
+		const struct iovec *part = &t->parts[i];
+		if (part->iov_base) {
+			obuf_write(o, part->iov_base, part->iov_len);
+			continue;
+		}
+
+		/* missing values leave the slot empty */
+		const char *value = values[part->iov_len];
+		if (value)
+			escape_write(o, value, strlen(value));
+	}
+}
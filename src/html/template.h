@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file template.h
+ * Precompiled page template header.
+ *
+ * Large parts of every page are the same byte for byte on every request, so
+ * instead of being generated element by element they're written out as
+ * templates. A template is a constant array of parts, each either static text
+ * whose length is known at build time or a slot for a value that's only known
+ * at run time. Static parts are written out as is, values are escaped, see
+ * escape.h.
+ *
+ * Parts are copied into the output buffer rather than handed to writev(), as
+ * pages are compressed and cached on their way out, see obuf.h.
+ *
+ * @code
+ *	static const struct iovec parts[] = {
+ *		TEMPLATE_TEXT("<title>"),
+ *		TEMPLATE_SLOT(0),
+ *		TEMPLATE_TEXT("</title>\n"),
+ *	};
+ *	static const struct template title = TEMPLATE(parts);
+ *
+ *	struct obuf o;
+ *	obuf_init(&o, -1);
+ *	template_write(&o, &title, (const char *[]){"exgt"});
+ * @endcode
+ */
+
+#ifndef EXGT_TEMPLATE_H
+#define EXGT_TEMPLATE_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include <utils/obuf.h>
+
+/**
+ * Static text part of a template.
+ *
+ * @param s String literal.
+ */
+#define TEMPLATE_TEXT(s) {(void *)(s), sizeof(s) - 1}
+
+/**
+ * Slot part of a template.
+ *
+ * @param i Index of value to fill slot with.
+ */
+#define TEMPLATE_SLOT(i) {NULL, (i)}
+
+/**
+ * Define template from array of parts.
+ *
+ * @param parts Array of \c iovec parts.
+ * @param ... Tags of elements template leaves open, outermost first.
+ */
+#define TEMPLATE(parts, ...)                                \
+	{parts, sizeof(parts) / sizeof((parts)[0]),         \
+	 (const char *const[]){__VA_ARGS__ __VA_OPT__(,) 0}}
+
+/** Precompiled template. */
+struct template {
+	/** Parts, static text has a base, slots have index as length. */
+	const struct iovec *parts;
+	/** Number of parts. */
+	size_t n;
+	/** Tags of elements left open by template, \c NULL terminated. */
+	const char *const *open;
+};
+
+/**
+ * Write out template.
+ *
+ * @param o Output buffer to write to.
+ * @param t Template to write.
+ * @param values Values of slots.
+ */
+void template_write(struct obuf *o, const struct template *t,
+                    const char *values[]);
+
+#endif /* EXGT_TEMPLATE_H */
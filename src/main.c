@@ -7,10 +7,31 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "css/css.h"
+#include "raw/raw.h"
 #include "html/html.h"
+#include "maint/maint.h"
+#include "warm/warm.h"
+#include "watch/watch.h"
 #include "utils/http.h"
+#include "utils/error.h"
+
+/**
+ * Serve bare status, without content.
+ *
+ * @param code Status code.
+ */
+static void serve_status(int code)
+{
+	struct obuf out;
+	obuf_init(&out, STDOUT_FILENO);
+	http_status(&out, code);
+	obuf_flush(&out);
+	obuf_free(&out);
+}
 
 /**
  * Serve one document.
@@ -28,18 +49,41 @@ static void serve()
 		css_serve();
 		break;
 
+	case RAW:
+		raw_serve();
+		break;
+
 	default:
-		http_status(stdout, 406);
+		serve_status(406);
 		break;
 	}
 }
 
 /**
  * Main entry point.
+ * Without arguments, serve one CGI request. Otherwise run one of the
+ * background modes.
  *
- * @return \c 0
+ * @param argc Number of arguments.
+ * @param argv Arguments.
+ * @return \c 0 on success, non-zero otherwise.
  */
-int main()
+int main(int argc, char *argv[])
 {
-	serve();
+	if (argc < 2) {
+		serve();
+		return 0;
+	}
+
+	if (strcmp(argv[1], "maintain") == 0)
+		return maint_main(argc - 1, argv + 1);
+
+	if (strcmp(argv[1], "warm") == 0)
+		return warm_main(argc - 1, argv + 1);
+
+	if (strcmp(argv[1], "watch") == 0)
+		return watch_main(argc - 1, argv + 1);
+
+	error("unknown mode %s\n", argv[1]);
+	return 1;
 }
@@ -0,0 +1,464 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file maint.c
+ * Repository maintenance daemon implementation.
+ *
+ * Layouts are recorded in the \c maintenance file in the cache root, one
+ * repository per line, so the status page can show them without touching any
+ * repository itself. Counters kept in shared memory are flushed to the stats
+ * file along the way, see stats.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <utils/error.h>
+#include <utils/chain.h>
+#include <utils/cache.h>
+#include <utils/config.h>
+#include <utils/path.h>
+#include <utils/stats.h>
+
+#include "maint.h"
+
+/** Loose objects before an incremental repack is scheduled. */
+#define MAINT_LOOSE_LIMIT 100
+
+/** Packs before an incremental repack is scheduled. */
+#define MAINT_PACK_LIMIT 8
+
+/**
+ * Check if \p path exists.
+ *
+ * @param path Path to check.
+ * @return \c true if \p path exists, \c false otherwise.
+ */
+static bool maint_exists(const char *path)
+{
+	struct stat st;
+	return stat(path, &st) == 0;
+}
+
+/**
+ * Check if \p root/name exists.
+ *
+ * @param root Directory to look in.
+ * @param name Name of file relative to \p root.
+ * @return \c true if file exists, \c false otherwise.
+ */
+static bool maint_has(const char *root, const char *name)
+{
+	char *path;
+	if (!(path = build_path(root, name)))
+		return false;
+
+	bool ret = maint_exists(path);
+	free(path);
+	return ret;
+}
+
+/**
+ * Count loose objects.
+ *
+ * @param objects Object directory of repository.
+ * @return Number of loose objects.
+ */
+static size_t maint_count_loose(const char *objects)
+{
+	size_t loose = 0;
+	char fanout[3] = {0};
+	for (int i = 0; i < 256; ++i) {
+		snprintf(fanout, sizeof(fanout), "%02x", i);
+
+		char *path;
+		if (!(path = build_path(objects, fanout)))
+			continue;
+
+		DIR *dir = opendir(path);
+		free(path);
+		if (!dir)
+			continue;
+
+		struct dirent *dirent;
+		while ((dirent = readdir(dir)))
+			if (dirent->d_name[0] != '.')
+				loose++;
+
+		closedir(dir);
+	}
+
+	return loose;
+}
+
+/**
+ * Inspect pack directory.
+ *
+ * @param objects Object directory of repository.
+ * @param repo Repository to record findings in.
+ */
+static void maint_inspect_packs(const char *objects, struct maint_repo *repo)
+{
+	char *pack;
+	if (!(pack = build_path(objects, "pack")))
+		return;
+
+	repo->midx = maint_has(pack, "multi-pack-index");
+
+	DIR *dir = opendir(pack);
+	free(pack);
+	if (!dir)
+		return;
+
+	struct dirent *dirent;
+	while ((dirent = readdir(dir))) {
+		char *suffix;
+		if (!(suffix = strrchr(dirent->d_name, '.')))
+			continue;
+
+		if (strcmp(suffix, ".pack") == 0)
+			repo->packs++;
+
+		/* covers both pack and multi-pack-index bitmaps */
+		if (strcmp(suffix, ".bitmap") == 0)
+			repo->bitmap = true;
+	}
+
+	closedir(dir);
+}
+
+/**
+ * Record layout of repository.
+ *
+ * @param gitdir Git directory of repository.
+ * @param repo Repository to record layout in.
+ */
+static void maint_inspect(const char *gitdir, struct maint_repo *repo)
+{
+	repo->loose = repo->packs = 0;
+	repo->graph = repo->midx = repo->bitmap = false;
+	repo->checked = time(NULL);
+
+	char *objects;
+	if (!(objects = build_path(gitdir, "objects")))
+		return;
+
+	repo->loose = maint_count_loose(objects);
+	repo->graph = maint_has(objects, "info/commit-graph")
+	              || maint_has(objects,
+	                           "info/commit-graphs/commit-graph-chain");
+
+	maint_inspect_packs(objects, repo);
+	free(objects);
+}
+
+/**
+ * Run one git command in repository and wait for it to finish.
+ *
+ * @param gitdir Git directory of repository.
+ * @param args Arguments to git, \c NULL terminated.
+ */
+static void maint_git(const char *gitdir, char *args[])
+{
+	char *cmd[16] = {"git", "--git-dir", (char *)gitdir};
+	size_t n = 3;
+	for (; *args && n < 15; ++args)
+		cmd[n++] = *args;
+
+	cmd[n] = NULL;
+
+	char **cmds[] = {cmd};
+	FILE *out = exgt_chain(1, cmds);
+	if (!out)
+		return;
+
+	char buf[4096];
+	while (fread(buf, 1, sizeof(buf), out))
+		;
+
+	fclose(out);
+
+	/* exgt_chain() doesn't wait for its children, so reap them here */
+	while (waitpid(-1, NULL, 0) > 0)
+		;
+}
+
+/**
+ * Bring repository layout up to date, if needed.
+ *
+ * @param gitdir Git directory of repository.
+ * @param repo Repository to maintain.
+ */
+static void maint_repo(const char *gitdir, struct maint_repo *repo)
+{
+	maint_inspect(gitdir, repo);
+
+	/* empty repository, nothing to do */
+	if (!repo->loose && !repo->packs)
+		return;
+
+	bool repacked = false;
+	if (repo->loose >= MAINT_LOOSE_LIMIT
+	    || repo->packs >= MAINT_PACK_LIMIT) {
+		/* incremental, only rolls up loose objects and small packs */
+		maint_git(gitdir, (char *[]){"repack", "-d", "-l", "-q",
+		                             "--geometric=2", 0});
+		maint_inspect(gitdir, repo);
+		repacked = true;
+	}
+
+	bool graph = !repo->graph || repacked;
+	if (graph)
+		maint_git(gitdir, (char *[]){"commit-graph", "write",
+		                             "--reachable", "--split",
+		                             "--no-progress", 0});
+
+	bool midx = repo->packs && (!repo->midx || !repo->bitmap || repacked);
+	if (midx)
+		maint_git(gitdir, (char *[]){"multi-pack-index", "write",
+		                             "--bitmap", "--no-progress", 0});
+
+	maint_inspect(gitdir, repo);
+	if (repacked || graph || midx)
+		repo->maintained = time(NULL);
+}
+
+int maint_load(struct maint_repo **repos, size_t *n)
+{
+	*repos = NULL;
+	*n = 0;
+
+	char *path;
+	if (!(path = cache_file("maintenance")))
+		return -1;
+
+	FILE *f = fopen(path, "r");
+	free(path);
+	if (!f)
+		return -1;
+
+	size_t max = 0;
+	size_t len = 0;
+	char *line = NULL;
+	while (getline(&line, &len, f) != -1) {
+		if (*n >= max) {
+			max = max ? max * 2 : 16;
+			struct maint_repo *new = realloc(*repos,
+			                                 max * sizeof(*new));
+			if (!new)
+				break;
+
+			*repos = new;
+		}
+
+		struct maint_repo repo = {0};
+		char name[256];
+		int graph, midx, bitmap;
+		long long checked, maintained;
+		if (sscanf(line, "%255[^\t]\t%zu\t%zu\t%d\t%d\t%d\t%lld\t%lld",
+		           name, &repo.loose, &repo.packs, &graph, &midx,
+		           &bitmap, &checked, &maintained) != 8)
+			continue;
+
+		if (!(repo.name = strdup(name)))
+			break;
+
+		repo.graph = graph;
+		repo.midx = midx;
+		repo.bitmap = bitmap;
+		repo.checked = checked;
+		repo.maintained = maintained;
+		(*repos)[(*n)++] = repo;
+	}
+
+	free(line);
+	fclose(f);
+	return 0;
+}
+
+void maint_free(struct maint_repo *repos, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		free(repos[i].name);
+
+	free(repos);
+}
+
+/**
+ * Write repository layouts for the status page.
+ *
+ * @param repos Repositories to write.
+ * @param n Number of repositories.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int maint_store(struct maint_repo *repos, size_t n)
+{
+	char *path, *tmp;
+	if (!(path = cache_file("maintenance")))
+		return -1;
+
+	if (!(tmp = cache_file("maintenance.tmp"))) {
+		free(path);
+		return -1;
+	}
+
+	int ret = -1;
+	FILE *f = fopen(tmp, "w");
+	if (!f)
+		goto out;
+
+	for (size_t i = 0; i < n; ++i)
+		fprintf(f, "%s\t%zu\t%zu\t%d\t%d\t%d\t%lld\t%lld\n",
+		        repos[i].name, repos[i].loose, repos[i].packs,
+		        repos[i].graph, repos[i].midx, repos[i].bitmap,
+		        (long long)repos[i].checked,
+		        (long long)repos[i].maintained);
+
+	if (fclose(f) == 0 && rename(tmp, path) == 0)
+		ret = 0;
+
+out:
+	free(path);
+	free(tmp);
+	return ret;
+}
+
+/**
+ * Find when repository was last maintained in previous pass.
+ *
+ * @param repos Repositories from previous pass.
+ * @param n Number of repositories.
+ * @param name Name of repository to look for.
+ * @return Time of last maintenance, \c 0 if never.
+ */
+static time_t maint_last(struct maint_repo *repos, size_t n, const char *name)
+{
+	for (size_t i = 0; i < n; ++i)
+		if (strcmp(repos[i].name, name) == 0)
+			return repos[i].maintained;
+
+	return 0;
+}
+
+/**
+ * Get git directory of repository, bare or not.
+ *
+ * @param repo Path to repository.
+ * @return Git directory in new buffer.
+ */
+static char *maint_gitdir(const char *repo)
+{
+	char *dotgit;
+	if (!(dotgit = build_path(repo, ".git")))
+		return NULL;
+
+	if (maint_exists(dotgit))
+		return dotgit;
+
+	free(dotgit);
+	return strdup(repo);
+}
+
+/**
+ * Do one maintenance pass over all repositories.
+ *
+ * @param root Project root.
+ * @param pause Seconds to sleep between repositories.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int maint_pass(const char *root, unsigned pause)
+{
+	struct maint_repo *prev, *repos = NULL;
+	size_t nprev, n = 0, max = 0;
+	maint_load(&prev, &nprev);
+
+	DIR *dir = opendir(root);
+	if (!dir) {
+		error("couldn't open exgt root %s\n", root);
+		maint_free(prev, nprev);
+		return -1;
+	}
+
+	struct dirent *dirent;
+	while ((dirent = readdir(dir))) {
+		if (dirent->d_name[0] == '.')
+			continue;
+
+		if (n >= max) {
+			max = max ? max * 2 : 16;
+			struct maint_repo *new = realloc(repos,
+			                                 max * sizeof(*new));
+			if (!new)
+				break;
+
+			repos = new;
+		}
+
+		char *path = build_path(root, dirent->d_name);
+		char *gitdir = path ? maint_gitdir(path) : NULL;
+		free(path);
+		if (!gitdir)
+			continue;
+
+		struct maint_repo *repo = &repos[n++];
+		*repo = (struct maint_repo){0};
+		repo->name = strdup(dirent->d_name);
+		repo->maintained = maint_last(prev, nprev, dirent->d_name);
+
+		maint_repo(gitdir, repo);
+		free(gitdir);
+
+		/* keep status page reasonably fresh during long passes, and
+		 * counters safe from the shared memory segment going away */
+		maint_store(repos, n);
+		stats_flush();
+		sleep(pause);
+	}
+
+	closedir(dir);
+	maint_store(repos, n);
+	stats_flush();
+	maint_free(repos, n);
+	maint_free(prev, nprev);
+	return 0;
+}
+
+int maint_main(int argc, char *argv[])
+{
+	bool once = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--once") == 0)
+			once = true;
+		else {
+			error("usage: exgt maintain [--once]\n");
+			return 1;
+		}
+	}
+
+	char *root;
+	if (!(root = getenv("GIT_PROJECT_ROOT"))) {
+		error("couldn't find GIT_PROJECT_ROOT\n");
+		return 1;
+	}
+
+	/* browsing takes priority */
+	exgt_lower_priority();
+
+	unsigned interval = config_size("EXGT_MAINT_INTERVAL", 3600);
+	unsigned pause = config_size("EXGT_MAINT_PAUSE", 1);
+	do {
+		if (maint_pass(root, pause))
+			return 1;
+
+		if (!once)
+			sleep(interval);
+	} while (!once);
+
+	return 0;
+}
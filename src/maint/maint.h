@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file maint.h
+ * Repository maintenance daemon header.
+ */
+
+#ifndef EXGT_MAINT_H
+#define EXGT_MAINT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+/** Layout of one repository, as far as browsing speed is concerned. */
+struct maint_repo {
+	/** Name of repository, relative to \c GIT_PROJECT_ROOT. */
+	char *name;
+	/** Number of loose objects. */
+	size_t loose;
+	/** Number of packs. */
+	size_t packs;
+	/** Whether repository has a commit-graph. */
+	bool graph;
+	/** Whether repository has a multi-pack-index. */
+	bool midx;
+	/** Whether repository has reachability bitmaps. */
+	bool bitmap;
+	/** Last time layout was checked, \c 0 if never. */
+	time_t checked;
+	/** Last time repository was maintained, \c 0 if never. */
+	time_t maintained;
+};
+
+/**
+ * Load repository layouts as last recorded by the maintenance daemon.
+ *
+ * @param repos Where to place array of repositories. Free with maint_free().
+ * @param n Where to place number of repositories.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int maint_load(struct maint_repo **repos, size_t *n);
+
+/**
+ * Free repositories loaded with maint_load().
+ *
+ * @param repos Repositories to free.
+ * @param n Number of repositories.
+ */
+void maint_free(struct maint_repo *repos, size_t n);
+
+/**
+ * Maintenance daemon entry point.
+ *
+ * Walks \c GIT_PROJECT_ROOT, records the layout of each repository and
+ * schedules incremental repacks, commit-graph and multi-pack-index writes
+ * where they are missing or out of date. Runs at the lowest CPU and I/O
+ * priority.
+ *
+ * @code
+ *	exgt maintain [--once]
+ * @endcode
+ *
+ * @param argc Number of arguments, including \c "maintain".
+ * @param argv Arguments.
+ * @return Exit status.
+ */
+int maint_main(int argc, char *argv[]);
+
+#endif /* EXGT_MAINT_H */
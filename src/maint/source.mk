@@ -0,0 +1,2 @@
+MAINT_LOCAL != echo src/maint/*.c
+SOURCES += $(MAINT_LOCAL)
@@ -0,0 +1,288 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file raw.c
+ * Raw blob implementation main file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include <utils/git.h>
+#include <utils/http.h>
+#include <utils/obuf.h>
+#include <utils/file.h>
+#include <utils/cache.h>
+#include <utils/stats.h>
+#include <utils/error.h>
+#include <utils/config.h>
+#include <utils/object.h>
+
+#include "raw.h"
+
+/** Default size of largest blob that's cached. */
+#define RAW_CACHE_MAX (1024 * 1024)
+
+/**
+ * Serve bare error status.
+ * Whoever fetches raw blobs has no use for an error page.
+ *
+ * @param out Output buffer to write to.
+ * @param code Status code.
+ * @param msg Reason of error, only logged.
+ */
+static void raw_error(struct obuf *out, int code, const char *msg)
+{
+	error("reporting error: %s\n", msg);
+	http_clear_headers();
+	http_status(out, code);
+}
+
+/**
+ * Parse number in \c Range header.
+ *
+ * @param s Start of number.
+ * @param n Where to place number.
+ * @return Character after number, \c NULL if there was no number.
+ */
+static const char *raw_range_number(const char *s, size_t *n)
+{
+	if (!isdigit((unsigned char)*s))
+		return NULL;
+
+	/* overflows saturate, which is never a satisfiable position */
+	char *end;
+	*n = strtoull(s, &end, 10);
+	return end;
+}
+
+/**
+ * Get part of blob requested with \c Range.
+ * Only single byte ranges are supported, anything else gets the whole blob
+ * like servers that don't support ranges at all would send.
+ *
+ * @param size Size of blob.
+ * @param etag Entity tag of blob.
+ * @param first Where to place first byte to send.
+ * @param len Where to place number of bytes to send.
+ * @return \c 0 for whole blob, \c 1 for part of it, negative if the range
+ * can't be satisfied.
+ */
+static int raw_range(size_t size, const char *etag, size_t *first,
+                     size_t *len)
+{
+	*first = 0;
+	*len = size;
+
+	const char *range = getenv("HTTP_RANGE");
+	if (!range || strncmp(range, "bytes=", 6) != 0 || strchr(range, ','))
+		return 0;
+
+	/* part of a stale copy is no use, send the whole new blob instead */
+	const char *if_range = getenv("HTTP_IF_RANGE");
+	if (if_range && (!etag || strcmp(if_range, etag) != 0))
+		return 0;
+
+	const char *p = range + 6;
+	size_t start, end = size ? size - 1 : 0;
+
+	/* last n bytes */
+	if (*p == '-') {
+		size_t n;
+		if (!(p = raw_range_number(p + 1, &n)) || *p)
+			return 0;
+
+		if (!n || !size)
+			return -1;
+
+		*first = n < size ? size - n : 0;
+		*len = size - *first;
+		return 1;
+	}
+
+	if (!(p = raw_range_number(p, &start)) || *p++ != '-')
+		return 0;
+
+	if (*p && (!(p = raw_range_number(p, &end)) || *p || end < start))
+		return 0;
+
+	if (start >= size)
+		return -1;
+
+	if (end >= size)
+		end = size - 1;
+
+	*first = start;
+	*len = end - start + 1;
+	return 1;
+}
+
+/**
+ * Queue header with integer value.
+ *
+ * @param name Name of header.
+ * @param n Value of header.
+ */
+static void raw_header_uint(const char *name, size_t n)
+{
+	char value[OBUF_UINT_MAX];
+	obuf_format_uint(value, n);
+	http_add_header(name, value);
+}
+
+/**
+ * Send blob not found in cache, and cache it if it's small enough.
+ * Partial blobs can't be cached, they're just sent.
+ *
+ * @param s Blob to send.
+ * @param oid ID of blob.
+ * @param size Size of blob.
+ * @param first First byte to send.
+ * @param len Number of bytes to send.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int raw_send_fresh(struct object_stream *s, const char *oid,
+                          size_t size, size_t first, size_t len)
+{
+	size_t max = config_size("EXGT_RAW_CACHE_MAX", RAW_CACHE_MAX);
+	if (len != size || size > max)
+		return object_send(s, STDOUT_FILENO, first, len);
+
+	char *buf;
+	if (!(buf = malloc(size ? size : 1)))
+		return -1;
+
+	size_t got = 0;
+	while (got < size) {
+		ssize_t r = object_read(s, buf + got, size - got);
+		if (r <= 0)
+			break;
+
+		got += r;
+	}
+
+	int ret = -1;
+	if (got == size && !write_all(STDOUT_FILENO, buf, size)) {
+		cache_put("raw", oid, buf, size);
+		ret = 0;
+	}
+
+	free(buf);
+	return ret;
+}
+
+/**
+ * Serve blob.
+ *
+ * @param out Output buffer of header.
+ * @param blob Blob to serve.
+ * @param commit Commit-ish blob was resolved through.
+ * @param root Path to repository.
+ */
+static void raw_serve_blob(struct obuf *out, struct git_obj *blob,
+                           const char *commit, const char *root)
+{
+	/* same blob in any repository is the same response, but it's not the
+	 * same as the file view of it */
+	char id[GIT_OID_MAX + 8];
+	snprintf(id, sizeof(id), "raw-%s", blob->oid);
+
+	char *etag;
+	if ((etag = http_etag(id))) {
+		http_add_header("ETag", etag);
+		http_add_header("Cache-Control", git_is_oid(commit)
+		                ? "public, max-age=31536000, immutable"
+		                : "no-cache");
+	}
+
+	if (etag && http_not_modified(etag)) {
+		http_status(out, 304);
+		free(etag);
+		return;
+	}
+
+	/* cached blobs go straight from the page cache */
+	size_t offset = 0, size;
+	struct object_stream *s = NULL;
+	int fd = cache_open("raw", blob->oid, &offset, &size);
+	stats_add(fd < 0 ? "raw_misses" : "raw_hits", 1);
+	if (fd < 0 && !(s = object_open(root, blob->oid, &size))) {
+		raw_error(out, 500, "couldn't read blob");
+		free(etag);
+		return;
+	}
+
+	size_t first, len;
+	int range = raw_range(size, etag, &first, &len);
+	free(etag);
+
+	http_add_header("Accept-Ranges", "bytes");
+
+	/* browsers mustn't take blobs for pages of our own */
+	http_add_header("X-Content-Type-Options", "nosniff");
+
+	if (range < 0) {
+		char unsatisfiable[OBUF_UINT_MAX + 8];
+		snprintf(unsatisfiable, sizeof(unsatisfiable), "bytes */%zu",
+		         size);
+		http_add_header("Content-Range", unsatisfiable);
+		http_status(out, 416);
+		goto out;
+	}
+
+	if (range) {
+		char part[3 * OBUF_UINT_MAX + 8];
+		snprintf(part, sizeof(part), "bytes %zu-%zu/%zu", first,
+		         first + len - 1, size);
+		http_add_header("Content-Range", part);
+	}
+
+	raw_header_uint("Content-Length", len);
+	http_header(out, range ? 206 : 200, "application/octet-stream");
+
+	const char *method = getenv("REQUEST_METHOD");
+	if (obuf_flush(out) || (method && strcmp(method, "HEAD") == 0))
+		goto out;
+
+	/* header is out, so all that's left to do on errors is to cut the
+	 * response short */
+	int ret = fd >= 0 ? send_file(STDOUT_FILENO, fd, offset + first, len)
+	          : raw_send_fresh(s, blob->oid, size, first, len);
+	if (ret)
+		error("sending blob failed\n");
+
+out:
+	object_close(s);
+	if (fd >= 0)
+		close(fd);
+}
+
+void raw_serve()
+{
+	struct obuf out;
+	obuf_init(&out, STDOUT_FILENO);
+
+	char *root = git_real_root();
+	char *commit = git_commit();
+	char *path = git_path();
+
+	struct git_obj obj;
+	if (!root || !commit || !path)
+		raw_error(&out, 500, "couldn't get intended blob");
+	else if (git_resolve(root, commit, path, &obj)
+	         || strcmp(obj.type, "blob") != 0)
+		raw_error(&out, 404, "no such blob");
+	else
+		raw_serve_blob(&out, &obj, commit, root);
+
+	obuf_flush(&out);
+	obuf_free(&out);
+	free(path);
+	free(commit);
+	free(root);
+}
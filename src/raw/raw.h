@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file raw.h
+ * Raw blob main header.
+ *
+ * Blobs are served as they are when the query string has \c raw in it, i.e.
+ * \c /exgt/src/main.c?raw, along with the usual \c commit option. Single
+ * byte ranges are supported for resuming downloads.
+ *
+ * Blobs up to \c EXGT_RAW_CACHE_MAX bytes, 1 MiB by default, are kept in the
+ * \c raw namespace of the cache and sent from there with sendfile(). Larger
+ * ones are read from the repository every time. Setting it to \c 0 keeps all
+ * blobs out of the cache.
+ */
+
+#ifndef EXGT_RAW_H
+#define EXGT_RAW_H
+
+/** Serve raw blob. */
+void raw_serve();
+
+#endif /* EXGT_RAW_H */
@@ -0,0 +1,2 @@
+RAW_LOCAL != echo src/raw/*.c
+SOURCES += $(RAW_LOCAL)
@@ -4,3 +4,7 @@ SOURCES += $(SRC_LOCAL)
 include src/utils/source.mk
 include src/html/source.mk
 include src/css/source.mk
+include src/raw/source.mk
+include src/maint/source.mk
+include src/warm/source.mk
+include src/watch/source.mk
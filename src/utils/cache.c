@@ -0,0 +1,625 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file cache.c
+ * On-disk cache implementation.
+ *
+ * Each entry lives in its own file at \c $EXGT_CACHE_DIR/ns/xx/xxxxxxxxxxxxxx,
+ * named after a hash of the key. The file starts with the full key followed by
+ * a newline, which is checked on lookup so hash collisions just look like
+ * misses.
+ *
+ * Total size of the cache is tracked in \c $EXGT_CACHE_DIR/usage. When it
+ * grows past \c EXGT_CACHE_SIZE, the least recently used entries are removed.
+ * Hits bump the modification time of entries, so modification time doubles as
+ * last use time.
+ *
+ * Entries inserted while prefetching are created with \ref
+ * CACHE_MODE_PREFETCHED instead of \ref CACHE_MODE. The first real hit flips
+ * the mode back and counts towards \c prefetch_hits, which is all the
+ * bookkeeping needed for prefetch hit rates.
+ *
+ * Entries stored with cache_put() that are small enough are also kept in the
+ * shared memory cache, see shm.h, which is checked before the disk. Prefetched
+ * entries only go to the disk until their first real hit, so prefetch hits are
+ * still counted.
+ */
+
+/* nftw() */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "error.h"
+#include "path.h"
+#include "config.h"
+#include "stats.h"
+#include "shm.h"
+#include "cache.h"
+
+/** Default size budget of the whole cache. */
+#define CACHE_DEFAULT_SIZE (256 * 1024 * 1024)
+
+/** How many seconds may pass before a hit bumps the last use time. */
+#define CACHE_TOUCH_INTERVAL 60
+
+/** Mode of regular entries. */
+#define CACHE_MODE 0644
+
+/** Mode of entries inserted by prefetching that haven't been hit yet. */
+#define CACHE_MODE_PREFETCHED 0640
+
+/** Whether entries are currently being prefetched. */
+static bool prefetching;
+
+void cache_prefetching(bool on)
+{
+	prefetching = on;
+}
+
+/**
+ * Get root directory of cache.
+ * Defaults to \c .exgt-cache in \c GIT_PROJECT_ROOT, so every repository
+ * under the root shares the same entries.
+ *
+ * @return Root directory of cache in new buffer, \c NULL if caching is
+ * disabled.
+ */
+static char *cache_root()
+{
+	char *root;
+	if ((root = getenv("EXGT_CACHE_DIR")))
+		return *root ? strdup(root) : NULL;
+
+	if (!(root = getenv("GIT_PROJECT_ROOT")))
+		return NULL;
+
+	return build_path(root, ".exgt-cache");
+}
+
+char *cache_file(const char *name)
+{
+	char *root;
+	if (!(root = cache_root()))
+		return NULL;
+
+	if (mkdir(root, 0755) && errno != EEXIST) {
+		error("couldn't create cache root %s\n", root);
+		free(root);
+		return NULL;
+	}
+
+	char *path = build_path(root, name);
+	free(root);
+	return path;
+}
+
+/**
+ * Hash cache key, FNV-1a.
+ *
+ * @param key Key to hash.
+ * @return 64bit hash of \p key.
+ */
+static uint64_t cache_hash(const char *key)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (; *key; ++key) {
+		h ^= (unsigned char)*key;
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+/**
+ * Get path of cache entry file.
+ *
+ * @param ns Namespace of entry.
+ * @param key Key of entry.
+ * @return Path to entry file, \c NULL if caching is disabled.
+ */
+static char *cache_path(const char *ns, const char *key)
+{
+	char *root;
+	if (!(root = cache_root()))
+		return NULL;
+
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx",
+	         (unsigned long long)cache_hash(key));
+
+	/* root/ns/xx/xxxxxxxxxxxxxx */
+	size_t len = strlen(root) + strlen(ns) + sizeof(name) + 4;
+	char *path;
+	if (!(path = malloc(len))) {
+		free(root);
+		return NULL;
+	}
+
+	snprintf(path, len, "%s/%s/%.2s/%s", root, ns, name, name + 2);
+	free(root);
+	return path;
+}
+
+/**
+ * Create missing parent directories of \p path.
+ *
+ * @param path Path whose parents to create.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int cache_mkdirs(char *path)
+{
+	char *slash = path;
+	while ((slash = strchr(slash + 1, '/'))) {
+		*slash = 0;
+		int ret = mkdir(path, 0755);
+		*slash = '/';
+
+		if (ret && errno != EEXIST)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Write whole buffer to file descriptor.
+ *
+ * @param fd File descriptor to write to.
+ * @param buf Buffer to write.
+ * @param size Size of \p buf.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int write_all(int fd, const char *buf, size_t size)
+{
+	while (size) {
+		ssize_t w = write(fd, buf, size);
+		if (w < 0 && errno == EINTR)
+			continue;
+
+		if (w <= 0)
+			return -1;
+
+		buf += w;
+		size -= w;
+	}
+
+	return 0;
+}
+
+/**
+ * Update recorded total size of cache.
+ *
+ * @param root Root directory of cache.
+ * @param delta Number of bytes to add, or new total if \p absolute.
+ * @param absolute Whether \p delta replaces the recorded total.
+ * @return New total size of cache.
+ */
+static long long cache_account(const char *root, long long delta,
+                               bool absolute)
+{
+	char *path;
+	if (!(path = build_path(root, "usage")))
+		return 0;
+
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	free(path);
+	if (fd < 0)
+		return 0;
+
+	/* lock is dropped on close */
+	flock(fd, LOCK_EX);
+
+	char buf[32] = {0};
+	long long usage = 0;
+	if (!absolute && pread(fd, buf, sizeof(buf) - 1, 0) > 0)
+		usage = strtoll(buf, NULL, 10);
+
+	usage = absolute ? delta : usage + delta;
+	if (usage < 0)
+		usage = 0;
+
+	int len = snprintf(buf, sizeof(buf), "%lld\n", usage);
+	if (ftruncate(fd, 0) == 0)
+		pwrite(fd, buf, len, 0);
+
+	close(fd);
+	return usage;
+}
+
+/** One entry file found while pruning. */
+struct cache_file {
+	/** Last use of entry. */
+	time_t mtime;
+	/** Size of entry on disk. */
+	off_t size;
+	/** Path to entry. */
+	char *path;
+};
+
+/** Entry files found while pruning, nftw() doesn't let us pass context. */
+static struct {
+	/** Number of files. */
+	size_t n;
+	/** Maximum number of files before expanding. */
+	size_t max;
+	/** Total size of files. */
+	long long total;
+	/** Files themselves. */
+	struct cache_file *files;
+} prune_list;
+
+/**
+ * Collect one entry file into \ref prune_list.
+ *
+ * @param path Path to file.
+ * @param st Status of file.
+ * @param flag Type of file.
+ * @param ftw Depth of file.
+ * @return \c 0 to continue walking, non-zero on failure.
+ */
+static int prune_visit(const char *path, const struct stat *st, int flag,
+                       struct FTW *ftw)
+{
+	/* entries are always root/ns/xx/file */
+	if (flag != FTW_F || ftw->level != 3)
+		return 0;
+
+	if (prune_list.n >= prune_list.max) {
+		size_t max = prune_list.max ? prune_list.max * 2 : 1024;
+		struct cache_file *files = realloc(prune_list.files,
+		                                   max * sizeof(*files));
+		if (!files)
+			return -1;
+
+		prune_list.files = files;
+		prune_list.max = max;
+	}
+
+	char *path_dup;
+	if (!(path_dup = strdup(path)))
+		return -1;
+
+	prune_list.files[prune_list.n++] =
+		(struct cache_file){st->st_mtime, st->st_size, path_dup};
+	prune_list.total += st->st_size;
+	return 0;
+}
+
+/**
+ * Compare entry files by last use.
+ *
+ * @param a First file.
+ * @param b Second file.
+ * @return Negative if \p a was used before \p b, positive if after.
+ */
+static int prune_cmp(const void *a, const void *b)
+{
+	const struct cache_file *fa = a, *fb = b;
+	return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+int cache_prune(size_t budget)
+{
+	char *root;
+	if (!(root = cache_root()))
+		return -1;
+
+	char *lock_path;
+	if (!(lock_path = build_path(root, "prune.lock"))) {
+		free(root);
+		return -1;
+	}
+
+	int lock = open(lock_path, O_RDWR | O_CREAT, 0644);
+	free(lock_path);
+	if (lock < 0) {
+		free(root);
+		return -1;
+	}
+
+	/* someone else is already pruning, no need to wait for them */
+	if (flock(lock, LOCK_EX | LOCK_NB)) {
+		close(lock);
+		free(root);
+		return 0;
+	}
+
+	int ret = nftw(root, prune_visit, 16, FTW_PHYS);
+	if (!ret) {
+		qsort(prune_list.files, prune_list.n, sizeof(struct cache_file),
+		      prune_cmp);
+
+		/* leave some headroom so we don't end up pruning on every
+		 * insertion */
+		long long target = budget - budget / 10;
+		for (size_t i = 0; i < prune_list.n; ++i) {
+			if (prune_list.total <= target)
+				break;
+
+			if (unlink(prune_list.files[i].path) == 0)
+				prune_list.total -= prune_list.files[i].size;
+		}
+
+		cache_account(root, prune_list.total, true);
+	}
+
+	for (size_t i = 0; i < prune_list.n; ++i)
+		free(prune_list.files[i].path);
+
+	free(prune_list.files);
+	prune_list.files = NULL;
+	prune_list.n = prune_list.max = 0;
+	prune_list.total = 0;
+
+	close(lock);
+	free(root);
+	return ret;
+}
+
+int cache_open(const char *ns, const char *key, size_t *offset, size_t *size)
+{
+	char *path;
+	if (!(path = cache_path(ns, key)))
+		return -1;
+
+	int fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	size_t kl = strlen(key);
+	if (fstat(fd, &st) || (size_t)st.st_size <= kl) {
+		close(fd);
+		return -1;
+	}
+
+	/* entry is prefixed with its key, anything else is a collision or a
+	 * truncated file */
+	char *header;
+	if (!(header = malloc(kl + 1))) {
+		close(fd);
+		return -1;
+	}
+
+	if (pread(fd, header, kl + 1, 0) != (ssize_t)(kl + 1)
+	    || memcmp(header, key, kl) != 0 || header[kl] != '\n') {
+		free(header);
+		close(fd);
+		return -1;
+	}
+
+	free(header);
+
+	if (st.st_mtime + CACHE_TOUCH_INTERVAL < time(NULL))
+		futimens(fd, NULL);
+
+	if (!prefetching && (st.st_mode & 0777) == CACHE_MODE_PREFETCHED
+	    && fchmod(fd, CACHE_MODE) == 0)
+		stats_add("prefetch_hits", 1);
+
+	*offset = kl + 1;
+	*size = st.st_size - kl - 1;
+	return fd;
+}
+
+/**
+ * Build key for shared memory cache.
+ *
+ * @param ns Namespace of entry.
+ * @param key Key of entry.
+ * @return Key in new buffer.
+ */
+static char *cache_shm_key(const char *ns, const char *key)
+{
+	size_t len = strlen(ns) + strlen(key) + 2;
+	char *shm_key;
+	if (!(shm_key = malloc(len)))
+		return NULL;
+
+	snprintf(shm_key, len, "%s\n%s", ns, key);
+	return shm_key;
+}
+
+char *cache_get(const char *ns, const char *key, size_t *size)
+{
+	char *shm_key = cache_shm_key(ns, key);
+	if (!shm_key)
+		return NULL;
+
+	char *buf;
+	if ((buf = shm_get(shm_key, size))) {
+		free(shm_key);
+		return buf;
+	}
+
+	size_t offset, len;
+	int fd = cache_open(ns, key, &offset, &len);
+	if (fd < 0) {
+		free(shm_key);
+		return NULL;
+	}
+
+	if (!(buf = malloc(len + 1))) {
+		free(shm_key);
+		close(fd);
+		return NULL;
+	}
+
+	size_t got = 0;
+	while (got < len) {
+		ssize_t r = pread(fd, buf + got, len - got, offset + got);
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r <= 0)
+			break;
+
+		got += r;
+	}
+
+	close(fd);
+
+	if (got != len) {
+		free(shm_key);
+		free(buf);
+		return NULL;
+	}
+
+	buf[len] = 0;
+	if (size)
+		*size = len;
+
+	shm_put(shm_key, buf, len, 0);
+	free(shm_key);
+	return buf;
+}
+
+/** Entry being written. */
+struct cache_entry {
+	/** Path of entry. */
+	char *path;
+	/** Path of temporary file the entry is written to. */
+	char *tmp;
+	/** Temporary file. */
+	int fd;
+	/** Size of file so far, key included. */
+	size_t size;
+	/** Set if writing failed. */
+	bool err;
+};
+
+void cache_abort(struct cache_entry *e)
+{
+	if (!e)
+		return;
+
+	close(e->fd);
+	unlink(e->tmp);
+	free(e->path);
+	free(e->tmp);
+	free(e);
+}
+
+struct cache_entry *cache_create(const char *ns, const char *key)
+{
+	struct cache_entry *e;
+	if (!(e = calloc(1, sizeof(*e))))
+		return NULL;
+
+	if (!(e->path = cache_path(ns, key)))
+		goto err;
+
+	if (cache_mkdirs(e->path)) {
+		error("couldn't create cache directory for %s\n", e->path);
+		goto err;
+	}
+
+	size_t len = strlen(e->path) + 32;
+	if (!(e->tmp = malloc(len)))
+		goto err;
+
+	snprintf(e->tmp, len, "%s.%ld.tmp", e->path, (long)getpid());
+
+	if ((e->fd = open(e->tmp, O_WRONLY | O_CREAT | O_TRUNC, CACHE_MODE)) < 0)
+		goto err;
+
+	/* don't let umask mix up regular and prefetched entries */
+	if (fchmod(e->fd, prefetching ? CACHE_MODE_PREFETCHED : CACHE_MODE)
+	    || cache_append(e, key, strlen(key))
+	    || cache_append(e, "\n", 1)) {
+		cache_abort(e);
+		return NULL;
+	}
+
+	return e;
+
+err:
+	free(e->path);
+	free(e->tmp);
+	free(e);
+	return NULL;
+}
+
+int cache_append(struct cache_entry *e, const char *data, size_t size)
+{
+	if (!e->err && write_all(e->fd, data, size))
+		e->err = true;
+
+	e->size += size;
+	return e->err;
+}
+
+int cache_commit(struct cache_entry *e)
+{
+	int ret = e->err;
+	if (close(e->fd))
+		ret = -1;
+
+	/* overwriting an entry only grows the cache by the difference */
+	struct stat st;
+	bool exists = stat(e->path, &st) == 0;
+	long long delta = e->size;
+	if (exists)
+		delta -= st.st_size;
+
+	if (!ret && rename(e->tmp, e->path))
+		ret = -1;
+
+	if (ret)
+		unlink(e->tmp);
+
+	free(e->path);
+	free(e->tmp);
+	free(e);
+
+	if (ret)
+		return ret;
+
+	if (prefetching && !exists)
+		stats_add("prefetch_issued", 1);
+
+	char *root;
+	if (!(root = cache_root()))
+		return ret;
+
+	size_t budget = config_size("EXGT_CACHE_SIZE", CACHE_DEFAULT_SIZE);
+	if (cache_account(root, delta, false) > (long long)budget && budget)
+		cache_prune(budget);
+
+	free(root);
+	return ret;
+}
+
+int cache_put(const char *ns, const char *key, const char *data, size_t size)
+{
+	char *shm_key;
+	if (!prefetching && (shm_key = cache_shm_key(ns, key))) {
+		shm_put(shm_key, data, size, 0);
+		free(shm_key);
+	}
+
+	struct cache_entry *e;
+	if (!(e = cache_create(ns, key)))
+		return -1;
+
+	if (cache_append(e, data, size)) {
+		cache_abort(e);
+		return -1;
+	}
+
+	return cache_commit(e);
+}
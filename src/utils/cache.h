@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file cache.h
+ * On-disk cache header.
+ *
+ * Entries are plain files under \c EXGT_CACHE_DIR, so they outlive the process
+ * that created them and are shared by every request. \c EXGT_CACHE_DIR
+ * defaults to \c .exgt-cache in \c GIT_PROJECT_ROOT, setting it to an empty
+ * string disables caching.
+ *
+ * Entries are meant to be keyed by object IDs and whatever parameters went into
+ * generating them, never by repository, so forks share the work done for
+ * upstream and identical work is only ever stored once. \c EXGT_CACHE_SIZE
+ * sets a size budget for the whole cache, \c 256M by default and \c 0 for
+ * unlimited.
+ */
+
+#ifndef EXGT_CACHE_H
+#define EXGT_CACHE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Look up entry in cache.
+ * The returned buffer is allocated and always zero terminated, remember to
+ * free it after use.
+ *
+ * @param ns Namespace of entry, e.g. \c "tree".
+ * @param key Key of entry, must not contain newlines.
+ * @param size Where to place size of entry, ignored if \c NULL.
+ * @return Contents of entry, \c NULL if not found.
+ */
+char *cache_get(const char *ns, const char *key, size_t *size);
+
+/**
+ * Open entry in cache without reading it.
+ * Handy for sending entries straight from the page cache with sendfile().
+ *
+ * @param ns Namespace of entry.
+ * @param key Key of entry, must not contain newlines.
+ * @param offset Where to place offset of entry contents in file.
+ * @param size Where to place size of entry contents.
+ * @return File descriptor of entry, \c -1 if not found. Caller should close.
+ */
+int cache_open(const char *ns, const char *key, size_t *offset, size_t *size);
+
+/**
+ * Insert entry into cache.
+ * The entry is written to a temporary file and renamed into place, so
+ * concurrent readers never see partial entries.
+ *
+ * @param ns Namespace of entry.
+ * @param key Key of entry, must not contain newlines.
+ * @param data Contents of entry.
+ * @param size Size of \p data.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int cache_put(const char *ns, const char *key, const char *data, size_t size);
+
+/** Entry being written, opaque. */
+struct cache_entry;
+
+/**
+ * Start writing entry into cache.
+ * Unlike cache_put(), contents are appended piece by piece with
+ * cache_append(), so an entry never has to be held in memory in full. Entries
+ * written this way skip the shared memory cache.
+ *
+ * @param ns Namespace of entry.
+ * @param key Key of entry, must not contain newlines.
+ * @return Entry being written, \c NULL on error. Finish with cache_commit()
+ * or drop with cache_abort().
+ */
+struct cache_entry *cache_create(const char *ns, const char *key);
+
+/**
+ * Append to entry being written.
+ * Once appending fails the entry can only be dropped, cache_commit() fails
+ * too.
+ *
+ * @param e Entry being written.
+ * @param data Data to append.
+ * @param size Size of \p data.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int cache_append(struct cache_entry *e, const char *data, size_t size);
+
+/**
+ * Rename entry being written into place.
+ * \p e is released either way.
+ *
+ * @param e Entry being written.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int cache_commit(struct cache_entry *e);
+
+/**
+ * Drop entry being written.
+ *
+ * @param e Entry being written, \c NULL is ignored.
+ */
+void cache_abort(struct cache_entry *e);
+
+/**
+ * Remove least recently used entries until cache fits in \p budget.
+ * Called automatically by cache_put() and cache_commit() when the cache grows
+ * too large. If some other process is already pruning, returns immediately.
+ *
+ * @param budget Size budget in bytes.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int cache_prune(size_t budget);
+
+/**
+ * Get path to a file in the cache root.
+ * Files directly in the cache root are never pruned, so they are a good place
+ * for state that isn't a cache entry as such.
+ *
+ * @param name Name of file.
+ * @return Path to file in new buffer, \c NULL if caching is disabled.
+ */
+char *cache_file(const char *name);
+
+/**
+ * Mark entries inserted from now on as prefetched.
+ * Newly prefetched entries count towards the \c prefetch_issued counter and
+ * the first hit on each one towards \c prefetch_hits, see stats.h.
+ *
+ * @param on Whether entries are prefetched.
+ */
+void cache_prefetching(bool on);
+
+#endif /* EXGT_CACHE_H */
@@ -10,14 +10,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include "chain.h"
 
+/** @name Linux I/O priority interface, glibc doesn't wrap it. */
+/** @{ */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+/** @} */
+
 /** Environment pointer. Weird that you have to manually define but eh. */
 extern char **environ;
 
 FILE *exgt_chain(size_t n, char **cmds[])
 {
-	int out = 0;
+	return exgt_chain_from(0, n, cmds);
+}
+
+FILE *exgt_chain_from(int in, size_t n, char **cmds[])
+{
+	int out = in;
 	int cout_pipe[2];
 	for (size_t i = 0; i < n; ++i) {
 		if (pipe(cout_pipe)) {
@@ -47,7 +61,7 @@ FILE *exgt_chain(size_t n, char **cmds[])
 
 		posix_spawn_file_actions_destroy(&actions);
 
-		if (out)
+		if (out && out != in)
 			close(out);
 
 		close(cout_pipe[1]);
@@ -56,3 +70,10 @@ FILE *exgt_chain(size_t n, char **cmds[])
 
 	return fdopen(out, "r");
 }
+
+void exgt_lower_priority()
+{
+	setpriority(PRIO_PROCESS, 0, 19);
+	syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+	        IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+}
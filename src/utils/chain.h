@@ -28,4 +28,29 @@
  */
 FILE *exgt_chain(size_t n, char **cmds[]);
 
+/**
+ * Chain one or more programs together, feeding \p in to the first one.
+ *
+ * Equivalent to doing
+ * @code
+ *	prog1 < in | prog2 | prog3 ...
+ * @endcode
+ *
+ * in a shell. \p in is not closed, so it is up to the caller to make sure
+ * the first program doesn't block on it. Regular files are the safest bet.
+ *
+ * @param in File descriptor to use as \c stdin of first command.
+ * @param n Number of commands to execute.
+ * @param cmds Array of commands to execute.
+ * @return \c stdout of last command in \p cmds.
+ */
+FILE *exgt_chain_from(int in, size_t n, char **cmds[]);
+
+/**
+ * Drop to lowest CPU and I/O priority.
+ * Meant for background work, anything spawned afterwards inherits the
+ * priorities.
+ */
+void exgt_lower_priority();
+
 #endif /* EXGT_CHAIN_H */
@@ -0,0 +1,319 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file compress.c
+ * Response compression implementation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <time.h>
+#include <zlib.h>
+
+#ifdef EXGT_ZSTD
+#include <zstd.h>
+#endif
+
+#include "config.h"
+#include "stats.h"
+#include "compress.h"
+
+/** Marks \c EXGT_COMPRESS_LEVEL as unset. */
+#define COMPRESS_DEFAULT_LEVEL ((size_t)-1)
+
+/** Size of chunks input is fed in and output is produced in. */
+#define COMPRESS_CHUNK (64 * 1024)
+
+/** Compression stream. */
+struct compress_stream {
+	/** Encoding being compressed with. */
+	enum compress_encoding enc;
+	/** gzip state. */
+	z_stream zs;
+#ifdef EXGT_ZSTD
+	/** zstd state. */
+	ZSTD_CCtx *zc;
+#endif
+	/** Number of bytes fed in so far. */
+	size_t in;
+	/** Number of bytes produced so far. */
+	size_t out;
+	/** CPU time spent compressing so far. */
+	long long usec;
+	/** Output is produced here before going to the output buffer. */
+	char chunk[COMPRESS_CHUNK];
+};
+
+/**
+ * Check if client accepts encoding.
+ *
+ * @param accept Value of \c Accept-Encoding.
+ * @param name Name of encoding.
+ * @return \c true if \p name is listed in \p accept without \c q=0.
+ */
+static bool compress_accepts(const char *accept, const char *name)
+{
+	size_t len = strlen(name);
+	const char *p = accept;
+	while (*p) {
+		p += strspn(p, " \t,");
+		size_t tlen = strcspn(p, " \t;,");
+		bool match = tlen == len && strncasecmp(p, name, len) == 0;
+		p += tlen;
+
+		/* only q=0 and friends matter, everything else is accepted */
+		bool refused = false;
+		const char *end = p + strcspn(p, ",");
+		const char *q = p;
+		while ((q = strchr(q, ';')) && q < end) {
+			q += 1 + strspn(q + 1, " \t");
+			if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=')
+				refused = strtod(q + 2, NULL) <= 0;
+		}
+
+		if (match)
+			return !refused;
+
+		p = end;
+	}
+
+	return false;
+}
+
+enum compress_encoding compress_negotiate()
+{
+	if (!config_size("EXGT_COMPRESS", 1))
+		return COMPRESS_IDENTITY;
+
+	char *accept;
+	if (!(accept = getenv("HTTP_ACCEPT_ENCODING")))
+		return COMPRESS_IDENTITY;
+
+#ifdef EXGT_ZSTD
+	if (compress_accepts(accept, "zstd"))
+		return COMPRESS_ZSTD;
+#endif
+
+	if (compress_accepts(accept, "gzip")
+	    || compress_accepts(accept, "x-gzip"))
+		return COMPRESS_GZIP;
+
+	return COMPRESS_IDENTITY;
+}
+
+size_t compress_encodings(enum compress_encoding encs[COMPRESS_ZSTD + 1])
+{
+	size_t n = 0;
+	encs[n++] = COMPRESS_IDENTITY;
+	if (!config_size("EXGT_COMPRESS", 1))
+		return n;
+
+	encs[n++] = COMPRESS_GZIP;
+#ifdef EXGT_ZSTD
+	encs[n++] = COMPRESS_ZSTD;
+#endif
+	return n;
+}
+
+const char *compress_name(enum compress_encoding enc)
+{
+	switch (enc) {
+	case COMPRESS_GZIP: return "gzip";
+	case COMPRESS_ZSTD: return "zstd";
+	default: return "identity";
+	}
+}
+
+/**
+ * Get compression level to use.
+ *
+ * @param def Default level of encoder.
+ * @return Level from \c EXGT_COMPRESS_LEVEL, \p def if unset.
+ */
+static int compress_level(int def)
+{
+	size_t level = config_size("EXGT_COMPRESS_LEVEL",
+	                           COMPRESS_DEFAULT_LEVEL);
+	return level == COMPRESS_DEFAULT_LEVEL ? def : (int)level;
+}
+
+struct compress_stream *compress_open(enum compress_encoding enc)
+{
+	struct compress_stream *z;
+	if (!(z = calloc(1, sizeof(*z))))
+		return NULL;
+
+	z->enc = enc;
+	switch (enc) {
+	case COMPRESS_GZIP:
+		/* 16 + 15 for gzip header and largest window */
+		if (deflateInit2(&z->zs, compress_level(Z_DEFAULT_COMPRESSION),
+		                 Z_DEFLATED, 16 + 15, 8,
+		                 Z_DEFAULT_STRATEGY) == Z_OK)
+			return z;
+		break;
+
+#ifdef EXGT_ZSTD
+	case COMPRESS_ZSTD: {
+		int level = compress_level(ZSTD_CLEVEL_DEFAULT);
+		if ((z->zc = ZSTD_createCCtx())
+		    && !ZSTD_isError(ZSTD_CCtx_setParameter(
+					     z->zc, ZSTD_c_compressionLevel, level)))
+			return z;
+
+		ZSTD_freeCCtx(z->zc);
+		break;
+	}
+#endif
+
+	default: break;
+	}
+
+	free(z);
+	return NULL;
+}
+
+/**
+ * Feed data to gzip stream.
+ *
+ * @param z Stream to compress with.
+ * @param out Output buffer to write compressed data to.
+ * @param data Data to compress.
+ * @param len Length of \p data.
+ * @param finish Whether this is the end of the data.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int compress_gzip(struct compress_stream *z, struct obuf *out,
+                         const char *data, size_t len, bool finish)
+{
+	int ret = Z_OK;
+	do {
+		/* avail_in is only an unsigned int */
+		size_t in = len < COMPRESS_CHUNK ? len : COMPRESS_CHUNK;
+		z->zs.next_in = (Bytef *)data;
+		z->zs.avail_in = in;
+		data += in;
+		len -= in;
+
+		int flush = finish && !len ? Z_FINISH : Z_NO_FLUSH;
+		do {
+			z->zs.next_out = (Bytef *)z->chunk;
+			z->zs.avail_out = COMPRESS_CHUNK;
+			if ((ret = deflate(&z->zs, flush)) == Z_STREAM_ERROR)
+				return -1;
+
+			size_t got = COMPRESS_CHUNK - z->zs.avail_out;
+			obuf_write(out, z->chunk, got);
+			z->out += got;
+		} while (z->zs.avail_out == 0);
+	} while (len);
+
+	return finish && ret != Z_STREAM_END;
+}
+
+#ifdef EXGT_ZSTD
+/**
+ * Feed data to zstd stream.
+ *
+ * @param z Stream to compress with.
+ * @param out Output buffer to write compressed data to.
+ * @param data Data to compress.
+ * @param len Length of \p data.
+ * @param finish Whether this is the end of the data.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int compress_zstd(struct compress_stream *z, struct obuf *out,
+                         const char *data, size_t len, bool finish)
+{
+	ZSTD_inBuffer in = {data, len, 0};
+	ZSTD_EndDirective mode = finish ? ZSTD_e_end : ZSTD_e_continue;
+	size_t left;
+	do {
+		ZSTD_outBuffer zout = {z->chunk, COMPRESS_CHUNK, 0};
+		left = ZSTD_compressStream2(z->zc, &zout, &in, mode);
+		if (ZSTD_isError(left))
+			return -1;
+
+		obuf_write(out, z->chunk, zout.pos);
+		z->out += zout.pos;
+	} while (finish ? left != 0 : in.pos < in.size);
+
+	return 0;
+}
+#endif
+
+/**
+ * Feed data to stream.
+ *
+ * @param z Stream to compress with.
+ * @param out Output buffer to write compressed data to.
+ * @param data Data to compress.
+ * @param len Length of \p data.
+ * @param finish Whether this is the end of the data.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int compress_feed(struct compress_stream *z, struct obuf *out,
+                         const char *data, size_t len, bool finish)
+{
+	struct timespec start, end;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+
+	int ret = -1;
+	switch (z->enc) {
+	case COMPRESS_GZIP:
+		ret = compress_gzip(z, out, data, len, finish);
+		break;
+#ifdef EXGT_ZSTD
+	case COMPRESS_ZSTD:
+		ret = compress_zstd(z, out, data, len, finish);
+		break;
+#endif
+	default: break;
+	}
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+	z->usec += (end.tv_sec - start.tv_sec) * 1000000LL
+	           + (end.tv_nsec - start.tv_nsec) / 1000;
+	z->in += len;
+	return ret;
+}
+
+int compress_write(struct compress_stream *z, struct obuf *out,
+                   const char *data, size_t len)
+{
+	if (!len)
+		return 0;
+
+	return compress_feed(z, out, data, len, false);
+}
+
+int compress_finish(struct compress_stream *z, struct obuf *out)
+{
+	if (compress_feed(z, out, NULL, 0, true))
+		return -1;
+
+	stats_add("compress_in", z->in);
+	stats_add("compress_out", z->out);
+	stats_add("compress_usec", z->usec);
+	return 0;
+}
+
+void compress_close(struct compress_stream *z)
+{
+	if (!z)
+		return;
+
+	switch (z->enc) {
+	case COMPRESS_GZIP: deflateEnd(&z->zs); break;
+#ifdef EXGT_ZSTD
+	case COMPRESS_ZSTD: ZSTD_freeCCtx(z->zc); break;
+#endif
+	default: break;
+	}
+
+	free(z);
+}
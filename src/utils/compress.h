@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file compress.h
+ * Response compression header.
+ *
+ * gzip is always available, zstd only when built with \c ZSTD=1.
+ * \c EXGT_COMPRESS_LEVEL sets the compression level, defaulting to each
+ * encoder's own default. Setting \c EXGT_COMPRESS to \c 0 disables
+ * compression altogether.
+ *
+ * Compression is streamed: data is fed to an open stream piece by piece and
+ * compressed output is written to an output buffer as it comes out, so nothing
+ * needs to be held in full.
+ */
+
+#ifndef EXGT_COMPRESS_H
+#define EXGT_COMPRESS_H
+
+#include <stddef.h>
+
+#include "obuf.h"
+
+/** Content encodings. */
+enum compress_encoding {
+	/** No compression. */
+	COMPRESS_IDENTITY,
+	/** gzip. */
+	COMPRESS_GZIP,
+	/** zstd. */
+	COMPRESS_ZSTD,
+};
+
+/**
+ * Pick best encoding client accepts, according to \c Accept-Encoding.
+ *
+ * @return Encoding to use.
+ */
+enum compress_encoding compress_negotiate();
+
+/**
+ * Get encodings responses may be sent in.
+ *
+ * @param encs Where to place encodings, \ref COMPRESS_IDENTITY first.
+ * @return Number of encodings.
+ */
+size_t compress_encodings(enum compress_encoding encs[COMPRESS_ZSTD + 1]);
+
+/**
+ * Get name of encoding, as used in \c Content-Encoding.
+ *
+ * @param enc Encoding.
+ * @return Name of encoding, \c "identity" for no compression.
+ */
+const char *compress_name(enum compress_encoding enc);
+
+/** Compression stream, opaque. */
+struct compress_stream;
+
+/**
+ * Open compression stream.
+ *
+ * @param enc Encoding to compress with, not \ref COMPRESS_IDENTITY.
+ * @return Open stream, \c NULL on error. Close with compress_close().
+ */
+struct compress_stream *compress_open(enum compress_encoding enc);
+
+/**
+ * Compress next part of data.
+ * Encoders keep some input back to find matches in, so output lags behind
+ * input until compress_finish().
+ *
+ * @param z Stream to compress with.
+ * @param out Output buffer to write compressed data to.
+ * @param data Data to compress.
+ * @param len Length of \p data.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int compress_write(struct compress_stream *z, struct obuf *out,
+                   const char *data, size_t len);
+
+/**
+ * Write out rest of compressed data.
+ * Counts towards the \c compress_in, \c compress_out and \c compress_usec
+ * counters, see stats.h.
+ *
+ * @param z Stream to finish.
+ * @param out Output buffer to write compressed data to.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int compress_finish(struct compress_stream *z, struct obuf *out);
+
+/**
+ * Close compression stream.
+ *
+ * @param z Stream to close.
+ */
+void compress_close(struct compress_stream *z);
+
+#endif /* EXGT_COMPRESS_H */
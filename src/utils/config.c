@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file config.c
+ * Configuration helper implementations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "error.h"
+#include "config.h"
+
+#ifndef EXGT_VERSION
+/** Version of exgt, normally set by the Makefile. */
+#define EXGT_VERSION "unknown"
+#endif
+
+size_t config_size(const char *name, size_t def)
+{
+	char *value;
+	if (!(value = getenv(name)) || !*value)
+		return def;
+
+	char *end;
+	unsigned long long size = strtoull(value, &end, 10);
+	if (end == value) {
+		error("couldn't parse %s=%s\n", name, value);
+		return def;
+	}
+
+	switch (toupper((unsigned char)*end)) {
+	case 'G': size *= 1024;
+	/* fallthrough */
+	case 'M': size *= 1024;
+	/* fallthrough */
+	case 'K': size *= 1024;
+	/* fallthrough */
+	case 0: break;
+
+	default:
+		error("unknown suffix in %s=%s\n", name, value);
+		return def;
+	}
+
+	return size;
+}
+
+const char *config_version()
+{
+	static char version[128];
+	if (version[0])
+		return version;
+
+	struct stat st = {0};
+	stat("/proc/self/exe", &st);
+	snprintf(version, sizeof(version), "%s-%llx-%llx", EXGT_VERSION,
+	         (unsigned long long)st.st_mtime,
+	         (unsigned long long)st.st_size);
+	return version;
+}
+
+char *config_tool_version(const char *name)
+{
+	char *path;
+	if (!(path = getenv("PATH")) || !(path = strdup(path)))
+		return NULL;
+
+	char *version = NULL;
+	char *save, *dir = strtok_r(path, ":", &save);
+	for (; dir; dir = strtok_r(NULL, ":", &save)) {
+		size_t len = strlen(dir) + strlen(name) + 2;
+		char *exe;
+		if (!(exe = malloc(len)))
+			break;
+
+		snprintf(exe, len, "%s/%s", dir, name);
+
+		struct stat st;
+		bool found = stat(exe, &st) == 0 && S_ISREG(st.st_mode)
+		             && access(exe, X_OK) == 0;
+		free(exe);
+		if (!found)
+			continue;
+
+		if (!(version = malloc(64)))
+			break;
+
+		snprintf(version, 64, "%llx-%llx",
+		         (unsigned long long)st.st_mtime,
+		         (unsigned long long)st.st_size);
+		break;
+	}
+
+	free(path);
+	return version;
+}
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file config.h
+ * Configuration helpers.
+ * All configuration is read from the environment, same as the CGI variables.
+ */
+
+#ifndef EXGT_CONFIG_H
+#define EXGT_CONFIG_H
+
+#include <stddef.h>
+
+/**
+ * Get size from environment.
+ * Accepts an optional \c K, \c M or \c G suffix, i.e. \c 512M.
+ *
+ * @param name Name of environment variable.
+ * @param def Default value if \p name is not set or unparseable.
+ * @return Value of \p name.
+ */
+size_t config_size(const char *name, size_t def);
+
+/**
+ * Get version of exgt.
+ * Includes the modification time and size of the executable, so anything
+ * keyed by version changes whenever exgt is rebuilt, even if \c EXGT_VERSION
+ * didn't.
+ *
+ * @return Version string, statically allocated.
+ */
+const char *config_version();
+
+/**
+ * Get version of external tool.
+ * Identifies the first executable called \p name in \c PATH by its
+ * modification time and size, which changes on upgrades just like a version
+ * number would, without having to run the tool.
+ *
+ * @param name Name of tool, i.e. \c "highlight".
+ * @return Version string in new buffer, \c NULL if tool wasn't found.
+ */
+char *config_tool_version(const char *name);
+
+#endif /* EXGT_CONFIG_H */
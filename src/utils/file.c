@@ -1,9 +1,16 @@
 /* SPDX-License-Identifier: copyleft-next-0.3.1 */
 /* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
 
+/* splice() */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
 
 #include "file.h"
 
@@ -32,3 +39,124 @@ char *read_file(const char *path)
 	fclose(f);
 	return buf;
 }
+
+char *read_stream(FILE *f, size_t *size)
+{
+	size_t buf_size = 4096;
+	size_t len = 0;
+	char *buf = malloc(buf_size);
+	if (!buf)
+		return NULL;
+
+	size_t r;
+	while ((r = fread(buf + len, 1, buf_size - len - 1, f))) {
+		len += r;
+		if (len < buf_size - 1)
+			continue;
+
+		char *new;
+		if (!(new = realloc(buf, buf_size *= 2))) {
+			free(buf);
+			return NULL;
+		}
+
+		buf = new;
+	}
+
+	buf[len] = 0;
+	if (size)
+		*size = len;
+
+	return buf;
+}
+
+int write_all(int fd, const void *buf, size_t size)
+{
+	const char *p = buf;
+	while (size) {
+		ssize_t w = write(fd, p, size);
+		if (w < 0 && errno == EINTR)
+			continue;
+
+		if (w <= 0)
+			return -1;
+
+		p += w;
+		size -= w;
+	}
+
+	return 0;
+}
+
+int send_file(int out, int in, off_t offset, size_t size)
+{
+	while (size) {
+		ssize_t w = sendfile(out, in, &offset, size);
+		if (w < 0 && errno == EINTR)
+			continue;
+
+		if (w < 0 && (errno == EINVAL || errno == ENOSYS))
+			break;
+
+		if (w <= 0)
+			return -1;
+
+		size -= w;
+	}
+
+	char buf[65536];
+	while (size) {
+		size_t want = size < sizeof(buf) ? size : sizeof(buf);
+		ssize_t r = pread(in, buf, want, offset);
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r <= 0)
+			return -1;
+
+		if (write_all(out, buf, r))
+			return -1;
+
+		offset += r;
+		size -= r;
+	}
+
+	return 0;
+}
+
+int send_pipe(int out, int in, size_t size)
+{
+	while (size) {
+		ssize_t w = splice(in, NULL, out, NULL, size,
+		                   SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (w < 0 && errno == EINTR)
+			continue;
+
+		/* i.e. out was opened with O_APPEND */
+		if (w < 0 && (errno == EINVAL || errno == ENOSYS))
+			break;
+
+		if (w <= 0)
+			return -1;
+
+		size -= w;
+	}
+
+	char buf[65536];
+	while (size) {
+		size_t want = size < sizeof(buf) ? size : sizeof(buf);
+		ssize_t r = read(in, buf, want);
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r <= 0)
+			return -1;
+
+		if (write_all(out, buf, r))
+			return -1;
+
+		size -= r;
+	}
+
+	return 0;
+}
@@ -4,6 +4,9 @@
 #ifndef EXGT_FILE_H
 #define EXGT_FILE_H
 
+#include <stdio.h>
+#include <sys/types.h>
+
 /**
  * @file file.h
  * File operation helper functions.
@@ -19,4 +22,52 @@
  */
 char *read_file(const char *path);
 
+/**
+ * Read a stream until EOF into a buffer.
+ * The buffer is always zero terminated. Allocates memory, remember to free the
+ * buffer after use.
+ *
+ * @param f Stream to read.
+ * @param size Where to place number of bytes read, ignored if \c NULL.
+ * @return Contents of stream in buffer.
+ */
+char *read_stream(FILE *f, size_t *size);
+
+/**
+ * Write whole buffer to a file descriptor, retrying short writes.
+ *
+ * @param fd File descriptor to write to.
+ * @param buf Data to write.
+ * @param size Size of \p buf.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int write_all(int fd, const void *buf, size_t size);
+
+/**
+ * Copy part of a file to a file descriptor.
+ * Uses sendfile() so the data can go straight from the page cache to \p out,
+ * falling back to plain reads and writes where that isn't supported.
+ *
+ * @param out File descriptor to write to.
+ * @param in File descriptor to read from.
+ * @param offset Offset in \p in to start from.
+ * @param size Number of bytes to copy.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int send_file(int out, int in, off_t offset, size_t size);
+
+/**
+ * Copy data from a pipe to a file descriptor.
+ * Uses splice() so the data can be moved along without copying it through
+ * user space, falling back to plain reads and writes where that isn't
+ * supported.
+ *
+ * @param out File descriptor to write to.
+ * @param in Pipe to read from.
+ * @param size Number of bytes to copy.
+ * @return \c 0 on success, non-zero otherwise, including if \p in ran out
+ * early.
+ */
+int send_pipe(int out, int in, size_t size);
+
 #endif /* EXGT_FILE_H */
@@ -5,6 +5,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
 
 #include "url.h"
 #include "git.h"
@@ -12,6 +15,11 @@
 #include "error.h"
 #include "chain.h"
 #include "file.h"
+#include "cache.h"
+#include "config.h"
+#include "shm.h"
+#include "watched.h"
+#include "stats.h"
 
 /**
  * @file git.c
@@ -35,8 +43,14 @@ char *git_commit()
 {
 	/*@todo implement url option parsing */
 	char *commit;
-	if ((commit = url_option("commit")))
+	if ((commit = url_option("commit"))) {
+		/* object IDs get one spelling, so they make one cache key */
+		if (git_is_oid(commit))
+			for (char *c = commit; *c; ++c)
+				*c = tolower((unsigned char)*c);
+
 		return commit;
+	}
 
 	return strdup("HEAD");
 }
@@ -137,12 +151,12 @@ char *git_web_root()
 char *git_web_last()
 {
 	char *path;
-	if (!(path = getenv("REQUEST_URI"))) {
-		error("couldn't find REQUEST_URI\n");
+	if (!(path = request_path()))
 		return NULL;
-	}
 
-	return path_last_elem(path);
+	char *last = path_last_elem(path);
+	free(path);
+	return last;
 }
 
 char *repo_last_commit(char *path)
@@ -207,3 +221,356 @@ char *repo_description(char *path)
 	free(real);
 	return desc;
 }
+
+char *git_tree(const char *root, const char *tree, size_t *size)
+{
+	char *listing;
+	if ((listing = cache_get("tree", tree, size)))
+		return listing;
+
+	char **cmds[] =
+	{(char *[]){"git", "-C", (char *)root, "ls-tree", "-z", (char *)tree,
+		    0}};
+	FILE *ls_tree = exgt_chain(1, cmds);
+	if (!ls_tree)
+		return NULL;
+
+	size_t len = 0;
+	listing = read_stream(ls_tree, &len);
+	fclose(ls_tree);
+
+	if (!listing)
+		return NULL;
+
+	/* git doesn't tell us if it failed, but even the empty tree is so rare
+	 * that it's not worth caching */
+	if (len)
+		cache_put("tree", tree, listing, len);
+
+	if (size)
+		*size = len;
+
+	return listing;
+}
+
+bool git_is_oid(const char *s)
+{
+	size_t len = strlen(s);
+	if (len != 40 && len != 64)
+		return false;
+
+	for (; *s; ++s)
+		if (!isxdigit((unsigned char)*s))
+			return false;
+
+	return true;
+}
+
+/**
+ * Find entry \p name in tree listing.
+ *
+ * @param listing Tree listing from git_tree().
+ * @param size Size of \p listing.
+ * @param name Name of entry.
+ * @param obj Where to place found entry.
+ * @return \c 0 if found, non-zero otherwise.
+ */
+static int git_tree_find(const char *listing, size_t size, const char *name,
+                         struct git_obj *obj)
+{
+	const char *end = listing + size;
+	for (const char *e = listing; e < end; e += strlen(e) + 1) {
+		const char *tab;
+		if (!(tab = strchr(e, '\t')))
+			continue;
+
+		if (strcmp(tab + 1, name) != 0)
+			continue;
+
+		if (sscanf(e, "%7s %7s %64s", obj->mode, obj->type,
+		           obj->oid) != 3)
+			return -1;
+
+		return 0;
+	}
+
+	return -1;
+}
+
+/** Default number of seconds resolved refs are cached for, if no watcher is
+ * running. */
+#define GIT_REF_TTL 5
+
+/** Default number of seconds failures to resolve something are cached for. */
+#define GIT_NEG_TTL 10
+
+/**
+ * Build shared memory cache key of resolved ref.
+ *
+ * @param root Path to repository.
+ * @param commit Commit-ish.
+ * @return Key in new buffer.
+ */
+static char *git_ref_key(const char *root, const char *commit)
+{
+	size_t kl = strlen(root) + strlen(commit) + sizeof("ref\t\t");
+	char *key;
+	if (!(key = malloc(kl)))
+		return NULL;
+
+	snprintf(key, kl, "ref\t%s\t%s", root, commit);
+	return key;
+}
+
+void git_ref_forget(const char *root, const char *commit)
+{
+	char *key;
+	if (!(key = git_ref_key(root, commit)))
+		return;
+
+	shm_del(key);
+	free(key);
+}
+
+/**
+ * Build key of negative cache entry.
+ * Bots probe all sorts of paths that don't exist, and failures are cached for
+ * \c EXGT_NEG_TTL seconds so they don't cost more than a lookup.
+ *
+ * @param kind Kind of entry, i.e. \c "noref".
+ * @param where What \p what is relative to, i.e. repository or tree.
+ * @param what What wasn't found.
+ * @return Key in new buffer.
+ */
+static char *git_neg_key(const char *kind, const char *where, const char *what)
+{
+	size_t len = strlen(kind) + strlen(where) + strlen(what) + 3;
+	char *key;
+	if (!(key = malloc(len)))
+		return NULL;
+
+	snprintf(key, len, "%s\t%s\t%s", kind, where, what);
+	return key;
+}
+
+/**
+ * Get time to live of negative cache entries.
+ *
+ * @return Seconds negative entries are kept for.
+ */
+static time_t git_neg_ttl()
+{
+	return config_size("EXGT_NEG_TTL", GIT_NEG_TTL);
+}
+
+int git_resolve_commit(const char *root, const char *commit,
+                       struct git_obj *obj)
+{
+	/* don't let anyone sneak options into git */
+	if (commit[0] == '-')
+		return -1;
+
+	char *key;
+	if (!(key = git_ref_key(root, commit)))
+		return -1;
+
+	/* object IDs always resolve the same way, refs only until the
+	 * repository changes */
+	bool oid = git_is_oid(commit);
+	char *stamp = NULL, *neg_stamp = NULL, *neg_key = NULL;
+	char *cached = oid ? shm_get(key, NULL)
+	               : watched_get(root, key, NULL, &stamp);
+
+	int ret = -1;
+	if (cached) {
+		int found = sscanf(cached, "%64s %64s", obj->commit, obj->oid);
+		free(cached);
+		if (found == 2)
+			goto found;
+	}
+
+	/* also covers repositories that don't exist, the watcher invalidates
+	 * those when the repository shows up */
+	if ((neg_key = git_neg_key("noref", root, commit))
+	    && (cached = watched_get(root, neg_key, NULL, &neg_stamp))) {
+		stats_add("negative_hits", 1);
+		free(cached);
+		goto out;
+	}
+
+	size_t cl = strlen(commit);
+	char *commit_rev = malloc(cl + sizeof("^{commit}"));
+	char *tree_rev = malloc(cl + sizeof("^{tree}"));
+	if (!commit_rev || !tree_rev) {
+		free(commit_rev);
+		free(tree_rev);
+		goto out;
+	}
+
+	sprintf(commit_rev, "%s^{commit}", commit);
+	sprintf(tree_rev, "%s^{tree}", commit);
+
+	char **cmds[] =
+	{(char *[]){"git", "-C", (char *)root, "rev-parse", commit_rev,
+		    tree_rev, "--", 0}};
+	FILE *rev_parse = exgt_chain(1, cmds);
+	free(commit_rev);
+	free(tree_rev);
+
+	if (!rev_parse)
+		goto out;
+
+	int found = fscanf(rev_parse, "%64s %64s", obj->commit, obj->oid);
+	fclose(rev_parse);
+
+	if (found != 2 || !git_is_oid(obj->commit) || !git_is_oid(obj->oid)) {
+		if (neg_key)
+			watched_put(neg_key, neg_stamp, "", 0, git_neg_ttl());
+
+		goto out;
+	}
+
+	char resolved[2 * GIT_OID_MAX + 2];
+	snprintf(resolved, sizeof(resolved), "%s %s", obj->commit, obj->oid);
+	if (oid)
+		shm_put(key, resolved, strlen(resolved), 0);
+	else
+		watched_put(key, stamp, resolved, strlen(resolved),
+		            config_size("EXGT_REF_TTL", GIT_REF_TTL));
+
+found:
+	strcpy(obj->type, "tree");
+	strcpy(obj->mode, "040000");
+	ret = 0;
+out:
+	free(neg_stamp);
+	free(neg_key);
+	free(stamp);
+	free(key);
+	return ret;
+}
+
+int git_resolve_path(const char *root, const char *path, struct git_obj *obj)
+{
+	/* the tree is content addressed, so a path missing from it is missing
+	 * in every repository */
+	char *neg_key, *neg;
+	if ((neg_key = git_neg_key("nopath", obj->oid, path))
+	    && (neg = shm_get(neg_key, NULL))) {
+		stats_add("negative_hits", 1);
+		free(neg);
+		free(neg_key);
+		return -1;
+	}
+
+	char *path_dup;
+	if (!(path_dup = strdup(path))) {
+		free(neg_key);
+		return -1;
+	}
+
+	int ret = 0;
+	bool missing = false;
+	char *save = NULL;
+	for (char *elem = strtok_r(path_dup, "/", &save); elem;
+	     elem = strtok_r(NULL, "/", &save)) {
+		if (strcmp(obj->type, "tree") != 0) {
+			missing = true;
+			ret = -1;
+			break;
+		}
+
+		size_t size = 0;
+		char *listing;
+		if (!(listing = git_tree(root, obj->oid, &size))) {
+			ret = -1;
+			break;
+		}
+
+		ret = git_tree_find(listing, size, elem, obj);
+		free(listing);
+
+		if (ret) {
+			missing = true;
+			break;
+		}
+	}
+
+	if (missing && neg_key)
+		shm_put(neg_key, "", 0, git_neg_ttl());
+
+	free(neg_key);
+	free(path_dup);
+	return ret;
+}
+
+int git_blob_sizes(const char *root, size_t n, char *oids[], ssize_t sizes[])
+{
+	FILE *misses = NULL;
+	for (size_t i = 0; i < n; ++i) {
+		char *size;
+		if ((size = cache_get("size", oids[i], NULL))) {
+			sizes[i] = strtoll(size, NULL, 10);
+			free(size);
+			continue;
+		}
+
+		sizes[i] = -1;
+
+		/* batch-check blocks on its output if we write to it directly,
+		 * so pass the list of misses in a temporary file instead */
+		if (!misses && !(misses = tmpfile()))
+			return -1;
+
+		fprintf(misses, "%s\n", oids[i]);
+	}
+
+	if (!misses)
+		return 0;
+
+	fflush(misses);
+	rewind(misses);
+
+	char **cmds[] =
+	{(char *[]){"git", "-C", (char *)root, "cat-file",
+		    "--batch-check=%(objectsize)", 0}};
+	FILE *batch = exgt_chain_from(fileno(misses), 1, cmds);
+	fclose(misses);
+
+	if (!batch)
+		return -1;
+
+	/* output is in the same order as input */
+	size_t len = 0;
+	char *line = NULL;
+	for (size_t i = 0; i < n; ++i) {
+		if (sizes[i] != -1)
+			continue;
+
+		if (getline(&line, &len, batch) == -1)
+			break;
+
+		/* missing objects are reported as "<oid> missing" */
+		if (!isdigit((unsigned char)line[0]))
+			continue;
+
+		sizes[i] = strtoll(line, NULL, 10);
+
+		char size[32];
+		int sl = snprintf(size, sizeof(size), "%lld", (long long)sizes[i]);
+		cache_put("size", oids[i], size, sl);
+	}
+
+	free(line);
+	fclose(batch);
+	return 0;
+}
+
+int git_resolve(const char *root, const char *commit, const char *path,
+                struct git_obj *obj)
+{
+	if (git_resolve_commit(root, commit, obj))
+		return -1;
+
+	return git_resolve_path(root, path, obj);
+}
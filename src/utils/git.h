@@ -9,6 +9,25 @@
  * Git helpers.
  */
 
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/** Maximum length of a hex object ID, large enough for SHA-256 repositories. */
+#define GIT_OID_MAX 64
+
+/** Git object resolved from a \c COMMIT:PATH pair. */
+struct git_obj {
+	/** ID of commit the object was resolved through. */
+	char commit[GIT_OID_MAX + 1];
+	/** ID of object itself. */
+	char oid[GIT_OID_MAX + 1];
+	/** Type of object, \c "tree", \c "blob" or \c "commit". */
+	char type[8];
+	/** Octal mode of object, the root tree is \c "040000". */
+	char mode[8];
+};
+
 /**
  * Get current page path relative to git directory. No trailing newlines.
  *
@@ -19,6 +38,8 @@ char *git_path();
 /**
  * Get git commit from URL.
  *
+ * Full object IDs are lowercased.
+ *
  * @todo check if HEAD works in bare repositories.
  * @return Commit ID to use. HEAD if commit is missing from URL.
  */
@@ -98,5 +119,85 @@ char *repo_real_file(char *path);
  */
 char *repo_description(char *path);
 
+/**
+ * Check if \p s is a full hex object ID.
+ *
+ * @param s String to check.
+ * @return \c true if \p s is an object ID, \c false otherwise.
+ */
+bool git_is_oid(const char *s);
+
+/**
+ * Get listing of tree, i.e. output of @code git ls-tree -z @endcode.
+ * Trees are content addressed, so listings are cached by tree ID and never
+ * go stale. Allocates memory, remember to free the listing after use.
+ *
+ * @param root Path to repository.
+ * @param tree ID of tree to list.
+ * @param size Where to place size of listing, ignored if \c NULL.
+ * @return Listing of tree, entries separated by \c NUL.
+ */
+char *git_tree(const char *root, const char *tree, size_t *size);
+
+/**
+ * Resolve commit.
+ * Sets \p obj to the root tree of \p commit, ready for git_resolve_path().
+ *
+ * @param root Path to repository.
+ * @param commit Commit-ish to resolve.
+ * @param obj Where to place resolved commit and its root tree.
+ * @return \c 0 on success, non-zero if \p commit doesn't exist.
+ */
+int git_resolve_commit(const char *root, const char *commit,
+                       struct git_obj *obj);
+
+/**
+ * Forget cached resolution of \p commit, i.e. after the ref was updated.
+ *
+ * @param root Path to repository.
+ * @param commit Commit-ish as passed to git_resolve_commit().
+ */
+void git_ref_forget(const char *root, const char *commit);
+
+/**
+ * Resolve path relative to tree.
+ * \p path is walked one tree at a time through git_tree().
+ *
+ * @param root Path to repository.
+ * @param path Path to object, relative to \p obj.
+ * @param obj Tree to start from, resolved object is placed here.
+ * @return \c 0 on success, non-zero if \p path doesn't exist.
+ */
+int git_resolve_path(const char *root, const char *path, struct git_obj *obj);
+
+/**
+ * Resolve \c COMMIT:PATH to an object.
+ * \p path is walked one tree at a time through git_tree(), so resolving
+ * paths in recently viewed directories doesn't have to touch git beyond
+ * resolving \p commit itself.
+ *
+ * @param root Path to repository.
+ * @param commit Commit-ish to resolve \p path in.
+ * @param path Path to object, relative to repository root.
+ * @param obj Where to place resolved object.
+ * @return \c 0 on success, non-zero if \p commit or \p path doesn't exist.
+ */
+int git_resolve(const char *root, const char *commit, const char *path,
+                struct git_obj *obj);
+
+/**
+ * Get sizes of blobs.
+ * Sizes are cached by blob ID. All misses are looked up with a single
+ * @code git cat-file --batch-check @endcode, which only reads object headers
+ * (and delta result size headers for deltified objects) without inflating
+ * any content.
+ *
+ * @param root Path to repository.
+ * @param n Number of blobs.
+ * @param oids IDs of blobs.
+ * @param sizes Where to place sizes of blobs, \c -1 if size is unknown.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int git_blob_sizes(const char *root, size_t n, char *oids[], ssize_t sizes[]);
 
 #endif /* EXGT_GIT_H */
@@ -6,29 +6,121 @@
  * HTTP helper implementation.
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include "config.h"
 #include "http.h"
+#include "url.h"
 
-void http_status(FILE *f, int code)
+/** Maximum number of extra headers in one response. */
+#define HTTP_MAX_HEADERS 8
+
+/** Extra headers queued for the response. */
+static struct {
+	/** Number of queued headers. */
+	size_t n;
+	/** Names of headers. */
+	const char *name[HTTP_MAX_HEADERS];
+	/** Values of headers. */
+	char *value[HTTP_MAX_HEADERS];
+} headers;
+
+void http_add_header(const char *name, const char *value)
+{
+	if (headers.n >= HTTP_MAX_HEADERS)
+		return;
+
+	char *value_dup;
+	if (!(value_dup = strdup(value)))
+		return;
+
+	headers.name[headers.n] = name;
+	headers.value[headers.n++] = value_dup;
+}
+
+void http_clear_headers()
+{
+	for (size_t i = 0; i < headers.n; ++i)
+		free(headers.value[i]);
+
+	headers.n = 0;
+}
+
+/**
+ * Write queued extra headers.
+ *
+ * @param o Output buffer to write to.
+ */
+static void http_print_headers(struct obuf *o)
+{
+	for (size_t i = 0; i < headers.n; ++i) {
+		obuf_str(o, headers.name[i]);
+		obuf_lit(o, ": ");
+		obuf_str(o, headers.value[i]);
+		obuf_char(o, '\n');
+	}
+}
+
+char *http_etag(const char *id)
+{
+	const char *version = config_version();
+	size_t len = strlen(version) + strlen(id) + 4;
+	char *etag;
+	if (!(etag = malloc(len)))
+		return NULL;
+
+	snprintf(etag, len, "\"%s-%s\"", version, id);
+	return etag;
+}
+
+bool http_not_modified(const char *etag)
 {
-	fprintf(f, "Status: %d\n\n", code);
+	char *match;
+	if (!(match = getenv("HTTP_IF_NONE_MATCH")))
+		return false;
+
+	if (strcmp(match, "*") == 0)
+		return true;
+
+	/* matches both strong and weak validators in a list of them */
+	return strstr(match, etag) != NULL;
 }
 
-void http_content(FILE *f, const char*type)
+void http_status(struct obuf *o, int code)
 {
-	fprintf(f, "Content-type: %s\n\n", type);
+	obuf_lit(o, "Status: ");
+	obuf_uint(o, code);
+	obuf_char(o, '\n');
+	http_print_headers(o);
+	obuf_char(o, '\n');
 }
 
-void http_header(FILE *f, int code, const char *type)
+void http_content(struct obuf *o, const char *type)
 {
-	fprintf(f, "Status: %d\n", code);
-	fprintf(f, "Content-type: %s\n\n", type);
+	obuf_lit(o, "Content-type: ");
+	obuf_str(o, type);
+	obuf_lit(o, "\n\n");
+}
+
+void http_header(struct obuf *o, int code, const char *type)
+{
+	obuf_lit(o, "Status: ");
+	obuf_uint(o, code);
+	obuf_char(o, '\n');
+	http_print_headers(o);
+	http_content(o, type);
 }
 
 enum http_type http_request_type()
 {
+	char *raw;
+	if (getenv("QUERY_STRING") && (raw = url_option("raw"))) {
+		free(raw);
+		return RAW;
+	}
+
 	char *accept = getenv("HTTP_ACCEPT");
 	if (!accept) {
 		fprintf(stderr, "couldn't find HTTP_ACCEPT\n");
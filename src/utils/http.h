@@ -9,42 +9,75 @@
 #ifndef EXGT_HTTP_H
 #define EXGT_HTTP_H
 
-#include <stdio.h>
+#include <stdbool.h>
+
+#include "obuf.h"
+
+/**
+ * Queue extra header for the response.
+ * Queued headers are written by http_status() and http_header().
+ *
+ * @param name Name of header.
+ * @param value Value of header, copied.
+ */
+void http_add_header(const char *name, const char *value);
+
+/** Drop all queued headers, i.e. when the response turns into an error. */
+void http_clear_headers();
+
+/**
+ * Build strong entity tag.
+ *
+ * @param id Something that uniquely identifies the response content, usually
+ * an object ID. The exgt version is added automatically.
+ * @return Quoted entity tag in new buffer.
+ */
+char *http_etag(const char *id);
+
+/**
+ * Check if client already has the response.
+ *
+ * @param etag Entity tag of response, from http_etag().
+ * @return \c true if \c If-None-Match matches \p etag.
+ */
+bool http_not_modified(const char *etag);
 
 /**
  * Write only \c http status.
  *
- * @param f Output file to write to.
+ * @param o Output buffer to write to.
  * @param code Status code to attach.
  */
-void http_status(FILE *f, int code);
+void http_status(struct obuf *o, int code);
 
 /**
  * Write only \c http content type.
  *
- * @param f Output file to write to.
+ * @param o Output buffer to write to.
  * @param type Content type. \c "text/html", \c "text/css" etc.
  */
-void http_content(FILE *f, const char *type);
+void http_content(struct obuf *o, const char *type);
 
 /**
  * Write both status and content.
  * Note that it's not possible by chaining http_status() and http_content(), as
  * the HTTP header requires two newlines after it.
  *
- * @param f Output file to write to.
+ * @param o Output buffer to write to.
  * @param code Status code to attach.
  * @param type Content type.
  */
-void http_header(FILE *f, int code, const char *type);
+void http_header(struct obuf *o, int code, const char *type);
 
-/** Requested content type. We only serve \c html and \c css. */
+/** Requested content type. We only serve \c html, \c css and raw blobs. */
 enum http_type {
-	TEXT_HTML, TEXT_CSS, OTHER,
+	TEXT_HTML, TEXT_CSS, RAW, OTHER,
 };
 
 /**
  * Get \c http request type.
+ * Raw blobs are requested with \c raw in the query string, whatever the
+ * client claims to accept.
  *
  * @return \c http request type.
  */
@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file lines.c
+ * Line splitting implementation.
+ */
+
+#include <stdlib.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "lines.h"
+
+/**
+ * Scalar version of lines_scan().
+ *
+ * @param buf Buffer to scan.
+ * @param size Size of \p buf.
+ * @param base Offset of \p buf in whole buffer.
+ * @param out Where to place offset after each newline, \c NULL to only count.
+ * @return Number of newlines found.
+ */
+static size_t lines_scan_scalar(const char *buf, size_t size, size_t base,
+                                uint64_t *out)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < size; ++i) {
+		if (buf[i] != '\n')
+			continue;
+
+		if (out)
+			out[n] = base + i + 1;
+
+		n++;
+	}
+
+	return n;
+}
+
+/**
+ * Turn newline mask of one vector into offsets.
+ *
+ * @param mask Bit \c i set if byte \c i is a newline.
+ * @param base Offset of vector in whole buffer.
+ * @param out Where to place offset after each newline, \c NULL to only count.
+ * @return Number of newlines in \p mask.
+ */
+static inline size_t lines_mask(unsigned mask, size_t base, uint64_t *out)
+{
+	if (!out)
+		return __builtin_popcount(mask);
+
+	size_t n = 0;
+	while (mask) {
+		out[n++] = base + __builtin_ctz(mask) + 1;
+		mask &= mask - 1;
+	}
+
+	return n;
+}
+
+#if defined(__x86_64__)
+/**
+ * SSE2 version of lines_scan().
+ * SSE2 is part of x86-64, so this is always available.
+ *
+ * @param buf Buffer to scan.
+ * @param size Size of \p buf.
+ * @param base Offset of \p buf in whole buffer.
+ * @param out Where to place offset after each newline, \c NULL to only count.
+ * @return Number of newlines found.
+ */
+static size_t lines_scan_sse2(const char *buf, size_t size, size_t base,
+                              uint64_t *out)
+{
+	const __m128i nl = _mm_set1_epi8('\n');
+
+	size_t n = 0, i = 0;
+	for (; i + 16 <= size; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+		n += lines_mask(mask, base + i, out ? out + n : NULL);
+	}
+
+	return n + lines_scan_scalar(buf + i, size - i, base + i,
+	                             out ? out + n : NULL);
+}
+
+/**
+ * AVX2 version of lines_scan().
+ *
+ * @param buf Buffer to scan.
+ * @param size Size of \p buf.
+ * @param base Offset of \p buf in whole buffer.
+ * @param out Where to place offset after each newline, \c NULL to only count.
+ * @return Number of newlines found.
+ */
+__attribute__((target("avx2,popcnt")))
+static size_t lines_scan_avx2(const char *buf, size_t size, size_t base,
+                              uint64_t *out)
+{
+	const __m256i nl = _mm256_set1_epi8('\n');
+
+	size_t n = 0, i = 0;
+	for (; i + 32 <= size; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+		n += lines_mask(mask, base + i, out ? out + n : NULL);
+	}
+
+	/* dirty upper halves would stall the SSE2 code */
+	_mm256_zeroupper();
+	return n + lines_scan_sse2(buf + i, size - i, base + i,
+	                           out ? out + n : NULL);
+}
+#endif
+
+/**
+ * Find newlines.
+ *
+ * @param buf Buffer to scan.
+ * @param size Size of \p buf.
+ * @param out Where to place offset after each newline, \c NULL to only count.
+ * @return Number of newlines found.
+ */
+static size_t lines_scan(const char *buf, size_t size, uint64_t *out)
+{
+#if defined(__x86_64__)
+	static int avx2 = -1;
+	if (avx2 < 0)
+		avx2 = __builtin_cpu_supports("avx2");
+
+	if (avx2)
+		return lines_scan_avx2(buf, size, 0, out);
+
+	return lines_scan_sse2(buf, size, 0, out);
+#else
+	return lines_scan_scalar(buf, size, 0, out);
+#endif
+}
+
+uint64_t *lines_split(const char *buf, size_t size, size_t *n)
+{
+	/* one pass to size the index, one to fill it */
+	size_t newlines = lines_scan(buf, size, NULL);
+
+	uint64_t *offsets;
+	if (!(offsets = malloc((newlines + 2) * sizeof(*offsets))))
+		return NULL;
+
+	offsets[0] = 0;
+	lines_scan(buf, size, offsets + 1);
+
+	/* a trailing newline ends the last line instead of starting a new one,
+	 * its offset already is size */
+	*n = size && buf[size - 1] != '\n' ? newlines + 1 : newlines;
+	offsets[*n] = size;
+	return offsets;
+}
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file lines.h
+ * Line splitting header.
+ *
+ * Splits a buffer into lines without copying anything, lines are described
+ * by the offset they start at. Large files have tens of thousands of short
+ * lines, so newlines are looked for a vector at a time with SSE2 or AVX2
+ * where available instead of one memchr() per line.
+ */
+
+#ifndef EXGT_LINES_H
+#define EXGT_LINES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Split buffer into lines.
+ * Lines keep their newline, same as getline(), and the last line doesn't
+ * need one. Line \c i spans from \c offsets[i] up to \c offsets[i + 1].
+ *
+ * @param buf Buffer to split.
+ * @param size Size of \p buf.
+ * @param n Where to place number of lines.
+ * @return Offset of each line followed by \p size, in new buffer, \c NULL on
+ * error.
+ */
+uint64_t *lines_split(const char *buf, size_t size, size_t *n);
+
+#endif /* EXGT_LINES_H */
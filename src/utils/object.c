@@ -0,0 +1,516 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file object.c
+ * Git object reader implementation.
+ *
+ * Packs are found through their version 2 indexes, which map object IDs to
+ * offsets in the pack. The index is the same for SHA-1 and SHA-256
+ * repositories apart from the length of the IDs in it.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <zlib.h>
+
+#include "object.h"
+#include "chain.h"
+#include "file.h"
+#include "path.h"
+#include "git.h"
+
+/** Size of chunks compressed data is read in. */
+#define OBJECT_CHUNK (64 * 1024)
+
+/** Longest header of a loose object, i.e. \c "blob 123\0". */
+#define OBJECT_HEADER 32
+
+/** Type of blobs in packs. */
+#define OBJECT_PACK_BLOB 3
+
+struct object_stream {
+	/** Number of bytes of blob not read yet. */
+	size_t left;
+	/** Loose object or pack the blob is inflated from, or pipe from git. */
+	int fd;
+	/** Offset of next compressed byte in \ref fd. */
+	off_t pos;
+	/** git the blob is read from, \c NULL if it's inflated directly. */
+	FILE *git;
+	/** Set once \ref z is initialized. */
+	bool inflating;
+	/** Inflate state. */
+	z_stream z;
+	/** Compressed data read but not inflated yet. */
+	unsigned char in[OBJECT_CHUNK];
+};
+
+/**
+ * Get object directory of repository, bare or not.
+ *
+ * @param root Path to repository.
+ * @return Object directory in new buffer.
+ */
+static char *object_dir(const char *root)
+{
+	char *dotgit;
+	if (!(dotgit = build_path(root, ".git")))
+		return NULL;
+
+	struct stat st;
+	char *objects = stat(dotgit, &st) == 0 && S_ISDIR(st.st_mode)
+	                ? build_path(dotgit, "objects")
+	                : build_path(root, "objects");
+
+	free(dotgit);
+	return objects;
+}
+
+/**
+ * Parse hex object ID.
+ *
+ * @param oid Object ID, already checked with git_is_oid().
+ * @param hash Where to place raw ID.
+ * @return Length of raw ID.
+ */
+static size_t object_hash(const char *oid, unsigned char hash[])
+{
+	size_t len = strlen(oid) / 2;
+	for (size_t i = 0; i < len; ++i) {
+		char byte[3] = {oid[2 * i], oid[2 * i + 1], 0};
+		hash[i] = strtoul(byte, NULL, 16);
+	}
+
+	return len;
+}
+
+/**
+ * Inflate next part of blob.
+ *
+ * @param s Blob to inflate.
+ * @param buf Buffer to inflate into.
+ * @param len Size of \p buf.
+ * @return Number of bytes inflated, negative on error.
+ */
+static ssize_t object_inflate(struct object_stream *s, char *buf, size_t len)
+{
+	s->z.next_out = (Bytef *)buf;
+	s->z.avail_out = len;
+	while (s->z.avail_out) {
+		if (!s->z.avail_in) {
+			ssize_t r = pread(s->fd, s->in, sizeof(s->in), s->pos);
+			if (r < 0 && errno == EINTR)
+				continue;
+
+			if (r <= 0)
+				return -1;
+
+			s->pos += r;
+			s->z.next_in = s->in;
+			s->z.avail_in = r;
+		}
+
+		int ret = inflate(&s->z, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END)
+			break;
+
+		if (ret != Z_OK)
+			return -1;
+	}
+
+	return len - s->z.avail_out;
+}
+
+/**
+ * Start inflating blob.
+ *
+ * @param s Blob to inflate.
+ * @param fd File to inflate blob from.
+ * @param pos Offset of compressed data in \p fd.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int object_start(struct object_stream *s, int fd, off_t pos)
+{
+	s->fd = fd;
+	s->pos = pos;
+	if (inflateInit(&s->z) != Z_OK)
+		return -1;
+
+	s->inflating = true;
+	return 0;
+}
+
+/**
+ * Open loose blob.
+ *
+ * @param s Blob to open.
+ * @param objects Object directory.
+ * @param oid ID of blob.
+ * @param size Where to place size of blob.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int object_open_loose(struct object_stream *s, const char *objects,
+                             const char *oid, size_t *size)
+{
+	size_t len = strlen(objects) + strlen(oid) + 3;
+	char *path;
+	if (!(path = malloc(len)))
+		return -1;
+
+	snprintf(path, len, "%s/%.2s/%s", objects, oid, oid + 2);
+	int fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0)
+		return -1;
+
+	if (object_start(s, fd, 0))
+		return -1;
+
+	/* inflate header a byte at a time so none of the blob is inflated
+	 * along with it */
+	char header[OBJECT_HEADER];
+	size_t hl = 0;
+	do {
+		if (hl == sizeof(header)
+		    || object_inflate(s, header + hl, 1) != 1)
+			return -1;
+	} while (header[hl++]);
+
+	char *end;
+	if (strncmp(header, "blob ", 5) != 0)
+		return -1;
+
+	*size = strtoull(header + 5, &end, 10);
+	return *end ? -1 : 0;
+}
+
+/**
+ * Read big endian 32 bit integer.
+ *
+ * @param p Bytes to read.
+ * @return Integer.
+ */
+static uint32_t object_be32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16
+	       | (uint32_t)p[2] << 8 | p[3];
+}
+
+/**
+ * Look up object in pack index.
+ *
+ * @param path Path to pack index.
+ * @param hash Raw ID of object.
+ * @param hl Length of \p hash.
+ * @param offset Where to place offset of object in pack.
+ * @return \c 0 if found, non-zero otherwise.
+ */
+static int object_pack_find(const char *path, const unsigned char *hash,
+                            size_t hl, uint64_t *offset)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) || st.st_size < 8 + 256 * 4) {
+		close(fd);
+		return -1;
+	}
+
+	size_t size = st.st_size;
+	const unsigned char *m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd,
+	                              0);
+	close(fd);
+	if (m == MAP_FAILED)
+		return -1;
+
+	int ret = -1;
+	if (memcmp(m, "\377tOc", 4) != 0 || object_be32(m + 4) != 2)
+		goto out;
+
+	/* fanout counts objects with a first byte up to and including its
+	 * index */
+	const unsigned char *fanout = m + 8;
+	uint32_t n = object_be32(fanout + 255 * 4);
+	uint32_t lo = hash[0] ? object_be32(fanout + (hash[0] - 1) * 4) : 0;
+	uint32_t hi = object_be32(fanout + hash[0] * 4);
+
+	const unsigned char *names = fanout + 256 * 4;
+	const unsigned char *offsets = names + (size_t)n * (hl + 4);
+	const unsigned char *large = offsets + (size_t)n * 4;
+	if (hi > n || lo > hi || (size_t)(large - m) > size)
+		goto out;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int c = memcmp(names + (size_t)mid * hl, hash, hl);
+		if (c == 0) {
+			uint32_t o = object_be32(offsets + (size_t)mid * 4);
+			if (!(o & 0x80000000)) {
+				*offset = o;
+				ret = 0;
+				break;
+			}
+
+			/* too large for 32 bits, stored separately */
+			const unsigned char *l = large
+			                         + (size_t)(o & 0x7fffffff) * 8;
+			if ((size_t)(l + 8 - m) > size)
+				break;
+
+			*offset = (uint64_t)object_be32(l) << 32
+			          | object_be32(l + 4);
+			ret = 0;
+			break;
+		}
+
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+out:
+	munmap((void *)m, size);
+	return ret;
+}
+
+/**
+ * Open packed blob, if it isn't deltified.
+ *
+ * @param s Blob to open.
+ * @param objects Object directory.
+ * @param oid ID of blob.
+ * @param size Where to place size of blob.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int object_open_packed(struct object_stream *s, const char *objects,
+                              const char *oid, size_t *size)
+{
+	unsigned char hash[GIT_OID_MAX / 2];
+	size_t hl = object_hash(oid, hash);
+
+	char *pack;
+	if (!(pack = build_path(objects, "pack")))
+		return -1;
+
+	DIR *dir = opendir(pack);
+	if (!dir) {
+		free(pack);
+		return -1;
+	}
+
+	int ret = -1;
+	struct dirent *dirent;
+	while ((dirent = readdir(dir))) {
+		char *suffix;
+		if (!(suffix = strrchr(dirent->d_name, '.'))
+		    || strcmp(suffix, ".idx") != 0)
+			continue;
+
+		char *idx;
+		if (!(idx = build_path(pack, dirent->d_name)))
+			break;
+
+		uint64_t offset;
+		int found = object_pack_find(idx, hash, hl, &offset);
+		if (found) {
+			free(idx);
+			continue;
+		}
+
+		/* pack has the same name as its index */
+		strcpy(idx + strlen(idx) - 4, ".pack");
+		s->fd = open(idx, O_RDONLY);
+		free(idx);
+		if (s->fd < 0)
+			break;
+
+		/* type and size, size continues in the low seven bits of
+		 * following bytes as long as the high bit is set */
+		unsigned char header[16];
+		ssize_t got = pread(s->fd, header, sizeof(header), offset);
+		if (got <= 0 || (header[0] >> 4 & 7) != OBJECT_PACK_BLOB)
+			break;
+
+		uint64_t len = header[0] & 15;
+		ssize_t i = 0;
+		for (unsigned shift = 4; header[i] & 0x80; shift += 7) {
+			if (++i == got || shift > 57)
+				break;
+
+			len |= (uint64_t)(header[i] & 0x7f) << shift;
+		}
+
+		if (i == got || header[i] & 0x80
+		    || object_start(s, s->fd, offset + i + 1))
+			break;
+
+		*size = len;
+		ret = 0;
+		break;
+	}
+
+	closedir(dir);
+	free(pack);
+	return ret;
+}
+
+/**
+ * Open blob through git.
+ *
+ * @param s Blob to open.
+ * @param root Path to repository.
+ * @param oid ID of blob.
+ * @param size Where to place size of blob.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int object_open_git(struct object_stream *s, const char *root,
+                           const char *oid, size_t *size)
+{
+	ssize_t blob_size = -1;
+	if (git_blob_sizes(root, 1, (char *[]){(char *)oid}, &blob_size)
+	    || blob_size < 0)
+		return -1;
+
+	char **cmds[] =
+	{(char *[]){"git", "-C", (char *)root, "cat-file", "blob", (char *)oid,
+		    0}};
+	if (!(s->git = exgt_chain(1, cmds)))
+		return -1;
+
+	s->fd = fileno(s->git);
+	*size = blob_size;
+	return 0;
+}
+
+/**
+ * Forget partially opened blob, so it can be opened some other way.
+ *
+ * @param s Blob to reset.
+ */
+static void object_reset(struct object_stream *s)
+{
+	if (s->inflating)
+		inflateEnd(&s->z);
+
+	if (s->fd >= 0)
+		close(s->fd);
+
+	memset(&s->z, 0, sizeof(s->z));
+	s->inflating = false;
+	s->fd = -1;
+}
+
+struct object_stream *object_open(const char *root, const char *oid,
+                                  size_t *size)
+{
+	/* also keeps the ID from escaping the object directory */
+	if (!git_is_oid(oid))
+		return NULL;
+
+	struct object_stream *s;
+	if (!(s = calloc(1, sizeof(*s))))
+		return NULL;
+
+	s->fd = -1;
+
+	char *objects = object_dir(root);
+	if (objects && !object_open_loose(s, objects, oid, size))
+		goto found;
+
+	object_reset(s);
+	if (objects && !object_open_packed(s, objects, oid, size))
+		goto found;
+
+	object_reset(s);
+	if (object_open_git(s, root, oid, size)) {
+		free(objects);
+		free(s);
+		return NULL;
+	}
+
+found:
+	free(objects);
+	s->left = *size;
+	return s;
+}
+
+ssize_t object_read(struct object_stream *s, char *buf, size_t len)
+{
+	if (len > s->left)
+		len = s->left;
+
+	if (!len)
+		return 0;
+
+	ssize_t r;
+	if (s->git) {
+		do
+			r = read(s->fd, buf, len);
+		while (r < 0 && errno == EINTR);
+	} else
+		r = object_inflate(s, buf, len);
+
+	/* blob ended before its size said it would */
+	if (r <= 0)
+		return -1;
+
+	s->left -= r;
+	return r;
+}
+
+int object_send(struct object_stream *s, int out, size_t offset, size_t size)
+{
+	char buf[OBJECT_CHUNK];
+	while (offset) {
+		ssize_t r = object_read(s, buf, offset < sizeof(buf)
+		                        ? offset : sizeof(buf));
+		if (r <= 0)
+			return -1;
+
+		offset -= r;
+	}
+
+	if (s->git)
+		return send_pipe(out, s->fd, size);
+
+	while (size) {
+		ssize_t r = object_read(s, buf, size < sizeof(buf)
+		                        ? size : sizeof(buf));
+		if (r <= 0 || write_all(out, buf, r))
+			return -1;
+
+		size -= r;
+	}
+
+	return 0;
+}
+
+void object_close(struct object_stream *s)
+{
+	if (!s)
+		return;
+
+	if (s->inflating)
+		inflateEnd(&s->z);
+
+	if (s->git)
+		fclose(s->git);
+	else if (s->fd >= 0)
+		close(s->fd);
+
+	free(s);
+}
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file object.h
+ * Git object reader header.
+ *
+ * Reads blobs straight from the object store without starting git. Loose
+ * objects and packed objects that aren't deltified are inflated as they are
+ * read. Anything else, like deltified objects or objects only found through
+ * alternates, is read from @code git cat-file blob @endcode instead.
+ */
+
+#ifndef EXGT_OBJECT_H
+#define EXGT_OBJECT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/** Blob being read, opaque. */
+struct object_stream;
+
+/**
+ * Open blob for reading.
+ *
+ * @param root Path to repository.
+ * @param oid ID of blob.
+ * @param size Where to place size of blob.
+ * @return Open blob, \c NULL on error. Close with object_close().
+ */
+struct object_stream *object_open(const char *root, const char *oid,
+                                  size_t *size);
+
+/**
+ * Read next part of blob.
+ *
+ * @param s Blob to read.
+ * @param buf Buffer to read into.
+ * @param len Size of \p buf.
+ * @return Number of bytes read, \c 0 at end of blob, negative on error.
+ */
+ssize_t object_read(struct object_stream *s, char *buf, size_t len);
+
+/**
+ * Write part of blob to a file descriptor.
+ * Blobs read from git are spliced over without copying, see send_pipe().
+ * There's no seeking in compressed data, so everything up to \p offset is
+ * still read and dropped.
+ *
+ * @param s Blob to write, nothing should have been read from it yet.
+ * @param out File descriptor to write to.
+ * @param offset Offset in blob to start from.
+ * @param size Number of bytes to write.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int object_send(struct object_stream *s, int out, size_t offset, size_t size);
+
+/**
+ * Close blob.
+ *
+ * @param s Blob to close.
+ */
+void object_close(struct object_stream *s);
+
+#endif /* EXGT_OBJECT_H */
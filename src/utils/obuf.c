@@ -0,0 +1,211 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file obuf.c
+ * Output buffer implementation.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "obuf.h"
+
+void obuf_init(struct obuf *o, int fd)
+{
+	*o = (struct obuf){NULL, 0, 0, fd, NULL, NULL, false, false};
+}
+
+void obuf_sink(struct obuf *o, int (*sink)(void *ctx, const char *data,
+                                           size_t len), void *ctx)
+{
+	o->sink = sink;
+	o->ctx = ctx;
+}
+
+/**
+ * Check if buffer is flushed as it fills up.
+ *
+ * @param o Output buffer.
+ * @return \c true if output goes to a file descriptor or sink.
+ */
+static bool obuf_streamed(const struct obuf *o)
+{
+	return o->fd >= 0 || o->sink;
+}
+
+/**
+ * Reset buffer to empty, keeping where output goes.
+ *
+ * @param o Output buffer.
+ */
+static void obuf_reset(struct obuf *o)
+{
+	int (*sink)(void *, const char *, size_t) = o->sink;
+	void *ctx = o->ctx;
+	obuf_init(o, o->fd);
+	obuf_sink(o, sink, ctx);
+}
+
+/**
+ * Write data out in full, to sink or file descriptor.
+ *
+ * @param o Output buffer.
+ * @param data Data to write.
+ * @param len Length of \p data.
+ */
+static void obuf_write_out(struct obuf *o, const char *data, size_t len)
+{
+	o->flushed = true;
+	if (o->sink) {
+		if (o->sink(o->ctx, data, len))
+			o->err = true;
+
+		return;
+	}
+
+	while (len) {
+		ssize_t w = write(o->fd, data, len);
+		if (w < 0 && errno == EINTR)
+			continue;
+
+		if (w <= 0) {
+			o->err = true;
+			return;
+		}
+
+		data += w;
+		len -= w;
+	}
+}
+
+/**
+ * Make room in buffer.
+ *
+ * @param o Output buffer.
+ * @param len Number of bytes to make room for.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int obuf_reserve(struct obuf *o, size_t len)
+{
+	if (o->cap - o->len >= len)
+		return 0;
+
+	if (obuf_streamed(o) && o->len) {
+		obuf_flush(o);
+		if (o->cap >= len)
+			return 0;
+	}
+
+	size_t cap = o->cap ? o->cap : OBUF_FLUSH;
+	while (cap - o->len < len)
+		cap *= 2;
+
+	char *buf;
+	if (!(buf = realloc(o->buf, cap))) {
+		o->err = true;
+		return -1;
+	}
+
+	o->buf = buf;
+	o->cap = cap;
+	return 0;
+}
+
+void obuf_write(struct obuf *o, const void *data, size_t len)
+{
+	if (obuf_streamed(o) && len >= OBUF_FLUSH) {
+		obuf_flush(o);
+		obuf_write_out(o, data, len);
+		return;
+	}
+
+	if (obuf_reserve(o, len))
+		return;
+
+	memcpy(o->buf + o->len, data, len);
+	o->len += len;
+}
+
+void obuf_str(struct obuf *o, const char *s)
+{
+	obuf_write(o, s, strlen(s));
+}
+
+void obuf_char(struct obuf *o, char c)
+{
+	if (o->len < o->cap) {
+		o->buf[o->len++] = c;
+		return;
+	}
+
+	obuf_write(o, &c, 1);
+}
+
+size_t obuf_format_uint(char *buf, unsigned long long n)
+{
+	/* digits come out backwards */
+	char tmp[OBUF_UINT_MAX];
+	size_t i = 0;
+	do {
+		tmp[i++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+
+	for (size_t j = 0; j < i; ++j)
+		buf[j] = tmp[i - j - 1];
+
+	buf[i] = 0;
+	return i;
+}
+
+void obuf_uint(struct obuf *o, unsigned long long n)
+{
+	char buf[OBUF_UINT_MAX];
+	obuf_write(o, buf, obuf_format_uint(buf, n));
+}
+
+int obuf_truncate(struct obuf *o)
+{
+	o->len = 0;
+	return o->flushed ? -1 : 0;
+}
+
+int obuf_flush(struct obuf *o)
+{
+	if (!obuf_streamed(o))
+		return o->err;
+
+	if (o->len)
+		obuf_write_out(o, o->buf, o->len);
+
+	o->len = 0;
+	return o->err;
+}
+
+char *obuf_take(struct obuf *o, size_t *size)
+{
+	/* terminate for convenience, not counted in size */
+	if (o->len && !obuf_reserve(o, 1))
+		o->buf[o->len] = 0;
+
+	char *buf = o->buf;
+	*size = o->len;
+	bool err = o->err;
+	obuf_reset(o);
+
+	if (err || !*size) {
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+void obuf_free(struct obuf *o)
+{
+	free(o->buf);
+	obuf_reset(o);
+}
@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file obuf.h
+ * Output buffer header.
+ *
+ * All output goes through an output buffer, which appends strings, literals
+ * and integers with a plain copy instead of going through stdio and format
+ * parsing for every little piece.
+ *
+ * A buffer either writes to a file descriptor or a sink function, in which
+ * case it's flushed in large blocks as it fills up, or keeps everything in
+ * memory to be taken with obuf_take(). Pages go to a sink that compresses them
+ * and tees them into the page cache on the way out, so only the first block
+ * can still be replaced by an error page.
+ */
+
+#ifndef EXGT_OBUF_H
+#define EXGT_OBUF_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/** Size at which a buffer writing to a file descriptor is flushed. */
+#define OBUF_FLUSH (64 * 1024)
+
+/** Room needed by obuf_format_uint(). */
+#define OBUF_UINT_MAX 21
+
+/** Output buffer. */
+struct obuf {
+	/** Buffered output. */
+	char *buf;
+	/** Number of bytes in \ref buf. */
+	size_t len;
+	/** Size of \ref buf. */
+	size_t cap;
+	/** File descriptor to flush to, \c -1 to keep everything in memory. */
+	int fd;
+	/** Called to flush instead of writing to \ref fd, \c NULL if none.
+	 * Returns non-zero if output was lost. */
+	int (*sink)(void *ctx, const char *data, size_t len);
+	/** Passed to \ref sink. */
+	void *ctx;
+	/** Set if something has been flushed, so can't be taken back. */
+	bool flushed;
+	/** Set if allocating or writing failed, output is incomplete. */
+	bool err;
+};
+
+/**
+ * Initialize output buffer.
+ *
+ * @param o Output buffer.
+ * @param fd File descriptor to write to, \c -1 to keep output in memory or
+ * to flush to a sink set with obuf_sink().
+ */
+void obuf_init(struct obuf *o, int fd);
+
+/**
+ * Flush buffer to a function instead.
+ * Blocks are handed to \p sink as the buffer fills up, in place of writing
+ * them to a file descriptor.
+ *
+ * @param o Output buffer.
+ * @param sink Function to hand flushed data to, returns non-zero on error.
+ * @param ctx Passed to \p sink.
+ */
+void obuf_sink(struct obuf *o, int (*sink)(void *ctx, const char *data,
+                                           size_t len), void *ctx);
+
+/**
+ * Append data.
+ * Large writes to a file descriptor or sink skip the buffer altogether.
+ *
+ * @param o Output buffer.
+ * @param data Data to append.
+ * @param len Length of \p data.
+ */
+void obuf_write(struct obuf *o, const void *data, size_t len);
+
+/**
+ * Append string.
+ *
+ * @param o Output buffer.
+ * @param s String to append.
+ */
+void obuf_str(struct obuf *o, const char *s);
+
+/**
+ * Append string literal, length is known at build time.
+ *
+ * @param o Output buffer.
+ * @param s String literal.
+ */
+#define obuf_lit(o, s) obuf_write((o), (s), sizeof(s) - 1)
+
+/**
+ * Append character.
+ *
+ * @param o Output buffer.
+ * @param c Character to append.
+ */
+void obuf_char(struct obuf *o, char c);
+
+/**
+ * Append unsigned integer in decimal.
+ *
+ * @param o Output buffer.
+ * @param n Integer to append.
+ */
+void obuf_uint(struct obuf *o, unsigned long long n);
+
+/**
+ * Format unsigned integer in decimal.
+ *
+ * @param buf Buffer with room for at least \ref OBUF_UINT_MAX characters.
+ * @param n Integer to format.
+ * @return Length of formatted integer, \p buf is \c NULL terminated.
+ */
+size_t obuf_format_uint(char *buf, unsigned long long n);
+
+/**
+ * Drop everything that's been appended and not flushed yet.
+ *
+ * @param o Output buffer.
+ * @return \c 0 on success, non-zero if some output was already flushed.
+ */
+int obuf_truncate(struct obuf *o);
+
+/**
+ * Write out buffered output.
+ * Does nothing for buffers kept in memory.
+ *
+ * @param o Output buffer.
+ * @return \c 0 on success, non-zero if some output was lost.
+ */
+int obuf_flush(struct obuf *o);
+
+/**
+ * Take output of buffer kept in memory.
+ * Buffer is left empty and can be reused.
+ *
+ * @param o Output buffer.
+ * @param size Where to place size of output.
+ * @return Output, \c NULL terminated for convenience, caller should free.
+ * \c NULL if there was none or if something failed along the way.
+ */
+char *obuf_take(struct obuf *o, size_t *size);
+
+/**
+ * Release output buffer.
+ * Unflushed output is dropped.
+ *
+ * @param o Output buffer.
+ */
+void obuf_free(struct obuf *o);
+
+#endif /* EXGT_OBUF_H */
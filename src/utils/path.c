@@ -78,6 +78,17 @@ char *build_path(const char *root, const char *path_info)
 	return path;
 }
 
+char *request_path()
+{
+	char *request_uri;
+	if (!(request_uri = getenv("REQUEST_URI"))) {
+		error("couldn't find REQUEST_URI\n");
+		return NULL;
+	}
+
+	return strndup(request_uri, strcspn(request_uri, "?"));
+}
+
 char *web_root_path()
 {
 	static char *request_uri;
@@ -97,10 +108,10 @@ char *web_root_path()
 		return NULL;
 	}
 
-	if (path_info[0] == '/' && path_info[1] == 0)
-		len = strlen(request_uri);
-	else
-		len = strlen(request_uri) - strlen(path_info);
+	/* query string isn't part of PATH_INFO */
+	len = strcspn(request_uri, "?");
+	if (path_info[0] != '/' || path_info[1] != 0)
+		len -= strlen(path_info);
 out:
 	return strndup(request_uri, len);
 }
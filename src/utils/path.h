@@ -20,6 +20,13 @@
  */
 char *build_path(const char *root, const char *path);
 
+/**
+ * Get path part of \c REQUEST_URI, without query string.
+ *
+ * @return Request path in new buffer, \c NULL on error.
+ */
+char *request_path();
+
 /**
  * Get web root path.
  *
@@ -0,0 +1,153 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file prefetch.c
+ * Speculative prefetching implementation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "chain.h"
+#include "cache.h"
+#include "config.h"
+#include "git.h"
+#include "prefetch.h"
+
+/** One queued object. */
+struct prefetch {
+	/** Kind of object. */
+	enum prefetch_type type;
+	/** ID of object. */
+	char oid[GIT_OID_MAX + 1];
+};
+
+/** Prefetch queue. Only ever one request per process, so a static is fine. */
+static struct {
+	/** Repository queued objects are in. */
+	char *root;
+	/** Number of queued objects. */
+	size_t n;
+	/** Maximum number of queued objects. */
+	size_t max;
+	/** Queued objects. */
+	struct prefetch *objs;
+	/** Called for each blob of prefetched trees, if set. */
+	void (*blob)(const char *root, const char *name, const char *oid);
+} queue;
+
+void prefetch_blobs(void (*fn)(const char *root, const char *name,
+                               const char *oid))
+{
+	queue.blob = fn;
+}
+
+void prefetch_add(const char *root, enum prefetch_type type, const char *oid)
+{
+	if (!queue.objs) {
+		if (!(queue.max = config_size("EXGT_PREFETCH", 0)))
+			return;
+
+		if (!(queue.objs = calloc(queue.max, sizeof(struct prefetch))))
+			return;
+	}
+
+	if (queue.n >= queue.max || strlen(oid) > GIT_OID_MAX)
+		return;
+
+	if (!queue.root && !(queue.root = strdup(root)))
+		return;
+
+	/* all objects should come from the same page, and thus the same
+	 * repository */
+	if (strcmp(queue.root, root) != 0)
+		return;
+
+	struct prefetch *p = &queue.objs[queue.n++];
+	p->type = type;
+	strcpy(p->oid, oid);
+}
+
+/**
+ * Prefetch one tree.
+ * Sizes of blobs are fetched first, as the listing needs them, then each blob
+ * is passed to \ref queue blob function.
+ *
+ * @param oid ID of tree.
+ */
+static void prefetch_tree(const char *oid)
+{
+	size_t size = 0;
+	char *listing;
+	if (!(listing = git_tree(queue.root, oid, &size)))
+		return;
+
+	size_t n = 0;
+	char **blobs = calloc(size / 2 + 1, sizeof(char *));
+	char **names = calloc(size / 2 + 1, sizeof(char *));
+	ssize_t *sizes = calloc(size / 2 + 1, sizeof(ssize_t));
+	for (char *e = listing; blobs && names && sizes && e < listing + size;
+	     e += strlen(e) + 1) {
+		char *type = strchr(e, ' ');
+		if (!type || strncmp(type + 1, "blob ", 5) != 0)
+			continue;
+
+		char *oid = type + 6;
+		char *tab;
+		if (!(tab = strchr(oid, '\t')))
+			continue;
+
+		*tab = 0;
+		names[n] = tab + 1;
+		blobs[n++] = oid;
+	}
+
+	if (blobs && names && sizes)
+		git_blob_sizes(queue.root, n, blobs, sizes);
+
+	for (size_t i = 0; queue.blob && i < n; ++i)
+		queue.blob(queue.root, names[i], blobs[i]);
+
+	free(blobs);
+	free(names);
+	free(sizes);
+	free(listing);
+}
+
+void prefetch_run()
+{
+	if (!queue.n)
+		return;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	/* parent just carries on to finish the request */
+	if (fork() != 0)
+		return;
+
+	/* let go of the web server, it's waiting for these to close */
+	setsid();
+	int null = open("/dev/null", O_RDWR);
+	dup2(null, STDIN_FILENO);
+	dup2(null, STDOUT_FILENO);
+	dup2(null, STDERR_FILENO);
+	close(null);
+
+	exgt_lower_priority();
+	cache_prefetching(true);
+
+	for (size_t i = 0; i < queue.n; ++i) {
+		switch (queue.objs[i].type) {
+		case PREFETCH_TREE:
+			prefetch_tree(queue.objs[i].oid);
+			break;
+		}
+	}
+
+	_exit(0);
+}
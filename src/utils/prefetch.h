@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file prefetch.h
+ * Speculative prefetching header.
+ *
+ * Pages queue objects the next request is likely to need while generating the
+ * current one. Once the response is out, prefetch_run() forks a low priority
+ * background process that pulls the queued objects into the cache.
+ * \c EXGT_PREFETCH sets how many objects one request may queue, \c 0 (the
+ * default) disables prefetching.
+ *
+ * Pages can also have blobs of prefetched trees rendered into the cache, see
+ * prefetch_blobs().
+ */
+
+#ifndef EXGT_PREFETCH_H
+#define EXGT_PREFETCH_H
+
+/** Kind of object to prefetch. */
+enum prefetch_type {
+	/** Tree listing and sizes of the blobs in it. */
+	PREFETCH_TREE,
+};
+
+/**
+ * Queue object for prefetching.
+ * Objects past the prefetch budget are silently dropped.
+ *
+ * @param root Path to repository the object is in.
+ * @param type Kind of object.
+ * @param oid ID of object.
+ */
+void prefetch_add(const char *root, enum prefetch_type type, const char *oid);
+
+/**
+ * Set function to call for each blob of prefetched trees.
+ * Lets pages render blobs they show as part of a tree, like READMEs, before
+ * the tree is visited.
+ *
+ * @param fn Function to call with path to repository, name of blob in tree
+ * and ID of blob.
+ */
+void prefetch_blobs(void (*fn)(const char *root, const char *name,
+                               const char *oid));
+
+/**
+ * Prefetch queued objects in the background.
+ * Should be called after the response has been written out, as the
+ * background process detaches from \c stdout.
+ */
+void prefetch_run();
+
+#endif /* EXGT_PREFETCH_H */
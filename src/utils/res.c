@@ -6,55 +6,166 @@
  * Simple resource manager implementation.
  */
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include "res.h"
 
+/** Size of regular chunks, arbitrary but fits most pages in one or two. */
+#define RES_CHUNK (64 * 1024)
+
+/** Alignment of allocations. */
+#define RES_ALIGN (_Alignof(max_align_t))
+
+/** Number of pointers in one block of handed over pointers. */
+#define RES_OWNED 64
+
+struct res_chunk {
+	/** Previous chunk. */
+	struct res_chunk *prev;
+	/** Size of \ref data. */
+	size_t size;
+	/** Bytes of \ref data in use. */
+	size_t used;
+	/** Memory allocations are carved out of. */
+	_Alignas(max_align_t) char data[];
+};
+
+struct res_owned {
+	/** Previous block. */
+	struct res_owned *prev;
+	/** Number of pointers in block. */
+	size_t n;
+	/** Handed over pointers. */
+	void *p[RES_OWNED];
+};
+
 /**
- * Grow resource manager buffer.
- * Doubles every call.
+ * Create new chunk.
  *
- * @param r Resource manager to expand.
+ * @param prev Previous chunk.
+ * @param size Minimum size of chunk.
+ * @return New chunk, \c NULL on error.
  */
-static void res_expand(struct res *r)
+static struct res_chunk *res_chunk_create(struct res_chunk *prev, size_t size)
 {
-	r->max *= 2;
-	r->p = realloc(r->p, r->max * sizeof(void *));
+	if (size < RES_CHUNK)
+		size = RES_CHUNK;
+
+	struct res_chunk *chunk;
+	if (!(chunk = malloc(sizeof(*chunk) + size)))
+		return NULL;
+
+	chunk->prev = prev;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
 }
 
 struct res *res_create()
 {
-	struct res *r = malloc(sizeof(struct res));
-	r->n = 0;
-	/* arbitrary number */
-	r->max = 1024;
-	r->p = calloc(1, r->max * sizeof(void *));
+	/* the manager itself is the first allocation in the first chunk */
+	struct res_chunk *chunk;
+	if (!(chunk = res_chunk_create(NULL, RES_CHUNK)))
+		return NULL;
+
+	struct res *r = (struct res *)chunk->data;
+	chunk->used = sizeof(*r);
+	r->chunk = chunk;
+	r->owned = NULL;
 	return r;
 }
 
-void res_add(struct res *r, void *p)
+void *res_alloc(struct res *r, size_t size)
 {
-	if (r->n >= r->max)
-		res_expand(r);
+	size = (size + RES_ALIGN - 1) & ~(RES_ALIGN - 1);
+
+	struct res_chunk *chunk = r->chunk;
+	if (chunk->size - chunk->used < size) {
+		/* big allocations get a chunk of their own, slipped in behind
+		 * the current one so what's left of it isn't wasted */
+		if (size > RES_CHUNK / 4) {
+			struct res_chunk *big;
+			if (!(big = res_chunk_create(chunk->prev, size)))
+				return NULL;
 
-	r->p[r->n++] = p;
+			chunk->prev = big;
+			big->used = size;
+			return big->data;
+		}
+
+		if (!(chunk = res_chunk_create(chunk, size)))
+			return NULL;
+
+		r->chunk = chunk;
+	}
+
+	void *p = chunk->data + chunk->used;
+	chunk->used += size;
+	return p;
 }
 
-void *res_alloc(struct res *r, size_t size)
+char *res_strdup(struct res *r, const char *s)
 {
-	void *p = malloc(size);
-	if (!p)
+	size_t len = strlen(s) + 1;
+	char *p;
+	if (!(p = res_alloc(r, len)))
+		return NULL;
+
+	return memcpy(p, s, len);
+}
+
+char *res_printf(struct res *r, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+
+	char *p;
+	if (len < 0 || !(p = res_alloc(r, len + 1)))
 		return NULL;
 
-	res_add(r, p);
+	va_start(args, fmt);
+	vsnprintf(p, len + 1, fmt, args);
+	va_end(args);
 	return p;
 }
 
+void res_add(struct res *r, void *p)
+{
+	if (!p)
+		return;
+
+	struct res_owned *owned = r->owned;
+	if (!owned || owned->n >= RES_OWNED) {
+		if (!(owned = res_alloc(r, sizeof(*owned)))) {
+			/* better to leak than to free something still in use */
+			return;
+		}
+
+		owned->prev = r->owned;
+		owned->n = 0;
+		r->owned = owned;
+	}
+
+	owned->p[owned->n++] = p;
+}
+
 void res_destroy(struct res *r)
 {
-	for (size_t i = 0; i < r->n; ++i)
-		free(r->p[i]);
+	for (struct res_owned *owned = r->owned; owned; owned = owned->prev)
+		for (size_t i = 0; i < owned->n; ++i)
+			free(owned->p[i]);
 
-	free(r->p);
-	free(r);
+	/* r lives in the first chunk, so nothing can touch it after this */
+	struct res_chunk *chunk = r->chunk;
+	while (chunk) {
+		struct res_chunk *prev = chunk->prev;
+		free(chunk);
+		chunk = prev;
+	}
 }
@@ -9,17 +9,31 @@
 #ifndef EXGT_RES_H
 #define EXGT_RES_H
 
+#include <stddef.h>
+
+/** Chunk of memory allocations are carved out of. */
+struct res_chunk;
+
+/** Block of pointers handed over with res_add(). */
+struct res_owned;
+
 /**
  * Very simple resource manager.
- * Keeps track of all allocations and frees them all at once.
+ *
+ * A region allocator, res_alloc() bumps a pointer in the current chunk and
+ * grabs a new chunk when it runs out, so allocating is cheap and everything
+ * is released at once by freeing a handful of chunks in res_destroy().
+ * Pointers allocated elsewhere, say by strdup() or some git helper, can still
+ * be handed over with res_add(), and are freed individually.
+ *
+ * One manager is expected to live for one request.
  */
 struct res {
-	/** Number of allocations. */
-	size_t n;
-	/** Maximum number of allocations. */
-	size_t max;
-	/** Pointer to array of pointers to allocations. */
-	void **p;
+	/** Current chunk, earlier ones are linked from it. */
+	struct res_chunk *chunk;
+	/** Current block of handed over pointers, earlier ones are linked from
+	 * it. */
+	struct res_owned *owned;
 };
 
 /**
@@ -30,19 +44,40 @@ struct res {
 struct res *res_create();
 
 /**
- * Resource manager wrapper around malloc().
+ * Allocate memory from resource manager.
+ * Memory is suitably aligned for any type and stays valid until
+ * res_destroy().
  *
  * @param r Resource manager.
  * @param size Size of allocation.
- * @return Pointer to newly allocated area.
+ * @return Pointer to newly allocated area, \c NULL on error.
  */
 void *res_alloc(struct res *r, size_t size);
 
+/**
+ * Duplicate string into resource manager.
+ *
+ * @param r Resource manager.
+ * @param s String to duplicate.
+ * @return Duplicate of \p s, \c NULL on error.
+ */
+char *res_strdup(struct res *r, const char *s);
+
+/**
+ * Format string into resource manager.
+ *
+ * @param r Resource manager.
+ * @param fmt Format string, see printf().
+ * @return Formatted string, \c NULL on error.
+ */
+char *res_printf(struct res *r, const char *fmt, ...)
+__attribute__((format(printf, 2, 3)));
+
 /**
  * Add already alloced pointer to manager.
  *
  * @param r Resource manager.
- * @param p Pointer to manage.
+ * @param p Pointer to manage, \c NULL is ignored.
  */
 void res_add(struct res *r, void *p);
 
@@ -0,0 +1,475 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file shm.c
+ * Shared memory cache implementation.
+ *
+ * The segment starts with a \ref shm_header, followed by sets of \ref SHM_WAYS
+ * fixed size slots. A freshly created segment is all zeroes, which is a valid
+ * empty cache, so there is no initialization step for processes to race on.
+ * The geometry is derived from the actual size of the segment, not from
+ * \c EXGT_SHM_SIZE, so processes with differing configuration still agree.
+ * Processes with differing layouts use different segments instead, see
+ * \ref SHM_LAYOUT.
+ *
+ * The header also holds a fixed table of named counters for stats.h, which
+ * are bumped with plain atomic adds. A slot is claimed for a name under
+ * \ref shm_header.counter_lock the first time the name is counted, and its
+ * name never changes after that.
+ *
+ * Locks store the pid of their holder. A process that dies while holding a
+ * lock would otherwise wedge its stripe forever, so waiters eventually check
+ * whether the holder is still around and take the lock over if not.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "shm.h"
+
+/**
+ * Layout version of segment, bump whenever \ref shm_header or \ref shm_slot
+ * change. It's part of the name, so binaries with differing layouts never map
+ * each other's segments.
+ */
+#define SHM_LAYOUT "2"
+
+/** Name of shared memory segment. */
+#define SHM_NAME "/exgt-cache-" SHM_LAYOUT
+
+/** Segments of earlier layouts, removed when a new segment is created. */
+static const char *const shm_old_names[] = {"/exgt-cache"};
+
+/** Default size of shared memory segment. */
+#define SHM_DEFAULT_SIZE (16 * 1024 * 1024)
+
+/** Size of one slot, including bookkeeping. */
+#define SHM_SLOT_SIZE 4096
+
+/** Slots per set. */
+#define SHM_WAYS 8
+
+/** Number of locks, sets are spread over them. */
+#define SHM_STRIPES 64
+
+/** Spins before checking whether lock holder is still alive. */
+#define SHM_SPINS 1024
+
+/** One named counter. */
+struct shm_counter {
+	/** Set once \ref name is filled in. */
+	uint32_t ready;
+	/** Name of counter. */
+	char name[SHM_COUNTER_NAME];
+	/** Value of counter. */
+	int64_t value;
+};
+
+/** One cache slot. */
+struct shm_slot {
+	/** Hash of key. */
+	uint64_t hash;
+	/** Clock value of last use, \c 0 if slot is empty. */
+	uint64_t used;
+	/** Time when entry expires, \c 0 for never. */
+	int64_t expires;
+	/** Length of key. */
+	uint32_t keylen;
+	/** Size of entry contents. */
+	uint32_t size;
+	/** Key immediately followed by entry contents. */
+	char data[SHM_SLOT_SIZE - 32];
+};
+
+/** Start of shared memory segment, padded to the size of one slot. */
+struct shm_header {
+	/** Use clock, ticks on every access. */
+	uint64_t clock;
+	/** Number of successful lookups. */
+	uint64_t hits;
+	/** Number of failed lookups. */
+	uint64_t misses;
+	/** Number of evictions. */
+	uint64_t evictions;
+	/** Pid of lock holders, \c 0 if unlocked. */
+	int32_t locks[SHM_STRIPES];
+	/** Pid of holder of lock for claiming counters. */
+	int32_t counter_lock;
+	/** Named counters. */
+	struct shm_counter counters[SHM_COUNTERS];
+	/** Padding. */
+	char pad[SHM_SLOT_SIZE - 32 - (SHM_STRIPES + 2) * sizeof(int32_t)
+	         - SHM_COUNTERS * sizeof(struct shm_counter)];
+};
+
+_Static_assert(sizeof(struct shm_header) == SHM_SLOT_SIZE,
+               "shm header must stay one slot in size");
+
+/** Mapped segment, \c NULL if not mapped yet. */
+static struct shm_header *shm;
+
+/** Number of sets in \ref shm. */
+static size_t shm_nsets;
+
+/** Whether mapping failed or shared memory is disabled. */
+static bool shm_disabled;
+
+/**
+ * Map shared memory segment, creating it if necessary.
+ *
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int shm_map()
+{
+	if (shm)
+		return 0;
+
+	if (shm_disabled)
+		return -1;
+
+	shm_disabled = true;
+	size_t size = config_size("EXGT_SHM_SIZE", SHM_DEFAULT_SIZE);
+	if (size < sizeof(struct shm_header) + SHM_WAYS * SHM_SLOT_SIZE)
+		return -1;
+
+	/* whoever creates the segment cleans up after earlier layouts, which
+	 * only upgrades leave behind */
+	int fd = shm_open(SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0)
+		for (size_t i = 0; i < sizeof(shm_old_names) /
+		     sizeof(shm_old_names[0]); ++i)
+			shm_unlink(shm_old_names[i]);
+	else if (errno == EEXIST)
+		fd = shm_open(SHM_NAME, O_RDWR, 0600);
+
+	if (fd < 0)
+		return -1;
+
+	/* only size new segments, resizing would move sets under others */
+	struct stat st;
+	if (fstat(fd, &st) || (st.st_size == 0 && ftruncate(fd, size))
+	    || fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+
+	size = st.st_size;
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	shm = map;
+	shm_nsets = (size - sizeof(struct shm_header)) /
+	            (SHM_WAYS * SHM_SLOT_SIZE);
+	shm_disabled = false;
+	return 0;
+}
+
+/**
+ * FNV-1a hash of key.
+ *
+ * @param key Key to hash.
+ * @param len Length of \p key.
+ * @return Hash of \p key.
+ */
+static uint64_t shm_hash(const char *key, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (unsigned char)key[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Take lock.
+ *
+ * @param lock Lock to take.
+ */
+static void shm_lock(int32_t *lock)
+{
+	int32_t self = getpid();
+	for (unsigned spins = 0;; ++spins) {
+		int32_t owner = 0;
+		if (__atomic_compare_exchange_n(lock, &owner, self, false,
+		                                __ATOMIC_ACQUIRE,
+		                                __ATOMIC_RELAXED))
+			return;
+
+		/* holder died without unlocking, take over */
+		if (spins >= SHM_SPINS && kill(owner, 0) && errno == ESRCH
+		    && __atomic_compare_exchange_n(lock, &owner, self, false,
+		                                   __ATOMIC_ACQUIRE,
+		                                   __ATOMIC_RELAXED))
+			return;
+
+		sched_yield();
+	}
+}
+
+/**
+ * Release lock.
+ *
+ * @param lock Lock to release.
+ */
+static void shm_unlock(int32_t *lock)
+{
+	__atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Find set that \p hash belongs to.
+ *
+ * @param hash Hash of key.
+ * @return First slot of set.
+ */
+static struct shm_slot *shm_set(uint64_t hash)
+{
+	struct shm_slot *slots = (struct shm_slot *)(shm + 1);
+	return &slots[(hash % shm_nsets) * SHM_WAYS];
+}
+
+/**
+ * Get lock of set that \p hash belongs to.
+ *
+ * @param hash Hash of key.
+ * @return Lock of set.
+ */
+static int32_t *shm_set_lock(uint64_t hash)
+{
+	return &shm->locks[(hash % shm_nsets) % SHM_STRIPES];
+}
+
+/**
+ * Check if slot holds key.
+ *
+ * @param slot Slot to check.
+ * @param hash Hash of key.
+ * @param key Key to check for.
+ * @param len Length of \p key.
+ * @return \c true if \p slot holds \p key.
+ */
+static bool shm_match(struct shm_slot *slot, uint64_t hash, const char *key,
+                      size_t len)
+{
+	return slot->used && slot->hash == hash && slot->keylen == len
+	       && memcmp(slot->data, key, len) == 0;
+}
+
+/**
+ * Tick use clock.
+ *
+ * @return New clock value.
+ */
+static uint64_t shm_tick()
+{
+	return __atomic_add_fetch(&shm->clock, 1, __ATOMIC_RELAXED);
+}
+
+char *shm_get(const char *key, size_t *size)
+{
+	if (shm_map())
+		return NULL;
+
+	size_t len = strlen(key);
+	uint64_t hash = shm_hash(key, len);
+	struct shm_slot *set = shm_set(hash);
+	int32_t *lock = shm_set_lock(hash);
+
+	char *buf = NULL;
+	shm_lock(lock);
+	for (size_t i = 0; i < SHM_WAYS; ++i) {
+		struct shm_slot *slot = &set[i];
+		if (!shm_match(slot, hash, key, len))
+			continue;
+
+		if (slot->expires && slot->expires <= time(NULL)) {
+			slot->used = 0;
+			break;
+		}
+
+		/* slot contents are only trusted as far as they fit */
+		if (slot->size > sizeof(slot->data) - len)
+			break;
+
+		if (!(buf = malloc(slot->size + 1)))
+			break;
+
+		memcpy(buf, slot->data + len, slot->size);
+		buf[slot->size] = 0;
+		if (size)
+			*size = slot->size;
+
+		slot->used = shm_tick();
+		break;
+	}
+
+	shm_unlock(lock);
+
+	__atomic_add_fetch(buf ? &shm->hits : &shm->misses, 1,
+	                   __ATOMIC_RELAXED);
+	return buf;
+}
+
+void shm_put(const char *key, const char *data, size_t size, time_t ttl)
+{
+	size_t len = strlen(key);
+	if (len + size > sizeof(((struct shm_slot *)0)->data))
+		return;
+
+	if (shm_map())
+		return;
+
+	uint64_t hash = shm_hash(key, len);
+	struct shm_slot *set = shm_set(hash);
+	int32_t *lock = shm_set_lock(hash);
+
+	shm_lock(lock);
+
+	/* replace old version of entry, else fill an empty slot, else evict
+	 * least recently used one */
+	struct shm_slot *slot = NULL;
+	for (size_t i = 0; i < SHM_WAYS; ++i) {
+		if (shm_match(&set[i], hash, key, len)) {
+			slot = &set[i];
+			break;
+		}
+
+		if (!slot || (slot->used && set[i].used < slot->used))
+			slot = &set[i];
+	}
+
+	if (slot->used && !shm_match(slot, hash, key, len))
+		__atomic_add_fetch(&shm->evictions, 1, __ATOMIC_RELAXED);
+
+	/* mark slot empty while writing, in case we die halfway through */
+	slot->used = 0;
+	slot->hash = hash;
+	slot->keylen = len;
+	slot->size = size;
+	slot->expires = ttl ? time(NULL) + ttl : 0;
+	memcpy(slot->data, key, len);
+	memcpy(slot->data + len, data, size);
+	slot->used = shm_tick();
+
+	shm_unlock(lock);
+}
+
+void shm_del(const char *key)
+{
+	if (shm_map())
+		return;
+
+	size_t len = strlen(key);
+	uint64_t hash = shm_hash(key, len);
+	struct shm_slot *set = shm_set(hash);
+	int32_t *lock = shm_set_lock(hash);
+
+	shm_lock(lock);
+	for (size_t i = 0; i < SHM_WAYS; ++i)
+		if (shm_match(&set[i], hash, key, len))
+			set[i].used = 0;
+
+	shm_unlock(lock);
+}
+
+int shm_stats(struct shm_stats *stats)
+{
+	if (shm_map())
+		return -1;
+
+	struct shm_slot *slots = (struct shm_slot *)(shm + 1);
+	stats->slots = shm_nsets * SHM_WAYS;
+	stats->used = 0;
+
+	/* unlocked, close enough for a status page */
+	for (size_t i = 0; i < stats->slots; ++i)
+		if (__atomic_load_n(&slots[i].used, __ATOMIC_RELAXED))
+			stats->used++;
+
+	stats->hits = __atomic_load_n(&shm->hits, __ATOMIC_RELAXED);
+	stats->misses = __atomic_load_n(&shm->misses, __ATOMIC_RELAXED);
+	stats->evictions = __atomic_load_n(&shm->evictions, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/**
+ * Find counter.
+ *
+ * @param name Name of counter.
+ * @return Counter, \c NULL if \p name hasn't been counted yet.
+ */
+static struct shm_counter *shm_counter_find(const char *name)
+{
+	for (size_t i = 0; i < SHM_COUNTERS; ++i) {
+		struct shm_counter *c = &shm->counters[i];
+		if (!__atomic_load_n(&c->ready, __ATOMIC_ACQUIRE))
+			break;
+
+		if (strcmp(c->name, name) == 0)
+			return c;
+	}
+
+	return NULL;
+}
+
+int shm_count(const char *name, long long delta)
+{
+	if (strlen(name) >= SHM_COUNTER_NAME || shm_map())
+		return -1;
+
+	struct shm_counter *c;
+	if (!(c = shm_counter_find(name))) {
+		/* slots are claimed in order, so readers can stop at the
+		 * first free one */
+		shm_lock(&shm->counter_lock);
+		if (!(c = shm_counter_find(name))) {
+			size_t i = 0;
+			while (i < SHM_COUNTERS && shm->counters[i].ready)
+				i++;
+
+			if (i < SHM_COUNTERS) {
+				c = &shm->counters[i];
+				strcpy(c->name, name);
+				__atomic_store_n(&c->ready, 1, __ATOMIC_RELEASE);
+			}
+		}
+
+		shm_unlock(&shm->counter_lock);
+		if (!c)
+			return -1;
+	}
+
+	__atomic_add_fetch(&c->value, delta, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int shm_counter(size_t i, char name[SHM_COUNTER_NAME], long long *value,
+                bool take)
+{
+	if (i >= SHM_COUNTERS || shm_map())
+		return -1;
+
+	struct shm_counter *c = &shm->counters[i];
+	if (!__atomic_load_n(&c->ready, __ATOMIC_ACQUIRE))
+		return -1;
+
+	strcpy(name, c->name);
+	*value = take ? __atomic_exchange_n(&c->value, 0, __ATOMIC_RELAXED)
+	         : __atomic_load_n(&c->value, __ATOMIC_RELAXED);
+	return 0;
+}
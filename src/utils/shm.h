@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file shm.h
+ * Shared memory cache header.
+ *
+ * A fixed size POSIX shared memory segment holds small, hot entries such as
+ * resolved refs and tree listings, so every exgt process on the host shares
+ * one warm cache without touching the disk. \c EXGT_SHM_SIZE sets the size of
+ * the segment, \c 16M by default and \c 0 to disable it.
+ *
+ * The segment is split into sets of a few slots each, and an entry can only
+ * live in the set its key hashes to. Each set is evicted in least recently
+ * used order, and sets are protected by a striped array of locks so that
+ * unrelated lookups don't contend.
+ *
+ * The segment also holds up to \ref SHM_COUNTERS named counters, which are
+ * cheap enough to bump on every request.
+ */
+
+#ifndef EXGT_SHM_H
+#define EXGT_SHM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+/** Maximum number of counters. */
+#define SHM_COUNTERS 32
+
+/** Room for name of counter, terminator included. */
+#define SHM_COUNTER_NAME 32
+
+/** Shared memory cache statistics. */
+struct shm_stats {
+	/** Total number of slots. */
+	size_t slots;
+	/** Number of occupied slots. */
+	size_t used;
+	/** Number of successful lookups. */
+	unsigned long long hits;
+	/** Number of failed lookups. */
+	unsigned long long misses;
+	/** Number of entries thrown out to make room for new ones. */
+	unsigned long long evictions;
+};
+
+/**
+ * Look up entry in shared memory cache.
+ * The returned buffer is allocated and always zero terminated.
+ *
+ * @param key Key of entry.
+ * @param size Where to place size of entry, ignored if \c NULL.
+ * @return Contents of entry, \c NULL if not found or expired.
+ */
+char *shm_get(const char *key, size_t *size);
+
+/**
+ * Insert entry into shared memory cache.
+ * Entries that don't fit in one slot are silently ignored, large entries are
+ * better served from the on-disk cache anyway.
+ *
+ * @param key Key of entry.
+ * @param data Contents of entry.
+ * @param size Size of \p data.
+ * @param ttl Seconds until entry expires, \c 0 for never.
+ */
+void shm_put(const char *key, const char *data, size_t size, time_t ttl);
+
+/**
+ * Remove entry from shared memory cache.
+ *
+ * @param key Key of entry.
+ */
+void shm_del(const char *key);
+
+/**
+ * Get shared memory cache statistics.
+ *
+ * @param stats Where to place statistics.
+ * @return \c 0 on success, non-zero if shared memory cache is disabled.
+ */
+int shm_stats(struct shm_stats *stats);
+
+/**
+ * Add to counter, creating it if it doesn't exist yet.
+ *
+ * @param name Name of counter, shorter than \ref SHM_COUNTER_NAME.
+ * @param delta Value to add to counter.
+ * @return \c 0 on success, non-zero if shared memory cache is disabled or
+ * out of counters.
+ */
+int shm_count(const char *name, long long delta);
+
+/**
+ * Get counter by index.
+ * Counters are numbered from \c 0 in the order they were created, so
+ * iterate until this fails.
+ *
+ * @param i Index of counter.
+ * @param name Where to place name of counter.
+ * @param value Where to place value of counter.
+ * @param take Whether to reset counter to zero, atomically with reading it.
+ * @return \c 0 on success, non-zero if there's no counter \p i.
+ */
+int shm_counter(size_t i, char name[SHM_COUNTER_NAME], long long *value,
+                bool take);
+
+#endif /* EXGT_SHM_H */
@@ -0,0 +1,239 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file stats.c
+ * Persistent counters implementation.
+ *
+ * Counters are bumped in shared memory, see shm.h, which costs one atomic add.
+ * The stats file is a list of @code name value @endcode lines holding totals,
+ * which stats_flush() moves the shared memory counts into every now and then.
+ * Without shared memory, the file is rewritten under an exclusive lock on
+ * every update instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include "cache.h"
+#include "stats.h"
+#include "shm.h"
+
+/**
+ * Read all counters from file.
+ *
+ * @param fd File descriptor of stats file, should be locked.
+ * @param entries Where to place array of counters.
+ * @param n Where to place number of counters.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int stats_read(int fd, struct stats_entry **entries, size_t *n)
+{
+	*entries = NULL;
+	*n = 0;
+
+	FILE *f = fdopen(dup(fd), "r");
+	if (!f)
+		return -1;
+
+	size_t max = 0;
+	struct stats_entry entry;
+	while (fscanf(f, "%31s %lld", entry.name, &entry.value) == 2) {
+		if (*n >= max) {
+			max = max ? max * 2 : 16;
+			struct stats_entry *new = realloc(*entries,
+			                                  max * sizeof(*new));
+			if (!new) {
+				fclose(f);
+				return -1;
+			}
+
+			*entries = new;
+		}
+
+		(*entries)[(*n)++] = entry;
+	}
+
+	fclose(f);
+	return 0;
+}
+
+/**
+ * Open stats file.
+ *
+ * @param lock Lock to take, \c LOCK_SH or \c LOCK_EX.
+ * @return File descriptor of locked stats file, \c -1 on failure.
+ */
+static int stats_open(int lock)
+{
+	char *path;
+	if (!(path = cache_file("stats")))
+		return -1;
+
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	free(path);
+	if (fd < 0)
+		return -1;
+
+	flock(fd, lock);
+	return fd;
+}
+
+/**
+ * Add to counter in array, appending it if it's not there yet.
+ *
+ * @param entries Array of counters.
+ * @param n Number of counters in \p entries.
+ * @param name Name of counter.
+ * @param delta Value to add to counter.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int stats_merge(struct stats_entry **entries, size_t *n,
+                       const char *name, long long delta)
+{
+	for (size_t i = 0; i < *n; ++i) {
+		if (strcmp((*entries)[i].name, name) == 0) {
+			(*entries)[i].value += delta;
+			return 0;
+		}
+	}
+
+	struct stats_entry *new;
+	if (!(new = realloc(*entries, (*n + 1) * sizeof(*new))))
+		return -1;
+
+	*entries = new;
+	snprintf(new[*n].name, sizeof(new[*n].name), "%s", name);
+	new[(*n)++].value = delta;
+	return 0;
+}
+
+/**
+ * Replace contents of stats file.
+ *
+ * @param fd File descriptor of stats file, should be locked exclusively.
+ * Closed, which also drops the lock.
+ * @param entries Counters to write.
+ * @param n Number of counters.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int stats_write(int fd, struct stats_entry *entries, size_t n)
+{
+	FILE *f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		return -1;
+	}
+
+	ftruncate(fd, 0);
+	lseek(fd, 0, SEEK_SET);
+
+	for (size_t i = 0; i < n; ++i)
+		fprintf(f, "%s %lld\n", entries[i].name, entries[i].value);
+
+	return fclose(f);
+}
+
+/**
+ * Add counts to stats file.
+ *
+ * @param names Names of counters.
+ * @param deltas Values to add to counters.
+ * @param count Number of counters.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+static int stats_file_add(char names[][SHM_COUNTER_NAME],
+                          const long long deltas[], size_t count)
+{
+	int fd = stats_open(LOCK_EX);
+	if (fd < 0)
+		return -1;
+
+	struct stats_entry *entries;
+	size_t n;
+	if (stats_read(fd, &entries, &n)) {
+		close(fd);
+		return -1;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+		if (stats_merge(&entries, &n, names[i], deltas[i])) {
+			free(entries);
+			close(fd);
+			return -1;
+		}
+
+	int ret = stats_write(fd, entries, n);
+	free(entries);
+	return ret;
+}
+
+int stats_add(const char *name, long long delta)
+{
+	if (!shm_count(name, delta))
+		return 0;
+
+	char names[1][SHM_COUNTER_NAME];
+	snprintf(names[0], sizeof(names[0]), "%s", name);
+	return stats_file_add(names, &delta, 1);
+}
+
+int stats_flush()
+{
+	char names[SHM_COUNTERS][SHM_COUNTER_NAME];
+	long long deltas[SHM_COUNTERS];
+	size_t count = 0;
+	while (count < SHM_COUNTERS
+	       && !shm_counter(count, names[count], &deltas[count], true))
+		count++;
+
+	if (!count)
+		return 0;
+
+	/* counts taken out of shared memory are lost if this fails, which is
+	 * fine for statistics */
+	return stats_file_add(names, deltas, count);
+}
+
+long long stats_get(const char *name)
+{
+	struct stats_entry *entries;
+	size_t n;
+	if (stats_load(&entries, &n))
+		return 0;
+
+	long long value = 0;
+	for (size_t i = 0; i < n; ++i)
+		if (strcmp(entries[i].name, name) == 0)
+			value = entries[i].value;
+
+	free(entries);
+	return value;
+}
+
+int stats_load(struct stats_entry **entries, size_t *n)
+{
+	int fd = stats_open(LOCK_SH);
+	if (fd < 0)
+		return -1;
+
+	int ret = stats_read(fd, entries, n);
+	close(fd);
+	if (ret)
+		return ret;
+
+	/* counts not flushed yet */
+	char name[SHM_COUNTER_NAME];
+	long long value;
+	for (size_t i = 0; !shm_counter(i, name, &value, false); ++i)
+		if (stats_merge(entries, n, name, value)) {
+			free(*entries);
+			return -1;
+		}
+
+	return 0;
+}
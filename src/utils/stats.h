@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file stats.h
+ * Persistent counters header.
+ *
+ * Counters are kept in shared memory and totalled in the \c stats file in the
+ * cache root, so every request and background mode adds to the same totals.
+ * Meant for things like cache hit rates that are shown on the status page.
+ */
+
+#ifndef EXGT_STATS_H
+#define EXGT_STATS_H
+
+#include <stddef.h>
+
+/** One named counter. */
+struct stats_entry {
+	/** Name of counter. */
+	char name[32];
+	/** Value of counter. */
+	long long value;
+};
+
+/**
+ * Add to counter, creating it if it doesn't exist yet.
+ *
+ * @param name Name of counter, no whitespace.
+ * @param delta Value to add to counter.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int stats_add(const char *name, long long delta);
+
+/**
+ * Move counts from shared memory to the stats file.
+ * Done periodically by the maintenance daemon, so counts survive the shared
+ * memory segment going away.
+ *
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int stats_flush();
+
+/**
+ * Get value of counter.
+ *
+ * @param name Name of counter.
+ * @return Value of counter, \c 0 if it doesn't exist.
+ */
+long long stats_get(const char *name);
+
+/**
+ * Load all counters.
+ *
+ * @param entries Where to place array of counters, free after use.
+ * @param n Where to place number of counters.
+ * @return \c 0 on success, non-zero otherwise.
+ */
+int stats_load(struct stats_entry **entries, size_t *n);
+
+#endif /* EXGT_STATS_H */
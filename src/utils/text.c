@@ -0,0 +1,431 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file text.c
+ * Text detection implementation.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "text.h"
+
+/** Returned by validation when data isn't valid UTF-8. */
+#define TEXT_INVALID SIZE_MAX
+
+/** What a scan found. */
+struct text_stats {
+	/** Set if a NUL byte was found, scans stop there. */
+	bool nul;
+	/** Set if data isn't valid UTF-8. */
+	bool invalid;
+	/** Number of control characters text doesn't normally have. */
+	size_t control;
+};
+
+/**
+ * Check if character is a control character text doesn't normally have.
+ * Same set as git uses: anything below space except backspace, tab, newline,
+ * form feed, carriage return and escape, and \c DEL.
+ *
+ * @param c Character to check.
+ * @return \c 1 if \p c is such a control character, \c 0 otherwise.
+ */
+static int text_control(unsigned char c)
+{
+	if (c == 0x7f)
+		return 1;
+
+	return c < 0x20 && c != '\b' && c != '\t' && c != '\n' && c != '\f'
+	       && c != '\r' && c != 0x1b;
+}
+
+/**
+ * Get length of UTF-8 character.
+ *
+ * @param s Data character is in.
+ * @param i Index of first byte of character, not ASCII.
+ * @param size Size of \p s.
+ * @param partial Whether a character may be cut off at \p size.
+ * @return Length of character, \c 0 if it isn't valid.
+ */
+static size_t text_char(const unsigned char *s, size_t i, size_t size,
+                        bool partial)
+{
+	/* number of continuation bytes, and range of the first one that
+	 * rules out overlong forms, surrogates and too large values */
+	unsigned char c = s[i];
+	size_t n;
+	unsigned char lo = 0x80, hi = 0xbf;
+	if (c >= 0xc2 && c <= 0xdf) {
+		n = 1;
+	} else if (c >= 0xe0 && c <= 0xef) {
+		n = 2;
+		lo = c == 0xe0 ? 0xa0 : 0x80;
+		hi = c == 0xed ? 0x9f : 0xbf;
+	} else if (c >= 0xf0 && c <= 0xf4) {
+		n = 3;
+		lo = c == 0xf0 ? 0x90 : 0x80;
+		hi = c == 0xf4 ? 0x8f : 0xbf;
+	} else {
+		return 0;
+	}
+
+	for (size_t k = 1; k <= n; ++k) {
+		if (i + k >= size)
+			return partial ? size - i : 0;
+
+		unsigned char b = s[i + k];
+		if (b < (k == 1 ? lo : 0x80) || b > (k == 1 ? hi : 0xbf))
+			return 0;
+	}
+
+	return n + 1;
+}
+
+/**
+ * Validate UTF-8.
+ * Characters starting before \p end are checked in full, even if they
+ * continue past it.
+ *
+ * @param s Data to validate.
+ * @param i Index to start at.
+ * @param end Index to stop at.
+ * @param size Size of \p s.
+ * @param partial Whether a character may be cut off at \p size.
+ * @return Index validation stopped at, \ref TEXT_INVALID if data isn't valid.
+ */
+static size_t text_validate(const unsigned char *s, size_t i, size_t end,
+                            size_t size, bool partial)
+{
+	while (i < end) {
+		if (s[i] < 0x80) {
+			i++;
+			continue;
+		}
+
+		size_t n;
+		if (!(n = text_char(s, i, size, partial)))
+			return TEXT_INVALID;
+
+		i += n;
+	}
+
+	return i;
+}
+
+/**
+ * Scalar version of text_scan().
+ *
+ * @param s Data to scan.
+ * @param i Index to start at.
+ * @param size Size of \p s.
+ * @param partial Whether a character may be cut off at \p size.
+ * @param st Where to add findings.
+ */
+static void text_scan_scalar(const unsigned char *s, size_t i, size_t size,
+                             bool partial, struct text_stats *st)
+{
+	while (i < size) {
+		unsigned char c = s[i];
+		if (!c) {
+			st->nul = true;
+			return;
+		}
+
+		if (c < 0x80) {
+			st->control += text_control(c);
+			i++;
+			continue;
+		}
+
+		/* once invalid, the rest is only checked for controls */
+		size_t n = st->invalid ? 1 : text_char(s, i, size, partial);
+		if (!n) {
+			st->invalid = true;
+			n = 1;
+		}
+
+		i += n;
+	}
+}
+
+#if defined(__x86_64__)
+/**
+ * Count control characters in vector, see text_control().
+ *
+ * @param v Vector to count control characters in.
+ * @return Number of control characters in \p v.
+ */
+static int text_control_sse2(__m128i v)
+{
+	/* unsigned v <= 0x1f */
+	const __m128i top = _mm_set1_epi8(0x1f);
+	int low = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, top), v));
+	int del = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+	if (!low)
+		return __builtin_popcount(del);
+
+	__m128i ok = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+	                          _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+	ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+	ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('\b')));
+	ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('\f')));
+	ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x1b)));
+	return __builtin_popcount((low & ~_mm_movemask_epi8(ok)) | del);
+}
+
+/**
+ * SSE2 version of text_scan().
+ * SSE2 is part of x86-64, so this is always available.
+ *
+ * @param s Data to scan.
+ * @param i Index to start at.
+ * @param size Size of \p s.
+ * @param partial Whether a character may be cut off at \p size.
+ * @param st Where to add findings.
+ */
+static void text_scan_sse2(const unsigned char *s, size_t i, size_t size,
+                           bool partial, struct text_stats *st)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	while (i + 16 <= size) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero))) {
+			st->nul = true;
+			return;
+		}
+
+		st->control += text_control_sse2(v);
+
+		/* all ASCII, or nothing left to validate */
+		if (st->invalid || !_mm_movemask_epi8(v)) {
+			i += 16;
+			continue;
+		}
+
+		/* skipped continuation bytes are never controls */
+		size_t next = text_validate(s, i, i + 16, size, partial);
+		if (next == TEXT_INVALID) {
+			st->invalid = true;
+			next = i + 16;
+		}
+
+		i = next;
+	}
+
+	text_scan_scalar(s, i, size, partial, st);
+}
+
+/**
+ * Count control characters in vector, see text_control().
+ *
+ * @param v Vector to count control characters in.
+ * @return Number of control characters in \p v.
+ */
+__attribute__((target("avx2")))
+static int text_control_avx2(__m256i v)
+{
+	/* unsigned v <= 0x1f */
+	const __m256i top = _mm256_set1_epi8(0x1f);
+	uint32_t low = _mm256_movemask_epi8(
+		_mm256_cmpeq_epi8(_mm256_min_epu8(v, top), v));
+	uint32_t del = _mm256_movemask_epi8(
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f)));
+	if (!low)
+		return __builtin_popcount(del);
+
+	__m256i ok = _mm256_or_si256(
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+	ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+	ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\b')));
+	ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f')));
+	ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x1b)));
+	uint32_t allowed = _mm256_movemask_epi8(ok);
+	return __builtin_popcount((low & ~allowed) | del);
+}
+
+/**
+ * AVX2 version of text_scan().
+ *
+ * @param s Data to scan.
+ * @param i Index to start at.
+ * @param size Size of \p s.
+ * @param partial Whether a character may be cut off at \p size.
+ * @param st Where to add findings.
+ */
+__attribute__((target("avx2")))
+static void text_scan_avx2(const unsigned char *s, size_t i, size_t size,
+                           bool partial, struct text_stats *st)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	while (i + 32 <= size) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero))) {
+			st->nul = true;
+			goto out;
+		}
+
+		st->control += text_control_avx2(v);
+
+		/* all ASCII, or nothing left to validate */
+		if (st->invalid || !_mm256_movemask_epi8(v)) {
+			i += 32;
+			continue;
+		}
+
+		/* skipped continuation bytes are never controls */
+		size_t next = text_validate(s, i, i + 32, size, partial);
+		if (next == TEXT_INVALID) {
+			st->invalid = true;
+			next = i + 32;
+		}
+
+		i = next;
+	}
+
+	/* dirty upper halves would stall the SSE2 code */
+	_mm256_zeroupper();
+	text_scan_sse2(s, i, size, partial, st);
+	return;
+
+out:
+	_mm256_zeroupper();
+}
+
+/**
+ * SSE2 version of text_valid().
+ *
+ * @param s Data to validate.
+ * @param size Size of \p s.
+ * @return Length of valid start of \p s.
+ */
+static size_t text_valid_sse2(const unsigned char *s, size_t size)
+{
+	size_t i = 0;
+	while (i + 16 <= size) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		if (!_mm_movemask_epi8(v)) {
+			i += 16;
+			continue;
+		}
+
+		size_t next = text_validate(s, i, i + 16, size, false);
+		if (next == TEXT_INVALID)
+			break;
+
+		i = next;
+	}
+
+	/* find the exact spot */
+	size_t n;
+	while (i < size && (s[i] < 0x80 || (n = text_char(s, i, size, false))))
+		i += s[i] < 0x80 ? 1 : n;
+
+	return i;
+}
+#endif
+
+/**
+ * Look for NUL bytes, control characters and invalid UTF-8.
+ *
+ * @param buf Data to scan.
+ * @param size Size of \p buf.
+ * @param partial Whether a character may be cut off at \p size.
+ * @param st Where to place findings.
+ */
+static void text_scan(const char *buf, size_t size, bool partial,
+                      struct text_stats *st)
+{
+	const unsigned char *s = (const unsigned char *)buf;
+	*st = (struct text_stats){false, false, 0};
+#if defined(__x86_64__)
+	static int avx2 = -1;
+	if (avx2 < 0)
+		avx2 = __builtin_cpu_supports("avx2");
+
+	if (avx2)
+		text_scan_avx2(s, 0, size, partial, st);
+	else
+		text_scan_sse2(s, 0, size, partial, st);
+#else
+	text_scan_scalar(s, 0, size, partial, st);
+#endif
+}
+
+void text_check(const char *buf, size_t size, bool partial,
+                struct text_info *info)
+{
+	struct text_stats st;
+	text_scan(buf, size, partial, &st);
+
+	/* same rule as git, a NUL or more than one odd control character per
+	 * 128 printable ones */
+	info->longest = 0;
+	info->utf8 = !st.invalid;
+	if ((info->binary = st.nul || st.control > (size - st.control) / 128))
+		return;
+
+	const char *end = buf + size;
+	for (const char *line = buf; line < end;) {
+		const char *nl = memchr(line, '\n', end - line);
+		size_t len = (nl ? nl : end) - line;
+		if (len > info->longest)
+			info->longest = len;
+
+		if (!nl)
+			break;
+
+		line = nl + 1;
+	}
+}
+
+size_t text_valid(const char *buf, size_t size)
+{
+	const unsigned char *s = (const unsigned char *)buf;
+#if defined(__x86_64__)
+	return text_valid_sse2(s, size);
+#else
+	size_t i = 0, n;
+	while (i < size && (s[i] < 0x80 || (n = text_char(s, i, size, false))))
+		i += s[i] < 0x80 ? 1 : n;
+
+	return i;
+#endif
+}
+
+char *text_replace(const char *buf, size_t size, size_t *len)
+{
+	/* every byte turns into at most one replacement character */
+	char *new;
+	if (size > (SIZE_MAX - 1) / 3 || !(new = malloc(3 * size + 1)))
+		return NULL;
+
+	char *p = new;
+	size_t i = 0;
+	while (i < size) {
+		size_t valid = text_valid(buf + i, size - i);
+		memcpy(p, buf + i, valid);
+		p += valid;
+		i += valid;
+		if (i == size)
+			break;
+
+		memcpy(p, "\xef\xbf\xbd", 3);
+		p += 3;
+		i++;
+	}
+
+	*p = 0;
+	*len = p - new;
+	return new;
+}
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file text.h
+ * Text detection header.
+ *
+ * Tells text from binary data before anything expensive is done with it.
+ * Like git, data with NUL bytes or more than one odd control character per
+ * 128 printable ones is taken as binary. Text in legacy encodings is still
+ * text, it just isn't valid UTF-8, and invalid sequences can be replaced with
+ * U+FFFD before it's shown.
+ *
+ * Nearly all text is plain ASCII, so NUL bytes, control characters and bytes
+ * with the high bit set are looked for a vector at a time with SSE2 or AVX2
+ * where available, and only vectors with the latter are validated one
+ * character at a time.
+ */
+
+#ifndef EXGT_TEXT_H
+#define EXGT_TEXT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/** What text_check() found out. */
+struct text_info {
+	/** Set if data has NUL bytes or too many control characters. */
+	bool binary;
+	/** Set if data is valid UTF-8. */
+	bool utf8;
+	/** Length of longest line in bytes, without newline. Only set for
+	 * text. */
+	size_t longest;
+};
+
+/**
+ * Check if data is text.
+ *
+ * @param buf Data to check.
+ * @param size Size of \p buf.
+ * @param partial Whether \p buf is only the start of the data, in which case
+ * a character cut off at the end is fine.
+ * @param info Where to place findings.
+ */
+void text_check(const char *buf, size_t size, bool partial,
+                struct text_info *info);
+
+/**
+ * Get length of valid UTF-8 at start of data.
+ *
+ * @param buf Data to check.
+ * @param size Size of \p buf.
+ * @return Length of valid start of \p buf, \p size if all of it is valid.
+ */
+size_t text_valid(const char *buf, size_t size);
+
+/**
+ * Replace each byte that isn't part of valid UTF-8 with U+FFFD.
+ *
+ * @param buf Data to fix.
+ * @param size Size of \p buf.
+ * @param len Where to place length of result.
+ * @return Fixed data in new buffer, \c NULL on error.
+ */
+char *text_replace(const char *buf, size_t size, size_t *len);
+
+#endif /* EXGT_TEXT_H */
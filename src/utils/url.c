@@ -1,10 +1,16 @@
 /* SPDX-License-Identifier: copyleft-next-0.3.1 */
 /* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
 
 #include "error.h"
+#include "git.h"
 #include "url.h"
 
 /**
@@ -12,6 +18,83 @@
  * Url helper implementations.
  */
 
+/**
+ * Get value of hex digit.
+ *
+ * @param c Character to convert.
+ * @return Value of \p c, negative if it isn't a hex digit.
+ */
+static int url_hex(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+/**
+ * Percent-decode value.
+ * Malformed escapes and \c %00 are kept as they are. A \c + is kept too,
+ * as it's a valid character in ref names and only forms use it for spaces.
+ *
+ * @param s Value to decode.
+ * @param len Length of \p s.
+ * @return Decoded value in new buffer, \c NULL on error.
+ */
+static char *url_decode(const char *s, size_t len)
+{
+	char *new;
+	if (!(new = malloc(len + 1)))
+		return NULL;
+
+	char *p = new;
+	for (size_t i = 0; i < len; ++i) {
+		int hi, lo;
+		if (s[i] == '%' && i + 2 < len
+		    && (hi = url_hex(s[i + 1])) >= 0
+		    && (lo = url_hex(s[i + 2])) >= 0 && (hi || lo)) {
+			*p++ = hi << 4 | lo;
+			i += 2;
+			continue;
+		}
+
+		*p++ = s[i];
+	}
+
+	*p = 0;
+	return new;
+}
+
+char *url_encode(const char *s)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	char *new;
+	if (!(new = malloc(3 * strlen(s) + 1)))
+		return NULL;
+
+	char *p = new;
+	for (; *s; ++s) {
+		unsigned char c = *s;
+		if (isalnum(c) || strchr("-._~/:@", c)) {
+			*p++ = c;
+			continue;
+		}
+
+		*p++ = '%';
+		*p++ = hex[c >> 4];
+		*p++ = hex[c & 0xf];
+	}
+
+	*p = 0;
+	return new;
+}
+
 char *url_option(const char *key)
 {
 	char *query = getenv("QUERY_STRING");
@@ -20,30 +103,217 @@ char *url_option(const char *key)
 		return NULL;
 	}
 
-	query = strdup(query);
-	if (!query)
-		return NULL;
+	size_t kl = strlen(key);
+	const char *opt = query;
+	while (*opt) {
+		const char *end;
+		if (!(end = strchr(opt, '&')))
+			end = opt + strlen(opt);
 
-	char *next = query, *prev = query;
-	while ((next = strchr(next, '='))) {
-		*next++ = '0';
+		if (strncmp(opt, key, kl) == 0) {
+			/* options without a value, i.e. ?raw, are empty strings */
+			if (opt + kl == end)
+				return strdup("");
 
-		if (strcmp(prev, key) == 0)
+			if (opt[kl] == '=')
+				return url_decode(opt + kl + 1,
+				                  end - opt - kl - 1);
+		}
+
+		if (!*end)
 			break;
 
-		next = strchr(next, '&') + 1;
+		opt = end + 1;
+	}
+
+	return NULL;
+}
+
+/**
+ * Parse line number.
+ * Only plain decimal digits are accepted, unlike strtoull() which would take
+ * signs and whitespace as well.
+ *
+ * @param s Start of number.
+ * @param n Where to place number.
+ * @return Character after number, \c NULL if there was no number or it
+ * doesn't fit.
+ */
+static const char *url_line(const char *s, size_t *n)
+{
+	if (!isdigit((unsigned char)*s))
+		return NULL;
+
+	errno = 0;
+	char *end;
+	unsigned long long v = strtoull(s, &end, 10);
+	if (errno || v > SIZE_MAX)
+		return NULL;
+
+	*n = v;
+	return end;
+}
+
+int url_lines(const char *value, size_t *first, size_t *last)
+{
+	const char *p;
+	if (!(p = url_line(value, first)))
+		return 0;
+
+	*last = *first;
+	if (*p == 0)
+		return 1;
 
-		if (!*next) {
-			free(query);
-			return NULL;
+	if (*p != '-' || !(p = url_line(p + 1, last)) || *p || *first > *last)
+		return 0;
+
+	return 2;
+}
+
+/** Options pages read, everything else is dropped from normalized queries. */
+static const struct {
+	/** Key of option. */
+	const char *key;
+	/** Whether only presence of option matters. */
+	bool flag;
+} url_known[] = {
+	{"commit", false},
+	{"lines", false},
+	{"nosizes", true},
+	{"raw", true},
+};
+
+/** Number of options in \ref url_known. */
+#define URL_KNOWN (sizeof(url_known) / sizeof(url_known[0]))
+
+/**
+ * Normalize value of \c lines option, as file pages read it.
+ *
+ * @param value Value of option.
+ * @return Normalized value in new buffer, \c NULL if \p value would be
+ * ignored.
+ */
+static char *url_normalize_lines(const char *value)
+{
+	char buf[64];
+	size_t first, last;
+	switch (url_lines(value, &first, &last)) {
+	case 1: snprintf(buf, sizeof(buf), "%zu", first); break;
+	case 2: snprintf(buf, sizeof(buf), "%zu-%zu", first, last); break;
+	default: return NULL;
+	}
+
+	return strdup(buf);
+}
+
+/**
+ * Get normalized value of known option.
+ *
+ * @param i Index of option in \ref url_known.
+ * @return Value in new buffer, percent-encoded, empty string for flags, \c NULL
+ * if option is missing or would be ignored.
+ */
+static char *url_known_value(size_t i)
+{
+	char *value;
+	if (!(value = url_option(url_known[i].key)))
+		return NULL;
+
+	if (url_known[i].flag) {
+		value[0] = 0;
+		return value;
+	}
+
+	if (strcmp(url_known[i].key, "lines") == 0) {
+		char *lines = url_normalize_lines(value);
+		free(value);
+		return lines;
+	}
+
+	if (strcmp(url_known[i].key, "commit") == 0 && git_is_oid(value))
+		for (char *c = value; *c; ++c)
+			*c = tolower((unsigned char)*c);
+
+	char *encoded = url_encode(value);
+	free(value);
+	return encoded;
+}
+
+/**
+ * Build normalized query string with one option replaced.
+ *
+ * @param key Key of option to replace, \c NULL to not replace any.
+ * @param value New value of option, \c NULL to drop option.
+ * @return Query string without leading \c '?', allocated in new buffer.
+ */
+static char *url_build(const char *key, const char *value)
+{
+	char *values[URL_KNOWN + 1] = {0};
+	const char *keys[URL_KNOWN + 1];
+	bool query = getenv("QUERY_STRING") != NULL;
+	bool replaced = false;
+	size_t len = 1;
+	size_t n = URL_KNOWN;
+	for (size_t i = 0; i < URL_KNOWN; ++i) {
+		keys[i] = url_known[i].key;
+		if (key && strcmp(key, keys[i]) == 0) {
+			replaced = true;
+			values[i] = value ? url_encode(value) : NULL;
+			if (values[i] && url_known[i].flag)
+				values[i][0] = 0;
 		}
+		else if (query)
+			values[i] = url_known_value(i);
+
+		if (values[i])
+			len += strlen(keys[i]) + strlen(values[i]) + 2;
 	}
 
-	char *res = NULL;
-	if (next)
-		res = strdup(next);
+	if (key && !replaced && value) {
+		keys[n] = key;
+		if ((values[n] = url_encode(value)))
+			len += strlen(key) + strlen(values[n]) + 2;
 
-	free(query);
+		n++;
+	}
+
+	char *new = malloc(len);
+	if (new) {
+		char *p = new;
+		for (size_t i = 0; i < n; ++i) {
+			if (!values[i])
+				continue;
+
+			p += sprintf(p, "%s%s%s%s", p != new ? "&" : "",
+			             keys[i], values[i][0] ? "=" : "",
+			             values[i]);
+		}
+
+		*p = 0;
+	}
 
-	return res;
+	for (size_t i = 0; i < n; ++i)
+		free(values[i]);
+
+	return new;
+}
+
+char *url_query()
+{
+	return url_build(NULL, NULL);
+}
+
+char *url_with_option(const char *key, const char *value)
+{
+	char *query;
+	if (!(query = url_build(key, value)))
+		return NULL;
+
+	size_t len = strlen(query) + 2;
+	char *new;
+	if ((new = malloc(len)))
+		snprintf(new, len, "?%s", query);
+
+	free(query);
+	return new;
 }
@@ -9,12 +9,58 @@
  * Url helpers.
  */
 
+#include <stddef.h>
+
 /**
  * Return value associated with key.
  *
  * @param key Key to search for.
- * @return Associated value, allocated in new buffer.
+ * @return Associated value, percent-decoded and allocated in new buffer. Empty
+ * string if \p key is present without a value, \c NULL if \p key is missing.
  */
 char *url_option(const char *key);
 
+/**
+ * Parse value of \c lines option.
+ * The option is either a single line \c N or an inclusive range \c A-B, in
+ * plain decimal digits.
+ *
+ * @param value Value of option.
+ * @param first Where to place first line.
+ * @param last Where to place last line, same as \p first for a single line.
+ * @return \c 1 for a single line, \c 2 for a range, \c 0 if \p value is
+ * malformed.
+ */
+int url_lines(const char *value, size_t *first, size_t *last);
+
+/**
+ * Percent-encode value for use in query string.
+ *
+ * @param s Value to encode.
+ * @return Encoded value in new buffer, \c NULL on error.
+ */
+char *url_encode(const char *s);
+
+/**
+ * Get normalized query string.
+ * Only options pages read are kept, in a fixed order. Flags lose their values,
+ * object IDs in \c commit are lowercased and \c lines is written in the form
+ * file pages would read it, so equivalent queries give the same string. Values
+ * are percent-encoded the same way whatever way they were encoded in the
+ * request.
+ *
+ * @return Query string without leading \c '?', allocated in new buffer.
+ */
+char *url_query();
+
+/**
+ * Build query string with one option replaced.
+ * The rest of the current query string is normalized like url_query() does.
+ *
+ * @param key Key of option to replace.
+ * @param value New value of option, not encoded, \c NULL to drop option.
+ * @return Query string starting with \c '?', allocated in new buffer.
+ */
+char *url_with_option(const char *key, const char *value);
+
 #endif /* EXGT_URL_H */
@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file watched.c
+ * Watched shared memory cache entries implementation.
+ *
+ * Entries are stored as their stamp, a newline and their contents. Entries
+ * stored while no watcher was running are stamped \ref WATCHED_NONE and rely
+ * on their time to live alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shm.h"
+#include "watched.h"
+
+/** Key the watcher announces itself under. */
+#define WATCHED_TOKEN_KEY "watch"
+
+/** Stamp of entries stored without a watcher. */
+#define WATCHED_NONE "-"
+
+/**
+ * Build key of scope generation.
+ *
+ * @param scope Scope to build key of.
+ * @return Key in new buffer.
+ */
+static char *watched_gen_key(const char *scope)
+{
+	size_t len = strlen(scope) + sizeof("gen\t");
+	char *key;
+	if (!(key = malloc(len)))
+		return NULL;
+
+	snprintf(key, len, "gen\t%s", scope);
+	return key;
+}
+
+/**
+ * Start new generation of scope.
+ *
+ * @param key Key of scope generation.
+ * @return New generation in new buffer.
+ */
+static char *watched_new_gen(const char *key)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	char *gen;
+	if (!(gen = malloc(64)))
+		return NULL;
+
+	snprintf(gen, 64, "%lx.%llx.%lx", (long)getpid(),
+	         (unsigned long long)ts.tv_sec, (long)ts.tv_nsec);
+	shm_put(key, gen, strlen(gen), 0);
+	return gen;
+}
+
+/**
+ * Get current stamp of scope.
+ *
+ * @param scope Scope to get stamp of.
+ * @return Stamp in new buffer.
+ */
+static char *watched_stamp(const char *scope)
+{
+	char *token;
+	if (!(token = shm_get(WATCHED_TOKEN_KEY, NULL)))
+		return strdup(WATCHED_NONE);
+
+	char *key = watched_gen_key(scope);
+	char *gen = key ? shm_get(key, NULL) : NULL;
+
+	/* generation was evicted or never existed, either way nothing stamped
+	 * with an older one may be trusted */
+	if (key && !gen)
+		gen = watched_new_gen(key);
+
+	free(key);
+
+	char *stamp = NULL;
+	size_t len = strlen(token) + (gen ? strlen(gen) : 0) + 2;
+	if (gen && (stamp = malloc(len)))
+		snprintf(stamp, len, "%s/%s", token, gen);
+
+	free(token);
+	free(gen);
+	return stamp;
+}
+
+char *watched_get(const char *scope, const char *key, size_t *size,
+                  char **stamp)
+{
+	*stamp = watched_stamp(scope);
+
+	size_t len;
+	char *entry;
+	if (!(entry = shm_get(key, &len)))
+		return NULL;
+
+	char *nl;
+	if (!(nl = memchr(entry, '\n', len)))
+		goto stale;
+
+	*nl = 0;
+	if (strcmp(entry, WATCHED_NONE) != 0
+	    && (!*stamp || strcmp(entry, *stamp) != 0))
+		goto stale;
+
+	/* move contents to start of buffer, including terminating zero */
+	len -= nl + 1 - entry;
+	memmove(entry, nl + 1, len + 1);
+	if (size)
+		*size = len;
+
+	return entry;
+
+stale:
+	free(entry);
+	return NULL;
+}
+
+void watched_put(const char *key, const char *stamp, const char *data,
+                 size_t size, time_t ttl)
+{
+	bool watched = stamp && strcmp(stamp, WATCHED_NONE) != 0;
+	if (!stamp || (!watched && !ttl))
+		return;
+
+	size_t len = strlen(stamp) + 1 + size;
+	char *entry;
+	if (!(entry = malloc(len)))
+		return;
+
+	memcpy(entry, stamp, strlen(stamp));
+	entry[strlen(stamp)] = '\n';
+	memcpy(entry + strlen(stamp) + 1, data, size);
+
+	shm_put(key, entry, len, watched ? 0 : ttl);
+	free(entry);
+}
+
+void watched_invalidate(const char *scope)
+{
+	char *key;
+	if (!(key = watched_gen_key(scope)))
+		return;
+
+	free(watched_new_gen(key));
+	free(key);
+}
+
+void watched_announce(const char *token, time_t ttl)
+{
+	shm_put(WATCHED_TOKEN_KEY, token, strlen(token), ttl);
+}
+
+void watched_retract()
+{
+	shm_del(WATCHED_TOKEN_KEY);
+}
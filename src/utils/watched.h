@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file watched.h
+ * Watched shared memory cache entries header.
+ *
+ * Some entries, like resolved refs, go stale whenever a repository changes.
+ * Without \c exgt \c watch running they can only be kept for a short while,
+ * but while it is running they are kept until the watcher notices a change
+ * in their repository.
+ *
+ * Each entry belongs to a scope, normally the path to its repository, and is
+ * stamped with the watcher's token and the scope's generation at the time it
+ * was computed. The watcher bumps the generation of a scope when something in
+ * it changes, and an entry is only valid while its stamp matches.
+ */
+
+#ifndef EXGT_WATCHED_H
+#define EXGT_WATCHED_H
+
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * Look up watched entry.
+ *
+ * @param scope Scope of entry.
+ * @param key Key of entry.
+ * @param size Where to place size of entry, ignored if \c NULL.
+ * @param stamp Where to place stamp to pass to watched_put() if the entry is
+ * recomputed. Taken before recomputing, so a change in between isn't missed.
+ * Caller should free.
+ * @return Contents of entry in new buffer, \c NULL if not found or stale.
+ */
+char *watched_get(const char *scope, const char *key, size_t *size,
+                  char **stamp);
+
+/**
+ * Insert watched entry.
+ *
+ * @param key Key of entry.
+ * @param stamp Stamp from watched_get().
+ * @param data Contents of entry.
+ * @param size Size of \p data.
+ * @param ttl Seconds the entry is kept if no watcher is running, \c 0 to not
+ * keep it at all.
+ */
+void watched_put(const char *key, const char *stamp, const char *data,
+                 size_t size, time_t ttl);
+
+/**
+ * Invalidate all entries in scope.
+ *
+ * @param scope Scope to invalidate.
+ */
+void watched_invalidate(const char *scope);
+
+/**
+ * Announce that a watcher is running.
+ * Has to be repeated within \p ttl seconds, or entries stop being trusted.
+ *
+ * @param token Token identifying watcher.
+ * @param ttl Seconds the announcement is valid for.
+ */
+void watched_announce(const char *token, time_t ttl);
+
+/**
+ * Announce that the watcher is stopping, so entries stop being trusted
+ * immediately.
+ */
+void watched_retract();
+
+#endif /* EXGT_WATCHED_H */
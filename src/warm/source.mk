@@ -0,0 +1,2 @@
+WARM_LOCAL != echo src/warm/*.c
+SOURCES += $(WARM_LOCAL)
@@ -0,0 +1,407 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file warm.c
+ * Push-triggered page cache warmer implementation.
+ *
+ * Pages are rendered by forking and running the regular CGI path with a
+ * made up request, so whatever ends up in the page cache is exactly what a
+ * real request would have stored. Each encoding is cached separately, so every
+ * page is rendered once for each encoding clients may get it in.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include <html/html.h>
+#include <utils/error.h>
+#include <utils/chain.h>
+#include <utils/config.h>
+#include <utils/file.h>
+#include <utils/git.h>
+#include <utils/path.h>
+#include <utils/compress.h>
+#include <utils/url.h>
+
+#include "warm.h"
+
+/** Default number of pages rendered at once. */
+#define WARM_JOBS 2
+
+/** Default maximum number of pages rendered per ref update. */
+#define WARM_MAX 256
+
+/** One ref update, as passed to \c post-receive. */
+struct warm_update {
+	/** Old value of ref. */
+	char old[GIT_OID_MAX + 1];
+	/** New value of ref. */
+	char new[GIT_OID_MAX + 1];
+	/** Name of ref. */
+	char ref[256];
+};
+
+/** Warmer state. */
+struct warm {
+	/** Name of repository, relative to \c GIT_PROJECT_ROOT. */
+	const char *repo;
+	/** Path to repository. */
+	char *root;
+	/** Ref \c HEAD points to, \c NULL if detached. */
+	char *head;
+	/** Maximum number of pages rendered at once. */
+	size_t jobs;
+	/** Number of pages currently being rendered. */
+	size_t running;
+	/** Processes rendering pages, \ref jobs of them. */
+	pid_t *pids;
+};
+
+/**
+ * Check if object ID is all zeroes, as used for created and deleted refs.
+ *
+ * @param oid Object ID to check.
+ * @return \c true if \p oid is all zeroes.
+ */
+static bool warm_is_null(const char *oid)
+{
+	return oid[strspn(oid, "0")] == 0;
+}
+
+/**
+ * Get ref \c HEAD points to.
+ *
+ * @param root Path to repository.
+ * @return Name of ref in new buffer, \c NULL if \c HEAD is detached.
+ */
+static char *warm_head(const char *root)
+{
+	char **cmds[] =
+	{(char *[]){"git", "-C", (char *)root, "symbolic-ref", "-q", "HEAD",
+		    0}};
+	FILE *f = exgt_chain(1, cmds);
+	if (!f)
+		return NULL;
+
+	char *head = read_stream(f, NULL);
+	fclose(f);
+	if (!head)
+		return NULL;
+
+	head[strcspn(head, "\n")] = 0;
+	if (!*head) {
+		free(head);
+		return NULL;
+	}
+
+	return head;
+}
+
+/**
+ * Wait for one rendering page to finish.
+ *
+ * @param w Warmer state.
+ */
+static void warm_reap(struct warm *w)
+{
+	/* git processes from exgt_chain() are reaped here as well, so make
+	 * sure the one that finished was actually rendering a page */
+	pid_t pid;
+	while ((pid = waitpid(-1, NULL, 0)) > 0) {
+		for (size_t i = 0; i < w->running; ++i) {
+			if (w->pids[i] != pid)
+				continue;
+
+			w->pids[i] = w->pids[--w->running];
+			return;
+		}
+	}
+
+	/* no children left at all */
+	w->running = 0;
+}
+
+/**
+ * Render one page into the page cache, in one encoding.
+ *
+ * @param w Warmer state.
+ * @param path Path of page in repository, empty for the root directory.
+ * @param query Query string of page.
+ * @param enc Encoding to render page in.
+ */
+static void warm_render(struct warm *w, const char *path, const char *query,
+                        enum compress_encoding enc)
+{
+	while (w->running >= w->jobs)
+		warm_reap(w);
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t pid = fork();
+	if (pid < 0)
+		return;
+
+	if (pid) {
+		w->pids[w->running++] = pid;
+		return;
+	}
+
+	char *web_root = getenv("EXGT_WEB_ROOT");
+	if (!web_root)
+		web_root = "";
+
+	size_t len = strlen(web_root) + strlen(w->repo) + strlen(path)
+	             + strlen(query) + 4;
+	char *path_info = malloc(len), *uri = malloc(len);
+	if (!path_info || !uri)
+		_exit(1);
+
+	snprintf(path_info, len, "/%s%s%s", w->repo, *path ? "/" : "", path);
+	snprintf(uri, len, "%s%s%s%s", web_root, path_info, *query ? "?" : "",
+	         query);
+
+	setenv("PATH_INFO", path_info, 1);
+	setenv("REQUEST_URI", uri, 1);
+	setenv("QUERY_STRING", query, 1);
+	setenv("HTTP_ACCEPT", "text/html", 1);
+	setenv("HTTP_ACCEPT_ENCODING", compress_name(enc), 1);
+	unsetenv("HTTP_IF_NONE_MATCH");
+
+	int null = open("/dev/null", O_WRONLY);
+	dup2(null, STDOUT_FILENO);
+	close(null);
+
+	html_serve();
+	fflush(stdout);
+	_exit(0);
+}
+
+/**
+ * Render one page into the page cache, in every encoding.
+ *
+ * @param w Warmer state.
+ * @param path Path of page in repository, empty for the root directory.
+ * @param query Query string of page.
+ */
+static void warm_page(struct warm *w, const char *path, const char *query)
+{
+	enum compress_encoding encs[COMPRESS_ZSTD + 1];
+	size_t n = compress_encodings(encs);
+	for (size_t i = 0; i < n; ++i)
+		warm_render(w, path, query, encs[i]);
+}
+
+/**
+ * Render pages changed by one ref update.
+ *
+ * @param w Warmer state.
+ * @param u Ref update.
+ */
+static void warm_update(struct warm *w, struct warm_update *u)
+{
+	/* deleted ref, nothing to show */
+	if (warm_is_null(u->new))
+		return;
+
+	const char *name = u->ref;
+	if (strncmp(name, "refs/heads/", 11) == 0)
+		name += 11;
+	else
+		return;
+
+	bool head = w->head && strcmp(w->head, u->ref) == 0;
+	char *encoded;
+	if (!(encoded = url_encode(name)))
+		return;
+
+	char *query = malloc(strlen(encoded) + sizeof("commit="));
+	if (!query) {
+		free(encoded);
+		return;
+	}
+
+	/* plain URLs show HEAD, other branches need to be asked for */
+	sprintf(query, "commit=%s", encoded);
+	free(encoded);
+	if (head) {
+		query[0] = 0;
+		git_ref_forget(w->root, "HEAD");
+	}
+
+	git_ref_forget(w->root, name);
+	warm_page(w, "", query);
+
+	/* new branch, changes relative to what aren't known */
+	if (warm_is_null(u->old)) {
+		free(query);
+		return;
+	}
+
+	char **cmds[] =
+	{(char *[]){"git", "-C", w->root, "diff-tree", "-r", "-t", "-z",
+		    "--name-only", "--no-commit-id", "--diff-filter=d", u->old,
+		    u->new, "--", 0}};
+	FILE *f = exgt_chain(1, cmds);
+	if (!f) {
+		free(query);
+		return;
+	}
+
+	size_t size = 0;
+	char *paths = read_stream(f, &size);
+	fclose(f);
+
+	size_t max = config_size("EXGT_WARM_MAX", WARM_MAX);
+	for (char *path = paths; path && path < paths + size && max;
+	     path += strlen(path) + 1, --max)
+		warm_page(w, path, query);
+
+	free(paths);
+	free(query);
+}
+
+/**
+ * Read ref updates in \c post-receive format.
+ *
+ * @param f File to read from.
+ * @param n Where to place number of updates.
+ * @return Array of updates.
+ */
+static struct warm_update *warm_read(FILE *f, size_t *n)
+{
+	struct warm_update *updates = NULL;
+	size_t max = 0;
+	*n = 0;
+
+	struct warm_update u;
+	while (fscanf(f, "%64s %64s %255s", u.old, u.new, u.ref) == 3) {
+		if (*n >= max) {
+			max = max ? max * 2 : 4;
+			struct warm_update *new = realloc(updates,
+			                                  max * sizeof(*new));
+			if (!new)
+				break;
+
+			updates = new;
+		}
+
+		updates[(*n)++] = u;
+	}
+
+	return updates;
+}
+
+/**
+ * Let go of the hook, so the push can finish.
+ */
+static void warm_detach()
+{
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t pid = fork();
+	if (pid < 0)
+		return;
+
+	if (pid)
+		_exit(0);
+
+	setsid();
+	int null = open("/dev/null", O_RDWR);
+	dup2(null, STDIN_FILENO);
+	dup2(null, STDOUT_FILENO);
+	dup2(null, STDERR_FILENO);
+	close(null);
+}
+
+/**
+ * Print usage.
+ *
+ * @return Exit status.
+ */
+static int warm_usage()
+{
+	error("usage: exgt warm [-w] [-j jobs] <repo> [<old> <new> <ref>]\n");
+	return 1;
+}
+
+int warm_main(int argc, char *argv[])
+{
+	bool wait = false;
+	struct warm w = {.jobs = WARM_JOBS};
+
+	int opt;
+	while ((opt = getopt(argc, argv, "wj:")) != -1) {
+		switch (opt) {
+		case 'w': wait = true; break;
+		case 'j': w.jobs = strtoul(optarg, NULL, 10); break;
+		default: return warm_usage();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+	if ((argc != 1 && argc != 4) || !w.jobs)
+		return warm_usage();
+
+	if (!(w.pids = calloc(w.jobs, sizeof(*w.pids))))
+		return 1;
+
+	char *project_root;
+	if (!(project_root = getenv("GIT_PROJECT_ROOT"))) {
+		error("couldn't find GIT_PROJECT_ROOT\n");
+		return 1;
+	}
+
+	w.repo = argv[0];
+	if (strstr(w.repo, "..") || !(w.root = build_path(project_root,
+	                                                     w.repo))) {
+		error("bad repository %s\n", w.repo);
+		return 1;
+	}
+
+	/* hooks run with these pointing at the repository, which would
+	 * override -C */
+	unsetenv("GIT_DIR");
+	unsetenv("GIT_WORK_TREE");
+
+	struct warm_update *updates;
+	size_t n;
+	if (argc == 4) {
+		n = 1;
+		if (!(updates = malloc(sizeof(*updates))))
+			return 1;
+
+		snprintf(updates->old, sizeof(updates->old), "%s", argv[1]);
+		snprintf(updates->new, sizeof(updates->new), "%s", argv[2]);
+		snprintf(updates->ref, sizeof(updates->ref), "%s", argv[3]);
+	}
+	else
+		updates = warm_read(stdin, &n);
+
+	if (!wait)
+		warm_detach();
+
+	/* visitors take priority */
+	exgt_lower_priority();
+
+	w.head = warm_head(w.root);
+	for (size_t i = 0; i < n; ++i)
+		warm_update(&w, &updates[i]);
+
+	while (w.running)
+		warm_reap(&w);
+
+	free(updates);
+	free(w.pids);
+	free(w.head);
+	free(w.root);
+	return 0;
+}
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file warm.h
+ * Push-triggered page cache warmer header.
+ */
+
+#ifndef EXGT_WARM_H
+#define EXGT_WARM_H
+
+/**
+ * Cache warmer entry point.
+ *
+ * Renders the pages a push changed into the page cache, so the first visitor
+ * after a push doesn't have to wait for them. Meant to be called from a
+ * \c post-receive hook, either with the ref update on the command line or
+ * with the hook's standard input passed along:
+ *
+ * @code
+ *	exgt warm [-w] [-j jobs] <repo> [<old> <new> <ref>]
+ * @endcode
+ *
+ * For each updated branch, the root directory view, every changed directory
+ * and every changed file are rendered, at most \c EXGT_WARM_MAX pages per
+ * update. Pages of the branch \c HEAD points to are rendered as plain URLs,
+ * others with a \c commit option. \c EXGT_WEB_ROOT should be set to the path
+ * exgt is served under, if it isn't served from the root of the site.
+ *
+ * Unless \c -w is given, the updates are read and the warmer detaches
+ * immediately so the push isn't held up. It runs at the lowest CPU and I/O
+ * priority, rendering at most \c jobs pages at once, two by default.
+ *
+ * @param argc Number of arguments, including \c "warm".
+ * @param argv Arguments.
+ * @return Exit status.
+ */
+int warm_main(int argc, char *argv[]);
+
+#endif /* EXGT_WARM_H */
@@ -0,0 +1,2 @@
+WATCH_LOCAL != echo src/watch/*.c
+SOURCES += $(WATCH_LOCAL)
@@ -0,0 +1,411 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file watch.c
+ * Repository watcher implementation.
+ *
+ * inotify isn't recursive, so every directory under \c refs/ gets a watch of
+ * its own, and new ones are picked up as they're created. The git directory
+ * itself is watched for \c HEAD, \c packed-refs and \c description, and the
+ * project root for repositories coming and going.
+ *
+ * Git updates files by writing a \c .lock file and renaming it into place,
+ * so \c .lock files themselves are ignored and the rename is what counts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include <utils/error.h>
+#include <utils/path.h>
+#include <utils/shm.h>
+#include <utils/watched.h>
+
+#include "watch.h"
+
+/** Seconds an announcement of the watcher is valid for. */
+#define WATCH_TTL 60
+
+/** Seconds between announcements, comfortably less than \ref WATCH_TTL. */
+#define WATCH_REFRESH 20
+
+/** Set when the watcher has been asked to stop. */
+static volatile sig_atomic_t stopping;
+
+/**
+ * Ask watcher to stop.
+ *
+ * @param sig Signal received.
+ */
+static void watch_stop(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+/** Kind of watched directory. */
+enum watch_kind {
+	/** Project root. */
+	WATCH_ROOT,
+	/** Repository or git directory of one. */
+	WATCH_REPO,
+	/** Directory under \c refs/. */
+	WATCH_REFS,
+};
+
+/** One watched directory. */
+struct watch_dir {
+	/** inotify watch descriptor. */
+	int wd;
+	/** Kind of directory. */
+	enum watch_kind kind;
+	/** Name of repository directory belongs to. */
+	char *repo;
+	/** Path to directory. */
+	char *path;
+};
+
+/** Watcher state. */
+struct watch {
+	/** inotify file descriptor. */
+	int fd;
+	/** Project root. */
+	const char *root;
+	/** Watched directories. */
+	struct watch_dir *dirs;
+	/** Number of watched directories. */
+	size_t n;
+	/** Number of directories there's room for in \ref dirs. */
+	size_t max;
+};
+
+/**
+ * Find watched directory by watch descriptor.
+ *
+ * @param w Watcher state.
+ * @param wd Watch descriptor.
+ * @return Watched directory, \c NULL if not found.
+ */
+static struct watch_dir *watch_find(struct watch *w, int wd)
+{
+	for (size_t i = 0; i < w->n; ++i)
+		if (w->dirs[i].wd == wd)
+			return &w->dirs[i];
+
+	return NULL;
+}
+
+/**
+ * Forget watched directory, after inotify dropped the watch.
+ *
+ * @param w Watcher state.
+ * @param dir Watched directory.
+ */
+static void watch_forget(struct watch *w, struct watch_dir *dir)
+{
+	free(dir->repo);
+	free(dir->path);
+	*dir = w->dirs[--w->n];
+}
+
+/**
+ * Start watching directory.
+ *
+ * @param w Watcher state.
+ * @param path Path to directory.
+ * @param kind Kind of directory.
+ * @param repo Name of repository directory belongs to.
+ */
+static void watch_add(struct watch *w, const char *path, enum watch_kind kind,
+                      const char *repo)
+{
+	uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+	                | IN_ONLYDIR;
+	if (kind != WATCH_ROOT)
+		mask |= IN_CLOSE_WRITE;
+
+	int wd = inotify_add_watch(w->fd, path, mask);
+	if (wd < 0)
+		return;
+
+	/* inotify hands out the same descriptor for the same directory */
+	if (watch_find(w, wd))
+		return;
+
+	if (w->n >= w->max) {
+		size_t max = w->max ? w->max * 2 : 64;
+		struct watch_dir *new = realloc(w->dirs, max * sizeof(*new));
+		if (!new)
+			return;
+
+		w->dirs = new;
+		w->max = max;
+	}
+
+	char *repo_dup = strdup(repo), *path_dup = strdup(path);
+	if (!repo_dup || !path_dup) {
+		free(repo_dup);
+		free(path_dup);
+		return;
+	}
+
+	w->dirs[w->n++] = (struct watch_dir){wd, kind, repo_dup, path_dup};
+}
+
+/**
+ * Watch directory under \c refs/ and everything below it.
+ *
+ * @param w Watcher state.
+ * @param path Path to directory.
+ * @param repo Name of repository.
+ */
+static void watch_refs(struct watch *w, const char *path, const char *repo)
+{
+	watch_add(w, path, WATCH_REFS, repo);
+
+	DIR *dir = opendir(path);
+	if (!dir)
+		return;
+
+	struct dirent *dirent;
+	while ((dirent = readdir(dir))) {
+		if (dirent->d_name[0] == '.')
+			continue;
+
+		char *sub;
+		if (!(sub = build_path(path, dirent->d_name)))
+			continue;
+
+		struct stat st;
+		if (stat(sub, &st) == 0 && S_ISDIR(st.st_mode))
+			watch_refs(w, sub, repo);
+
+		free(sub);
+	}
+
+	closedir(dir);
+}
+
+/**
+ * Watch repository.
+ *
+ * @param w Watcher state.
+ * @param repo Name of repository.
+ */
+static void watch_repo(struct watch *w, const char *repo)
+{
+	char *path;
+	if (!(path = build_path(w->root, repo)))
+		return;
+
+	watch_add(w, path, WATCH_REPO, repo);
+
+	/* non-bare repository, the interesting bits are in .git */
+	char *gitdir;
+	struct stat st;
+	if ((gitdir = build_path(path, ".git"))
+	    && stat(gitdir, &st) == 0 && S_ISDIR(st.st_mode))
+		watch_add(w, gitdir, WATCH_REPO, repo);
+	else {
+		free(gitdir);
+		gitdir = path;
+		path = NULL;
+	}
+
+	char *refs;
+	if ((refs = build_path(gitdir, "refs")))
+		watch_refs(w, refs, repo);
+
+	free(refs);
+	free(gitdir);
+	free(path);
+}
+
+/**
+ * Invalidate cached entries of repository.
+ *
+ * @param w Watcher state.
+ * @param repo Name of repository.
+ */
+static void watch_invalidate(struct watch *w, const char *repo)
+{
+	char *path;
+	if (!(path = build_path(w->root, repo)))
+		return;
+
+	watched_invalidate(path);
+	free(path);
+}
+
+/**
+ * Check if event can change what exgt shows.
+ *
+ * @param dir Directory event happened in.
+ * @param ev Event.
+ * @return \c true if event is relevant.
+ */
+static bool watch_relevant(struct watch_dir *dir, struct inotify_event *ev)
+{
+	if (!ev->len)
+		return false;
+
+	size_t len = strlen(ev->name);
+	if (len >= 5 && strcmp(ev->name + len - 5, ".lock") == 0)
+		return false;
+
+	switch (dir->kind) {
+	case WATCH_REPO:
+		return strcmp(ev->name, "HEAD") == 0
+		       || strcmp(ev->name, "packed-refs") == 0
+		       || strcmp(ev->name, "description") == 0
+		       || strcmp(ev->name, "refs") == 0
+		       || strcmp(ev->name, ".git") == 0;
+
+	default:
+		return ev->name[0] != '.';
+	}
+}
+
+/**
+ * Handle one event.
+ *
+ * @param w Watcher state.
+ * @param ev Event to handle.
+ */
+static void watch_event(struct watch *w, struct inotify_event *ev)
+{
+	/* lost track of what changed, so everything might have */
+	if (ev->mask & IN_Q_OVERFLOW) {
+		for (size_t i = 0; i < w->n; ++i)
+			if (w->dirs[i].kind == WATCH_REPO)
+				watch_invalidate(w, w->dirs[i].repo);
+
+		return;
+	}
+
+	struct watch_dir *dir;
+	if (!(dir = watch_find(w, ev->wd)))
+		return;
+
+	if (ev->mask & IN_IGNORED) {
+		watch_forget(w, dir);
+		return;
+	}
+
+	if (!watch_relevant(dir, ev))
+		return;
+
+	bool new_dir = (ev->mask & IN_ISDIR)
+	               && (ev->mask & (IN_CREATE | IN_MOVED_TO));
+
+	if (dir->kind == WATCH_ROOT) {
+		if (new_dir)
+			watch_repo(w, ev->name);
+
+		watch_invalidate(w, ev->name);
+		return;
+	}
+
+	/* copy, adding watches may move dir */
+	char *repo = strdup(dir->repo);
+	if (!repo)
+		return;
+
+	if (new_dir && dir->kind == WATCH_REPO)
+		watch_repo(w, repo);
+
+	char *sub;
+	if (new_dir && dir->kind == WATCH_REFS
+	    && (sub = build_path(dir->path, ev->name))) {
+		watch_refs(w, sub, repo);
+		free(sub);
+	}
+
+	watch_invalidate(w, repo);
+	free(repo);
+}
+
+int watch_main(int argc, char *argv[])
+{
+	(void)argv;
+	if (argc != 1) {
+		error("usage: exgt watch\n");
+		return 1;
+	}
+
+	struct watch w = {0};
+	if (!(w.root = getenv("GIT_PROJECT_ROOT"))) {
+		error("couldn't find GIT_PROJECT_ROOT\n");
+		return 1;
+	}
+
+	struct shm_stats stats;
+	if (shm_stats(&stats)) {
+		error("shared memory cache is disabled, nothing to watch for\n");
+		return 1;
+	}
+
+	if ((w.fd = inotify_init1(IN_CLOEXEC)) < 0) {
+		error("couldn't initialize inotify\n");
+		return 1;
+	}
+
+	watch_add(&w, w.root, WATCH_ROOT, "");
+
+	DIR *dir = opendir(w.root);
+	if (!dir) {
+		error("couldn't open exgt root %s\n", w.root);
+		return 1;
+	}
+
+	struct dirent *dirent;
+	while ((dirent = readdir(dir)))
+		if (dirent->d_name[0] != '.')
+			watch_repo(&w, dirent->d_name);
+
+	closedir(dir);
+
+	/* entries stamped by an earlier watcher won't match this token */
+	char token[64];
+	snprintf(token, sizeof(token), "%lx.%llx", (long)getpid(),
+	         (unsigned long long)time(NULL));
+
+	char buf[4096]
+	__attribute__((aligned(__alignof__(struct inotify_event))));
+
+	/* no handler flags, so poll() is interrupted */
+	struct sigaction sa = {.sa_handler = watch_stop};
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	struct pollfd pfd = {.fd = w.fd, .events = POLLIN};
+	while (!stopping) {
+		watched_announce(token, WATCH_TTL);
+		if (poll(&pfd, 1, WATCH_REFRESH * 1000) <= 0)
+			continue;
+
+		ssize_t len = read(w.fd, buf, sizeof(buf));
+		if (len <= 0)
+			continue;
+
+		for (char *p = buf; p < buf + len;) {
+			struct inotify_event *ev = (struct inotify_event *)p;
+			watch_event(&w, ev);
+			p += sizeof(*ev) + ev->len;
+		}
+	}
+
+	/* nobody is watching for changes anymore */
+	watched_retract();
+	return 0;
+}
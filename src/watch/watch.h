@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: copyleft-next-0.3.1 */
+/* Copyright 2023 Kim Kuparinen < kimi.h.kuparinen@gmail.com > */
+
+/**
+ * @file watch.h
+ * Repository watcher header.
+ */
+
+#ifndef EXGT_WATCH_H
+#define EXGT_WATCH_H
+
+/**
+ * Repository watcher entry point.
+ *
+ * Watches \c GIT_PROJECT_ROOT and every repository in it with inotify, and
+ * invalidates the watched cache entries of a repository, see watched.h, as
+ * soon as its \c HEAD, \c packed-refs, \c description or anything under
+ * \c refs/ changes. While the watcher is running, resolved refs and project
+ * list rows are cached until invalidated instead of for a few seconds.
+ *
+ * @code
+ *	exgt watch
+ * @endcode
+ *
+ * Requires the shared memory cache, see shm.h.
+ *
+ * @param argc Number of arguments, including \c "watch".
+ * @param argv Arguments.
+ * @return Exit status.
+ */
+int watch_main(int argc, char *argv[]);
+
+#endif /* EXGT_WATCH_H */